@@ -1,5 +1,9 @@
 #include "rydb_internal.h"
 #include "rydb_hashtable.h"
+#include "rydb_direct.h"
+#include "rydb_column.h"
+#include "rydb_changes.h"
+#include "rydb_backup.h"
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
@@ -55,6 +59,10 @@ char *rydb_strdup(const char *str){
 
 static bool rydb_index_type_valid(rydb_index_type_t index_type);
 static off_t rydb_find_index_num(const rydb_t *db, const char *name);
+static bool rydb_index_set_reload(rydb_t *db);
+static bool rydb_index_ensure_open(rydb_t *db, rydb_index_t *idx);
+static bool rydb_indices_ensure_open(rydb_t *db);
+static bool rydb_meta_revision_changed(const rydb_t *db);
 
 static bool is_little_endian(void) {
   volatile union {
@@ -127,6 +135,14 @@ const char *rydb_error_code_str(rydb_error_code_t code) {
     return "RYDB_ERROR_LINK_NOT_FOUND";
   case RYDB_ERROR_NO_WRITE_PRIVILEGE:
     return "RYDB_ERROR_NO_WRITE_PRIVILEGE";
+  case RYDB_ERROR_CHANGES_LOST:
+    return "RYDB_ERROR_CHANGES_LOST";
+  case RYDB_ERROR_REPLICATION:
+    return "RYDB_ERROR_REPLICATION";
+  case RYDB_ERROR_BACKUP_MISMATCH:
+    return "RYDB_ERROR_BACKUP_MISMATCH";
+  case RYDB_ERROR_SNAPSHOT_ACTIVE:
+    return "RYDB_ERROR_SNAPSHOT_ACTIVE";
   }
   return "???";
 }
@@ -213,6 +229,10 @@ rydb_t *rydb_new(void) {
   db->data.fd = -1;
   db->meta.fd = -1;
   db->state.fd = -1;
+  db->changes.file.fd = -1;
+  db->replication.fd = -1;
+  db->backup.pages.fd = -1;
+  db->snapshot.fd = -1;
   return db;
 }
 
@@ -370,12 +390,130 @@ bool rydb_config_add_row_link(rydb_t *db, const char *link_name, const char *rev
   return true;
 }
 
+static inline int column_group_config_compare(const void *v1, const void *v2) {
+  const rydb_config_column_group_t *grp1 = v1;
+  const rydb_config_column_group_t *grp2 = v2;
+  return strcmp(grp1->name, grp2->name);
+}
+
+static off_t rydb_find_column_group_num(const rydb_t *db, const char *name) {
+  rydb_config_column_group_t  match = {.name = name};
+  rydb_config_column_group_t *start = db->config.column_group, *found;
+  if(!start) {
+    return -1;
+  }
+  found = bsearch(&match, start, db->config.column_group_count, sizeof(*start), column_group_config_compare);
+  if(!found) {
+    return -1;
+  }
+  return found - start;
+}
+
+bool rydb_config_add_column_group(rydb_t *db, const char *name, unsigned start, unsigned len) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  if(db->config.column_group_count >= RYDB_COLUMN_GROUPS_MAX) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Cannot exceed %i column groups per database.", RYDB_COLUMN_GROUPS_MAX);
+    return false;
+  }
+  if(strlen(name) == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid column group name of length 0.");
+    return false;
+  }
+  if(strlen(name) > RYDB_NAME_MAX_LEN) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Column group name is too long, must be at most %i", RYDB_NAME_MAX_LEN);
+    return false;
+  }
+  if(!is_alphanumeric(name)) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid column group name \"%s\", must be alphanumeric or underscores.", name);
+    return false;
+  }
+  if(len == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Column group \"%s\" length can't be 0", name);
+    return false;
+  }
+  if(start + len > db->config.row_len) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Column group \"%s\" is out of bounds: row length is %"PRIu16", but the group is set to end at %u", name, db->config.row_len, start + len);
+    return false;
+  }
+  if(rydb_find_column_group_num(db, name) != -1) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Column group with name \"%s\" already exists.", name);
+    return false;
+  }
+  
+  char *grpname = rydb_strdup(name);
+  if(!grpname) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Failed to allocate memory for column group name");
+    return false;
+  }
+  rydb_config_column_group_t *groups;
+  if(db->config.column_group_count == 0) {
+    groups = rydb_mem.malloc(sizeof(*groups));
+  }
+  else {
+    groups = rydb_mem.realloc(db->config.column_group, sizeof(*groups) * (db->config.column_group_count + 1));
+  }
+  if(!groups) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Failed to allocate memory for column group");
+    rydb_mem.free(grpname);
+    return false;
+  }
+  db->config.column_group = groups;
+  groups[db->config.column_group_count++] = (rydb_config_column_group_t ){.name = grpname, .start = start, .len = len};
+  qsort(db->config.column_group, db->config.column_group_count, sizeof(*db->config.column_group), column_group_config_compare);
+  return true;
+}
+
+bool rydb_config_change_feed(rydb_t *db, unsigned capacity) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  if(capacity == 0 || capacity > RYDB_CHANGE_FEED_CAPACITY_MAX) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Change feed capacity must be between 1 and %i", RYDB_CHANGE_FEED_CAPACITY_MAX);
+    return false;
+  }
+  db->config.change_feed_capacity = capacity;
+  return true;
+}
+
+bool rydb_config_lazy_indices(rydb_t *db, bool lazy) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  db->config.lazy_indices = lazy;
+  return true;
+}
+
+bool rydb_config_incremental_backup(rydb_t *db, unsigned page_size) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  if(page_size < RYDB_BACKUP_PAGE_SIZE_MIN || page_size > RYDB_BACKUP_PAGE_SIZE_MAX || (page_size & (page_size - 1)) != 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Backup page size must be a power of 2 between %i and %i", RYDB_BACKUP_PAGE_SIZE_MIN, RYDB_BACKUP_PAGE_SIZE_MAX);
+    return false;
+  }
+  db->config.backup_page_size = page_size;
+  return true;
+}
+
 static inline int index_config_compare(const void *v1, const void *v2) {
   const rydb_config_index_t *idx1 = v1;
   const rydb_config_index_t *idx2 = v2;
   return strcmp(idx1->name, idx2->name);
 }
 
+static bool rydb_index_segments_same(const rydb_config_index_t *cf1, const rydb_config_index_t *cf2) {
+  return cf1->segment_count == cf2->segment_count && memcmp(cf1->segment, cf2->segment, sizeof(*cf1->segment) * cf1->segment_count) == 0;
+}
+
+static bool rydb_index_filters_same(const rydb_config_index_t *cf1, const rydb_config_index_t *cf2) {
+  if(cf1->filter.mask == 0 || cf2->filter.mask == 0) {
+    return cf1->filter.mask == cf2->filter.mask;
+  }
+  return cf1->filter.offset == cf2->filter.offset && cf1->filter.mask == cf2->filter.mask && cf1->filter.value == cf2->filter.value;
+}
+
 static bool rydb_config_add_index(rydb_t *db, rydb_config_index_t *idx) {
   int primary = 0;
   if(strcmp(idx->name, "primary") == 0 || rydb_find_index_num(db, "primary") != -1) {
@@ -405,10 +543,16 @@ static bool rydb_config_add_index(rydb_t *db, rydb_config_index_t *idx) {
     rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" is out of bounds: row length is %"PRIu16", but index is set to start at %"PRIu16, idx->name, db->config.row_len, idx->start);
     return false;
   }
-  if(idx->start + idx->len > db->config.row_len) {
+  if(!rydb_index_composite(idx) && idx->start + idx->len > db->config.row_len) {
     rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" is out of bounds: row length is %"PRIu16", but index is set to end at %i", idx->name, db->config.row_len, idx->start + idx->len);
     return false;
   }
+  for(int i = 0; i < idx->segment_count; i++) {
+    if(idx->segment[i].start + idx->segment[i].len > db->config.row_len) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" is out of bounds: row length is %"PRIu16", but segment %i is set to end at %i", idx->name, db->config.row_len, i, idx->segment[i].start + idx->segment[i].len);
+      return false;
+    }
+  }
   if(rydb_find_index_num(db, idx->name) != -1) {
     rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" already exists", idx->name);
     return false;
@@ -464,11 +608,20 @@ static off_t rydb_find_index_num(const rydb_t *db, const char *name) {
 }
 
 static rydb_index_t *rydb_get_index(rydb_t *db, const char *name) {
+  if(!db->privileges.write && db->status == RYDB_STATUS_OPEN && rydb_meta_revision_changed(db)) {
+    //the writer has added or dropped some indices since we last looked
+    if(!rydb_index_set_reload(db)) {
+      return NULL;
+    }
+  }
   int             indexnum = rydb_find_index_num(db, name);
   if(indexnum == -1) {
     rydb_set_error(db, RYDB_ERROR_INDEX_NOT_FOUND, "Index %s does not exist in this database", name);
     return NULL;
   }
+  if(!rydb_index_ensure_open(db, &db->index[indexnum])) {
+    return NULL;
+  }
   return &db->index[indexnum];
 }
 
@@ -480,6 +633,53 @@ static bool rydb_config_index_check_flags(rydb_t *db, const rydb_config_index_t
   return true;
 }
 
+static bool rydb_config_index_set_segments(rydb_t *db, rydb_config_index_t *idx, const rydb_index_segment_t *segments, unsigned segment_count) {
+  unsigned len = 0;
+  if(segment_count == 0 || segment_count > RYDB_INDEX_MAX_SEGMENTS) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" must have between 1 and %i segments", idx->name, RYDB_INDEX_MAX_SEGMENTS);
+    return false;
+  }
+  for(unsigned i = 0; i < segment_count; i++) {
+    if(segments[i].len == 0) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" segment %u is empty", idx->name, i);
+      return false;
+    }
+    len += segments[i].len;
+  }
+  if(segment_count == 1) {
+    //that's just a plain old index
+    idx->segment_count = 0;
+    idx->start = segments[0].start;
+    idx->len = segments[0].len;
+    return true;
+  }
+  if(len > RYDB_INDEX_COMPOSITE_KEY_MAX) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" composite key is too long: %u bytes, at most %i allowed", idx->name, len, RYDB_INDEX_COMPOSITE_KEY_MAX);
+    return false;
+  }
+  idx->segment_count = segment_count;
+  memcpy(idx->segment, segments, sizeof(*segments) * segment_count);
+  idx->start = segments[0].start;
+  idx->len = len;
+  return true;
+}
+
+static bool rydb_config_add_index_hashtable_generic(rydb_t *db, rydb_config_index_t *idx, rydb_config_index_hashtable_t *advanced_config) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  
+  if(!rydb_config_index_check_flags(db, idx)) {
+    return false;
+  }
+  
+  if(!rydb_config_index_hashtable_set_config(db, idx, advanced_config)) {
+    return false;
+  }
+  
+  return rydb_config_add_index(db, idx);
+}
+
 bool rydb_config_add_index_hashtable(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_hashtable_t *advanced_config) {
   rydb_config_index_t idx;
   idx.name = name;
@@ -487,6 +687,32 @@ bool rydb_config_add_index_hashtable(rydb_t *db, const char *name, unsigned star
   idx.start = start;
   idx.len = len;
   idx.flags = flags;
+  idx.segment_count = 0;
+  idx.filter = (rydb_index_filter_t ){.mask = 0};
+  return rydb_config_add_index_hashtable_generic(db, &idx, advanced_config);
+}
+
+bool rydb_config_add_index_hashtable_composite(rydb_t *db, const char *name, const rydb_index_segment_t *segments, unsigned segment_count, uint8_t flags, rydb_config_index_hashtable_t *advanced_config) {
+  rydb_config_index_t idx;
+  idx.name = name;
+  idx.type = RYDB_INDEX_HASHTABLE;
+  idx.flags = flags;
+  idx.filter = (rydb_index_filter_t ){.mask = 0};
+  if(!rydb_config_index_set_segments(db, &idx, segments, segment_count)) {
+    return false;
+  }
+  return rydb_config_add_index_hashtable_generic(db, &idx, advanced_config);
+}
+
+bool rydb_config_add_index_direct(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_direct_t *advanced_config) {
+  rydb_config_index_t idx;
+  idx.name = name;
+  idx.type = RYDB_INDEX_DIRECT;
+  idx.start = start;
+  idx.len = len;
+  idx.flags = flags;
+  idx.segment_count = 0;
+  idx.filter = (rydb_index_filter_t ){.mask = 0};
   
   if(!rydb_ensure_closed(db, "and cannot be configured")) {
     return false;
@@ -496,13 +722,45 @@ bool rydb_config_add_index_hashtable(rydb_t *db, const char *name, unsigned star
     return false;
   }
   
-  if(!rydb_config_index_hashtable_set_config(db, &idx, advanced_config)) {
+  if(!rydb_config_index_direct_set_config(db, &idx, advanced_config)) {
     return false;
   }
   
   return rydb_config_add_index(db, &idx);
 }
 
+bool rydb_config_index_filter(rydb_t *db, const char *name, unsigned offset, uint8_t mask, uint8_t value) {
+  if(!rydb_ensure_closed(db, "and cannot be configured")) {
+    return false;
+  }
+  off_t indexnum = rydb_find_index_num(db, name);
+  if(indexnum == -1) {
+    rydb_set_error(db, RYDB_ERROR_INDEX_NOT_FOUND, "Index %s does not exist in this database", name);
+    return false;
+  }
+  rydb_config_index_t *idx = &db->config.index[indexnum];
+  if(strcmp(idx->name, "primary") == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Primary index must cover every row and can't have a filter");
+    return false;
+  }
+  if(offset >= db->config.row_len) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" filter is out of bounds: row length is %"PRIu16", but filter offset is %u", idx->name, db->config.row_len, offset);
+    return false;
+  }
+  if(mask == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" filter mask can't be 0", idx->name);
+    return false;
+  }
+  if((value & ~mask) != 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Index \"%s\" filter value has bits outside the mask and would never match", idx->name);
+    return false;
+  }
+  idx->filter.offset = offset;
+  idx->filter.mask = mask;
+  idx->filter.value = value;
+  return true;
+}
+
 
 static off_t rydb_filename(const rydb_t *db, const char *what, char *buf, off_t maxlen) {
   return snprintf(buf, maxlen, "%s%srydb.%s%s%s",
@@ -539,6 +797,12 @@ static void rydb_free(rydb_t *db) {
     }
     rydb_subfree(&db->config.link);
   }
+  for(int i = 0; i < db->config.column_group_count; i++) {
+    rydb_subfree(&db->config.column_group[i].name);
+  }
+  rydb_subfree(&db->config.column_group);
+  rydb_subfree(&db->column_group);
+  rydb_subfree(&db->stats);
   
   rydb_mem.free(db);
 }
@@ -628,6 +892,7 @@ bool rydb_modcount_changed(rydb_t *db, int64_t *prev_modcount) {
 #ifdef RYDB_DEBUG
   db->modcount_changed++;
 #endif
+  rydb_stats_count(db, modcount_retries);
   *prev_modcount = cur_modcount;
   return true;
 }
@@ -663,6 +928,7 @@ bool rydb_file_ensure_size(rydb_t *db, rydb_file_t *f, size_t min_sz, ptrdiff_t
       return false;
     }
     offset = remapped - f->mmap.start;
+    rydb_stats_count(db, file_remaps);
     
     //printf("remapped file %s from %p-%p to %p-%p\n", f->path, (void *)f->mmap.start, (void *)&f->mmap.start[current_mmap_sz], (void *)remapped, (void *)&remapped[new_mmap_sz]);
     f->mmap.end = &f->mmap.start[new_mmap_sz];
@@ -684,6 +950,7 @@ bool rydb_file_ensure_size(rydb_t *db, rydb_file_t *f, size_t min_sz, ptrdiff_t
       if(remmap_offset) *remmap_offset = offset;
       return false;
     }
+    rydb_stats_count(db, file_grows);
     if(f->file.end == f->data.end) {
       f->data.end += file_sz_diff;
     }
@@ -778,6 +1045,9 @@ bool rydb_file_close_index(rydb_t *db, rydb_index_t *idx) {
 bool rydb_file_close_map(rydb_t *db, rydb_index_t *idx) {
   return rydb_file_close(db, &idx->map);
 }
+bool rydb_file_close_filter(rydb_t *db, rydb_index_t *idx) {
+  return rydb_file_close(db, &idx->filter);
+}
 
 bool rydb_file_open(rydb_t *db, const char *what, rydb_file_t *f) {
   off_t sz;
@@ -802,7 +1072,14 @@ bool rydb_file_open(rydb_t *db, const char *what, rydb_file_t *f) {
     return false;
   }
   
+  off_t file_sz;
+  if(!rydb_file_getsize(db, f->fd, &file_sz)) {
+    rydb_file_close(db, f);
+    return false;
+  }
+  //existing files may well be bigger than the default mapping
   sz = RYDB_DEFAULT_MMAP_SIZE;
+  while(sz < file_sz) sz *= 2;
   f->mmap.start = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
   if(f->mmap.start == MAP_FAILED) {
     rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to mmap file %.900s", path);
@@ -812,11 +1089,7 @@ bool rydb_file_open(rydb_t *db, const char *what, rydb_file_t *f) {
   f->mmap.end = &f->mmap.start[sz]; //last mmapped address
   
   f->file.start = f->mmap.start;
-  if(!rydb_file_getsize(db, f->fd, &sz)) {
-    rydb_file_close(db, f);
-    return false;
-  }
-  f->file.end = &f->file.start[sz];
+  f->file.end = &f->file.start[file_sz];
   
   f->data = f->file;
   
@@ -833,11 +1106,17 @@ bool rydb_file_open_index_map(rydb_t *db, rydb_index_t *idx) {
   snprintf(path, sizeof(path)-1, "index.%s.map", idx->config->name);
   return rydb_file_open(db, path, &idx->map);
 }
+bool rydb_file_open_index_filter(rydb_t *db, rydb_index_t *idx) {
+  char path[256];
+  snprintf(path, sizeof(path)-1, "index.%s.filter", idx->config->name);
+  return rydb_file_open(db, path, &idx->filter);
+}
 
 static bool rydb_index_type_valid(rydb_index_type_t index_type) {
   switch(index_type) {
     case RYDB_INDEX_HASHTABLE:
     case RYDB_INDEX_BTREE:
+    case RYDB_INDEX_DIRECT:
       return true;
     case RYDB_INDEX_INVALID:
       return false;
@@ -851,6 +1130,8 @@ static const char *rydb_index_type_str(rydb_index_type_t index_type) {
       return "hashtable";
     case RYDB_INDEX_BTREE:
       return "B-tree";
+    case RYDB_INDEX_DIRECT:
+      return "direct";
     case RYDB_INDEX_INVALID:
       return "invalid";
   }
@@ -864,20 +1145,62 @@ static rydb_index_type_t rydb_index_type(const char *str) {
   if(strcmp(str, "B-tree") == 0) {
     return RYDB_INDEX_BTREE;
   }
+  if(strcmp(str, "direct") == 0) {
+    return RYDB_INDEX_DIRECT;
+  }
   return RYDB_INDEX_INVALID;
 }
 
-static bool rydb_meta_save(rydb_t *db) {
-  FILE     *fp = db->meta.fp;
+//composite indices list their segments right after the common index fields
+static bool rydb_meta_load_index_segments(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp) {
+  rydb_index_segment_t segments[RYDB_INDEX_MAX_SEGMENTS];
+  uint16_t             count;
+  long                 pos = ftell(fp);
+  if(fscanf(fp, "    segments: %"SCNu16"\n", &count) < 1) {
+    fseek(fp, pos, SEEK_SET);
+    return true;
+  }
+  if(count < 2 || count > RYDB_INDEX_MAX_SEGMENTS) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" segments are corrupted or invalid", idx_cf->name);
+    return false;
+  }
+  for(int i = 0; i < count; i++) {
+    if(fscanf(fp, "      - start: %"SCNu16"\n        len: %"SCNu16"\n", &segments[i].start, &segments[i].len) < 2) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" segments are corrupted or invalid", idx_cf->name);
+      return false;
+    }
+  }
+  if(!rydb_config_index_set_segments(db, idx_cf, segments, count)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" segments are corrupted or invalid", idx_cf->name);
+    return false;
+  }
+  return true;
+}
+
+//partial indices have their filter after that
+static bool rydb_meta_load_index_filter(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp) {
+  uint16_t             offset, mask, value;
+  long                 pos = ftell(fp);
+  if(fscanf(fp, "    filter:\n      offset: %"SCNu16"\n      mask: %"SCNu16"\n      value: %"SCNu16"\n", &offset, &mask, &value) < 3) {
+    fseek(fp, pos, SEEK_SET);
+    return true;
+  }
+  if(mask == 0 || mask > UINT8_MAX || (value & ~mask) != 0) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" filter is corrupted or invalid", idx_cf->name);
+    return false;
+  }
+  idx_cf->filter.offset = offset;
+  idx_cf->filter.mask = mask;
+  idx_cf->filter.value = value;
+  return true;
+}
+
+//the old human-readable meta format. still loaded if it's there, and written out by rydb_meta_export()
+static bool rydb_meta_write_text(rydb_t *db, FILE *fp) {
   int       rc;
   bool      ret;
   rydb_config_index_t *idxcf;
   
-  if(fseek(fp, 0, SEEK_SET) == -1) {
-    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Failed seeking to start of meta file %s", db->meta.path);
-    return false;
-  }
-  
   char hash_key_hexstr_buf[33];
   for (unsigned i = 0; i < sizeof(db->config.hash_key.value); i ++) {
     sprintf(&hash_key_hexstr_buf[i*2], "%02x", db->config.hash_key.value[i]);
@@ -939,10 +1262,30 @@ static bool rydb_meta_save(rydb_t *db) {
       rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing header to meta file %s", db->meta.path);
       return false;
     }
+    if(rydb_index_composite(idxcf)) {
+      rc = fprintf(fp, "    segments: %"PRIu16"\n", (uint16_t )idxcf->segment_count);
+      for(int j = 0; rc > 0 && j < idxcf->segment_count; j++) {
+        rc = fprintf(fp, "      - start: %"PRIu16"\n        len: %"PRIu16"\n", idxcf->segment[j].start, idxcf->segment[j].len);
+      }
+      if(rc <= 0) {
+        rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing index segments to meta file %s", db->meta.path);
+        return false;
+      }
+    }
+    if(idxcf->filter.mask != 0) {
+      rc = fprintf(fp, "    filter:\n      offset: %"PRIu16"\n      mask: %"PRIu16"\n      value: %"PRIu16"\n", idxcf->filter.offset, (uint16_t )idxcf->filter.mask, (uint16_t )idxcf->filter.value);
+      if(rc <= 0) {
+        rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing index filter to meta file %s", db->meta.path);
+        return false;
+      }
+    }
     switch(idxcf->type) {
       case RYDB_INDEX_HASHTABLE:
         ret = rydb_meta_save_index_hashtable(db, idxcf, fp);
         break;
+      case RYDB_INDEX_DIRECT:
+        ret = rydb_meta_save_index_direct(db, idxcf, fp);
+        break;
       case RYDB_INDEX_BTREE:
       case RYDB_INDEX_INVALID:
         rydb_set_error(db, RYDB_ERROR_UNSPECIFIED, "Unsupported index type");
@@ -969,34 +1312,390 @@ static bool rydb_meta_save(rydb_t *db) {
       }
     }
   }
+  
+  //column groups, only written if there are any
+  if(db->config.column_group_count > 0) {
+    rc = fprintf(fp, "column_group_count: %"PRIu16"\ncolumn_group:\n", db->config.column_group_count);
+    if(rc <= 0) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing column groups to meta file %s", db->meta.path);
+      return false;
+    }
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      rydb_config_column_group_t *grp = &db->config.column_group[i];
+      rc = fprintf(fp, "  - [ %s , %"PRIu16" , %"PRIu16" ]\n", grp->name, grp->start, grp->len);
+      if(rc <= 0) {
+        rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing column groups to meta file %s", db->meta.path);
+        return false;
+      }
+    }
+  }
+  
+  if(db->config.change_feed_capacity > 0) {
+    rc = fprintf(fp, "change_feed_capacity: %"PRIu32"\n", db->config.change_feed_capacity);
+    if(rc <= 0) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing change feed to meta file %s", db->meta.path);
+      return false;
+    }
+  }
+  if(db->config.backup_page_size > 0) {
+    rc = fprintf(fp, "backup_page_size: %"PRIu32"\n", db->config.backup_page_size);
+    if(rc <= 0) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing backup page size to meta file %s", db->meta.path);
+      return false;
+    }
+  }
   fflush(fp);
   return true;
 }
 
+#define RYDB_META_CHECKSUM_START (offsetof(rydb_meta_header_t, checksum) + sizeof(uint32_t))
+
+typedef struct {
+  size_t          index;
+  size_t          link;
+  size_t          column_group;
+  size_t          end;
+} rydb_meta_layout_t;
+
+static void rydb_meta_binary_layout(unsigned index_count, unsigned link_pair_count, unsigned column_group_count, rydb_meta_layout_t *layout) {
+  layout->index = ry_align(sizeof(rydb_meta_header_t), 8);
+  layout->link = ry_align(layout->index + sizeof(rydb_meta_index_t) * index_count, 8);
+  layout->column_group = ry_align(layout->link + sizeof(rydb_meta_link_t) * link_pair_count, 8);
+  layout->end = ry_align(layout->column_group + sizeof(rydb_meta_column_group_t) * column_group_count, 8);
+}
+
+static bool rydb_meta_binary(const rydb_file_t *ryf) {
+  return (size_t )(ryf->file.end - ryf->file.start) >= sizeof(rydb_meta_header_t) && memcmp(ryf->file.start, RYDB_META_MAGIC, sizeof(RYDB_META_MAGIC)) == 0;
+}
+
+static void rydb_meta_write_index(const rydb_config_index_t *cf, rydb_meta_index_t *mi) {
+  strcpy(mi->name, cf->name);
+  mi->type = cf->type;
+  mi->flags = cf->flags;
+  mi->start = cf->start;
+  mi->len = cf->len;
+  mi->segment_count = cf->segment_count;
+  memcpy(mi->segment, cf->segment, sizeof(*cf->segment) * cf->segment_count);
+  mi->filter_offset = cf->filter.offset;
+  mi->filter_mask = cf->filter.mask;
+  mi->filter_value = cf->filter.value;
+  if(cf->type == RYDB_INDEX_HASHTABLE) {
+    const rydb_config_index_hashtable_t *ht = &cf->type_config.hashtable;
+    mi->options = (ht->store_value ? RYDB_META_INDEX_STORE_VALUE : 0) | (ht->store_hash ? RYDB_META_INDEX_STORE_HASH : 0) | (ht->compact_hash ? RYDB_META_INDEX_COMPACT_HASH : 0) | (ht->bloom_filter ? RYDB_META_INDEX_BLOOM_FILTER : 0) | (ht->integer_big_endian ? RYDB_META_INDEX_INTEGER_BIG_ENDIAN : 0);
+    mi->hash_function = ht->hash_function;
+    mi->rehash = ht->rehash;
+    mi->collision_resolution = ht->collision_resolution;
+    mi->cover_start = ht->cover_start;
+    mi->cover_len = ht->cover_len;
+    mi->load_factor_max = ht->load_factor_max;
+  }
+  else if(cf->type == RYDB_INDEX_DIRECT) {
+    mi->options = cf->type_config.direct.big_endian ? RYDB_META_INDEX_DIRECT_BIG_ENDIAN : 0;
+  }
+}
+
+static bool rydb_meta_write(rydb_t *db, FILE *fp) {
+  rydb_meta_layout_t        layout;
+  rydb_meta_header_t       *header;
+  rydb_meta_link_t         *link;
+  rydb_meta_column_group_t *grp;
+  char                     *buf;
+  bool                      ok;
+  for(int i = 0; i < db->config.index_count; i++) {
+    if(db->config.index[i].type != RYDB_INDEX_HASHTABLE && db->config.index[i].type != RYDB_INDEX_DIRECT) {
+      rydb_set_error(db, RYDB_ERROR_UNSPECIFIED, "Unsupported index type");
+      return false;
+    }
+  }
+  rydb_meta_binary_layout(db->config.index_count, db->config.link_pair_count, db->config.column_group_count, &layout);
+  if((buf = rydb_mem.malloc(layout.end)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for meta file");
+    return false;
+  }
+  //padding too, so the checksum is the same for the same config
+  memset(buf, '\0', layout.end);
+  
+  header = (void *)buf;
+  memcpy(header->magic, RYDB_META_MAGIC, sizeof(RYDB_META_MAGIC));
+  header->little_endian = is_little_endian();
+  header->rownum_width = sizeof(rydb_rownum_t);
+  header->start_offset = RYDB_DATA_START_OFFSET;
+  header->version = RYDB_META_BINARY_VERSION;
+  header->size = layout.end;
+  header->format_revision = RYDB_FORMAT_VERSION;
+  header->database_revision = db->config.revision;
+  header->type_offset = offsetof(rydb_stored_row_t, type);
+  header->reserved_offset = offsetof(rydb_stored_row_t, reserved1);
+  header->data_offset = RYDB_ROW_DATA_OFFSET;
+  header->row_len = db->config.row_len;
+  header->id_len = db->config.id_len;
+  header->index_count = db->config.index_count;
+  header->link_pair_count = db->config.link_pair_count;
+  header->column_group_count = db->config.column_group_count;
+  memcpy(header->hash_key, db->config.hash_key.value, sizeof(header->hash_key));
+  header->hash_key_quality = db->config.hash_key.quality;
+  header->change_feed_capacity = db->config.change_feed_capacity;
+  header->backup_page_size = db->config.backup_page_size;
+  
+  for(int i = 0; i < db->config.index_count; i++) {
+    rydb_meta_write_index(&db->config.index[i], &((rydb_meta_index_t *)&buf[layout.index])[i]);
+  }
+  link = (void *)&buf[layout.link];
+  for(int i = 0; i < db->config.link_pair_count * 2; i++) {
+    if(!db->config.link[i].inverse) {
+      strcpy(link->next, db->config.link[i].next);
+      strcpy(link->prev, db->config.link[i].prev);
+      link++;
+    }
+  }
+  grp = (void *)&buf[layout.column_group];
+  for(int i = 0; i < db->config.column_group_count; i++) {
+    strcpy(grp[i].name, db->config.column_group[i].name);
+    grp[i].start = db->config.column_group[i].start;
+    grp[i].len = db->config.column_group[i].len;
+  }
+  header->checksum = crc32((uint8_t *)&buf[RYDB_META_CHECKSUM_START], layout.end - RYDB_META_CHECKSUM_START);
+  
+  ok = fwrite(buf, 1, layout.end, fp) == layout.end && fflush(fp) == 0;
+  rydb_mem.free(buf);
+  if(!ok) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed writing meta file %s", db->meta.path);
+    return false;
+  }
+  return true;
+}
+
+bool rydb_meta_export(rydb_t *db, FILE *fp) {
+  if(!rydb_ensure_open(db)) {
+    return false;
+  }
+  return rydb_meta_write_text(db, fp);
+}
+
+static bool rydb_meta_save(rydb_t *db) {
+  if(fseek(db->meta.fp, 0, SEEK_SET) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Failed seeking to start of meta file %s", db->meta.path);
+    return false;
+  }
+  return rydb_meta_write(db, db->meta.fp);
+}
+
+// write out the meta file with a different set of indices, and atomically replace the old one with it.
+static bool rydb_meta_publish(rydb_t *db, rydb_config_index_t *index_cf, uint16_t index_count) {
+  char                 path[2048], tmppath[2048];
+  FILE                *fp;
+  bool                 ok;
+  rydb_config_index_t *prev_index_cf = db->config.index;
+  uint16_t             prev_index_count = db->config.index_count;
+  rydb_filename(db, "meta", path, sizeof(path));
+  rydb_filename(db, "meta.tmp", tmppath, sizeof(tmppath));
+  
+  if((fp = fopen(tmppath, "w")) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open file %.900s", tmppath);
+    return false;
+  }
+  db->config.index = index_cf;
+  db->config.index_count = index_count;
+  ok = rydb_meta_write(db, fp);
+  db->config.index = prev_index_cf;
+  db->config.index_count = prev_index_count;
+  if(ok && fsync(fileno(fp)) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to sync file %.900s", tmppath);
+    ok = false;
+  }
+  fclose(fp);
+  if(ok && rename(tmppath, path) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to replace meta file %.900s", path);
+    ok = false;
+  }
+  if(!ok) {
+    unlink(tmppath);
+    return false;
+  }
+  //our meta file handle still points to the old file
+  rydb_file_close(db, &db->meta);
+  if(!rydb_file_open(db, "meta", &db->meta)) {
+    return false;
+  }
+  db->meta_revision = AO_fetch_and_add(&((rydb_state_t *)db->state.file.start)->meta_revision, 1) + 1;
+  return true;
+}
 
+static bool rydb_meta_revision_changed(const rydb_t *db) {
+  return AO_load(&((rydb_state_t *)db->state.file.start)->meta_revision) != db->meta_revision;
+}
 
 #define QUOTE(str) #str
 #define EXPAND_AND_QUOTE(str) QUOTE(str)
 #define RYDB_NAME_MAX_LEN_STR EXPAND_AND_QUOTE(RYDB_NAME_MAX_LEN)
 
-static bool rydb_meta_load(rydb_t *db, rydb_file_t *ryf) {
-  FILE     *fp = ryf->fp;
-  char      endianness_buf[17];
-  char      rowformat_buf[33];
-  char      hashkey_buf[35];
-  uint8_t   hashkey_quality;
-  int       little_endian;
-  uint16_t  rydb_format_version, db_revision, start_offset, rownum_width, row_len, id_len, index_count;
-  if(fseek(fp, 0, SEEK_SET) == -1) {
-    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Failed seeking to start of data file");
-    return false;
-  }
-  
-  struct {
-    uint16_t  type_off;
-    uint16_t  reserved_off;
-    uint16_t  data_off;
-  } rowformat;
+static bool rydb_meta_load_binary_index(rydb_t *db, const rydb_meta_index_t *mi) {
+  rydb_config_index_t idx_cf;
+  if(memchr(mi->name, '\0', sizeof(mi->name)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index specification is corrupted or invalid");
+    return false;
+  }
+  idx_cf.name = mi->name;
+  idx_cf.type = mi->type;
+  idx_cf.start = mi->start;
+  idx_cf.len = mi->len;
+  idx_cf.flags = mi->flags;
+  idx_cf.segment_count = 0;
+  idx_cf.filter = (rydb_index_filter_t ){.offset = mi->filter_offset, .mask = mi->filter_mask, .value = mi->filter_value};
+  if((mi->filter_value & ~mi->filter_mask) != 0) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" filter is corrupted or invalid", mi->name);
+    return false;
+  }
+  if(mi->segment_count > 0 && !rydb_config_index_set_segments(db, &idx_cf, mi->segment, mi->segment_count)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" segments are corrupted or invalid", mi->name);
+    return false;
+  }
+  switch(idx_cf.type) {
+    case RYDB_INDEX_HASHTABLE: {
+      rydb_config_index_hashtable_t ht = {
+        .hash_function = mi->hash_function,
+        .rehash = mi->rehash,
+        .load_factor_max = mi->load_factor_max,
+        .store_value = (mi->options & RYDB_META_INDEX_STORE_VALUE) != 0,
+        .store_hash = (mi->options & RYDB_META_INDEX_STORE_HASH) != 0,
+        .compact_hash = (mi->options & RYDB_META_INDEX_COMPACT_HASH) != 0,
+        .bloom_filter = (mi->options & RYDB_META_INDEX_BLOOM_FILTER) != 0,
+        .integer_big_endian = (mi->options & RYDB_META_INDEX_INTEGER_BIG_ENDIAN) != 0,
+        .cover_start = mi->cover_start,
+        .cover_len = mi->cover_len,
+        .collision_resolution = mi->collision_resolution
+      };
+      if(!(ht.load_factor_max > 0 && ht.load_factor_max < 1) || !rydb_config_index_hashtable_set_config(db, &idx_cf, &ht)) {
+        rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Hashtable \"%s\" specification is corrupted or invalid", mi->name);
+        return false;
+      }
+      break;
+    }
+    case RYDB_INDEX_DIRECT: {
+      rydb_config_index_direct_t direct = {.big_endian = (mi->options & RYDB_META_INDEX_DIRECT_BIG_ENDIAN) != 0};
+      if(!rydb_config_index_direct_set_config(db, &idx_cf, &direct)) {
+        rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Direct index \"%s\" specification is corrupted or invalid", mi->name);
+        return false;
+      }
+      break;
+    }
+    default:
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" type is invalid", mi->name);
+      return false;
+  }
+  return rydb_config_add_index(db, &idx_cf);
+}
+
+//nothing to parse: check the header and the checksum, then take the config straight from the mapped file
+static bool rydb_meta_load_binary(rydb_t *db, const rydb_file_t *ryf) {
+  const rydb_meta_header_t       *header = (const void *)ryf->file.start;
+  size_t                          size = ryf->file.end - ryf->file.start;
+  const rydb_meta_link_t         *link;
+  const rydb_meta_column_group_t *grp;
+  rydb_meta_layout_t              layout;
+  if(header->little_endian != is_little_endian()) {
+    rydb_set_error(db, RYDB_ERROR_WRONG_ENDIANNESS, "File has wrong endianness");
+    return false;
+  }
+  if(header->version != RYDB_META_BINARY_VERSION) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Meta file version mismatch, expected %i, loaded %"PRIu32, RYDB_META_BINARY_VERSION, header->version);
+    return false;
+  }
+  if(header->index_count > RYDB_INDICES_MAX || header->link_pair_count > RYDB_ROW_LINK_PAIRS_MAX || header->column_group_count > RYDB_COLUMN_GROUPS_MAX) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Not a RyDB file or is corrupted");
+    return false;
+  }
+  rydb_meta_binary_layout(header->index_count, header->link_pair_count, header->column_group_count, &layout);
+  if(header->size != size || layout.end != size) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Meta file is %zu bytes, expected %zu", size, layout.end);
+    return false;
+  }
+  if(crc32((const uint8_t *)&ryf->file.start[RYDB_META_CHECKSUM_START], size - RYDB_META_CHECKSUM_START) != header->checksum) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Meta file checksum mismatch");
+    return false;
+  }
+  if(header->format_revision != RYDB_FORMAT_VERSION) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Format version mismatch, expected %i, loaded %"PRIu32, RYDB_FORMAT_VERSION, header->format_revision);
+    return false;
+  }
+  if(header->type_offset != offsetof(rydb_stored_row_t, type) || header->reserved_offset != offsetof(rydb_stored_row_t, reserved1) || header->data_offset != offsetof(rydb_stored_row_t, data)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Row format mismatch");
+    return false;
+  }
+  if(header->start_offset != RYDB_DATA_START_OFFSET) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Wrong data offset, expected %i, got %"PRIu16, RYDB_DATA_START_OFFSET, header->start_offset);
+    return false;
+  }
+  if(header->rownum_width != sizeof(rydb_rownum_t)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Rownum is a %i-bit integer, expected %"PRIu16"-bit", header->rownum_width * 8, (uint16_t )(sizeof(rydb_rownum_t) * 8));
+    return false;
+  }
+  if(header->hash_key_quality > 1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Invalid hash key quality");
+    return false;
+  }
+  db->config.hash_key.quality = header->hash_key_quality;
+  memcpy(db->config.hash_key.value, header->hash_key, sizeof(header->hash_key));
+  db->config.hash_key.permanent = 1;
+  
+  if(!rydb_config_row(db, header->row_len, header->id_len)) {
+    return false;
+  }
+  if(!rydb_config_revision(db, header->database_revision)) {
+    return false;
+  }
+  for(int i = 0; i < header->index_count; i++) {
+    if(!rydb_meta_load_binary_index(db, &((const rydb_meta_index_t *)&ryf->file.start[layout.index])[i])) {
+      return false;
+    }
+  }
+  link = (const void *)&ryf->file.start[layout.link];
+  for(int i = 0; i < header->link_pair_count; i++) {
+    if(memchr(link[i].next, '\0', sizeof(link[i].next)) == NULL || memchr(link[i].prev, '\0', sizeof(link[i].prev)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "link specification is corrupted or invalid");
+      return false;
+    }
+    if(!rydb_config_add_row_link(db, link[i].next, link[i].prev)) {
+      return false;
+    }
+  }
+  grp = (const void *)&ryf->file.start[layout.column_group];
+  for(int i = 0; i < header->column_group_count; i++) {
+    if(memchr(grp[i].name, '\0', sizeof(grp[i].name)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "column group specification is corrupted or invalid");
+      return false;
+    }
+    if(!rydb_config_add_column_group(db, grp[i].name, grp[i].start, grp[i].len)) {
+      return false;
+    }
+  }
+  if(header->change_feed_capacity > 0 && !rydb_config_change_feed(db, header->change_feed_capacity)) {
+    return false;
+  }
+  if(header->backup_page_size > 0 && !rydb_config_incremental_backup(db, header->backup_page_size)) {
+    return false;
+  }
+  return true;
+}
+
+static bool rydb_meta_load_text(rydb_t *db, rydb_file_t *ryf) {
+  FILE     *fp = ryf->fp;
+  char      endianness_buf[17];
+  char      rowformat_buf[33];
+  char      hashkey_buf[35];
+  uint8_t   hashkey_quality;
+  int       little_endian;
+  uint16_t  rydb_format_version, db_revision, start_offset, rownum_width, row_len, id_len, index_count;
+  if(fseek(fp, 0, SEEK_SET) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Failed seeking to start of data file");
+    return false;
+  }
+  
+  struct {
+    uint16_t  type_off;
+    uint16_t  reserved_off;
+    uint16_t  data_off;
+  } rowformat;
   
   const char *fmt =
     "--- #rydb\n"
@@ -1144,15 +1843,28 @@ static bool rydb_meta_load(rydb_t *db, rydb_file_t *ryf) {
       idx_cf.type = rydb_index_type(index_type_buf);
       idx_cf.name = index_name_buf;
       idx_cf.flags = 0;
+      idx_cf.segment_count = 0;
+      idx_cf.filter = (rydb_index_filter_t ){.mask = 0};
       if(index_unique) {
         idx_cf.flags |= RYDB_INDEX_UNIQUE;
       }
+      if(!rydb_meta_load_index_segments(db, &idx_cf, fp)) {
+        return false;
+      }
+      if(!rydb_meta_load_index_filter(db, &idx_cf, fp)) {
+        return false;
+      }
       switch(idx_cf.type) {
         case RYDB_INDEX_HASHTABLE:
           if(!rydb_meta_load_index_hashtable(db, &idx_cf, fp)) {
             return false;
           }
           break;
+        case RYDB_INDEX_DIRECT:
+          if(!rydb_meta_load_index_direct(db, &idx_cf, fp)) {
+            return false;
+          }
+          break;
         case RYDB_INDEX_BTREE:
           rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "index \"%s\" type btree is not supported", index_name_buf);
           return false;
@@ -1191,10 +1903,58 @@ static bool rydb_meta_load(rydb_t *db, rydb_file_t *ryf) {
     }
   }
   
+  //column groups, the change feed and backup page tracking are optional
+  uint16_t           column_group_count;
+  uint32_t           change_feed_capacity;
+  uint32_t           backup_page_size;
+  long               pos = ftell(fp);
+  if(fscanf(fp, "column_group_count: %"SCNu16"\n", &column_group_count) < 1) {
+    fseek(fp, pos, SEEK_SET);
+  }
+  else {
+    char             group_name_buf[RYDB_NAME_MAX_LEN+1];
+    uint16_t         group_start, group_len;
+    if(column_group_count > RYDB_COLUMN_GROUPS_MAX || fscanf(fp, "column_group:\n") < 0) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "column group specification is corrupted or invalid");
+      return false;
+    }
+    for(int i = 0; i < column_group_count; i++) {
+      rc = fscanf(fp, "  - [ %" RYDB_NAME_MAX_LEN_STR "s , %"SCNu16" , %"SCNu16" ]\n", group_name_buf, &group_start, &group_len);
+      if(rc < 3) {
+        rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "column group specification is corrupted or invalid");
+        return false;
+      }
+      if(!rydb_config_add_column_group(db, group_name_buf, group_start, group_len)) {
+        return false;
+      }
+    }
+  }
+  pos = ftell(fp);
+  if(fscanf(fp, "change_feed_capacity: %"SCNu32"\n", &change_feed_capacity) < 1) {
+    fseek(fp, pos, SEEK_SET);
+  }
+  else if(!rydb_config_change_feed(db, change_feed_capacity)) {
+    return false;
+  }
+  pos = ftell(fp);
+  if(fscanf(fp, "backup_page_size: %"SCNu32"\n", &backup_page_size) < 1) {
+    fseek(fp, pos, SEEK_SET);
+  }
+  else if(!rydb_config_incremental_backup(db, backup_page_size)) {
+    return false;
+  }
+  
   //ok, that's everything
   return true;
 }
 
+static bool rydb_meta_load(rydb_t *db, rydb_file_t *ryf) {
+  if(rydb_meta_binary(ryf)) {
+    return rydb_meta_load_binary(db, ryf);
+  }
+  return rydb_meta_load_text(db, ryf);
+}
+
 static bool rydb_config_match(rydb_t *db, const rydb_t *db2, const char *db_lbl, const char *db2_lbl) {
   //see if the loaded config and the one passed in are the same
   if(db->config.revision != db2->config.revision) {
@@ -1243,6 +2003,14 @@ static bool rydb_config_match(rydb_t *db, const rydb_t *db2, const char *db_lbl,
       rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching index %i length: expected %"PRIu16", loaded %"PRIu16, i, idx1->len, idx2->len);
       return false;
     }
+    if(!rydb_index_segments_same(idx1, idx2)) {
+      rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching index %i segments", i);
+      return false;
+    }
+    if(!rydb_index_filters_same(idx1, idx2)) {
+      rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching index %i filter", i);
+      return false;
+    }
   }
   
   //compare row-links
@@ -1266,16 +2034,66 @@ static bool rydb_config_match(rydb_t *db, const rydb_t *db2, const char *db_lbl,
     }
   }
   
+  if(db->config.change_feed_capacity != db2->config.change_feed_capacity) {
+    rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching change feed capacity: %s %"PRIu32", %s %"PRIu32, db_lbl, db->config.change_feed_capacity, db2_lbl, db2->config.change_feed_capacity);
+    return false;
+  }
+  if(db->config.backup_page_size != db2->config.backup_page_size) {
+    rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching backup page size: %s %"PRIu32", %s %"PRIu32, db_lbl, db->config.backup_page_size, db2_lbl, db2->config.backup_page_size);
+    return false;
+  }
+  
+  //compare column groups
+  if(db->config.column_group_count != db2->config.column_group_count) {
+    rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching column group count: %s %"PRIu8", %s %"PRIu8, db_lbl, db->config.column_group_count, db2_lbl, db2->config.column_group_count);
+    return false;
+  }
+  for(int i = 0; i < db2->config.column_group_count; i++) {
+    rydb_config_column_group_t *grp1 = &db->config.column_group[i];
+    rydb_config_column_group_t *grp2 = &db2->config.column_group[i];
+    if(strcmp(grp1->name, grp2->name) != 0 || grp1->start != grp2->start || grp1->len != grp2->len) {
+      rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Mismatching column group %i: %s %s [%"PRIu16", %"PRIu16"], %s %s [%"PRIu16", %"PRIu16"]", i, db_lbl, grp1->name, grp1->start, grp1->len, db2_lbl, grp2->name, grp2->start, grp2->len);
+      return false;
+    }
+  }
+  
   return true;
 }
 
+//the checkpoint is good if it fits in the data file and the data really does end where it says
+static bool rydb_data_checkpoint_valid(const rydb_t *db, const rydb_state_t *state) {
+  rydb_rownum_t data_next = AO_load(&state->checkpoint.data_next_rownum);
+  rydb_rownum_t cmd_next = AO_load(&state->checkpoint.cmd_next_rownum);
+  rydb_rownum_t commit = AO_load(&state->checkpoint.commit_rownum);
+  if(data_next == 0 || cmd_next < data_next || (char *)rydb_rownum_to_row(db, cmd_next) > db->data.file.end) {
+    return false;
+  }
+  if(commit != 0 && (commit < data_next || commit >= cmd_next)) {
+    return false;
+  }
+  return data_next == 1 || rydb_rownum_to_row(db, data_next - 1)->type == RYDB_ROW_DATA;
+}
+
 static bool rydb_data_scan_tail(rydb_t *db) {
   uint16_t stored_row_size = db->stored_row_size;
   rydb_stored_row_t *firstrow = (void *)(db->data.data.start);
   rydb_stored_row_t *last_possible_row = (void *)((char *)firstrow + stored_row_size * ((db->data.file.end - (char *)firstrow)/stored_row_size));
+  rydb_state_t *state = (void *)db->state.file.start;
   uint_fast8_t  lastrow_found=0, data_lastrow_found = 0;
   rydb_stored_row_t *last_commit_row = NULL;
+  if(rydb_data_checkpoint_valid(db, state)) {
+    //nothing past the last COMMIT the checkpoint knows of was ever committed, and with no COMMIT, nothing past the
+    //end of the data. so start from there, instead of from the end of the file
+    rydb_rownum_t start = AO_load(&state->checkpoint.commit_rownum);
+    if(start == 0) {
+      start = AO_load(&state->checkpoint.data_next_rownum) - 1;
+    }
+    last_possible_row = start > 0 ? rydb_rownum_to_row(db, start) : NULL;
+  }
   for(rydb_stored_row_t *cur = last_possible_row; cur && cur >= firstrow; cur = rydb_row_next(cur, stored_row_size, -1)) {
+#ifdef RYDB_DEBUG
+    db->tail_rows_scanned++;
+#endif
     if(!lastrow_found && cur->type != RYDB_ROW_EMPTY) {
       db->cmd_next_rownum = rydb_row_next_rownum(db, cur, 1);
       lastrow_found = 1;
@@ -1297,7 +2115,8 @@ static bool rydb_data_scan_tail(rydb_t *db) {
   }
   
   if(last_commit_row) {
-    if(!rydb_transaction_run(db, last_commit_row)) {
+    //running it writes to every index
+    if(!rydb_indices_ensure_open(db) || !rydb_transaction_run(db, last_commit_row)) {
       return false;
     }
   }
@@ -1306,10 +2125,54 @@ static bool rydb_data_scan_tail(rydb_t *db) {
   if(!rydb_file_shrink_to_size(db, &db->data, (char *)rydb_rownum_to_row(db, db->data_next_rownum) - db->data.file.start)) {
     return false;
   }
+  db->cmd_next_rownum = db->data_next_rownum;
+  rydb_checkpoint(db, 0);
   return true;
   
 }
 
+//a writer that closed cleanly left nothing to recover. if the files are still the size it left them, the data
+//ends right where it said, and there's no need to go looking
+static bool rydb_data_clean_shutdown(rydb_t *db) {
+  rydb_state_t *state = (void *)db->state.file.start;
+  rydb_rownum_t data_next = AO_load(&state->shutdown.data_next_rownum);
+  if(!AO_load(&state->shutdown.clean) || data_next == 0) {
+    return false;
+  }
+  if(AO_load(&state->shutdown.data_size) != (AO_t )(db->data.file.end - db->data.file.start) || AO_load(&state->shutdown.meta_size) != (AO_t )(db->meta.file.end - db->meta.file.start)) {
+    return false;
+  }
+  if((char *)rydb_rownum_to_row(db, data_next) != db->data.file.end) {
+    return false;
+  }
+  if(data_next > 1 && rydb_rownum_to_row(db, data_next - 1)->type != RYDB_ROW_DATA) {
+    return false;
+  }
+  db->data_next_rownum = data_next;
+  db->cmd_next_rownum = data_next;
+  return true;
+}
+
+static void rydb_data_mark_clean_shutdown(rydb_t *db) {
+  rydb_state_t *state = (void *)db->state.file.start;
+  struct stat   st;
+  if(db->status != RYDB_STATUS_OPEN || !db->privileges.write || db->transaction.active) {
+    return;
+  }
+  //leave the files just as the tail scan would have
+  if(!rydb_file_shrink_to_size(db, &db->data, (char *)rydb_rownum_to_row(db, db->data_next_rownum) - db->data.file.start)) {
+    return;
+  }
+  if(stat(db->meta.path, &st) == -1) {
+    return;
+  }
+  AO_store(&state->shutdown.data_next_rownum, db->data_next_rownum);
+  AO_store(&state->shutdown.data_size, db->data.file.end - db->data.file.start);
+  AO_store(&state->shutdown.meta_size, st.st_size);
+  AO_nop_full();
+  AO_store(&state->shutdown.clean, 1);
+}
+
 static bool rydb_data_file_exists(const rydb_t *db) {
   char path[1024];
   rydb_filename(db, "data", path, 1024);
@@ -1317,13 +2180,22 @@ static bool rydb_data_file_exists(const rydb_t *db) {
 }
 
 static void rydb_close_nofree(rydb_t *db) {
+  rydb_snapshot_abort(db);
   rydb_file_close(db, &db->data);
   rydb_file_close(db, &db->meta);
   rydb_file_close(db, &db->state);
+  rydb_file_close(db, &db->changes.file);
+  rydb_file_close(db, &db->backup.pages);
   if(db->index) {
     for(int i = 0; i < db->config.index_count; i++) {
       rydb_file_close(db, &db->index[i].index);
       rydb_file_close(db, &db->index[i].map);
+      rydb_file_close(db, &db->index[i].filter);
+    }
+  }
+  if(db->column_group) {
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      rydb_file_close(db, &db->column_group[i].file);
     }
   }
 }
@@ -1337,13 +2209,138 @@ static bool rydb_open_abort(rydb_t *db) {
   rydb_subfree(&db->unique_index);
   rydb_subfree(&db->index_scratch);
   rydb_subfree(&db->index_scratch_buffer);
+  rydb_subfree(&db->column_group);
   db->status = RYDB_STATUS_CLOSED;
   return false;
 }
 
+typedef struct {
+  rydb_config_index_t *config;
+  uint16_t             count;
+  rydb_index_t        *index;
+  uint8_t              unique_index_count;
+  rydb_index_t       **unique_index;
+  char                *index_scratch_buffer;
+  const char         **index_scratch;
+} rydb_index_set_t;
+
+static bool rydb_index_open(rydb_t *db, rydb_index_t *idx) {
+  switch(idx->config->type) {
+    case RYDB_INDEX_INVALID:
+    case RYDB_INDEX_BTREE:
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Tried opening unsupported index \"%s\" type", idx->config->name);
+      return false;
+    case RYDB_INDEX_HASHTABLE:
+      return rydb_index_hashtable_open(db, idx);
+    case RYDB_INDEX_DIRECT:
+      return rydb_index_direct_open(db, idx);
+  }
+  return false;
+}
+
+//lazy indices aren't opened until they're needed
+static bool rydb_index_ensure_open(rydb_t *db, rydb_index_t *idx) {
+  if(idx->index.fd != -1) {
+    return true;
+  }
+  return rydb_index_open(db, idx);
+}
+
+static bool rydb_indices_ensure_open(rydb_t *db) {
+  RYDB_EACH_INDEX(db, idx) {
+    if(!rydb_index_ensure_open(db, idx)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool rydb_index_build(rydb_t *db, rydb_index_t *idx) {
+  switch(idx->config->type) {
+    case RYDB_INDEX_HASHTABLE:
+      return rydb_index_hashtable_build(db, idx);
+    case RYDB_INDEX_DIRECT:
+      return rydb_index_direct_build(db, idx);
+    case RYDB_INDEX_INVALID:
+    case RYDB_INDEX_BTREE:
+      break;
+  }
+  rydb_set_error(db, RYDB_ERROR_WRONG_INDEX_TYPE, "Index %s cannot be built", idx->config->name);
+  return false;
+}
+
+//a brand-new (or lost and recreated) index file gets built from whatever's already in the data file.
+//a successful build marks the index active, so one that's just been built isn't built again here
+static bool rydb_index_activate(rydb_t *db, rydb_index_t *idx) {
+  switch(idx->config->type) {
+    case RYDB_INDEX_HASHTABLE:
+      return rydb_index_hashtable_activate(db, idx);
+    case RYDB_INDEX_DIRECT:
+      return rydb_index_direct_activate(db, idx);
+    case RYDB_INDEX_INVALID:
+    case RYDB_INDEX_BTREE:
+      break;
+  }
+  return true;
+}
+
+//we'll be wanting to check all unique indices during row changes, so they should be made easy to locate
+static bool rydb_index_set_init_unique(rydb_t *db, rydb_index_set_t *set) {
+  size_t    total_unique_index_len = 0, scratch_len = 0;
+  uint8_t   n = 0;
+  set->unique_index_count = 0;
+  set->unique_index = NULL;
+  set->index_scratch_buffer = NULL;
+  set->index_scratch = NULL;
+  for(int i = 0; i < set->count; i++) {
+    if(set->config[i].flags & RYDB_INDEX_UNIQUE) {
+      set->unique_index_count++;
+      total_unique_index_len += set->config[i].len;
+    }
+    //cursors pad their search values out to the key length in here too, for any index
+    if(set->config[i].len > scratch_len) {
+      scratch_len = set->config[i].len;
+    }
+  }
+  if(total_unique_index_len > scratch_len) {
+    scratch_len = total_unique_index_len;
+  }
+  if(set->unique_index_count == 0) {
+    if(scratch_len > 0 && (set->index_scratch_buffer = rydb_mem.malloc(scratch_len)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index scratchspace buffer");
+      return false;
+    }
+    return true;
+  }
+  set->unique_index = rydb_mem.malloc(sizeof(*set->unique_index) * (off_t )set->unique_index_count);
+  if(!set->unique_index) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for unique indices");
+    return false;
+  }
+  for(int i = 0; i < set->count; i++) {
+    if(set->config[i].flags & RYDB_INDEX_UNIQUE) {
+      set->unique_index[n++]=&set->index[i];
+    }
+  }
+  
+  //allocate some index string buffer space
+  if((set->index_scratch_buffer = rydb_mem.malloc(scratch_len)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index scratchspace buffer");
+    rydb_subfree(&set->unique_index);
+    return false;
+  }
+  if((set->index_scratch = rydb_mem.malloc(sizeof(rydb_index_t *) * set->unique_index_count)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index scratchspace");
+    rydb_subfree(&set->unique_index);
+    rydb_subfree(&set->index_scratch_buffer);
+    return false;
+  }
+  return true;
+}
 
 static bool rydb_open_with_privileges(rydb_t *db, const char *path, const char *name, uint8_t privileges) {
   int           new_db = 0;
+  bool          clean_shutdown;
   if(!rydb_ensure_closed(db, "and cannot be reopened")) {
     return rydb_open_abort(db);
   }
@@ -1436,10 +2433,9 @@ static bool rydb_open_with_privileges(rydb_t *db, const char *path, const char *
     
   }
   
-  db->unique_index_count = 0;
-  
   //create index file array
   if(db->config.index_count > 0) {
+    const bool lazy_indices = db->config.lazy_indices && !(privileges & RYDB_LOCK_WRITE);
     sz = sizeof(*db->index) * db->config.index_count;
     if((db->index = rydb_mem.malloc(sz))==NULL) {
       rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index files");
@@ -1447,52 +2443,55 @@ static bool rydb_open_with_privileges(rydb_t *db, const char *path, const char *
     }
     memset(db->index, '\00', sz);
     
-    size_t total_unique_index_len = 0;
+    //every fd gets marked closed first, so that a failed open doesn't close() the zeroes of the ones after it
     for(int i = 0; i < db->config.index_count; i++) {
-      if(db->config.index[i].flags & RYDB_INDEX_UNIQUE) {
-        db->unique_index_count++;
-        total_unique_index_len += db->config.index[i].len;
-      }
       db->index[i].config = &db->config.index[i];
       db->index[i].index.fd = -1;
       db->index[i].map.fd = -1;
-      switch(db->config.index[i].type) {
-        case RYDB_INDEX_INVALID:
-        case RYDB_INDEX_BTREE:
-          rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Tried opening unsupported index \"%s\" type", db->config.index[i].name);
-          return rydb_open_abort(db);
-        case RYDB_INDEX_HASHTABLE:
-          if(!rydb_index_hashtable_open(db, &db->index[i])) {
-            return rydb_open_abort(db);
-          }
-          break;
-      }
+      db->index[i].filter.fd = -1;
     }
-    //we'll be wanting to check all unique indices during row changes, so they should be made easy to locate
-    if(db->unique_index_count > 0) {
-      uint8_t n = 0;
-      db->unique_index = rydb_mem.malloc(sizeof(*db->unique_index) * (off_t )db->unique_index_count);
-      if(!db->unique_index) {
-        rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for unique indices");
-        return rydb_open_abort(db);
-      }
-      for(int i = 0; i < db->config.index_count; i++) {
-        if(db->config.index[i].flags & RYDB_INDEX_UNIQUE) {
-          db->unique_index[n++]=&db->index[i];
-        }
-      }
-      
-      //allocate some index string buffer space
-      if((db->index_scratch_buffer = rydb_mem.malloc(total_unique_index_len)) == NULL) {
-        rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index scratchspace buffer");
+    for(int i = 0; i < db->config.index_count && !lazy_indices; i++) {
+      if(!rydb_index_open(db, &db->index[i])) {
         return rydb_open_abort(db);
       }
-      if((db->index_scratch = rydb_mem.malloc(sizeof(rydb_index_t *) * db->unique_index_count)) == NULL) {
-        rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index scratchspace");
+    }
+  }
+  rydb_index_set_t set = {.config = db->config.index, .count = db->config.index_count, .index = db->index};
+  if(!rydb_index_set_init_unique(db, &set)) {
+    return rydb_open_abort(db);
+  }
+  db->unique_index_count = set.unique_index_count;
+  db->unique_index = set.unique_index;
+  db->index_scratch_buffer = set.index_scratch_buffer;
+  db->index_scratch = set.index_scratch;
+  
+  //column group files
+  if(db->config.column_group_count > 0) {
+    sz = sizeof(*db->column_group) * db->config.column_group_count;
+    if((db->column_group = rydb_mem.malloc(sz))==NULL) {
+      rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for column group files");
+      return rydb_open_abort(db);
+    }
+    memset(db->column_group, '\00', sz);
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      db->column_group[i].config = &db->config.column_group[i];
+      db->column_group[i].file.fd = -1;
+    }
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      if(!rydb_column_group_open(db, &db->column_group[i])) {
         return rydb_open_abort(db);
       }
     }
   }
+  
+  if(db->config.change_feed_capacity > 0 && !rydb_changes_open(db)) {
+    return rydb_open_abort(db);
+  }
+  
+  if(db->config.backup_page_size > 0 && !rydb_backup_pages_open(db)) {
+    return rydb_open_abort(db);
+  }
+  
   db->stored_row_size = calculate_stored_row_size(db->config.row_len, db->config.link_pair_count);
   if(new_db) {
     if(!rydb_debug_hash_key) {
@@ -1514,23 +2513,58 @@ static bool rydb_open_with_privileges(rydb_t *db, const char *path, const char *
   if(!rydb_lock(db, privileges)) {
     return rydb_open_abort(db);
   }
+  db->meta_revision = AO_load(&((rydb_state_t *)db->state.file.start)->meta_revision);
   
-  if(!rydb_data_scan_tail(db)) {
+  //before the tail scan, which may well replay a transaction
+  if(db->privileges.write && db->config.change_feed_capacity > 0 && !rydb_changes_activate(db)) {
+    return rydb_open_abort(db);
+  }
+  if(db->privileges.write && db->config.backup_page_size > 0 && !rydb_backup_pages_activate(db)) {
     return rydb_open_abort(db);
   }
   
-  db->status = RYDB_STATUS_OPEN;
-  return true;
-}
-
-bool rydb_open(rydb_t *db, const char *path, const char *name) {
-  return rydb_open_with_privileges(db, path, name, RYDB_LOCK_CLIENT | RYDB_LOCK_READ | RYDB_LOCK_WRITE);
-}
-
-bool rydb_open_reader(rydb_t *db, const char *path, const char *name) {
-  return rydb_open_with_privileges(db, path, name, RYDB_LOCK_CLIENT | RYDB_LOCK_READ);
-}
-
+  clean_shutdown = !new_db && rydb_data_clean_shutdown(db);
+  if(db->privileges.write) {
+    //from here on, it's up to this writer to close cleanly
+    AO_store(&((rydb_state_t *)db->state.file.start)->shutdown.clean, 0);
+  }
+  if(clean_shutdown) {
+    rydb_checkpoint(db, 0);
+  }
+  else if(!rydb_data_scan_tail(db)) {
+    return rydb_open_abort(db);
+  }
+  
+  //a meta file from before the binary format is converted, so it won't be parsed next time
+  if(!new_db && db->privileges.write && !rydb_meta_binary(&db->meta) && !rydb_meta_publish(db, db->config.index, db->config.index_count)) {
+    return rydb_open_abort(db);
+  }
+  
+  if(db->privileges.write) {
+    RYDB_EACH_INDEX(db, idx) {
+      if(!rydb_index_activate(db, idx)) {
+        return rydb_open_abort(db);
+      }
+    }
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      if(!rydb_column_group_activate(db, &db->column_group[i])) {
+        return rydb_open_abort(db);
+      }
+    }
+  }
+  
+  db->status = RYDB_STATUS_OPEN;
+  return true;
+}
+
+bool rydb_open(rydb_t *db, const char *path, const char *name) {
+  return rydb_open_with_privileges(db, path, name, RYDB_LOCK_CLIENT | RYDB_LOCK_READ | RYDB_LOCK_WRITE);
+}
+
+bool rydb_open_reader(rydb_t *db, const char *path, const char *name) {
+  return rydb_open_with_privileges(db, path, name, RYDB_LOCK_CLIENT | RYDB_LOCK_READ);
+}
+
 static bool rydb_file_delete(rydb_t *db, rydb_file_t *f) {
   if (f->path && remove(f->path) == -1) {
     rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to delete file %s", f->path);
@@ -1543,10 +2577,19 @@ bool rydb_delete(rydb_t *db) {
   if(!rydb_file_delete(db, &db->data)) return false;
   if(!rydb_file_delete(db, &db->meta)) return false;
   if(!rydb_file_delete(db, &db->state)) return false;
+  if(!rydb_file_delete(db, &db->changes.file)) return false;
+  if(!rydb_file_delete(db, &db->backup.pages)) return false;
   if(db->index) {
     for(int i = 0; i < db->config.index_count; i++) {
+      if(!rydb_index_ensure_open(db, &db->index[i])) return false;
       if(!rydb_file_delete(db, &db->index[i].index)) return false;
       if(!rydb_file_delete(db, &db->index[i].map)) return false;
+      if(!rydb_file_delete(db, &db->index[i].filter)) return false;
+    }
+  }
+  if(db->column_group) {
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      if(!rydb_file_delete(db, &db->column_group[i].file)) return false;
     }
   }
   return true;
@@ -1554,6 +2597,7 @@ bool rydb_delete(rydb_t *db) {
 
 bool rydb_close(rydb_t *db) {
   if(db->name && db->path) {
+    rydb_data_mark_clean_shutdown(db);
     if(!rydb_unlock(db)) {
       return false;
     }
@@ -1606,6 +2650,17 @@ bool getrandombytes(unsigned char *p, size_t len) {
   return good;
 }
 
+uint64_t rydb_clock_usec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t )ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t rydb_clock_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t )ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 rydb_stored_row_t *rydb_rownum_to_row(const rydb_t *db, const rydb_rownum_t rownum) {
   char *start = db->data.data.start;
@@ -1641,6 +2696,7 @@ void rydb_data_update_last_nonempty_data_row(rydb_t *db, rydb_stored_row_t *row_
 }
 
 bool rydb_insert(rydb_t *db, const char *data, uint16_t len) {
+  uint64_t started = rydb_stats_start(db);
   if(!rydb_ensure_open(db)) {
     return false;
   }
@@ -1655,6 +2711,7 @@ bool rydb_insert(rydb_t *db, const char *data, uint16_t len) {
   rydb_transaction_start_oneshot_or_continue(db, &txstarted);
   
   if(!rydb_indices_check_unique(db, 0, data, 0, len, 1, txstarted ? NULL : tx_unique_callback_add)) {
+    if(txstarted) rydb_transaction_data_reset(db);
     return false;
   }
   
@@ -1666,7 +2723,7 @@ bool rydb_insert(rydb_t *db, const char *data, uint16_t len) {
     if(txstarted) rydb_transaction_data_reset(db);
     return false;
   }
-  return rydb_transaction_finish_or_continue(db, txstarted);
+  return rydb_stats_done(db, RYDB_STATS_INSERT, started, rydb_transaction_finish_or_continue(db, txstarted));
 }
 
 bool rydb_insert_str(rydb_t *db, const char *data) {
@@ -1685,16 +2742,21 @@ bool rydb_rownum_in_data_range(rydb_t *db, rydb_rownum_t rownum) {
   return true;
 }
 
-static void tx_unique_callback_update(rydb_t *db, int i, off_t start, UNUSED(off_t end), rydb_rownum_t rownum, const rydb_stored_row_t *row, const char *val) {
+static void tx_unique_callback_update(rydb_t *db, int i, UNUSED(off_t start), UNUSED(off_t end), rydb_rownum_t rownum, const rydb_stored_row_t *row, const char *val) {
+  char                 keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  rydb_config_index_t *cf = db->unique_index[i]->config;
   if(!row) {
     row = rydb_rownum_to_row(db, rownum);
   }
-  rydb_transaction_unique_remove(db, &row->data[start], i);
+  if(rydb_index_covers_row(cf, row->data)) {
+    rydb_transaction_unique_remove(db, rydb_index_row_key(cf, row->data, keybuf), i);
+  }
   rydb_transaction_unique_add(db, val, i);
 }
 
 
 bool rydb_update_rownum(rydb_t *db, const rydb_rownum_t rownum, const char *data, const uint16_t start, const uint16_t len) {
+  uint64_t started = rydb_stats_start(db);
   if(!rydb_ensure_open(db)) {
     return false;
   }
@@ -1710,7 +2772,8 @@ bool rydb_update_rownum(rydb_t *db, const rydb_rownum_t rownum, const char *data
   int txstarted;
   rydb_transaction_start_oneshot_or_continue(db, &txstarted);
   
-  if(!rydb_indices_check_unique(db, rownum, data, start, len, 1, txstarted ? NULL : tx_unique_callback_update)) {
+  if(!rydb_indices_check_unique(db, rownum, data, start, start + len, 1, txstarted ? NULL : tx_unique_callback_update)) {
+    if(txstarted) rydb_transaction_data_reset(db);
     return false;
   }
   
@@ -1732,10 +2795,11 @@ bool rydb_update_rownum(rydb_t *db, const rydb_rownum_t rownum, const char *data
     if(txstarted) rydb_transaction_data_reset(db);
     return false;
   }
-  return rydb_transaction_finish_or_continue(db, txstarted);
+  return rydb_stats_done(db, RYDB_STATS_UPDATE, started, rydb_transaction_finish_or_continue(db, txstarted));
 }
 
 bool rydb_delete_rownum(rydb_t *db, rydb_rownum_t rownum) {
+  uint64_t started = rydb_stats_start(db);
   if(!rydb_ensure_open(db)) {
     return false;
   }
@@ -1749,10 +2813,13 @@ bool rydb_delete_rownum(rydb_t *db, rydb_rownum_t rownum) {
   if(db->transaction.active && !db->transaction.oneshot && db->unique_index_count > 0) {
     const rydb_stored_row_t   *row = NULL;
     int                        i = 0;
+    char                       keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
     row = rydb_rownum_to_row(db, rownum);
     RYDB_EACH_UNIQUE_INDEX(db, idx) {
       rydb_config_index_t *cf = idx->config;
-      rydb_transaction_unique_remove(db, &row->data[cf->start], i);
+      if(rydb_index_covers_row(cf, row->data)) {
+        rydb_transaction_unique_remove(db, rydb_index_row_key(cf, row->data, keybuf), i);
+      }
       i++;
     }
   }
@@ -1768,7 +2835,7 @@ bool rydb_delete_rownum(rydb_t *db, rydb_rownum_t rownum) {
     if(txstarted) rydb_transaction_data_reset(db);
     return false;
   }
-  return rydb_transaction_finish_or_continue(db, txstarted);
+  return rydb_stats_done(db, RYDB_STATS_DELETE, started, rydb_transaction_finish_or_continue(db, txstarted));
 }
 
 bool rydb_swap_rownum(rydb_t *db, rydb_rownum_t rownum1, rydb_rownum_t rownum2) {
@@ -1804,10 +2871,16 @@ bool rydb_swap_rownum(rydb_t *db, rydb_rownum_t rownum1, rydb_rownum_t rownum2)
 bool rydb_indices_remove_row(rydb_t *db, rydb_stored_row_t *row) {
   bool ret = true;
   RYDB_EACH_INDEX(db, idx) {
+    if(!rydb_index_covers_row(idx->config, row->data)) {
+      continue;
+    }
     switch(idx->config->type) {
       case RYDB_INDEX_HASHTABLE:
         ret = rydb_index_hashtable_remove_row(db, idx, row);
         break;
+      case RYDB_INDEX_DIRECT:
+        ret = rydb_index_direct_remove_row(db, idx, row);
+        break;
       case RYDB_INDEX_BTREE:
         assert(0); //not implemented
         break;
@@ -1822,10 +2895,16 @@ bool rydb_indices_remove_row(rydb_t *db, rydb_stored_row_t *row) {
 bool rydb_indices_add_row(rydb_t *db, rydb_stored_row_t *row) {
   bool ret = true;
   RYDB_EACH_INDEX(db, idx) {
+    if(!rydb_index_covers_row(idx->config, row->data)) {
+      continue;
+    }
     switch(idx->config->type) {
       case RYDB_INDEX_HASHTABLE:
         ret = rydb_index_hashtable_add_row(db, idx, row);
         break;
+      case RYDB_INDEX_DIRECT:
+        ret = rydb_index_direct_add_row(db, idx, row);
+        break;
       case RYDB_INDEX_BTREE:
         assert(0); //not implemented
         break;
@@ -1838,84 +2917,113 @@ bool rydb_indices_add_row(rydb_t *db, rydb_stored_row_t *row) {
   return ret;
 }
 
-static inline bool index_data_in_range(off_t start, off_t end, off_t idx_start, off_t idx_end) {
-  if(start == end || start > idx_end || end < idx_start) {
-    //index string range is outside the data range
+bool rydb_index_data_in_range(const rydb_config_index_t *cf, off_t start, off_t end) {
+  if(start == end) {
     return false;
   }
-  return true;
+  //[start, end) and the key just touching doesn't count
+  if(!rydb_index_composite(cf)) {
+    return start < cf->start + cf->len && end > cf->start;
+  }
+  for(int i = 0; i < cf->segment_count; i++) {
+    if(start < cf->segment[i].start + cf->segment[i].len && end > cf->segment[i].start) {
+      return true;
+    }
+  }
+  //index string range is outside the data range
+  return false;
 }
 
-const char *rydb_overlay_data_on_row_for_index(const rydb_t *db, char *dst, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row, const char *overlay, off_t ostart, off_t oend, off_t istart, off_t iend) {
-  off_t ilen = iend - istart, olen = oend - ostart;
+//one contiguous stretch of an index key: the row's data (or zeroes if there's no row) with the overlay on top
+static void overlay_range(char *dst, const rydb_stored_row_t *row, const char *overlay, off_t ostart, off_t oend, off_t istart, off_t iend) {
+  off_t lo = ostart > istart ? ostart : istart, hi = oend < iend ? oend : iend;
+  if(lo >= hi) {
+    lo = hi = iend;
+  }
+  if(lo > istart) {
+    if(row) memcpy(dst, &row->data[istart], lo - istart);
+    else    memset(dst, '\00', lo - istart);
+  }
+  if(hi > lo) {
+    memcpy(&dst[lo - istart], &overlay[lo - ostart], hi - lo);
+  }
+  if(iend > hi) {
+    if(row) memcpy(&dst[hi - istart], &row->data[hi], iend - hi);
+    else    memset(&dst[hi - istart], '\00', iend - hi);
+  }
+}
+
+//the index key the row would have with the overlay's [ostart, oend) data written over it.
+//composite keys are always put together in dst, contiguous ones only when they need to be
+const char *rydb_overlay_data_on_row_for_index(const rydb_t *db, char *dst, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row, const char *overlay, off_t ostart, off_t oend, const rydb_config_index_t *cf) {
+  const rydb_stored_row_t *row = NULL;
+  const off_t              istart = cf->start, iend = istart + cf->len;
   
-  if(ostart <= istart && olen >= ilen) {
+  if(!rydb_index_composite(cf) && ostart <= istart && oend >= iend) {
     return &overlay[istart - ostart];
   }
   
-  const rydb_stored_row_t *row = NULL;
   if(rownum != 0 && (row = *cached_row) == NULL) {
     row = rydb_rownum_to_row(db, rownum);
     *cached_row = row;
   }
   
-  if(olen == 0 || ostart + olen < istart || ostart > istart + ilen) {
-    return &row->data[istart];
+  if(!rydb_index_composite(cf)) {
+    if(row && (ostart == oend || oend < istart || ostart > iend)) {
+      return &row->data[istart];
+    }
+    overlay_range(dst, row, overlay, ostart, oend, istart, iend);
+    return dst;
   }
   
-  if(ostart <= istart) {
-    off_t len = olen - (istart - ostart);
-    memcpy(dst, &overlay[istart - ostart], len);
-    if(rownum != 0) {
-      memcpy(&dst[len] , &row->data[istart + len], ilen - len);
-    }
-    else {
-      memset(&dst[len], '\00', ilen - len);
-    }
+  char *cur = dst;
+  for(int i = 0; i < cf->segment_count; i++) {
+    overlay_range(cur, row, overlay, ostart, oend, cf->segment[i].start, cf->segment[i].start + cf->segment[i].len);
+    cur += cf->segment[i].len;
   }
-  else {
-    off_t len = ostart - istart;
-    if(rownum != 0) {
-      memcpy(dst, &row->data[istart], len);
-    }
-    else {
-      memset(dst, '\00', len);
-    }
-    if(ostart + olen > istart + ilen) {
-      memcpy(&dst[len], overlay, ilen - len);
-    }
-    else {
-      memcpy(&dst[len], overlay, olen);
-      len += olen;
-      if(rownum != 0) {
-        memcpy(&dst[len], &row->data[len], ilen - len);
-      }
-      else {
-        memset(&dst[len], '\00', ilen - len);
-      }
-    }
+  return dst;
+}
+
+//search values can be shorter than the key, the rest is zero-filled
+const char *rydb_index_search_value(char *dst, const rydb_config_index_t *cf, const char *val, size_t len) {
+  if(len >= cf->len) {
+    return val;
   }
+  memcpy(dst, val, len);
+  memset(&dst[len], '\00', cf->len - len);
   return dst;
 }
 
 bool rydb_indices_update_row(rydb_t *db, rydb_stored_row_t *row, uint_fast8_t step, off_t start, off_t end) {
-  bool ret = true;
+  bool ret = true, ok = true;
+  //no bailing early: every index locked on step 0 must be unlocked on step 1
   RYDB_EACH_INDEX(db, idx) {
     rydb_config_index_t *cf = idx->config;
-    off_t idx_start = cf->start;
-    off_t idx_end = idx_start + cf->len;
-    if(index_data_in_range(start, end, idx_start, idx_end)) {
+    if(rydb_index_data_in_range(cf, start, end) || rydb_index_filter_in_range(cf, start, end) || (cf->type == RYDB_INDEX_HASHTABLE && rydb_index_hashtable_covered_in_range(cf, start, end))) {
+      //rows move in and out of partial indices as their filter byte changes
+      bool covered = rydb_index_covers_row(cf, row->data);
+      ok = true;
       switch(idx->config->type) {
         case RYDB_INDEX_HASHTABLE:
           if(step == 0) { //remove old row
             rydb_hashtable_lock(idx);
-            ret = rydb_index_hashtable_remove_row_locked(db, idx, row);
+            if(covered) ok = rydb_index_hashtable_remove_row_locked(db, idx, row);
           }
-          else { //remove
-            ret = rydb_index_hashtable_add_row_locked(db, idx, row);
+          else { //add updated row
+            if(covered) ok = rydb_index_hashtable_add_row_locked(db, idx, row);
             rydb_hashtable_unlock(idx);
           }
           break;
+        case RYDB_INDEX_DIRECT:
+          if(step == 0) {
+            rydb_direct_lock(idx);
+            if(covered) ok = rydb_index_direct_remove_row_locked(db, idx, row);
+          }
+          else {
+            if(covered) ok = rydb_index_direct_add_row_locked(db, idx, row);
+            rydb_direct_unlock(idx);
+          }
+          break;
         case RYDB_INDEX_BTREE:
           assert(0); //not implemented
           break;
@@ -1924,25 +3032,52 @@ bool rydb_indices_update_row(rydb_t *db, rydb_stored_row_t *row, uint_fast8_t st
           break;
       }
     }
-    if(!ret) break;
+    if(!ok) ret = false;
   }
   return ret;
 }
 
+static const rydb_stored_row_t *rydb_overlay_row(const rydb_t *db, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row) {
+  if(*cached_row == NULL) {
+    *cached_row = rydb_rownum_to_row(db, rownum);
+  }
+  return *cached_row;
+}
+
+//would a partial index cover the row with the overlay's [ostart, oend) data written over it?
+static bool rydb_overlay_covered(const rydb_t *db, const rydb_config_index_t *cf, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row, const char *overlay, off_t ostart, off_t oend) {
+  char filterbyte = 0;
+  if(cf->filter.mask == 0) {
+    return true;
+  }
+  if(rydb_index_filter_in_range(cf, ostart, oend)) {
+    filterbyte = overlay[cf->filter.offset - ostart];
+  }
+  else if(rownum != 0) {
+    filterbyte = rydb_overlay_row(db, rownum, cached_row)->data[cf->filter.offset];
+  }
+  return (filterbyte & cf->filter.mask) == cf->filter.value;
+}
+
 bool rydb_indices_check_unique(rydb_t *db, rydb_rownum_t rownum, const char *data, off_t start, off_t end, uint_fast8_t set_error, void (*callback)(rydb_t *, int , off_t, off_t, rydb_rownum_t, const rydb_stored_row_t *, const char *)) {
   const rydb_stored_row_t   *row = NULL;
   int                        i = 0;
   uint_fast8_t               tx_unique;
   char                      *dst = db->index_scratch_buffer;
-  RYDB_EACH_UNIQUE_INDEX(db, idx) {
+  for(i = 0; i < db->unique_index_count; i++) {
+    rydb_index_t        *idx = db->unique_index[i];
     rydb_config_index_t *cf = idx->config;
-    off_t idx_start = cf->start;
-    off_t idx_end = idx_start + cf->len;
-    if(start == end || start > idx_end || end < idx_start) {
-      //index string range is outside the data range
+    db->index_scratch[i] = NULL;
+    if(!rydb_index_data_in_range(cf, start, end)) {
+      //the key stays put, but a partial index may be getting a row it didn't have before
+      if(!rydb_index_filter_in_range(cf, start, end) || (rownum != 0 && rydb_index_covers_row(cf, rydb_overlay_row(db, rownum, &row)->data))) {
+        continue;
+      }
+    }
+    if(!rydb_overlay_covered(db, cf, rownum, &row, data, start, end)) {
       continue;
     }
-    const char *val = rydb_overlay_data_on_row_for_index(db, dst, rownum, &row, data, start, end, idx_start, idx_end);
+    const char *val = rydb_overlay_data_on_row_for_index(db, dst, rownum, &row, data, start, end, cf);
     db->index_scratch[i] = val;
     dst += cf->len;
     if(db->transaction.active && !db->transaction.oneshot) {
@@ -1966,6 +3101,17 @@ bool rydb_indices_check_unique(rydb_t *db, rydb_rownum_t rownum, const char *dat
           return false;
         }
         break;
+      case RYDB_INDEX_DIRECT:
+        if(!rydb_index_direct_key_valid(db, idx, val, set_error)) {
+          return false;
+        }
+        if(rydb_index_direct_contains(db, idx, val)) {
+          if(set_error) {
+            rydb_set_error(db, RYDB_ERROR_NOT_UNIQUE, "Data for index %s must be unique", cf->name);
+          }
+          return false;
+        }
+        break;
       case RYDB_INDEX_BTREE:
         assert(0); //not implemented
         break;
@@ -1973,15 +3119,13 @@ bool rydb_indices_check_unique(rydb_t *db, rydb_rownum_t rownum, const char *dat
         assert(0); //not supported
         break;
     }
-    i++;
   }
   
   if(callback) {
-    i = 0;
-    RYDB_EACH_UNIQUE_INDEX(db, idx) {
-      rydb_config_index_t *cf = idx->config;
-      callback(db, i, cf->start, 0, rownum, row, db->index_scratch[i]);
-      i++;
+    for(i = 0; i < db->unique_index_count; i++) {
+      if(db->index_scratch[i]) {
+        callback(db, i, db->unique_index[i]->config->start, 0, rownum, row, db->index_scratch[i]);
+      }
     }
   }
   return true;
@@ -1999,6 +3143,7 @@ bool rydb_index_find_row_str(rydb_t *db, const char *index_name, const char *val
 }
 
 bool rydb_index_find_row(rydb_t *db, const char *index_name, const char *val, size_t len, rydb_row_t *result) {
+  uint64_t        started = rydb_stats_start(db);
   rydb_index_t   *idx = rydb_get_index(db, index_name);
   if(!idx) return false;
   
@@ -2010,7 +3155,7 @@ bool rydb_index_find_row(rydb_t *db, const char *index_name, const char *val, si
       rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Cannot allocate memory for search string");
       return false;
     }
-    memcpy(allocd_searchval, val, indexed_data_len);
+    memcpy(allocd_searchval, val, len);
     searchval = allocd_searchval;
   }
   else {
@@ -2023,6 +3168,9 @@ bool rydb_index_find_row(rydb_t *db, const char *index_name, const char *val, si
       case RYDB_INDEX_HASHTABLE:
         ret = rydb_index_hashtable_find_row(db, idx, searchval, result);
         break;
+      case RYDB_INDEX_DIRECT:
+        ret = rydb_index_direct_find_row(db, idx, searchval, result);
+        break;
       case RYDB_INDEX_BTREE:
         assert(0); //not implemented
         break;
@@ -2032,6 +3180,21 @@ bool rydb_index_find_row(rydb_t *db, const char *index_name, const char *val, si
     }
   }
   if(allocd_searchval) free(allocd_searchval);
+  return rydb_stats_done(db, RYDB_STATS_FIND, started, ret);
+}
+
+bool rydb_index_find_covered(rydb_t *db, const char *index_name, const char *val, size_t len, char *covered, rydb_rownum_t *rownum) {
+  rydb_index_t   *idx = rydb_get_index(db, index_name);
+  if(!idx) return false;
+  if(idx->config->type != RYDB_INDEX_HASHTABLE || idx->config->type_config.hashtable.cover_len == 0) {
+    rydb_set_error(db, RYDB_ERROR_WRONG_INDEX_TYPE, "Index %s is not a covering index", index_name);
+    return false;
+  }
+  const char     *searchval = rydb_index_search_value(db->index_scratch_buffer, idx->config, val, len);
+  bool            ret = false;
+  RYDB_WHILE_MODCOUNT_CHANGES(db) {
+    ret = rydb_index_hashtable_find_covered(db, idx, searchval, covered, rownum);
+  }
   return ret;
 }
 
@@ -2059,10 +3222,12 @@ void rydb_cursor_done(rydb_cursor_t *cur) {
     case RYDB_CURSOR_TYPE_NONE:
       return;
     case RYDB_CURSOR_TYPE_HASHTABLE:
+    case RYDB_CURSOR_TYPE_DIRECT:
       idx = cur->state.index.idx;
       rydb_index_cursor_detach(idx, cur);
       return;
     case RYDB_CURSOR_TYPE_DATA:
+    case RYDB_CURSOR_TYPE_COLUMN:
       //do nothing
       return;
   }
@@ -2079,9 +3244,20 @@ bool rydb_cursor_next(rydb_cursor_t *cur, rydb_row_t *row) {
       case RYDB_CURSOR_TYPE_HASHTABLE:
         nextrownum = rydb_hashtable_cursor_next(cur);
         break;
+      case RYDB_CURSOR_TYPE_DIRECT:
+        nextrownum = rydb_direct_cursor_next(cur);
+        break;
       case RYDB_CURSOR_TYPE_DATA:
         nextrownum = data_cursor_step(cur);
         break;
+      case RYDB_CURSOR_TYPE_COLUMN:
+        //column group rows don't come from the data file
+        if(rydb_column_group_cursor_next(cur, row)) {
+          return true;
+        }
+        rydb_cursor_done(cur);
+        rydb_row_init(row);
+        return false;
     }
     assert(nextrownum != 0);
     nextstoredrow = rydb_rownum_to_row(db, nextrownum);
@@ -2093,10 +3269,12 @@ bool rydb_cursor_next(rydb_cursor_t *cur, rydb_row_t *row) {
       case RYDB_CURSOR_TYPE_NONE:
         return false;
       case RYDB_CURSOR_TYPE_HASHTABLE:
+      case RYDB_CURSOR_TYPE_DIRECT:
         idx = cur->state.index.idx;
         rydb_index_cursor_detach(idx, cur);
         break;
       case RYDB_CURSOR_TYPE_DATA:
+      case RYDB_CURSOR_TYPE_COLUMN:
         break;
     }
     rydb_cursor_done(cur);
@@ -2105,6 +3283,52 @@ bool rydb_cursor_next(rydb_cursor_t *cur, rydb_row_t *row) {
   }
 }
 
+static size_t data_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max) {
+  rydb_t                   *db = cur->db;
+  const uint16_t            sz = db->stored_row_size;
+  const rydb_stored_row_t  *endrow = rydb_rownum_to_row(db, db->data_next_rownum);
+  rydb_stored_row_t        *row = rydb_rownum_to_row(db, cur->state.data.rownum);
+  size_t                    n = 0;
+  while(n < max && row < endrow) {
+    if(row->type == RYDB_ROW_DATA) {
+      rydb_storedrow_to_row(db, row, &rows[n++]);
+      cur->step++;
+    }
+    row = rydb_row_next(row, sz, 1);
+  }
+  cur->state.data.rownum = rydb_row_to_rownum(db, row);
+  if(row >= endrow) {
+    cur->finished = 1;
+  }
+  return n;
+}
+
+size_t rydb_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max) {
+  size_t n = 0;
+  if(!cur->finished) {
+    switch(cur->type) {
+      case RYDB_CURSOR_TYPE_NONE:
+        return 0;
+      case RYDB_CURSOR_TYPE_HASHTABLE:
+        n = rydb_hashtable_cursor_next_batch(cur, rows, max);
+        break;
+      case RYDB_CURSOR_TYPE_DIRECT:
+        n = rydb_direct_cursor_next_batch(cur, rows, max);
+        break;
+      case RYDB_CURSOR_TYPE_DATA:
+        n = data_cursor_next_batch(cur, rows, max);
+        break;
+      case RYDB_CURSOR_TYPE_COLUMN:
+        n = rydb_column_group_cursor_next_batch(cur, rows, max);
+        break;
+    }
+  }
+  if(n == 0 && max > 0) {
+    rydb_cursor_done(cur);
+  }
+  return n;
+}
+
 bool rydb_find_rows_str(rydb_t *db, const char *str, rydb_cursor_t *cur) {
   return rydb_find_rows(db, str, strlen(str), cur);
 }
@@ -2139,6 +3363,13 @@ bool rydb_index_find_rows(rydb_t *db, const char *index_name, const char *val, s
       cur->state.index.config = idx->config;
       ret = rydb_hashtable_cursor_init(cur);
       break;
+    case RYDB_INDEX_DIRECT:
+      cur->type = RYDB_CURSOR_TYPE_DIRECT;
+      cur->state.index.type = RYDB_INDEX_DIRECT;
+      cur->state.index.idx = idx;
+      cur->state.index.config = idx->config;
+      ret = rydb_direct_cursor_init(cur);
+      break;
     default:
       assert(0);
   }
@@ -2162,6 +3393,45 @@ bool rydb_rows(rydb_t *db, rydb_cursor_t *cur) {
   return true;
 }
 
+static rydb_column_group_t *rydb_get_column_group(rydb_t *db, const char *group_name) {
+  if(!rydb_ensure_open(db)) {
+    return NULL;
+  }
+  off_t groupnum = rydb_find_column_group_num(db, group_name);
+  if(groupnum == -1) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Column group \"%s\" does not exist in this database", group_name);
+    return NULL;
+  }
+  return &db->column_group[groupnum];
+}
+
+bool rydb_column_group_rows(rydb_t *db, const char *group_name, rydb_cursor_t *cur) {
+  rydb_column_group_t *grp = rydb_get_column_group(db, group_name);
+  if(!grp) {
+    cur->type = RYDB_CURSOR_TYPE_NONE;
+    return false;
+  }
+  *cur = (rydb_cursor_t ){
+    .db = db,
+    .data = NULL,
+    .len = 0,
+    .step = 0,
+    .finished = 0,
+    .type = RYDB_CURSOR_TYPE_COLUMN
+  };
+  cur->state.column.group = grp;
+  cur->state.column.rownum = 1;
+  return true;
+}
+
+bool rydb_column_group_find_row_at(rydb_t *db, const char *group_name, rydb_rownum_t rownum, rydb_row_t *row) {
+  rydb_column_group_t *grp = rydb_get_column_group(db, group_name);
+  if(!grp) {
+    return false;
+  }
+  return rydb_column_group_entry_get(db, grp, rownum, row);
+}
+
 bool rydb_index_rehash(rydb_t *db, const char *index_name) {
   rydb_index_t   *idx = rydb_get_index(db, index_name);
   if(!idx) return false;
@@ -2172,6 +3442,382 @@ bool rydb_index_rehash(rydb_t *db, const char *index_name) {
   return rydb_index_hashtable_rehash(db, idx, 0, 0, 1);
 }
 
+bool rydb_index_stats(rydb_t *db, const char *index_name, rydb_index_stats_t *stats) {
+  rydb_index_t   *idx = rydb_get_index(db, index_name);
+  if(!idx) return false;
+  if(idx->config->type != RYDB_INDEX_HASHTABLE) {
+    rydb_set_error(db, RYDB_ERROR_WRONG_INDEX_TYPE, "Index %s is not a hashtable, no stats to report", idx->config->name);
+    return false;
+  }
+  RYDB_WHILE_MODCOUNT_CHANGES(db) {
+    rydb_index_hashtable_stats(idx, stats);
+  }
+  return true;
+}
+
+bool rydb_index_rebuild(rydb_t *db, const char *index_name) {
+  if(!rydb_ensure_open(db)) {
+    return false;
+  }
+  if(!rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  rydb_index_t   *idx = rydb_get_index(db, index_name);
+  if(!idx) return false;
+  rydb_modcount_incr(db);
+  return rydb_index_build(db, idx);
+}
+
+static bool rydb_index_config_same(const rydb_config_index_t *cf1, const rydb_config_index_t *cf2) {
+  if(cf1->type != cf2->type || cf1->start != cf2->start || cf1->len != cf2->len || cf1->flags != cf2->flags || !rydb_index_segments_same(cf1, cf2) || !rydb_index_filters_same(cf1, cf2)) {
+    return false;
+  }
+  switch(cf1->type) {
+    case RYDB_INDEX_HASHTABLE:
+      return memcmp(&cf1->type_config.hashtable, &cf2->type_config.hashtable, sizeof(cf1->type_config.hashtable)) == 0;
+    case RYDB_INDEX_DIRECT:
+      return cf1->type_config.direct.big_endian == cf2->type_config.direct.big_endian;
+    default:
+      return true;
+  }
+}
+
+//has the file been replaced (or removed) since we opened it?
+static bool rydb_file_replaced(const rydb_file_t *f) {
+  struct stat st_open, st_path;
+  if(fstat(f->fd, &st_open) == -1 || stat(f->path, &st_path) == -1) {
+    return true;
+  }
+  return st_open.st_ino != st_path.st_ino || st_open.st_dev != st_path.st_dev;
+}
+
+static void rydb_index_set_discard(rydb_t *db, rydb_index_set_t *set, const bool *opened, bool delete_files) {
+  for(int i = 0; i < set->count; i++) {
+    if(opened[i]) {
+      if(delete_files) {
+        rydb_file_delete(db, &set->index[i].index);
+        rydb_file_delete(db, &set->index[i].map);
+        rydb_file_delete(db, &set->index[i].filter);
+      }
+      rydb_file_close(db, &set->index[i].index);
+      rydb_file_close(db, &set->index[i].map);
+      rydb_file_close(db, &set->index[i].filter);
+    }
+  }
+  rydb_subfree(&set->index);
+  rydb_subfree(&set->unique_index);
+  rydb_subfree(&set->index_scratch_buffer);
+  rydb_subfree(&set->index_scratch);
+}
+
+/*
+ * switch the database over to a new set of indices. Indices that have the same name
+ * and definition in the old set are carried over as-is; new ones are opened, and
+ * (for the writer) built from the data file before the meta file is atomically replaced.
+ * The new index config array (and the names in it) becomes owned by the db.
+ */
+static bool rydb_index_set_switch(rydb_t *db, rydb_config_index_t *config, uint16_t count) {
+  rydb_index_set_t  set = {.config = config, .count = count, .index = NULL};
+  bool              opened[RYDB_INDICES_MAX];
+  bool              carried[RYDB_INDICES_MAX];
+  const bool        writer = db->privileges.write;
+  memset(opened, 0, sizeof(opened));
+  memset(carried, 0, sizeof(carried));
+  
+  if(count > 0) {
+    if((set.index = rydb_mem.malloc(sizeof(*set.index) * count)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for index files");
+      return false;
+    }
+    memset(set.index, '\00', sizeof(*set.index) * count);
+  }
+  for(int i = 0; i < count; i++) {
+    rydb_index_t *idx = &set.index[i];
+    off_t         prev = rydb_find_index_num(db, config[i].name);
+    if(prev != -1 && rydb_index_config_same(&db->config.index[prev], &config[i]) && (writer || !rydb_file_replaced(&db->index[prev].index))) {
+      *idx = db->index[prev];
+      idx->config = &config[i];
+      carried[prev] = 1;
+      continue;
+    }
+    idx->config = &config[i];
+    idx->index.fd = -1;
+    idx->map.fd = -1;
+    idx->filter.fd = -1;
+    opened[i] = 1;
+    if(!writer && db->config.lazy_indices) {
+      continue;
+    }
+    if(!rydb_index_open(db, idx)) {
+      rydb_index_set_discard(db, &set, opened, writer);
+      return false;
+    }
+    //always build new indices from scratch, in case there's a stale index file lying around
+    if(writer && !rydb_index_build(db, idx)) {
+      rydb_index_set_discard(db, &set, opened, writer);
+      return false;
+    }
+  }
+  if(!rydb_index_set_init_unique(db, &set)) {
+    rydb_index_set_discard(db, &set, opened, writer);
+    return false;
+  }
+  if(writer) {
+    if(!rydb_meta_publish(db, config, count)) {
+      rydb_index_set_discard(db, &set, opened, writer);
+      return false;
+    }
+    rydb_modcount_incr(db);
+  }
+  
+  //point of no return. move the cursors over to the new index structs
+  for(int i = 0; i < count; i++) {
+    if(opened[i]) continue;
+    for(rydb_cursor_t *cur = set.index[i].cursor; cur; cur = cur->next) {
+      cur->state.index.idx = &set.index[i];
+      cur->state.index.config = &config[i];
+    }
+  }
+  for(int i = 0; i < db->config.index_count; i++) {
+    rydb_index_t *idx = &db->index[i];
+    if(carried[i]) continue;
+    while(idx->cursor) {
+      rydb_cursor_t *cur = idx->cursor;
+      rydb_index_cursor_detach(idx, cur);
+      cur->type = RYDB_CURSOR_TYPE_NONE;
+      cur->finished = 1;
+    }
+    if(writer) {
+      rydb_file_delete(db, &idx->index);
+      rydb_file_delete(db, &idx->map);
+      rydb_file_delete(db, &idx->filter);
+    }
+    rydb_file_close(db, &idx->index);
+    rydb_file_close(db, &idx->map);
+    rydb_file_close(db, &idx->filter);
+  }
+  for(int i = 0; i < db->config.index_count; i++) {
+    bool name_kept = false;
+    for(int j = 0; j < count; j++) {
+      if(config[j].name == db->config.index[i].name) {
+        name_kept = true;
+        break;
+      }
+    }
+    if(!name_kept) {
+      rydb_subfree(&db->config.index[i].name);
+    }
+  }
+  
+  db->transaction.oneshot = 0;
+  rydb_transaction_data_free(db);
+  rydb_subfree(&db->config.index);
+  rydb_subfree(&db->index);
+  rydb_subfree(&db->unique_index);
+  rydb_subfree(&db->index_scratch);
+  rydb_subfree(&db->index_scratch_buffer);
+  db->config.index = config;
+  db->config.index_count = count;
+  db->index = set.index;
+  db->unique_index_count = set.unique_index_count;
+  db->unique_index = set.unique_index;
+  db->index_scratch_buffer = set.index_scratch_buffer;
+  db->index_scratch = set.index_scratch;
+  if(!rydb_transaction_data_init(db)) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for transaction data");
+    return false;
+  }
+  return true;
+}
+
+static bool rydb_index_set_reload(rydb_t *db) {
+  uint64_t  revision = AO_load(&((rydb_state_t *)db->state.file.start)->meta_revision);
+  rydb_t   *loaded_db = rydb_new();
+  if(!loaded_db) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to reload RyDB indices");
+    return false;
+  }
+  //the meta file has been replaced, so reopen it before reading
+  rydb_file_close(db, &db->meta);
+  if(!rydb_file_open(db, "meta", &db->meta)) {
+    rydb_close(loaded_db);
+    return false;
+  }
+  if(!rydb_meta_load(loaded_db, &db->meta)) {
+    rydb_set_error(db, loaded_db->error.code, "Failed to reload database indices: %.900s", loaded_db->error.str);
+    rydb_close(loaded_db);
+    return false;
+  }
+  rydb_config_index_t *config = loaded_db->config.index;
+  uint16_t             count = loaded_db->config.index_count;
+  loaded_db->config.index = NULL;
+  loaded_db->config.index_count = 0;
+  rydb_close(loaded_db);
+  
+  if(!rydb_index_set_switch(db, config, count)) {
+    for(int i = 0; i < count; i++) {
+      rydb_subfree(&config[i].name);
+    }
+    rydb_subfree(&config);
+    return false;
+  }
+  db->meta_revision = revision;
+  return true;
+}
+
+static bool rydb_ensure_index_set_changeable(rydb_t *db) {
+  if(!rydb_ensure_open(db)) {
+    return false;
+  }
+  if(!rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  if(db->transaction.active) {
+    rydb_set_error(db, RYDB_ERROR_TRANSACTION_ACTIVE, "Cannot change indices while a transaction is active");
+    return false;
+  }
+  return true;
+}
+
+//validate the new index the same way as if it were configured before opening
+static rydb_t *rydb_index_add_scratch_db(rydb_t *db) {
+  if(!rydb_ensure_index_set_changeable(db)) {
+    return NULL;
+  }
+  rydb_t *scratch = rydb_new();
+  if(!scratch) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to add index");
+    return NULL;
+  }
+  scratch->config.row_len = db->config.row_len;
+  if(db->config.index_count > 0) {
+    if((scratch->config.index = rydb_mem.malloc(sizeof(*db->config.index) * db->config.index_count)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to add index");
+      rydb_close(scratch);
+      return NULL;
+    }
+    memcpy(scratch->config.index, db->config.index, sizeof(*db->config.index) * db->config.index_count);
+    scratch->config.index_count = db->config.index_count;
+  }
+  return scratch;
+}
+
+static bool rydb_index_add_from_scratch_db(rydb_t *db, rydb_t *scratch, bool ok, const char *name) {
+  rydb_config_index_t *config = scratch->config.index;
+  uint16_t             count = scratch->config.index_count;
+  if(!ok) {
+    rydb_set_error(db, scratch->error.code, "%.900s", scratch->error.str);
+  }
+  //the index names are shared with the db, don't let the scratch db free them
+  scratch->config.index = NULL;
+  scratch->config.index_count = 0;
+  rydb_close(scratch);
+  
+  if(ok && !rydb_index_set_switch(db, config, count)) {
+    for(int i = 0; i < count; i++) {
+      if(strcmp(config[i].name, name) == 0) {
+        rydb_subfree(&config[i].name);
+      }
+    }
+    ok = false;
+  }
+  if(!ok && config) {
+    rydb_mem.free(config);
+  }
+  return ok;
+}
+
+bool rydb_index_add_hashtable(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_hashtable_t *advanced_config) {
+  rydb_t *scratch = rydb_index_add_scratch_db(db);
+  if(!scratch) {
+    return false;
+  }
+  return rydb_index_add_from_scratch_db(db, scratch, rydb_config_add_index_hashtable(scratch, name, start, len, flags, advanced_config), name);
+}
+
+bool rydb_index_add_direct(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_direct_t *advanced_config) {
+  rydb_t *scratch = rydb_index_add_scratch_db(db);
+  if(!scratch) {
+    return false;
+  }
+  return rydb_index_add_from_scratch_db(db, scratch, rydb_config_add_index_direct(scratch, name, start, len, flags, advanced_config), name);
+}
+
+bool rydb_index_add_hashtable_composite(rydb_t *db, const char *name, const rydb_index_segment_t *segments, unsigned segment_count, uint8_t flags, rydb_config_index_hashtable_t *advanced_config) {
+  rydb_t *scratch = rydb_index_add_scratch_db(db);
+  if(!scratch) {
+    return false;
+  }
+  return rydb_index_add_from_scratch_db(db, scratch, rydb_config_add_index_hashtable_composite(scratch, name, segments, segment_count, flags, advanced_config), name);
+}
+
+bool rydb_index_drop(rydb_t *db, const char *name) {
+  if(!rydb_ensure_index_set_changeable(db)) {
+    return false;
+  }
+  off_t dropnum = rydb_find_index_num(db, name);
+  if(dropnum == -1) {
+    rydb_set_error(db, RYDB_ERROR_INDEX_NOT_FOUND, "Index %s does not exist in this database", name);
+    return false;
+  }
+  if(strcmp(name, "primary") == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Cannot drop the primary index");
+    return false;
+  }
+  rydb_config_index_t *config = NULL;
+  uint16_t             count = db->config.index_count - 1;
+  if(count > 0) {
+    if((config = rydb_mem.malloc(sizeof(*config) * count)) == NULL) {
+      rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to drop index");
+      return false;
+    }
+    memcpy(config, db->config.index, sizeof(*config) * dropnum);
+    memcpy(&config[dropnum], &db->config.index[dropnum + 1], sizeof(*config) * (count - dropnum));
+  }
+  if(!rydb_index_set_switch(db, config, count)) {
+    if(config) rydb_mem.free(config);
+    return false;
+  }
+  return true;
+}
+
+bool rydb_maintenance(rydb_t *db, unsigned budget_usec) {
+  if(!rydb_ensure_open(db)) {
+    return false;
+  }
+  if(!rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  uint64_t deadline = rydb_clock_usec() + budget_usec;
+  RYDB_EACH_INDEX(db, idx) {
+    if(idx->index.fd == -1 || idx->config->type != RYDB_INDEX_HASHTABLE) {
+      continue;
+    }
+    if(!rydb_index_hashtable_maintenance(db, idx, deadline)) {
+      return false;
+    }
+    if(rydb_clock_usec() >= deadline) {
+      break;
+    }
+  }
+  if(db->snapshot.fd != -1 && !rydb_snapshot_step(db, deadline)) {
+    return false;
+  }
+  return true;
+}
+
+bool rydb_maintenance_pending(rydb_t *db) {
+  if(db->status != RYDB_STATUS_OPEN) {
+    return false;
+  }
+  RYDB_EACH_INDEX(db, idx) {
+    if(idx->index.fd != -1 && idx->config->type == RYDB_INDEX_HASHTABLE && rydb_index_hashtable_maintenance_pending(idx)) {
+      return true;
+    }
+  }
+  return db->snapshot.fd != -1;
+}
+
 bool rydb_stored_row_in_range(rydb_t *db, rydb_stored_row_t *storedrow) {
   if((char *)storedrow < db->data.data.start || &((char *)storedrow)[db->stored_row_size] > db->data.data.end) {
     return false;
@@ -17,6 +17,7 @@ typedef uint32_t rydb_rownum_t;
 #define RYDB_ROWNUM_NEXT  ((rydb_rownum_t ) -2)
 
 #define RYDB_ROW_LINK_PAIRS_MAX 5
+#define RYDB_COLUMN_GROUPS_MAX 8
 #define rydb_link_bitmap_t      uint_fast8_t
 
 
@@ -82,14 +83,16 @@ typedef struct {
 typedef enum {
   RYDB_INDEX_INVALID = 0,
   RYDB_INDEX_HASHTABLE = 1,
-  RYDB_INDEX_BTREE = 2
+  RYDB_INDEX_BTREE = 2,
+  RYDB_INDEX_DIRECT = 3  //dense unsigned integer keys, addressed directly in a radix array. unique only
 } rydb_index_type_t;
 
 typedef enum {
   RYDB_HASH_INVALID =   0,
   RYDB_HASH_CRC32 =     1,
   RYDB_HASH_NOHASH =    2, //treat the value as if it's already a good hash
-  RYDB_HASH_SIPHASH =   3
+  RYDB_HASH_SIPHASH =   3,
+  RYDB_HASH_INTEGER =   4  //the value is a 4- or 8-byte unsigned integer. Fibonacci-hashed, compared as an integer
 } rydb_hash_function_t;
 
 typedef struct {
@@ -99,11 +102,21 @@ typedef struct {
   //storing the value in the hashtable prevents extra datafile reads at the cost of possibly much larger hashtable entries
   unsigned             store_value: 1;
   unsigned             store_hash:  1; //storing the hash adds 8 bytes per bucket entry
+  unsigned             compact_hash: 1; //store a 4-byte hash tag instead. needs store_hash
+  unsigned             bloom_filter: 1; //a blocked Bloom filter (1 byte per slot) turns away most lookups of absent keys in a single cache line
+  unsigned             integer_big_endian: 1; //RYDB_HASH_INTEGER keys are stored big-endian instead of little-endian
+  //covering indices keep cover_len more bytes of the row, from cover_start, in each bucket. needs store_value
+  uint16_t             cover_start;
+  uint16_t             cover_len;
   
   //direct mapping uses closed-address linear probing, ideal for a 1-to-1 unique primary index. <2 reads avg.
+  //Robin Hood is linear probing with runs kept sorted by home slot: short, predictable probes even at high load factors. needs store_hash.
+  //its table isn't grown incrementally: the insert that crosses load_factor_max re-lays out the whole table before it returns,
+  //a stall that grows with the index. open addressing with RYDB_REHASH_BACKGROUND spreads that work out instead
   enum {
     RYDB_OPEN_ADDRESSING = 0,
-    RYDB_SEPARATE_CHAINING = 1
+    RYDB_SEPARATE_CHAINING = 1,
+    RYDB_ROBIN_HOOD = 2
   }                    collision_resolution;
 } rydb_config_index_hashtable_t;
 
@@ -114,9 +127,15 @@ typedef struct {
 #define RYDB_REHASH_INCREMENTAL_ON_WRITE  (1<<4)
 #define RYDB_REHASH_INCREMENTAL_ADJACENT  (1<<5)
 #define RYDB_REHASH_INCREMENTAL           (RYDB_REHASH_INCREMENTAL_ON_READ | RYDB_REHASH_INCREMENTAL_ON_WRITE | RYDB_REHASH_INCREMENTAL_ADJACENT)
+#define RYDB_REHASH_BACKGROUND            (1<<6) //rehash in bounded slices from rydb_maintenance()
+
+typedef struct {
+  unsigned             big_endian: 1; //keys are stored big-endian instead of little-endian
+} rydb_config_index_direct_t;
 
 typedef union {
   rydb_config_index_hashtable_t hashtable;
+  rydb_config_index_direct_t    direct;
 } rydb_config_index_type_t;
 
 
@@ -131,20 +150,40 @@ typedef struct {
     uint8_t       load_factor;
     size_t        datasize;
   }             derived;
-  uint64_t    (*hash_function)(const char *data, size_t data_len);
+  //hash and key-compare kernels specialized for the index's key length, picked when the index is opened
+  uint64_t    (*hash_function)(const char *data, size_t data_len, const uint8_t *key);
+  int         (*compare)(const char *a, const char *b, size_t data_len); //0 if the keys match
 } rydb_index_state_hashtable_t;
 
 typedef union {
   rydb_index_state_hashtable_t hashtable;
 } rydb_index_state_t;
 
+#define RYDB_INDEX_MAX_SEGMENTS 8
+#define RYDB_INDEX_COMPOSITE_KEY_MAX 256
+
+typedef struct {
+  uint16_t           start;
+  uint16_t           len;
+} rydb_index_segment_t;
+
+//partial indices only cover rows where (row[offset] & mask) == value
+typedef struct {
+  uint16_t           offset;
+  uint8_t            mask; //0 for an index covering every row
+  uint8_t            value;
+} rydb_index_filter_t;
+
 typedef struct {
   const char        *name;
   rydb_index_type_t  type;
-  uint16_t           start; // start of indexable value in row
-  uint16_t           len; //length of indexable data
+  uint16_t           start; // start of indexable value in row. the first segment's start for composite indices
+  uint16_t           len; //length of indexable data. all the segments' lengths together for composite indices
   rydb_config_index_type_t type_config;
   uint8_t            flags;
+  uint8_t            segment_count; //0 for a plain start/len index
+  rydb_index_segment_t segment[RYDB_INDEX_MAX_SEGMENTS];
+  rydb_index_filter_t filter;
 } rydb_config_index_t;
 
 struct rydb_cursor_s;
@@ -152,6 +191,7 @@ struct rydb_cursor_s;
 typedef struct {
   rydb_file_t          index;
   rydb_file_t          map;
+  rydb_file_t          filter;
   rydb_config_index_t *config;
   rydb_index_state_t   state;
   struct rydb_cursor_s *cursor;
@@ -163,6 +203,38 @@ typedef struct {
   unsigned    inverse: 1;
 } rydb_config_row_link_t;
 
+//a range of the row mirrored into its own file, so scans over just that range don't page in whole rows
+typedef struct {
+  const char *name;
+  uint16_t    start;
+  uint16_t    len;
+} rydb_config_column_group_t;
+
+typedef struct {
+  rydb_config_column_group_t *config;
+  rydb_file_t                 file;
+} rydb_column_group_t;
+
+//change feed records. the ops use the same characters as the commands they come from
+typedef enum {
+  RYDB_CHANGE_SET       ='@', //the whole row was written
+  RYDB_CHANGE_UPDATE    ='^', //row[start, start+len) was updated
+  RYDB_CHANGE_DELETE    ='x',
+} rydb_change_op_t;
+
+typedef struct {
+  uint64_t          lsn;
+  rydb_rownum_t     rownum;
+  rydb_change_op_t  op;
+  uint16_t          start;
+  uint16_t          len;
+} rydb_change_t;
+
+#define RYDB_CHANGE_FEED_CAPACITY_MAX (1 << 24)
+
+#define RYDB_BACKUP_PAGE_SIZE_MIN 4096
+#define RYDB_BACKUP_PAGE_SIZE_MAX (1 << 24)
+
 #define RYDB_ERROR_MAX_LEN 1024
 typedef enum {
   RYDB_NO_ERROR                   = 0,
@@ -193,6 +265,10 @@ typedef enum {
   RYDB_ERROR_WRONG_INDEX_TYPE     = 25,
   RYDB_ERROR_LINK_NOT_FOUND       = 26,
   RYDB_ERROR_NO_WRITE_PRIVILEGE   = 27,
+  RYDB_ERROR_CHANGES_LOST         = 28,
+  RYDB_ERROR_REPLICATION          = 29,
+  RYDB_ERROR_BACKUP_MISMATCH      = 30,
+  RYDB_ERROR_SNAPSHOT_ACTIVE      = 31,
 } rydb_error_code_t;
 const char *rydb_error_code_str(rydb_error_code_t code);
 
@@ -221,6 +297,11 @@ typedef struct {
   rydb_config_row_link_t *link;
   uint16_t index_count;
   rydb_config_index_t *index;
+  uint8_t  column_group_count;
+  rydb_config_column_group_t *column_group;
+  uint32_t change_feed_capacity; //0 for no change feed
+  uint32_t backup_page_size; //0 if changed pages aren't tracked for incremental backups
+  unsigned lazy_indices:1; //readers open index files on first use. not saved in the meta file
   struct {
     uint8_t   value[16];
     unsigned  quality:2;
@@ -228,6 +309,72 @@ typedef struct {
   }        hash_key;
 } rydb_config_t;
 
+//latencies in nanoseconds, bucketed HDR-style: exact below 8, then 8 buckets per power of 2 (within 12.5%),
+//up to 2^40 ns. anything longer goes in the last bucket
+#define RYDB_STATS_HISTOGRAM_SUB_BUCKETS 8
+#define RYDB_STATS_HISTOGRAM_MAX_BITS 40
+#define RYDB_STATS_HISTOGRAM_BUCKETS ((RYDB_STATS_HISTOGRAM_MAX_BITS - 2) * RYDB_STATS_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t          count;
+  uint64_t          sum;
+  uint64_t          min;
+  uint64_t          max;
+  uint64_t          bucket[RYDB_STATS_HISTOGRAM_BUCKETS];
+} rydb_stats_histogram_t;
+
+typedef enum {
+  RYDB_STATS_INSERT = 0,
+  RYDB_STATS_UPDATE = 1,
+  RYDB_STATS_DELETE = 2,
+  RYDB_STATS_FIND   = 3,
+  RYDB_STATS_COMMIT = 4, //running a transaction, oneshot or not
+  RYDB_STATS_OPS    = 5
+} rydb_stats_op_t;
+
+typedef struct {
+  rydb_stats_histogram_t latency[RYDB_STATS_OPS];
+  struct {
+    uint64_t          modcount_retries; //reads redone because the writer changed something underneath them
+    uint64_t          file_grows;
+    uint64_t          file_remaps;
+    uint64_t          index_grows; //hashtables doubling in size
+    uint64_t          bitlevel_pushes;
+    uint64_t          rehashes; //full passes over a hashtable
+    uint64_t          index_builds; //indices built from scratch from the data file
+  }                 counter;
+} rydb_stats_t;
+
+#define RYDB_INDEX_STATS_BITLEVELS_MAX (4*sizeof(rydb_rownum_t) + 1)
+#define RYDB_INDEX_STATS_RUN_LENGTHS 16 //runs this long or longer all go in the last slot
+
+//hashtable health. everything but the probe runs comes straight from the index header
+typedef struct {
+  uint64_t          rows;
+  uint64_t          buckets; //2^hashbits, not counting overflow. chain slots for separate chaining
+  uint64_t          overflow_buckets; //appended past the end of the table by runs that spilled off it
+  double            load_factor;
+  double            load_factor_max;
+  uint64_t          rows_until_grow;
+  uint8_t           bitlevel_count;
+  struct {
+    uint8_t           bits;
+    uint64_t          rows;
+  }                 bitlevel[RYDB_INDEX_STATS_BITLEVELS_MAX]; //[0] is the current size, the rest haven't been rehashed up to it yet
+  struct {
+    uint64_t          scanned; //buckets (or chain slots) looked at. fewer than the table has if it was sampled
+    uint64_t          runs; //contiguous filled buckets, or non-empty chains
+    uint64_t          rows; //in those runs
+    uint64_t          longest;
+    uint64_t          length[RYDB_INDEX_STATS_RUN_LENGTHS]; //length[n-1] is the number of runs n long
+  }                 probe;
+  struct {
+    uint64_t          rows; //still on an older bitlevel, that a full rehash would move up to the current one
+    uint64_t          bytes; //of buckets it would read through
+    uint64_t          pending; //buckets background rehashing has yet to get through
+  }                 rehash;
+} rydb_index_stats_t;
+
 typedef struct rydb_s rydb_t;
 struct rydb_s {
   rydb_status_t       status;
@@ -240,12 +387,30 @@ struct rydb_s {
   rydb_file_t         data;
   rydb_file_t         meta;
   rydb_file_t         state;
+  struct {
+    rydb_file_t         file;
+    uint32_t            pending; //recorded by the running transaction, not yet published
+  }                   changes;
+  struct {
+    int                 fd; //where committed transactions are shipped to, -1 if they aren't
+  }                   replication;
+  struct {
+    rydb_file_t         pages; //the epoch each data file page was last changed in
+  }                   backup;
+  struct {
+    int                 fd; //the snapshot's data file, -1 if no snapshot is being taken
+    char               *path;
+    size_t              copied; //data file bytes copied so far
+    uint32_t            epoch; //pages stamped with this epoch or a later one changed after the snapshot started
+  }                   snapshot;
   rydb_config_t       config;
   rydb_index_t       *index;
   char               *index_scratch_buffer;
   const char        **index_scratch;
   uint8_t             unique_index_count;
   rydb_index_t      **unique_index;
+  rydb_column_group_t *column_group;
+  uint64_t            meta_revision; //meta file revision the index set was loaded from
   struct {
     unsigned            read:1;
     unsigned            write:1;
@@ -266,8 +431,10 @@ struct rydb_s {
     void               *privdata;
   }                   error_handler;
   rydb_error_t        error;
+  rydb_stats_t       *stats; //NULL unless collection is enabled
 #ifdef RYDB_DEBUG
   uint64_t            modcount_changed;
+  uint64_t            tail_rows_scanned;
 #endif
 };// rydb_t
 
@@ -278,6 +445,8 @@ typedef struct rydb_cursor_s{
     RYDB_CURSOR_TYPE_NONE = 0,
     RYDB_CURSOR_TYPE_DATA = 1,
     RYDB_CURSOR_TYPE_HASHTABLE = 2,
+    RYDB_CURSOR_TYPE_DIRECT = 3,
+    RYDB_CURSOR_TYPE_COLUMN = 4,
   }                  type;
   unsigned           finished:1;
   const char        *data;
@@ -295,14 +464,26 @@ typedef struct rydb_cursor_s{
           uint64_t        bucketnum;
           int_fast8_t     bitlevel;
         }               hashtable;
+        struct {
+          rydb_rownum_t   rownum;
+        }               direct;
       }                 typedata;
     }                 index;
     struct {
       rydb_rownum_t     rownum;
     }                 data;
+    struct {
+      rydb_column_group_t *group;
+      rydb_rownum_t     rownum;
+    }                 column;
   }                 state;
 } rydb_cursor_t;
 
+typedef struct {
+  rydb_t            *db;
+  uint64_t           lsn; //next change to read
+} rydb_changes_cursor_t;
+
 rydb_error_t *rydb_error(const rydb_t *db);
 int rydb_error_print(const rydb_t *db);
 int rydb_error_fprint(const rydb_t *db, FILE *file);
@@ -316,11 +497,24 @@ bool rydb_config_row(rydb_t *db, unsigned row_len, unsigned id_len);
 bool rydb_config_revision(rydb_t *db, unsigned revision);
 bool rydb_config_add_row_link(rydb_t *db, const char *link_name, const char *reverse_link_name);
 bool rydb_config_add_index_hashtable(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_hashtable_t *advanced_config);
+bool rydb_config_add_index_direct(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_direct_t *advanced_config);
+//composite keys: the segments of the row are indexed as if they were one value, concatenated in order
+bool rydb_config_add_index_hashtable_composite(rydb_t *db, const char *name, const rydb_index_segment_t *segments, unsigned segment_count, uint8_t flags, rydb_config_index_hashtable_t *advanced_config);
+//make an already-configured index partial: only rows with (row[offset] & mask) == value are indexed
+bool rydb_config_index_filter(rydb_t *db, const char *name, unsigned offset, uint8_t mask, uint8_t value);
+//mirror row[start, start+len) into its own file, kept in sync with the data
+bool rydb_config_add_column_group(rydb_t *db, const char *name, unsigned start, unsigned len);
+//keep a ring of the last capacity committed changes in its own file, for other processes to follow
+bool rydb_config_change_feed(rydb_t *db, unsigned capacity);
+//readers put off opening each index until it's first looked up. writers always open them all
+bool rydb_config_lazy_indices(rydb_t *db, bool lazy);
 
 bool rydb_set_error_handler(rydb_t *db, void (*fn)(rydb_t *, rydb_error_t *, void *), void *pd);
 
 bool rydb_open(rydb_t *db, const char *path, const char *name);
 bool rydb_open_reader(rydb_t *db, const char *path, const char *name);
+//write the open database's config in the human-readable meta format, for debugging. meta files in that format still load
+bool rydb_meta_export(rydb_t *db, FILE *fp);
 
 bool rydb_insert(rydb_t *db, const char *data, uint16_t len);
 bool rydb_insert_str(rydb_t *db, const char *data);
@@ -347,14 +541,63 @@ bool rydb_index_find_row(rydb_t *db, const char *index_name, const char *val, si
 bool rydb_index_find_row_str(rydb_t *db, const char *index_name, const char *str, rydb_row_t *result);
 bool rydb_index_find_rows(rydb_t *db, const char *index_name, const char *val, size_t len, rydb_cursor_t *cur);
 bool rydb_index_find_rows_str(rydb_t *db, const char *index_name, const char *str, rydb_cursor_t *cur);
+//read a covering index's covered bytes for a key straight from the index. covered must fit cover_len bytes, rownum may be NULL
+bool rydb_index_find_covered(rydb_t *db, const char *index_name, const char *val, size_t len, char *covered, rydb_rownum_t *rownum);
 
 //cursor stuff
 bool rydb_cursor_next(rydb_cursor_t *cur, rydb_row_t *row);
+size_t rydb_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max); //returns number of rows written to rows[]
 void rydb_cursor_done(rydb_cursor_t *cur);
 
 //all rows
 bool rydb_rows(rydb_t *db, rydb_cursor_t *cur);
 
+//column groups. the rows' data points at the group's bytes, and their start and len are the group's range in the row
+bool rydb_column_group_rows(rydb_t *db, const char *group_name, rydb_cursor_t *cur);
+bool rydb_column_group_find_row_at(rydb_t *db, const char *group_name, rydb_rownum_t rownum, rydb_row_t *row);
+
+//change feed. start at lsn, or at the oldest change still in the feed if lsn is 0
+bool rydb_changes(rydb_t *db, uint64_t lsn, rydb_changes_cursor_t *cur);
+//false when caught up. fails with RYDB_ERROR_CHANGES_LOST if the feed wrapped past the cursor, and moves it up to the oldest change left
+bool rydb_changes_next(rydb_changes_cursor_t *cur, rydb_change_t *change);
+uint64_t rydb_changes_last_lsn(rydb_t *db); //0 if nothing has been recorded yet
+
+//copy the database's files into dest_path, which is created if need be, as a database that opens on its own.
+//needs write privilege and no transaction in progress. runs on the writer, so nothing can be written until every
+//file has been copied. that's quick when copy_file_range() can clone the extents (btrfs, xfs on the same
+//filesystem), but anywhere else it's a full byte-for-byte copy and the writer is blocked for all of it
+bool rydb_snapshot(rydb_t *db, const char *dest_path);
+//start a snapshot into dest_path that doesn't hold up the writer. needs incremental backups configured.
+//rydb_maintenance() copies the data file a slice at a time while writes carry on, then recopies the pages that
+//changed in the meantime and finishes up between transactions. rydb_maintenance_pending() is true until then.
+//indices, column groups and the change feed are left out, and get rebuilt when the snapshot is opened for writing
+bool rydb_snapshot_start(rydb_t *db, const char *dest_path);
+
+//incremental backups. changed data pages are tracked in page_size chunks (a power of 2) by epoch, and every
+//snapshot or incremental backup starts a new epoch
+bool rydb_config_incremental_backup(rydb_t *db, unsigned page_size);
+//the epoch to pass as since_epoch to the next incremental backup, 0 if pages aren't being tracked
+uint32_t rydb_backup_epoch(rydb_t *db);
+//write every data page changed since since_epoch to the file dest. needs write privilege, same as a snapshot
+bool rydb_backup_incremental(rydb_t *db, uint32_t since_epoch, const char *dest);
+//apply a delta to the closed database at path, which must be a snapshot or a restore of it. indices, column
+//groups and the change feed are dropped, to be rebuilt from the data when it's next opened
+bool rydb_backup_restore(rydb_t *db, const char *path, const char *name, const char *delta);
+
+//replication. the leader ships every transaction it commits to fd (blocking), the follower replays them
+//one at a time. the follower has to start out as a copy of the leader, and shouldn't be written to otherwise
+bool rydb_replication_ship(rydb_t *db, int fd); //-1 to stop
+bool rydb_replication_apply(rydb_t *db, int fd);
+//last transaction shipped (leader) or replayed (follower). follower lag is the difference between the two
+uint64_t rydb_replication_lsn(rydb_t *db);
+
+//stats. collection is off until enabled, and costs a branch per operation when it is
+bool rydb_stats_enable(rydb_t *db, bool enable);
+void rydb_stats(const rydb_t *db, rydb_stats_t *stats); //all zeros if collection isn't enabled
+void rydb_stats_reset(rydb_t *db);
+//the latency at or below which percentile (0-100) of the recorded operations fell, as the top of its bucket
+uint64_t rydb_stats_percentile(const rydb_stats_histogram_t *histogram, double percentile);
+
 //row links
 bool rydb_row_set_link(rydb_t *db, rydb_row_t *row, const char *link_name, rydb_row_t *linked_row);
 bool rydb_row_set_link_rownum(rydb_t *db, rydb_row_t *row, const char *link_name, rydb_rownum_t linked_rownum);
@@ -363,6 +606,15 @@ bool rydb_row_get_link_rownum(rydb_t *db, rydb_rownum_t rownum, const char *link
 
 //index-specific stuff
 bool rydb_index_rehash(rydb_t *db, const char *index_name);
+bool rydb_index_rebuild(rydb_t *db, const char *index_name); //rebuild from the data file in one pass
+//hashtable health report. probe runs are sampled for big tables, so it's cheap enough to poll
+bool rydb_index_stats(rydb_t *db, const char *index_name, rydb_index_stats_t *stats);
+bool rydb_index_add_hashtable(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_hashtable_t *advanced_config);
+bool rydb_index_add_direct(rydb_t *db, const char *name, unsigned start, unsigned len, uint8_t flags, rydb_config_index_direct_t *advanced_config);
+bool rydb_index_add_hashtable_composite(rydb_t *db, const char *name, const rydb_index_segment_t *segments, unsigned segment_count, uint8_t flags, rydb_config_index_hashtable_t *advanced_config);
+bool rydb_index_drop(rydb_t *db, const char *name);
+bool rydb_maintenance(rydb_t *db, unsigned budget_usec); //do pending background work for at most budget_usec microseconds
+bool rydb_maintenance_pending(rydb_t *db);
 
 bool rydb_close(rydb_t *db); //also free()s db
 bool rydb_delete(rydb_t *db); //deletes all files in an open db
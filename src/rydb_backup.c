@@ -0,0 +1,411 @@
+#include "rydb_internal.h"
+#include "rydb_backup.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*
+ * incremental backups: every data file page gets stamped with the current epoch whenever a row on it is changed,
+ * by the command that changes it. a backup since some epoch is then just the pages stamped with that epoch or a
+ * later one, and taking it starts a new epoch. only the data file is tracked. indices, column groups and the
+ * change feed are all derived from the data, so a restore drops them and they're rebuilt the next time the
+ * database is opened.
+ */
+
+static inline rydb_backup_pages_header_t *pages_header(const rydb_t *db) {
+  return (void *)db->backup.pages.file.start;
+}
+
+static inline uint32_t *pages_stamps(const rydb_t *db) {
+  return (void *)db->backup.pages.data.start;
+}
+
+static inline size_t pages_tracked(const rydb_t *db) {
+  return (db->backup.pages.file.end - db->backup.pages.data.start) / sizeof(uint32_t);
+}
+
+static inline size_t pages_in(size_t sz, size_t page_size) {
+  return (sz + page_size - 1) / page_size;
+}
+
+static inline size_t data_size(const rydb_t *db) {
+  return db->data.file.end - db->data.file.start;
+}
+
+static void backup_filename(const char *path, const char *name, const char *what, char *buf, size_t buflen) {
+  snprintf(buf, buflen, "%s%srydb.%s%s%s", path, strlen(path) > 0 ? RYDB_PATH_SEPARATOR : "", name, strlen(name) > 0 ? "." : "", what);
+}
+
+static bool pages_reserve_size(rydb_t *db, size_t sz) {
+  rydb_file_t *f = &db->backup.pages;
+  size_t       cur_sz = f->file.end - f->file.start;
+  size_t       min_sz = RYDB_BACKUP_PAGES_START_OFFSET + pages_in(sz, db->config.backup_page_size) * sizeof(uint32_t);
+  if(min_sz <= cur_sz) {
+    return true;
+  }
+  //grow by at least half again, same as the column groups
+  if(min_sz < cur_sz + cur_sz / 2) {
+    min_sz = cur_sz + cur_sz / 2;
+  }
+  return rydb_file_ensure_size(db, f, min_sz, NULL);
+}
+
+bool rydb_backup_pages_open(rydb_t *db) {
+  rydb_file_t *f = &db->backup.pages;
+  if(!rydb_file_open(db, "pages", f)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, f, RYDB_BACKUP_PAGES_START_OFFSET, NULL)) {
+    return false;
+  }
+  f->data.start = &f->file.start[RYDB_BACKUP_PAGES_START_OFFSET];
+  f->data.end = f->file.end;
+  return true;
+}
+
+bool rydb_backup_pages_activate(rydb_t *db) {
+  rydb_backup_pages_header_t *header = pages_header(db);
+  bool                        reset = header->epoch == 0 || header->page_size != db->config.backup_page_size;
+  if(reset) {
+    header->page_size = db->config.backup_page_size;
+  }
+  if(!pages_reserve_size(db, data_size(db))) {
+    return false;
+  }
+  header = pages_header(db);
+  if(reset) {
+    //nothing's known about when any of the pages changed, so as far as the next backup's concerned, they all just did
+    uint32_t *stamps = pages_stamps(db);
+    header->epoch++;
+    for(size_t i = 0, n = pages_tracked(db); i < n; i++) {
+      stamps[i] = header->epoch;
+    }
+  }
+  return true;
+}
+
+//make room to stamp the pages of every row before rownum, so that stamping them can't fail
+bool rydb_backup_pages_reserve(rydb_t *db, rydb_rownum_t rownum) {
+  if(db->config.backup_page_size == 0 || !db->privileges.write) {
+    return true;
+  }
+  return pages_reserve_size(db, (char *)rydb_rownum_to_row(db, rownum) - db->data.file.start);
+}
+
+void rydb_backup_mark_rows(rydb_t *db, rydb_rownum_t rownum, rydb_rownum_t count) {
+  size_t    page_size = db->config.backup_page_size;
+  size_t    first, last, max;
+  uint32_t *stamps, epoch;
+  if(page_size == 0 || !db->privileges.write || count == 0) {
+    return;
+  }
+  first = ((char *)rydb_rownum_to_row(db, rownum) - db->data.file.start) / page_size;
+  last = ((char *)rydb_rownum_to_row(db, rownum + count) - 1 - db->data.file.start) / page_size;
+  max = pages_tracked(db);
+  stamps = pages_stamps(db);
+  epoch = pages_header(db)->epoch;
+  for(size_t i = first; i <= last && i < max; i++) {
+    stamps[i] = epoch;
+  }
+}
+
+void rydb_backup_epoch_next(rydb_t *db) {
+  if(db->config.backup_page_size > 0 && db->privileges.write) {
+    pages_header(db)->epoch++;
+  }
+}
+
+//untracked pages could have changed any time
+bool rydb_backup_page_changed(rydb_t *db, size_t page, uint32_t since_epoch) {
+  return page >= pages_tracked(db) || pages_stamps(db)[page] >= since_epoch;
+}
+
+uint32_t rydb_backup_epoch(rydb_t *db) {
+  if(!rydb_ensure_open(db) || db->config.backup_page_size == 0) {
+    return 0;
+  }
+  return pages_header(db)->epoch;
+}
+
+static bool backup_read_file(rydb_t *db, const char *path, char **buf, size_t *len) {
+  FILE        *fp;
+  struct stat  st;
+  if((fp = fopen(path, "r")) == NULL || fstat(fileno(fp), &st) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open file %.900s", path);
+    if(fp) fclose(fp);
+    return false;
+  }
+  if((*buf = rydb_mem.malloc(st.st_size > 0 ? st.st_size : 1)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Failed to allocate memory for %.900s", path);
+    fclose(fp);
+    return false;
+  }
+  *len = fread(*buf, 1, st.st_size, fp);
+  fclose(fp);
+  if(*len != (size_t )st.st_size) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to read file %.900s", path);
+    rydb_mem.free(*buf);
+    return false;
+  }
+  return true;
+}
+
+static bool backup_write_delta(rydb_t *db, FILE *fp, uint32_t since_epoch, const char *meta, size_t meta_len) {
+  rydb_backup_delta_header_t  delta;
+  rydb_state_t                state;
+  size_t                      page_size = db->config.backup_page_size;
+  size_t                      sz = data_size(db);
+  size_t                      count = pages_in(sz, page_size);
+
+  memset(&delta, '\0', sizeof(delta));
+  strcpy(delta.magic, RYDB_BACKUP_DELTA_MAGIC);
+  delta.since_epoch = since_epoch;
+  delta.epoch = pages_header(db)->epoch;
+  delta.page_size = page_size;
+  delta.data_size = sz;
+  delta.meta_size = meta_len;
+  delta.state_size = sizeof(state);
+  for(size_t i = 0; i < count; i++) {
+    if(rydb_backup_page_changed(db, i, since_epoch)) {
+      delta.page_count++;
+    }
+  }
+  //nobody's holding any locks on the restored database
+  memcpy(&state, db->state.file.start, sizeof(state));
+  memset(&state.lock, '\0', sizeof(state.lock));
+
+  if(fwrite(&delta, sizeof(delta), 1, fp) != 1 || fwrite(meta, 1, meta_len, fp) != meta_len || fwrite(&state, sizeof(state), 1, fp) != 1) {
+    return false;
+  }
+  for(uint64_t i = 0; i < count; i++) {
+    size_t len = (i + 1) * page_size <= sz ? page_size : sz - i * page_size;
+    if(!rydb_backup_page_changed(db, i, since_epoch)) {
+      continue;
+    }
+    if(fwrite(&i, sizeof(i), 1, fp) != 1 || fwrite(&db->data.file.start[i * page_size], 1, len, fp) != len) {
+      return false;
+    }
+  }
+  return fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+}
+
+bool rydb_backup_incremental(rydb_t *db, uint32_t since_epoch, const char *dest) {
+  FILE   *fp;
+  int     fd;
+  char   *meta;
+  size_t  meta_len;
+  bool    ok;
+  if(!rydb_ensure_open(db) || !rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  if(db->config.backup_page_size == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Incremental backups aren't configured for this database");
+    return false;
+  }
+  if(db->transaction.active) {
+    rydb_set_error(db, RYDB_ERROR_TRANSACTION_ACTIVE, "Cannot back up while a transaction is active");
+    return false;
+  }
+  if(since_epoch > pages_header(db)->epoch) {
+    rydb_set_error(db, RYDB_ERROR_BACKUP_MISMATCH, "Epoch %"PRIu32" hasn't started yet, the current one is %"PRIu32, since_epoch, pages_header(db)->epoch);
+    return false;
+  }
+  if(!backup_read_file(db, db->meta.path, &meta, &meta_len)) {
+    return false;
+  }
+  //never write over another backup
+  if((fd = open(dest, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
+    rydb_set_error(db, errno == EEXIST ? RYDB_ERROR_FILE_EXISTS : RYDB_ERROR_FILE_ACCESS, "Failed to create backup file %.900s", dest);
+    if(fd != -1) {
+      close(fd);
+      unlink(dest);
+    }
+    rydb_mem.free(meta);
+    return false;
+  }
+  ok = backup_write_delta(db, fp, since_epoch, meta, meta_len);
+  rydb_mem.free(meta);
+  if(fclose(fp) == EOF) {
+    ok = false;
+  }
+  if(!ok) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to write backup file %.900s", dest);
+    unlink(dest);
+    return false;
+  }
+  rydb_backup_epoch_next(db);
+  return true;
+}
+
+//everything that's rebuilt from the data on open
+static bool restore_drop_derived_files(rydb_t *db, const char *path, const char *name) {
+  DIR           *dir;
+  struct dirent *ent;
+  char           prefix[1024], filepath[2048];
+  size_t         prefix_len;
+  bool           ok = true;
+  snprintf(prefix, sizeof(prefix), "rydb.%s%s", name, strlen(name) > 0 ? "." : "");
+  prefix_len = strlen(prefix);
+  if((dir = opendir(strlen(path) > 0 ? path : ".")) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open directory %.900s", path);
+    return false;
+  }
+  while(ok && (ent = readdir(dir)) != NULL) {
+    const char *what = ent->d_name;
+    if(strncmp(what, prefix, prefix_len) != 0) {
+      continue;
+    }
+    what += prefix_len;
+    if(strncmp(what, "index.", 6) == 0 || strncmp(what, "column.", 7) == 0 || strcmp(what, "changes") == 0) {
+      backup_filename(path, name, what, filepath, sizeof(filepath));
+      if(unlink(filepath) == -1) {
+        rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to delete file %.900s", filepath);
+        ok = false;
+      }
+    }
+  }
+  closedir(dir);
+  return ok;
+}
+
+static bool restore_pages(rydb_t *db, FILE *fp, const rydb_backup_delta_header_t *delta, const char *data_path) {
+  char     *buf;
+  int       fd;
+  uint64_t  pagenum;
+  size_t    len;
+  bool      ok = true;
+  if((fd = open(data_path, O_WRONLY)) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_NOT_FOUND, "Failed to open file %.900s", data_path);
+    return false;
+  }
+  if((buf = rydb_mem.malloc(delta->page_size)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Failed to allocate memory for a backup page");
+    close(fd);
+    return false;
+  }
+  for(uint32_t i = 0; ok && i < delta->page_count; i++) {
+    if(fread(&pagenum, sizeof(pagenum), 1, fp) != 1 || pagenum * delta->page_size >= delta->data_size) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Backup page %"PRIu32" is corrupted or missing", i);
+      ok = false;
+      break;
+    }
+    len = (pagenum + 1) * delta->page_size <= delta->data_size ? delta->page_size : delta->data_size - pagenum * delta->page_size;
+    if(fread(buf, 1, len, fp) != len) {
+      rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Backup page %"PRIu32" is corrupted or missing", i);
+      ok = false;
+    }
+    else if(pwrite(fd, buf, len, pagenum * delta->page_size) != (ssize_t )len) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to write to file %.900s", data_path);
+      ok = false;
+    }
+  }
+  if(ok && (ftruncate(fd, delta->data_size) == -1 || fsync(fd) == -1)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to write to file %.900s", data_path);
+    ok = false;
+  }
+  rydb_mem.free(buf);
+  close(fd);
+  return ok;
+}
+
+static bool restore_file(rydb_t *db, const char *path, const char *buf, size_t len) {
+  char  tmppath[2048];
+  FILE *fp;
+  bool  ok;
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+  if((fp = fopen(tmppath, "w")) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open file %.900s", tmppath);
+    return false;
+  }
+  ok = fwrite(buf, 1, len, fp) == len && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if(fclose(fp) == EOF) {
+    ok = false;
+  }
+  if(!ok || rename(tmppath, path) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to replace file %.900s", path);
+    unlink(tmppath);
+    return false;
+  }
+  return true;
+}
+
+static bool restore_delta(rydb_t *db, FILE *fp, const rydb_backup_delta_header_t *delta, const char *path, const char *name, int pages_fd, rydb_backup_pages_header_t *base) {
+  char   filepath[2048];
+  char  *meta, *state;
+  bool   ok;
+  if((meta = rydb_mem.malloc(delta->meta_size + delta->state_size + 1)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Failed to allocate memory for backup meta");
+    return false;
+  }
+  state = &meta[delta->meta_size];
+  if(fread(meta, 1, delta->meta_size + delta->state_size, fp) != delta->meta_size + delta->state_size) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Backup file is corrupted or truncated");
+    rydb_mem.free(meta);
+    return false;
+  }
+  backup_filename(path, name, "data", filepath, sizeof(filepath));
+  ok = restore_drop_derived_files(db, path, name) && restore_pages(db, fp, delta, filepath);
+  if(ok) {
+    backup_filename(path, name, "meta", filepath, sizeof(filepath));
+    ok = restore_file(db, filepath, meta, delta->meta_size);
+  }
+  if(ok) {
+    backup_filename(path, name, "state", filepath, sizeof(filepath));
+    ok = restore_file(db, filepath, state, delta->state_size);
+  }
+  rydb_mem.free(meta);
+  //the base only moves up to the delta's epoch once all of it is in, so a restore that failed partway can be rerun
+  if(ok) {
+    base->epoch = delta->epoch;
+    if(pwrite(pages_fd, base, sizeof(*base), 0) != sizeof(*base) || fsync(pages_fd) == -1) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to write backup epoch");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool rydb_backup_restore(rydb_t *db, const char *path, const char *name, const char *delta_path) {
+  rydb_backup_delta_header_t  delta;
+  rydb_backup_pages_header_t  base;
+  char                        pages_path[2048];
+  FILE                       *fp;
+  int                         pages_fd;
+  bool                        ok;
+  if(!rydb_ensure_closed(db, "and cannot be restored into")) {
+    return false;
+  }
+  if((fp = fopen(delta_path, "r")) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_FILE_NOT_FOUND, "Failed to open backup file %.900s", delta_path);
+    return false;
+  }
+  if(fread(&delta, sizeof(delta), 1, fp) != 1 || strncmp(delta.magic, RYDB_BACKUP_DELTA_MAGIC, sizeof(delta.magic)) != 0) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "%.900s is not a backup file", delta_path);
+    fclose(fp);
+    return false;
+  }
+  backup_filename(path, name, "pages", pages_path, sizeof(pages_path));
+  if((pages_fd = open(pages_path, O_RDWR)) == -1 || pread(pages_fd, &base, sizeof(base), 0) != sizeof(base)) {
+    rydb_set_error(db, RYDB_ERROR_BACKUP_MISMATCH, "Database to restore into doesn't track backup pages");
+    if(pages_fd != -1) close(pages_fd);
+    fclose(fp);
+    return false;
+  }
+  if(base.page_size != delta.page_size) {
+    rydb_set_error(db, RYDB_ERROR_BACKUP_MISMATCH, "Backup page size %"PRIu32" doesn't match the database's %"PRIu32, delta.page_size, base.page_size);
+    ok = false;
+  }
+  else if(delta.since_epoch > base.epoch + 1 || delta.epoch <= base.epoch) {
+    rydb_set_error(db, RYDB_ERROR_BACKUP_MISMATCH, "Backup has epochs %"PRIu32" to %"PRIu32", but the database is at epoch %"PRIu32, delta.since_epoch, delta.epoch, base.epoch);
+    ok = false;
+  }
+  else {
+    ok = restore_delta(db, fp, &delta, path, name, pages_fd, &base);
+  }
+  close(pages_fd);
+  fclose(fp);
+  return ok;
+}
@@ -0,0 +1,45 @@
+#ifndef _RYDB_BACKUP_H
+#define _RYDB_BACKUP_H
+#include "rydb.h"
+
+/*
+ * the pages file is this header followed by a uint32_t for every page_size chunk of the data file: the epoch
+ * it was last changed in. pages that have never been stamped are 0.
+ */
+typedef struct {
+  uint32_t        epoch; //pages changed right now get this one
+  uint32_t        page_size;
+} rydb_backup_pages_header_t;
+
+#define RYDB_BACKUP_PAGES_START_OFFSET ry_align(sizeof(rydb_backup_pages_header_t), 8)
+
+#define RYDB_BACKUP_DELTA_MAGIC "rydb delta"
+
+/*
+ * a delta file is this header, then the meta file, then the state file, then page_count pages, each one its
+ * page number followed by its bytes. only the data file's last page can be shorter than page_size.
+ */
+typedef struct {
+  char            magic[16];
+  uint32_t        since_epoch;
+  uint32_t        epoch; //every change up to the end of this epoch is in here
+  uint32_t        page_size;
+  uint32_t        page_count;
+  uint64_t        data_size;
+  uint32_t        meta_size;
+  uint32_t        state_size;
+} rydb_backup_delta_header_t;
+
+bool rydb_backup_pages_open(rydb_t *db);
+bool rydb_backup_pages_activate(rydb_t *db);
+
+bool rydb_backup_pages_reserve(rydb_t *db, rydb_rownum_t rownum);
+void rydb_backup_mark_rows(rydb_t *db, rydb_rownum_t rownum, rydb_rownum_t count);
+void rydb_backup_epoch_next(rydb_t *db);
+bool rydb_backup_page_changed(rydb_t *db, size_t page, uint32_t since_epoch);
+
+//snapshots taken a slice at a time by rydb_maintenance()
+bool rydb_snapshot_step(rydb_t *db, uint64_t deadline_usec);
+void rydb_snapshot_abort(rydb_t *db);
+
+#endif //_RYDB_BACKUP_H
@@ -0,0 +1,152 @@
+#include "rydb_internal.h"
+#include "rydb_changes.h"
+#include <string.h>
+
+/*
+ * change feed: a fixed-size ring of (lsn, rownum, op, byte range) records for every change the command log
+ * applies. the writer fills them in as a transaction runs and publishes them all at once when it's done, readers
+ * in other processes follow along by lsn. when a reader falls more than a ring's worth behind, it's told so and
+ * skipped ahead, so it knows to resync from the data.
+ */
+
+static inline rydb_changes_header_t *changes_header(const rydb_t *db) {
+  return (void *)db->changes.file.file.start;
+}
+
+static inline rydb_changes_record_t *changes_record(const rydb_t *db, uint64_t lsn) {
+  return &((rydb_changes_record_t *)(void *)db->changes.file.data.start)[(lsn - 1) % db->config.change_feed_capacity];
+}
+
+static inline uint64_t changes_oldest_lsn(const rydb_t *db, uint64_t next_lsn) {
+  return next_lsn > db->config.change_feed_capacity ? next_lsn - db->config.change_feed_capacity : 1;
+}
+
+bool rydb_changes_open(rydb_t *db) {
+  rydb_file_t *f = &db->changes.file;
+  if(!rydb_file_open(db, "changes", f)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, f, RYDB_CHANGES_START_OFFSET + (size_t )db->config.change_feed_capacity * sizeof(rydb_changes_record_t), NULL)) {
+    return false;
+  }
+  f->data.start = &f->file.start[RYDB_CHANGES_START_OFFSET];
+  f->data.end = f->file.end;
+  return true;
+}
+
+//a brand new feed starts at lsn 1. one written with a different capacity loses its records, but keeps counting
+bool rydb_changes_activate(rydb_t *db) {
+  rydb_changes_header_t *header = changes_header(db);
+  AO_t                   next_lsn = AO_load(&header->next_lsn);
+  if(next_lsn > 0 && header->capacity == db->config.change_feed_capacity) {
+    return true;
+  }
+  memset(db->changes.file.data.start, '\00', db->changes.file.data.end - db->changes.file.data.start);
+  header->capacity = db->config.change_feed_capacity;
+  AO_nop_full();
+  AO_store(&header->next_lsn, next_lsn > 0 ? next_lsn : 1);
+  return true;
+}
+
+void rydb_changes_record(rydb_t *db, rydb_rownum_t rownum, rydb_change_op_t op, uint16_t start, uint16_t len) {
+  rydb_changes_record_t *rec;
+  AO_t                   lsn;
+  if(db->config.change_feed_capacity == 0 || !db->privileges.write) {
+    return;
+  }
+  lsn = AO_load(&changes_header(db)->next_lsn) + db->changes.pending;
+  rec = changes_record(db, lsn);
+  AO_store(&rec->lsn, 0);
+  AO_nop_full();
+  rec->rownum = rownum;
+  rec->op = op;
+  rec->start = start;
+  rec->len = len;
+  AO_nop_full();
+  AO_store(&rec->lsn, lsn);
+  db->changes.pending++;
+}
+
+void rydb_changes_publish(rydb_t *db) {
+  rydb_changes_header_t *header;
+  if(db->changes.pending == 0) {
+    return;
+  }
+  header = changes_header(db);
+  AO_nop_full();
+  AO_store(&header->next_lsn, AO_load(&header->next_lsn) + db->changes.pending);
+  db->changes.pending = 0;
+}
+
+static bool rydb_changes_ensure_enabled(rydb_t *db) {
+  if(!rydb_ensure_open(db)) {
+    return false;
+  }
+  if(db->config.change_feed_capacity == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Change feed is not enabled for this database");
+    return false;
+  }
+  return true;
+}
+
+bool rydb_changes(rydb_t *db, uint64_t lsn, rydb_changes_cursor_t *cur) {
+  if(!rydb_changes_ensure_enabled(db)) {
+    return false;
+  }
+  *cur = (rydb_changes_cursor_t ){
+    .db = db,
+    .lsn = lsn > 0 ? lsn : changes_oldest_lsn(db, AO_load(&changes_header(db)->next_lsn))
+  };
+  return true;
+}
+
+bool rydb_changes_next(rydb_changes_cursor_t *cur, rydb_change_t *change) {
+  rydb_t                *db = cur->db;
+  rydb_changes_record_t *rec;
+  uint64_t               next_lsn, oldest_lsn;
+  AO_t                   lsn;
+  if(!rydb_changes_ensure_enabled(db)) {
+    return false;
+  }
+  next_lsn = AO_load(&changes_header(db)->next_lsn);
+  if(cur->lsn >= next_lsn) {
+    //caught up
+    return false;
+  }
+  if(cur->lsn >= changes_oldest_lsn(db, next_lsn)) {
+    rec = changes_record(db, cur->lsn);
+    lsn = AO_load(&rec->lsn);
+    AO_nop_full();
+    *change = (rydb_change_t ){
+      .lsn = cur->lsn,
+      .rownum = rec->rownum,
+      .op = (rydb_change_op_t )rec->op,
+      .start = rec->start,
+      .len = rec->len
+    };
+    AO_nop_full();
+    if(lsn == cur->lsn && AO_load(&rec->lsn) == lsn) {
+      cur->lsn++;
+      return true;
+    }
+    //overwritten while we were reading it
+    next_lsn = AO_load(&changes_header(db)->next_lsn);
+  }
+  oldest_lsn = changes_oldest_lsn(db, next_lsn);
+  if(oldest_lsn <= cur->lsn) {
+    //the writer is lapping us but hasn't published yet. at least this one's gone
+    oldest_lsn = cur->lsn + 1;
+  }
+  rydb_set_error(db, RYDB_ERROR_CHANGES_LOST, "Changes %"PRIu64" to %"PRIu64" are no longer in the feed", cur->lsn, oldest_lsn - 1);
+  cur->lsn = oldest_lsn;
+  return false;
+}
+
+uint64_t rydb_changes_last_lsn(rydb_t *db) {
+  uint64_t next_lsn;
+  if(!rydb_changes_ensure_enabled(db)) {
+    return 0;
+  }
+  next_lsn = AO_load(&changes_header(db)->next_lsn);
+  return next_lsn > 0 ? next_lsn - 1 : 0;
+}
@@ -0,0 +1,31 @@
+#ifndef _RYDB_CHANGES_H
+#define _RYDB_CHANGES_H
+#include "rydb.h"
+
+/*
+ * the change feed file is this header followed by a ring of capacity records, the one for lsn at
+ * slot (lsn - 1) % capacity. a record's lsn is zeroed while it's being rewritten, so readers can tell when it
+ * changed under them. next_lsn is only moved once all of a transaction's records are in.
+ */
+typedef struct {
+  AO_t            next_lsn; //every change before this one has been published
+  uint32_t        capacity;
+} rydb_changes_header_t;
+
+typedef struct {
+  AO_t            lsn;
+  rydb_rownum_t   rownum;
+  uint8_t         op;
+  uint16_t        start;
+  uint16_t        len;
+} rydb_changes_record_t;
+
+#define RYDB_CHANGES_START_OFFSET ry_align(sizeof(rydb_changes_header_t), 8)
+
+bool rydb_changes_open(rydb_t *db);
+bool rydb_changes_activate(rydb_t *db);
+
+void rydb_changes_record(rydb_t *db, rydb_rownum_t rownum, rydb_change_op_t op, uint16_t start, uint16_t len);
+void rydb_changes_publish(rydb_t *db);
+
+#endif //_RYDB_CHANGES_H
@@ -0,0 +1,162 @@
+#include "rydb_internal.h"
+#include "rydb_column.h"
+#include <string.h>
+
+/*
+ * column groups: a range of the row mirrored into a file of its own. rows sit back to back in the data file,
+ * so reading a few bytes out of every wide row still pages in all of them. a group's entries are only as wide
+ * as the group, so a scan over it touches just the pages it needs. the copies are written by the same
+ * transaction commands that change the data, so crash recovery keeps them in sync too.
+ */
+
+static inline rydb_column_group_header_t *column_header(const rydb_column_group_t *grp) {
+  return (void *)grp->file.file.start;
+}
+
+static inline size_t column_entry_size(const rydb_config_column_group_t *cf) {
+  return 1 + cf->len; //type byte, then the data
+}
+
+static inline char *column_entry(const rydb_column_group_t *grp, rydb_rownum_t rownum) {
+  return &grp->file.data.start[(size_t )(rownum - 1) * column_entry_size(grp->config)];
+}
+
+//readers don't follow the file as it grows, so anything past what's mapped just isn't there yet
+static inline bool column_entry_in_range(const rydb_column_group_t *grp, rydb_rownum_t rownum) {
+  return rownum > 0 && column_entry(grp, rownum) + column_entry_size(grp->config) <= grp->file.file.end;
+}
+
+static inline rydb_rownum_t data_rows(const rydb_t *db) {
+  return db->data_next_rownum > 0 ? db->data_next_rownum - 1 : 0;
+}
+
+static void column_entry_write(const rydb_column_group_t *grp, char *entry, const rydb_stored_row_t *row) {
+  if(row->type == RYDB_ROW_DATA) {
+    memcpy(&entry[1], &row->data[grp->config->start], grp->config->len);
+    entry[0] = RYDB_ROW_DATA;
+  }
+  else {
+    entry[0] = RYDB_ROW_EMPTY;
+  }
+}
+
+bool rydb_column_group_open(rydb_t *db, rydb_column_group_t *grp) {
+  char path[256];
+  snprintf(path, sizeof(path)-1, "column.%s", grp->config->name);
+  if(!rydb_file_open(db, path, &grp->file)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, &grp->file, RYDB_COLUMN_GROUP_START_OFFSET, NULL)) {
+    return false;
+  }
+  grp->file.data.start = &grp->file.file.start[RYDB_COLUMN_GROUP_START_OFFSET];
+  grp->file.data.end = grp->file.file.end;
+  return true;
+}
+
+bool rydb_column_group_build(rydb_t *db, rydb_column_group_t *grp) {
+  rydb_column_group_header_t *header;
+  rydb_rownum_t               rows = data_rows(db);
+  //start from an empty file so that nothing stale is left past the last row
+  if(!rydb_file_shrink_to_size(db, &grp->file, RYDB_COLUMN_GROUP_START_OFFSET)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, &grp->file, RYDB_COLUMN_GROUP_START_OFFSET + (size_t )rows * column_entry_size(grp->config), NULL)) {
+    return false;
+  }
+  for(rydb_rownum_t rownum = 1; rownum <= rows; rownum++) {
+    column_entry_write(grp, column_entry(grp, rownum), rydb_rownum_to_row(db, rownum));
+  }
+  header = column_header(grp);
+  header->start = grp->config->start;
+  header->len = grp->config->len;
+  header->rows = rows;
+  return true;
+}
+
+bool rydb_column_group_activate(rydb_t *db, rydb_column_group_t *grp) {
+  rydb_column_group_header_t *header = column_header(grp);
+  rydb_rownum_t               rows = data_rows(db);
+  if(header->start != grp->config->start || header->len != grp->config->len || header->rows < rows || (rows > 0 && !column_entry_in_range(grp, rows))) {
+    return rydb_column_group_build(db, grp);
+  }
+  return true;
+}
+
+//make room for rownum's entries before the row is written, so that writing them can't fail halfway through a command
+bool rydb_column_groups_reserve(rydb_t *db, rydb_rownum_t rownum) {
+  for(int i = 0; i < db->config.column_group_count; i++) {
+    rydb_column_group_t *grp = &db->column_group[i];
+    size_t               cur_sz = grp->file.file.end - grp->file.file.start;
+    size_t               min_sz = RYDB_COLUMN_GROUP_START_OFFSET + (size_t )rownum * column_entry_size(grp->config);
+    if(min_sz <= cur_sz) {
+      continue;
+    }
+    //grow by at least half again, rather than an ftruncate() for every new row
+    if(min_sz < cur_sz + cur_sz / 2) {
+      min_sz = cur_sz + cur_sz / 2;
+    }
+    if(!rydb_file_ensure_size(db, &grp->file, min_sz, NULL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//copy the row into every group that overlaps [start, end)
+void rydb_column_groups_write_row(rydb_t *db, const rydb_stored_row_t *row, off_t start, off_t end) {
+  rydb_rownum_t rownum = rydb_row_to_rownum(db, row);
+  for(int i = 0; i < db->config.column_group_count; i++) {
+    rydb_column_group_t        *grp = &db->column_group[i];
+    rydb_config_column_group_t *cf = grp->config;
+    rydb_column_group_header_t *header;
+    if(start >= cf->start + cf->len || end <= cf->start || !column_entry_in_range(grp, rownum)) {
+      continue;
+    }
+    column_entry_write(grp, column_entry(grp, rownum), row);
+    header = column_header(grp);
+    if(header->rows < rownum) {
+      header->rows = rownum;
+    }
+  }
+}
+
+bool rydb_column_group_entry_get(const rydb_t *db, const rydb_column_group_t *grp, rydb_rownum_t rownum, rydb_row_t *row) {
+  const char *entry;
+  if(rownum > data_rows(db) || rownum > column_header(grp)->rows || !column_entry_in_range(grp, rownum)) {
+    return false;
+  }
+  entry = column_entry(grp, rownum);
+  if(row) {
+    row->num = rownum;
+    row->type = (rydb_row_type_t )entry[0];
+    row->data = &entry[1];
+    row->start = grp->config->start;
+    row->len = grp->config->len;
+  }
+  return true;
+}
+
+bool rydb_column_group_cursor_next(rydb_cursor_t *cur, rydb_row_t *row) {
+  const rydb_column_group_t *grp = cur->state.column.group;
+  rydb_rownum_t              rownum = cur->state.column.rownum;
+  while(rydb_column_group_entry_get(cur->db, grp, rownum, row)) {
+    rownum++;
+    if(row->type == RYDB_ROW_DATA) {
+      cur->state.column.rownum = rownum;
+      cur->step++;
+      return true;
+    }
+  }
+  cur->state.column.rownum = rownum;
+  cur->finished = 1;
+  return false;
+}
+
+size_t rydb_column_group_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max) {
+  size_t n = 0;
+  while(n < max && !cur->finished && rydb_column_group_cursor_next(cur, &rows[n])) {
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,29 @@
+#ifndef _RYDB_COLUMN_H
+#define _RYDB_COLUMN_H
+#include "rydb.h"
+
+/*
+ * a column group file is this header followed by one entry per row, addressed by rownum: the row's type byte,
+ * then a copy of the group's bytes. the data file stays the source of truth, the group file is rebuilt from it
+ * whenever the header doesn't match the config or doesn't cover all the rows.
+ */
+typedef struct {
+  uint16_t        start;
+  uint16_t        len;
+  rydb_rownum_t   rows; //entries that have been written so far
+} rydb_column_group_header_t;
+
+#define RYDB_COLUMN_GROUP_START_OFFSET ry_align(sizeof(rydb_column_group_header_t), 8)
+
+bool rydb_column_group_open(rydb_t *db, rydb_column_group_t *grp);
+bool rydb_column_group_activate(rydb_t *db, rydb_column_group_t *grp);
+bool rydb_column_group_build(rydb_t *db, rydb_column_group_t *grp);
+
+bool rydb_column_groups_reserve(rydb_t *db, rydb_rownum_t rownum);
+void rydb_column_groups_write_row(rydb_t *db, const rydb_stored_row_t *row, off_t start, off_t end);
+
+bool rydb_column_group_entry_get(const rydb_t *db, const rydb_column_group_t *grp, rydb_rownum_t rownum, rydb_row_t *row);
+bool rydb_column_group_cursor_next(rydb_cursor_t *cur, rydb_row_t *row);
+size_t rydb_column_group_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max);
+
+#endif //_RYDB_COLUMN_H
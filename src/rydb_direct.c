@@ -0,0 +1,305 @@
+#include "rydb_internal.h"
+#include "rydb_direct.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * direct-addressed index: the key is a 4- or 8-byte unsigned integer, and it's used as-is to find its rownum
+ * in a two-level radix array. Dense keys fill up their leaf pages, sparse ones only cost a page per
+ * RYDB_DIRECT_PAGE_SLOTS-key range that's actually used. Lookups are a directory load and a page load. No hashing,
+ * no probing, and no value compares.
+ */
+
+static inline rydb_direct_header_t *direct_header(const rydb_index_t *idx) {
+  return (void *)idx->index.file.start;
+}
+
+static inline rydb_rownum_t *direct_directory(const rydb_index_t *idx) {
+  return (rydb_rownum_t *)idx->index.data.start;
+}
+
+static inline rydb_rownum_t *direct_page(const rydb_index_t *idx, rydb_rownum_t pagenum) {
+  return (rydb_rownum_t *)&idx->map.data.start[(size_t )(pagenum - 1) * RYDB_DIRECT_PAGE_SIZE];
+}
+
+static inline uint64_t direct_key(const rydb_config_index_t *cf, const char *val) {
+  const uint8_t *d = (const uint8_t *)val;
+  const bool     big_endian = cf->type_config.direct.big_endian;
+  uint64_t       key = 0;
+  for(size_t i = 0; i < cf->len; i++) {
+    key = (key << 8) | d[big_endian ? i : cf->len - 1 - i];
+  }
+  return key;
+}
+
+void rydb_direct_lock(const rydb_index_t *idx) {
+  assert(AO_compare_and_swap(&direct_header(idx)->writelock, 0, 1));
+}
+void rydb_direct_unlock(const rydb_index_t *idx) {
+  assert(AO_compare_and_swap(&direct_header(idx)->writelock, 1, 0));
+}
+
+//the key's slot, or NULL if there's no page for it yet
+static rydb_rownum_t *direct_slot(const rydb_index_t *idx, uint64_t key) {
+  const rydb_direct_header_t *header = direct_header(idx);
+  const uint64_t              dirnum = key >> RYDB_DIRECT_PAGE_BITS;
+  rydb_rownum_t              *dirent, pagenum, *page;
+  if(key > RYDB_DIRECT_KEY_MAX || dirnum >= header->directory_len) {
+    return NULL;
+  }
+  dirent = &direct_directory(idx)[dirnum];
+  //readers don't follow the files as they grow, so anything past what's mapped just isn't there yet
+  if((char *)&dirent[1] > idx->index.mmap.end || (pagenum = *dirent) == 0) {
+    return NULL;
+  }
+  page = direct_page(idx, pagenum);
+  if((char *)page + RYDB_DIRECT_PAGE_SIZE > idx->map.mmap.end) {
+    return NULL;
+  }
+  return &page[key & (RYDB_DIRECT_PAGE_SLOTS - 1)];
+}
+
+static rydb_rownum_t *direct_slot_create(rydb_t *db, rydb_index_t *idx, uint64_t key) {
+  rydb_direct_header_t *header = direct_header(idx);
+  const uint64_t        dirnum = key >> RYDB_DIRECT_PAGE_BITS;
+  rydb_rownum_t        *dirent;
+  if(dirnum >= header->directory_len) {
+    if(!rydb_file_ensure_size(db, &idx->index, RYDB_INDEX_DIRECT_START_OFFSET + (dirnum + 1) * sizeof(rydb_rownum_t), NULL)) {
+      return NULL;
+    }
+    header = direct_header(idx);
+    memset(&direct_directory(idx)[header->directory_len], '\00', (dirnum + 1 - header->directory_len) * sizeof(rydb_rownum_t));
+    header->directory_len = dirnum + 1;
+  }
+  dirent = &direct_directory(idx)[dirnum];
+  if(*dirent == 0) {
+    if(!rydb_file_ensure_size(db, &idx->map, (size_t )(header->pages + 1) * RYDB_DIRECT_PAGE_SIZE, NULL)) {
+      return NULL;
+    }
+    header->pages++;
+    memset(direct_page(idx, header->pages), '\00', RYDB_DIRECT_PAGE_SIZE);
+    *dirent = header->pages;
+  }
+  return &direct_page(idx, *dirent)[key & (RYDB_DIRECT_PAGE_SLOTS - 1)];
+}
+
+bool rydb_meta_load_index_direct(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp) {
+  uint16_t                   big_endian;
+  rydb_config_index_direct_t direct_config;
+  int rc = fscanf(fp, "    big_endian: %"SCNu16"\n", &big_endian);
+  if(rc < 1 || big_endian > 1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Direct index \"%s\" specification is corrupted or invalid", idx_cf->name);
+    return false;
+  }
+  direct_config.big_endian = big_endian;
+  if(!rydb_config_index_direct_set_config(db, idx_cf, &direct_config)) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Direct index \"%s\" specification is corrupted or invalid", idx_cf->name);
+    return false;
+  }
+  return true;
+}
+
+bool rydb_meta_save_index_direct(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp) {
+  int rc = fprintf(fp, "    big_endian: %"PRIu16"\n", (uint16_t )idx_cf->type_config.direct.big_endian);
+  if(rc <= 0) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "failed writing direct index \"%s\" config ", idx_cf->name);
+    return false;
+  }
+  return true;
+}
+
+bool rydb_config_index_direct_set_config(rydb_t *db, rydb_config_index_t *cf, rydb_config_index_direct_t *advanced_config) {
+  if(rydb_index_composite(cf)) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Direct index \"%s\" can't have a composite key", cf->name);
+    return false;
+  }
+  if(cf->len != sizeof(uint32_t) && cf->len != sizeof(uint64_t)) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Direct index \"%s\" must have a 4- or 8-byte integer key, not %"PRIu16" bytes", cf->name, cf->len);
+    return false;
+  }
+  if(!(cf->flags & RYDB_INDEX_UNIQUE)) {
+    //each key has room for just the one rownum
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Direct index \"%s\" must be unique", cf->name);
+    return false;
+  }
+  if(!advanced_config) {
+    cf->type_config.direct.big_endian = 0;
+  }
+  else {
+    cf->type_config.direct = *advanced_config;
+  }
+  return true;
+}
+
+bool rydb_index_direct_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  const rydb_config_index_t *cf = idx->config;
+  const uint64_t             key = direct_key(cf, &row->data[cf->start]);
+  const rydb_rownum_t        rownum = rydb_row_to_rownum(db, row);
+  rydb_rownum_t             *slot;
+  if(!rydb_index_direct_key_valid(db, idx, &row->data[cf->start], 1)) {
+    return false;
+  }
+  if((slot = direct_slot_create(db, idx, key)) == NULL) {
+    return false;
+  }
+  if(*slot == rownum) {
+    return true;
+  }
+  if(*slot != 0) {
+    rydb_set_error(db, RYDB_ERROR_NOT_UNIQUE, "Data for index %s must be unique", cf->name);
+    return false;
+  }
+  *slot = rownum;
+  direct_header(idx)->count++;
+  return true;
+}
+
+bool rydb_index_direct_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  const rydb_config_index_t *cf = idx->config;
+  const rydb_rownum_t        rownum = rydb_row_to_rownum(db, row);
+  rydb_rownum_t             *slot = direct_slot(idx, direct_key(cf, &row->data[cf->start]));
+  if(slot == NULL || *slot != rownum) {
+    return true;
+  }
+  //emptied pages stay put until the index is rebuilt
+  *slot = 0;
+  direct_header(idx)->count--;
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    if(cur->state.index.typedata.direct.rownum == rownum) {
+      cur->finished = 1;
+    }
+  }
+  return true;
+}
+
+bool rydb_index_direct_add_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  rydb_direct_lock(idx);
+  bool ret = rydb_index_direct_add_row_locked(db, idx, row);
+  rydb_direct_unlock(idx);
+  return ret;
+}
+
+bool rydb_index_direct_remove_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  rydb_direct_lock(idx);
+  bool ret = rydb_index_direct_remove_row_locked(db, idx, row);
+  rydb_direct_unlock(idx);
+  return ret;
+}
+
+bool rydb_index_direct_build(rydb_t *db, rydb_index_t *idx) {
+  const uint16_t             row_sz = db->stored_row_size;
+  const rydb_stored_row_t   *endrow = rydb_rownum_to_row(db, db->data_next_rownum);
+  rydb_direct_header_t      *header = direct_header(idx);
+  bool                       ok = true;
+
+  rydb_stats_count(db, index_builds);
+  rydb_direct_lock(idx);
+  header->count = 0;
+  header->pages = 0;
+  header->directory_len = 0;
+  if(!rydb_file_shrink_to_size(db, &idx->index, RYDB_INDEX_DIRECT_START_OFFSET) || !rydb_file_shrink_to_size(db, &idx->map, 0)) {
+    rydb_direct_unlock(idx);
+    return false;
+  }
+  for(rydb_stored_row_t *row = rydb_rownum_to_row(db, 1); ok && row < endrow; row = rydb_row_next(row, row_sz, 1)) {
+    if(row->type == RYDB_ROW_DATA && rydb_index_covers_row(idx->config, row->data)) {
+      ok = rydb_index_direct_add_row_locked(db, idx, row);
+    }
+  }
+  if(ok) {
+    direct_header(idx)->active = 1;
+  }
+  rydb_direct_unlock(idx);
+  return ok;
+}
+
+bool rydb_index_direct_activate(rydb_t *db, rydb_index_t *idx) {
+  if(direct_header(idx)->active) {
+    return true;
+  }
+  if(db->data_next_rownum > 1) {
+    return rydb_index_direct_build(db, idx);
+  }
+  direct_header(idx)->active = 1;
+  return true;
+}
+
+bool rydb_index_direct_open(rydb_t *db, rydb_index_t *idx) {
+  assert(idx->config->type == RYDB_INDEX_DIRECT);
+  if(!rydb_file_open_index(db, idx)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, &idx->index, RYDB_INDEX_DIRECT_START_OFFSET, NULL)) {
+    rydb_file_close_index(db, idx);
+    return false;
+  }
+  idx->index.data.start = idx->index.file.start + RYDB_INDEX_DIRECT_START_OFFSET;
+  if(!rydb_file_open_index_map(db, idx)) {
+    rydb_file_close_index(db, idx);
+    return false;
+  }
+  return true;
+}
+
+bool rydb_index_direct_key_valid(rydb_t *db, const rydb_index_t *idx, const char *val, uint_fast8_t set_error) {
+  uint64_t key = direct_key(idx->config, val);
+  if(key > RYDB_DIRECT_KEY_MAX) {
+    if(set_error) {
+      rydb_set_error(db, RYDB_ERROR_DATA_TOO_LARGE, "Key %"PRIu64" is too large for direct index %s", key, idx->config->name);
+    }
+    return false;
+  }
+  return true;
+}
+
+bool rydb_index_direct_contains(const rydb_t *db, const rydb_index_t *idx, const char *val) {
+  (void )db;
+  const rydb_rownum_t *slot = direct_slot(idx, direct_key(idx->config, val));
+  return slot != NULL && *slot != 0;
+}
+
+//assumes val is at least as long as the indexed data
+bool rydb_index_direct_find_row(rydb_t *db, rydb_index_t *idx, const char *val, rydb_row_t *row) {
+  const rydb_rownum_t *slot = direct_slot(idx, direct_key(idx->config, val));
+  rydb_rownum_t        rownum;
+  rydb_stored_row_t   *datarow;
+  if(slot == NULL || (rownum = *slot) == 0) {
+    return false;
+  }
+  if((datarow = rydb_rownum_to_row(db, rownum)) == NULL) {
+    return false;
+  }
+  if(row) {
+    rydb_storedrow_to_row(db, datarow, row);
+  }
+  return true;
+}
+
+//there's at most one row per key, so a cursor just hangs on to its rownum until it's asked for it
+bool rydb_direct_cursor_init(rydb_cursor_t *cur) {
+  rydb_t                    *db = cur->db;
+  const rydb_config_index_t *cf = cur->state.index.config;
+  const char                *val = rydb_index_search_value(db->index_scratch_buffer, cf, cur->data, cur->len);
+  const rydb_rownum_t       *slot = direct_slot(cur->state.index.idx, direct_key(cf, val));
+  cur->state.index.typedata.direct.rownum = slot ? *slot : 0;
+  if(cur->state.index.typedata.direct.rownum == 0) {
+    cur->finished = 1;
+  }
+  return true;
+}
+
+rydb_rownum_t rydb_direct_cursor_next(rydb_cursor_t *cur) {
+  cur->step++;
+  cur->finished = 1;
+  return cur->state.index.typedata.direct.rownum;
+}
+
+size_t rydb_direct_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max) {
+  if(cur->finished || max == 0) {
+    return 0;
+  }
+  rydb_storedrow_to_row(cur->db, rydb_rownum_to_row(cur->db, rydb_direct_cursor_next(cur)), &rows[0]);
+  return 1;
+}
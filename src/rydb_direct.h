@@ -0,0 +1,51 @@
+#ifndef _RYDB_DIRECT_H
+#define _RYDB_DIRECT_H
+#include "rydb.h"
+
+//each leaf page maps 2^RYDB_DIRECT_PAGE_BITS consecutive keys to their rownums
+#define RYDB_DIRECT_PAGE_BITS 12
+#define RYDB_DIRECT_PAGE_SLOTS ((uint64_t )1 << RYDB_DIRECT_PAGE_BITS)
+#define RYDB_DIRECT_PAGE_SIZE (RYDB_DIRECT_PAGE_SLOTS * sizeof(rydb_rownum_t))
+#define RYDB_DIRECT_KEY_MAX ((uint64_t )UINT32_MAX)
+
+/*
+ * the index file is this header followed by the directory: one entry per leaf page's worth of keys,
+ * holding the page's number in the .map file (counting from 1), or 0 if none of those keys have been seen yet.
+ * the .map file is nothing but leaf pages
+ */
+typedef struct {
+  AO_t            writelock;
+  uint8_t         active;
+  rydb_rownum_t   count; //keys in the index
+  rydb_rownum_t   pages; //leaf pages carved out of the .map file so far
+  rydb_rownum_t   directory_len; //directory entries in use
+} rydb_direct_header_t;
+
+bool rydb_index_direct_open(rydb_t *db, rydb_index_t *idx);
+bool rydb_index_direct_activate(rydb_t *db, rydb_index_t *idx);
+bool rydb_index_direct_build(rydb_t *db, rydb_index_t *idx);
+
+bool rydb_meta_load_index_direct(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp);
+bool rydb_meta_save_index_direct(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp);
+
+bool rydb_config_index_direct_set_config(rydb_t *db, rydb_config_index_t *idx_cf, rydb_config_index_direct_t *advanced_config);
+
+bool rydb_index_direct_add_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row);
+bool rydb_index_direct_remove_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row);
+bool rydb_index_direct_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row);
+bool rydb_index_direct_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row);
+
+void rydb_direct_lock(const rydb_index_t *idx);
+void rydb_direct_unlock(const rydb_index_t *idx);
+
+bool rydb_index_direct_key_valid(rydb_t *db, const rydb_index_t *idx, const char *val, uint_fast8_t set_error);
+bool rydb_index_direct_contains(const rydb_t *db, const rydb_index_t *idx, const char *val);
+bool rydb_index_direct_find_row(rydb_t *db, rydb_index_t *idx, const char *val, rydb_row_t *row);
+
+bool rydb_direct_cursor_init(rydb_cursor_t *cur);
+rydb_rownum_t rydb_direct_cursor_next(rydb_cursor_t *cur);
+size_t rydb_direct_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max);
+
+#define RYDB_INDEX_DIRECT_START_OFFSET ry_align(sizeof(rydb_direct_header_t), 8)
+
+#endif //_RYDB_DIRECT_H
@@ -94,7 +94,7 @@ static const crc_t crc_table[256] = {
  * \param data_len Number of bytes in the \a data buffer.
  * \return         The updated crc value.
  *****************************************************************************/
-static crc_t crc_update(crc_t crc, const void *data, size_t data_len)
+static inline crc_t crc_update(crc_t crc, const void *data, size_t data_len)
 {
     const unsigned char *d = (const unsigned char *)data;
     unsigned int tbl_idx;
@@ -109,13 +109,26 @@ static crc_t crc_update(crc_t crc, const void *data, size_t data_len)
 }
 
 
-uint64_t crc32(const uint8_t *data, size_t data_len) {
+static inline uint64_t crc32_inline(const uint8_t *data, size_t data_len) {
   crc_t crc = crc_init();
   crc = crc_update(crc, data, data_len);
   crc = crc_finalize(crc);
   return crc;
 }
 
+uint64_t crc32(const uint8_t *data, size_t data_len) {
+  return crc32_inline(data, data_len);
+}
+
+//crc32 of a composite key's segments, as if they were one contiguous value
+static inline uint64_t crc32_segments(const rydb_config_index_t *cf, const char *rowdata) {
+  crc_t crc = crc_init();
+  for(int i = 0; i < cf->segment_count; i++) {
+    crc = crc_update(crc, &rowdata[cf->segment[i].start], cf->segment[i].len);
+  }
+  return crc_finalize(crc);
+}
+
 /*
    SipHash reference C implementation
    Copyright (c) 2012-2016 Jean-Philippe Aumasson
@@ -195,7 +208,7 @@ uint64_t crc32(const uint8_t *data, size_t data_len) {
     v2 = ROTL(v2, 32);                                                     \
   } while (0)
     
-uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k) {
+static inline uint64_t siphash_inline(const uint8_t *in, const size_t inlen, const uint8_t *k) {
 #ifndef UNALIGNED_LE_CPU
   uint64_t hash;
   uint8_t *out = (uint8_t*) &hash;
@@ -258,6 +271,91 @@ uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k) {
 #endif
 }
 
+uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k) {
+  return siphash_inline(in, inlen, k);
+}
+
+//siphash of a composite key's segments, as if they were one contiguous value.
+//words that straddle two segments are put together in m
+static inline uint64_t siphash_segments(const rydb_config_index_t *cf, const char *rowdata, const uint8_t *k) {
+#ifndef UNALIGNED_LE_CPU
+  uint64_t hash;
+  uint8_t *out = (uint8_t*) &hash;
+#endif
+  uint64_t v0 = 0x736f6d6570736575ULL;
+  uint64_t v1 = 0x646f72616e646f6dULL;
+  uint64_t v2 = 0x6c7967656e657261ULL;
+  uint64_t v3 = 0x7465646279746573ULL;
+  uint64_t k0 = U8TO64_LE(k);
+  uint64_t k1 = U8TO64_LE(k + 8);
+  uint64_t m = 0, w, b;
+  unsigned mlen = 0;
+  size_t   inlen = 0;
+  v3 ^= k1;
+  v2 ^= k0;
+  v1 ^= k1;
+  v0 ^= k0;
+
+  for(int i = 0; i < cf->segment_count; i++) {
+    const uint8_t *in = (const uint8_t *)&rowdata[cf->segment[i].start];
+    size_t         len = cf->segment[i].len;
+    inlen += len;
+    for(; mlen > 0 && len > 0; len--) {
+      m |= ((uint64_t)*in++) << (8 * mlen);
+      if(++mlen == 8) {
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+        m = 0;
+        mlen = 0;
+      }
+    }
+    for(; len >= 8; len -= 8, in += 8) {
+      w = U8TO64_LE(in);
+      v3 ^= w;
+      SIPROUND;
+      SIPROUND;
+      v0 ^= w;
+    }
+    for(; len > 0; len--) {
+      m |= ((uint64_t)*in++) << (8 * mlen++);
+    }
+  }
+
+  b = (((uint64_t)inlen) << 56) | m;
+  v3 ^= b;
+
+  SIPROUND;
+  SIPROUND;
+
+  v0 ^= b;
+  v2 ^= 0xff;
+
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+
+  b = v0 ^ v1 ^ v2 ^ v3;
+#ifndef UNALIGNED_LE_CPU
+  U64TO8_LE(out, b);
+  return hash;
+#else
+  return b;
+#endif
+}
+
+//options added since the original format come after it, each optional, so older meta files still load
+static bool meta_load_optional(FILE *fp, const char *fmt, uint16_t *val1, uint16_t *val2) {
+  long pos = ftell(fp);
+  if(fscanf(fp, fmt, val1, val2) < (val2 ? 2 : 1)) {
+    fseek(fp, pos, SEEK_SET);
+    return false;
+  }
+  return true;
+}
+
 bool rydb_meta_load_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp) {
   const char *fmt =
     "    hash_function: %32s\n"
@@ -270,14 +368,25 @@ bool rydb_meta_load_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FIL
   char      hash_func_buf[33];
   uint16_t  store_value;
   uint16_t  store_hash;
+  uint16_t  compact_hash = 0;
+  uint16_t  bloom_filter = 0;
+  uint16_t  integer_big_endian = 0;
   uint16_t  collision_resolution;
   uint8_t   rehash_flags;
   double    load_factor_max;
+  uint16_t  cover_start = 0;
+  uint16_t  cover_len = 0;
 
   rydb_config_index_hashtable_t hashtable_config;
   
   int rc = fscanf(fp, fmt, hash_func_buf, &store_value, &store_hash, &collision_resolution, &rehash_flags, &load_factor_max);
-  if(rc < 4 || store_value > 1 || store_hash > 1 || load_factor_max >= 1 || load_factor_max <= 0) {
+  if(rc == 6) {
+    meta_load_optional(fp, "    compact_hash: %"SCNu16"\n", &compact_hash, NULL);
+    meta_load_optional(fp, "    bloom_filter: %"SCNu16"\n", &bloom_filter, NULL);
+    meta_load_optional(fp, "    integer_big_endian: %"SCNu16"\n", &integer_big_endian, NULL);
+    meta_load_optional(fp, "    cover_offset: %"SCNu16"\n    cover_length: %"SCNu16"\n", &cover_start, &cover_len);
+  }
+  if(rc < 6 || store_value > 1 || store_hash > 1 || compact_hash > 1 || bloom_filter > 1 || integer_big_endian > 1 || load_factor_max >= 1 || load_factor_max <= 0) {
     rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Hashtable \"%s\" specification is corrupted or invalid", idx_cf->name);
     return false;
   }
@@ -290,15 +399,23 @@ bool rydb_meta_load_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FIL
   else if(strcmp("SipHash", hash_func_buf) == 0) {
     hashtable_config.hash_function = RYDB_HASH_SIPHASH;
   }
+  else if(strcmp("integer", hash_func_buf) == 0) {
+    hashtable_config.hash_function = RYDB_HASH_INTEGER;
+  }
   else {
     rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Unsupported hash function %s for hashtable \"%s\"", hash_func_buf, idx_cf->name);
     return false;
   }
   hashtable_config.store_value = store_value;
   hashtable_config.store_hash = store_hash;
+  hashtable_config.compact_hash = compact_hash;
+  hashtable_config.bloom_filter = bloom_filter;
+  hashtable_config.integer_big_endian = integer_big_endian;
   hashtable_config.rehash = rehash_flags;
   hashtable_config.collision_resolution = collision_resolution;
   hashtable_config.load_factor_max = load_factor_max;
+  hashtable_config.cover_start = cover_start;
+  hashtable_config.cover_len = cover_len;
   
   if(!rydb_config_index_hashtable_set_config(db, idx_cf, &hashtable_config)) {
     rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Hashtable \"%s\" specification is corrupted or invalid", idx_cf->name);
@@ -314,6 +431,8 @@ char *rydb_hashfunction_to_str(rydb_hash_function_t hashfn) {
       return "nohash";
     case RYDB_HASH_SIPHASH:
       return "SipHash";
+    case RYDB_HASH_INTEGER:
+      return "integer";
     case RYDB_HASH_INVALID:
       return "invalid";
   }
@@ -326,6 +445,7 @@ static bool hashfunction_valid(rydb_config_index_hashtable_t *acf) {
     case RYDB_HASH_CRC32:
     case RYDB_HASH_NOHASH:
     case RYDB_HASH_SIPHASH:
+    case RYDB_HASH_INTEGER:
       return true;
   }
   return false;
@@ -338,9 +458,14 @@ bool rydb_meta_save_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FIL
     "    store_hash: %"PRIu16"\n"
     "    collision_resolution: %"PRIu16"\n"
     "    rehash_flags: %"PRIu8"\n"
-    "    load_factor_max: %.4f\n";
+    "    load_factor_max: %.4f\n"
+    "    compact_hash: %"PRIu16"\n"
+    "    bloom_filter: %"PRIu16"\n"
+    "    integer_big_endian: %"PRIu16"\n"
+    "    cover_offset: %"PRIu16"\n"
+    "    cover_length: %"PRIu16"\n";
   int rc;
-  rc = fprintf(fp, fmt, rydb_hashfunction_to_str(idx_cf->type_config.hashtable.hash_function), (uint16_t )idx_cf->type_config.hashtable.store_value, (uint16_t )idx_cf->type_config.hashtable.store_hash, (uint16_t )idx_cf->type_config.hashtable.collision_resolution,  (uint8_t )idx_cf->type_config.hashtable.rehash, idx_cf->type_config.hashtable.load_factor_max);
+  rc = fprintf(fp, fmt, rydb_hashfunction_to_str(idx_cf->type_config.hashtable.hash_function), (uint16_t )idx_cf->type_config.hashtable.store_value, (uint16_t )idx_cf->type_config.hashtable.store_hash, (uint16_t )idx_cf->type_config.hashtable.collision_resolution,  (uint8_t )idx_cf->type_config.hashtable.rehash, idx_cf->type_config.hashtable.load_factor_max, (uint16_t )idx_cf->type_config.hashtable.compact_hash, (uint16_t )idx_cf->type_config.hashtable.bloom_filter, (uint16_t )idx_cf->type_config.hashtable.integer_big_endian, idx_cf->type_config.hashtable.cover_start, idx_cf->type_config.hashtable.cover_len);
   if(rc <= 0) {
     rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "failed writing hashtable \"%s\" config ", idx_cf->name);
     return false;
@@ -354,6 +479,11 @@ bool rydb_config_index_hashtable_set_config(rydb_t *db, rydb_config_index_t *cf,
     cf->type_config.hashtable.collision_resolution = RYDB_OPEN_ADDRESSING;
     cf->type_config.hashtable.store_value = 0;
     cf->type_config.hashtable.store_hash = 1;
+    cf->type_config.hashtable.compact_hash = 0;
+    cf->type_config.hashtable.bloom_filter = 0;
+    cf->type_config.hashtable.integer_big_endian = 0;
+    cf->type_config.hashtable.cover_start = 0;
+    cf->type_config.hashtable.cover_len = 0;
     cf->type_config.hashtable.hash_function = RYDB_HASH_SIPHASH;
     cf->type_config.hashtable.load_factor_max = RYDB_HASHTABLE_DEFAULT_MAX_LOAD_FACTOR;
     cf->type_config.hashtable.rehash = RYDB_HASHTABLE_DEFAULT_REHASH_FLAGS;
@@ -367,12 +497,57 @@ bool rydb_config_index_hashtable_set_config(rydb_t *db, rydb_config_index_t *cf,
       rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid load_factor_max for hashtable \"%s\", value %f must be between 0 and 1", cf->name, advanced_config->load_factor_max);
       return false;
     }
+    if(advanced_config->hash_function == RYDB_HASH_INTEGER && cf->len != sizeof(uint32_t) && cf->len != sizeof(uint64_t)) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Integer-keyed hashtable \"%s\" must have a 4- or 8-byte key, not %"PRIu16" bytes", cf->name, cf->len);
+      return false;
+    }
+    if(advanced_config->integer_big_endian && advanced_config->hash_function != RYDB_HASH_INTEGER) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "integer_big_endian requires the integer hash function for hashtable \"%s\"", cf->name);
+      return false;
+    }
+    if(advanced_config->cover_len > 0 && !advanced_config->store_value) {
+      //without the value in the bucket, every lookup would go to the data file anyway
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Covering hashtable \"%s\" requires store_value to be on", cf->name);
+      return false;
+    }
+    if(advanced_config->cover_start + advanced_config->cover_len > db->config.row_len) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Hashtable \"%s\" cover is out of bounds: row length is %"PRIu16", but cover is set to end at %i", cf->name, db->config.row_len, advanced_config->cover_start + advanced_config->cover_len);
+      return false;
+    }
+    if(advanced_config->compact_hash && !advanced_config->store_hash) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "compact_hash requires store_hash to be on for hashtable \"%s\"", cf->name);
+      return false;
+    }
     uint8_t rehash = advanced_config->rehash;
+    if(advanced_config->collision_resolution == RYDB_ROBIN_HOOD) {
+      //probe distances come from the stored hash, and runs must stay sorted by home slot for the current bitlevel
+      if(!advanced_config->store_hash) {
+        rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Robin Hood hashtable \"%s\" requires store_hash to be on", cf->name);
+        return false;
+      }
+      if(rehash == RYDB_REHASH_DEFAULT) {
+        rehash = RYDB_REHASH_ALL_AT_ONCE;
+      }
+      else if(rehash != RYDB_REHASH_ALL_AT_ONCE) {
+        rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid rehash flags for hashtable \"%s\": Robin Hood hashtables can only be rehashed ALL_AT_ONCE", cf->name);
+        return false;
+      }
+    }
+    else if(advanced_config->collision_resolution == RYDB_SEPARATE_CHAINING) {
+      //chains are relinked in a single pass whenever the table grows. there's nothing to do incrementally
+      if(rehash == RYDB_REHASH_DEFAULT) {
+        rehash = RYDB_REHASH_ALL_AT_ONCE;
+      }
+      else if(rehash & (RYDB_REHASH_INCREMENTAL | RYDB_REHASH_BACKGROUND)) {
+        rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid rehash flags for hashtable \"%s\": INCREMENTAL and BACKGROUND rehashing can't be used with separate chaining", cf->name);
+        return false;
+      }
+    }
     if(rehash == RYDB_REHASH_DEFAULT) {
       rehash = RYDB_HASHTABLE_DEFAULT_REHASH_FLAGS;
     }
     char *flagfail = NULL;
-    if(rehash > RYDB_REHASH_INCREMENTAL) {
+    if(rehash > (RYDB_REHASH_INCREMENTAL | RYDB_REHASH_BACKGROUND)) {
       rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid rehash flags for hashtable \"%s\"", cf->name);
       return false;
     }
@@ -383,16 +558,26 @@ bool rydb_config_index_hashtable_set_config(rydb_t *db, rydb_config_index_t *cf,
       else if(rehash & RYDB_REHASH_INCREMENTAL) {
         flagfail = "MANUAL and INCREMENTAL";
       }
+      else if(rehash & RYDB_REHASH_BACKGROUND) {
+        flagfail = "MANUAL and BACKGROUND";
+      }
     }
     else if(rehash & RYDB_REHASH_ALL_AT_ONCE) {
       if(rehash & RYDB_REHASH_INCREMENTAL) {
         flagfail = "ALL_AT_ONCE and INCREMENTAL";
       }
+      else if(rehash & RYDB_REHASH_BACKGROUND) {
+        flagfail = "ALL_AT_ONCE and BACKGROUND";
+      }
     }
     else if((rehash & RYDB_REHASH_INCREMENTAL) && !advanced_config->store_hash) {
       rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Rehash flag INCREMENTAL requires store_hash to be on for hashtable \"%s\"", cf->name);
       return false;
     }
+    else if((rehash & RYDB_REHASH_BACKGROUND) && !advanced_config->store_hash) {
+      rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Rehash flag BACKGROUND requires store_hash to be on for hashtable \"%s\"", cf->name);
+      return false;
+    }
     if(flagfail) {
       rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid rehash flags for hashtable \"%s\": %s are mutually exclusive", cf->name, flagfail);
       return false;
@@ -402,12 +587,18 @@ bool rydb_config_index_hashtable_set_config(rydb_t *db, rydb_config_index_t *cf,
     cf->type_config.hashtable.rehash = rehash;
     
     if(cf->type_config.hashtable.load_factor_max == 0) {
-      cf->type_config.hashtable.load_factor_max = RYDB_HASHTABLE_DEFAULT_MAX_LOAD_FACTOR;
+      if(cf->type_config.hashtable.collision_resolution == RYDB_ROBIN_HOOD) {
+        cf->type_config.hashtable.load_factor_max = RYDB_HASHTABLE_ROBIN_HOOD_DEFAULT_MAX_LOAD_FACTOR;
+      }
+      else {
+        cf->type_config.hashtable.load_factor_max = RYDB_HASHTABLE_DEFAULT_MAX_LOAD_FACTOR;
+      }
     }
     
     switch(cf->type_config.hashtable.collision_resolution) {
       case RYDB_OPEN_ADDRESSING:
       case RYDB_SEPARATE_CHAINING:
+      case RYDB_ROBIN_HOOD:
         break;
       default:
         rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Invalid collision resolution scheme for hashtable \"%s\"", cf->name);
@@ -426,6 +617,169 @@ static uint64_t nohash(const char *data, size_t len) {
   return h;
 }
 
+/*
+ * hash and key-compare kernels, picked once per index by hashtable_kernels_init() when it's opened.
+ * with the key length fixed, the compiler unrolls the hash loops and turns key compares into a few word loads.
+ * compare kernels only tell matching keys apart: 0 if they match, nonzero if they don't
+ */
+static uint64_t hash_crc32(const char *data, size_t data_len, const uint8_t *key) {
+  (void )key;
+  return crc32_inline((const uint8_t *)data, data_len);
+}
+static uint64_t hash_siphash(const char *data, size_t data_len, const uint8_t *key) {
+  return siphash_inline((const uint8_t *)data, data_len, key);
+}
+static uint64_t hash_nohash(const char *data, size_t data_len, const uint8_t *key) {
+  (void )key;
+  return nohash(data, data_len);
+}
+static uint64_t hash_nohash_wide(const char *data, size_t data_len, const uint8_t *key) {
+  //nohash only ever looks at the first 8 bytes
+  (void )data_len;
+  (void )key;
+  return nohash(data, sizeof(uint64_t));
+}
+
+static inline uint64_t key_load64(const char *data) {
+  uint64_t v;
+  memcpy(&v, data, sizeof(v));
+  return v;
+}
+static inline uint32_t key_load32(const char *data) {
+  uint32_t v;
+  memcpy(&v, data, sizeof(v));
+  return v;
+}
+static inline int key_compare_words(const char *a, const char *b, const size_t words) {
+  uint64_t diff = 0;
+  for(size_t i = 0; i < words; i++) {
+    diff |= key_load64(&a[i * sizeof(uint64_t)]) ^ key_load64(&b[i * sizeof(uint64_t)]);
+  }
+  return diff != 0;
+}
+static int key_compare(const char *a, const char *b, size_t data_len) {
+  return memcmp(a, b, data_len);
+}
+static int key_compare_4(const char *a, const char *b, size_t data_len) {
+  (void )data_len;
+  return key_load32(a) != key_load32(b);
+}
+
+#define HASHTABLE_KERNELS(len) \
+static uint64_t hash_crc32_##len(const char *data, size_t data_len, const uint8_t *key) { \
+  (void )data_len; \
+  (void )key; \
+  return crc32_inline((const uint8_t *)data, len); \
+} \
+static uint64_t hash_siphash_##len(const char *data, size_t data_len, const uint8_t *key) { \
+  (void )data_len; \
+  return siphash_inline((const uint8_t *)data, len, key); \
+}
+HASHTABLE_KERNELS(4)
+HASHTABLE_KERNELS(8)
+HASHTABLE_KERNELS(16)
+HASHTABLE_KERNELS(32)
+#undef HASHTABLE_KERNELS
+
+#define HASHTABLE_COMPARE_KERNEL(len) \
+static int key_compare_##len(const char *a, const char *b, size_t data_len) { \
+  (void )data_len; \
+  return key_compare_words(a, b, len / sizeof(uint64_t)); \
+}
+HASHTABLE_COMPARE_KERNEL(8)
+HASHTABLE_COMPARE_KERNEL(16)
+HASHTABLE_COMPARE_KERNEL(32)
+#undef HASHTABLE_COMPARE_KERNEL
+
+/*
+ * integer keys. home slots are a hash's low bits, so the Fibonacci hash's well-mixed top bits
+ * are reversed into the bottom: a table with 2^n slots uses the top n bits of the product, like it should.
+ * integer compares give the keys' order, not just whether they match, so they'll serve an ordered index too
+ */
+static inline uint64_t integer_key(const char *data, const size_t width, const bool big_endian) {
+  const uint8_t *d = (const uint8_t *)data;
+  uint64_t       v = 0;
+  for(size_t i = 0; i < width; i++) {
+    v = (v << 8) | d[big_endian ? i : width - 1 - i];
+  }
+  return v;
+}
+static inline uint64_t bitreverse64(uint64_t v) {
+  v = ((v >> 1) & 0x5555555555555555) | ((v & 0x5555555555555555) << 1);
+  v = ((v >> 2) & 0x3333333333333333) | ((v & 0x3333333333333333) << 2);
+  v = ((v >> 4) & 0x0f0f0f0f0f0f0f0f) | ((v & 0x0f0f0f0f0f0f0f0f) << 4);
+  v = ((v >> 8) & 0x00ff00ff00ff00ff) | ((v & 0x00ff00ff00ff00ff) << 8);
+  v = ((v >> 16) & 0x0000ffff0000ffff) | ((v & 0x0000ffff0000ffff) << 16);
+  return (v >> 32) | (v << 32);
+}
+static inline uint64_t fibonacci_hash(uint64_t v) {
+  return bitreverse64(v * 0x9e3779b97f4a7c15); //2^64 / golden ratio
+}
+
+#define HASHTABLE_INTEGER_KERNELS(width, endian, big_endian) \
+static uint64_t hash_integer##width##_##endian(const char *data, size_t data_len, const uint8_t *key) { \
+  (void )data_len; \
+  (void )key; \
+  return fibonacci_hash(integer_key(data, width / 8, big_endian)); \
+} \
+static int key_compare_integer##width##_##endian(const char *a, const char *b, size_t data_len) { \
+  (void )data_len; \
+  uint64_t ka = integer_key(a, width / 8, big_endian), kb = integer_key(b, width / 8, big_endian); \
+  return ka < kb ? -1 : ka > kb; \
+}
+HASHTABLE_INTEGER_KERNELS(32, le, 0)
+HASHTABLE_INTEGER_KERNELS(32, be, 1)
+HASHTABLE_INTEGER_KERNELS(64, le, 0)
+HASHTABLE_INTEGER_KERNELS(64, be, 1)
+#undef HASHTABLE_INTEGER_KERNELS
+
+static const struct {
+  uint16_t  len;
+  uint64_t (*crc32)(const char *data, size_t data_len, const uint8_t *key);
+  uint64_t (*siphash)(const char *data, size_t data_len, const uint8_t *key);
+  int      (*compare)(const char *a, const char *b, size_t data_len);
+} hashtable_kernels[] = {
+  {4,  hash_crc32_4,  hash_siphash_4,  key_compare_4},
+  {8,  hash_crc32_8,  hash_siphash_8,  key_compare_8},
+  {16, hash_crc32_16, hash_siphash_16, key_compare_16},
+  {32, hash_crc32_32, hash_siphash_32, key_compare_32}
+};
+
+static void hashtable_kernels_init(rydb_index_t *idx) {
+  rydb_index_state_hashtable_t *state = &idx->state.hashtable;
+  const rydb_config_index_t    *cf = idx->config;
+  unsigned                      i;
+  for(i = 0; i < sizeof(hashtable_kernels)/sizeof(hashtable_kernels[0]); i++) {
+    if(hashtable_kernels[i].len == cf->len) {
+      break;
+    }
+  }
+  const bool fixed = i < sizeof(hashtable_kernels)/sizeof(hashtable_kernels[0]);
+  state->compare = fixed ? hashtable_kernels[i].compare : key_compare;
+  switch(cf->type_config.hashtable.hash_function) {
+    case RYDB_HASH_CRC32:
+      state->hash_function = fixed ? hashtable_kernels[i].crc32 : hash_crc32;
+      break;
+    case RYDB_HASH_NOHASH:
+      state->hash_function = cf->len >= sizeof(uint64_t) ? hash_nohash_wide : hash_nohash;
+      break;
+    case RYDB_HASH_INTEGER:
+      if(cf->len == sizeof(uint32_t)) {
+        state->hash_function = cf->type_config.hashtable.integer_big_endian ? hash_integer32_be : hash_integer32_le;
+        state->compare = cf->type_config.hashtable.integer_big_endian ? key_compare_integer32_be : key_compare_integer32_le;
+      }
+      else {
+        state->hash_function = cf->type_config.hashtable.integer_big_endian ? hash_integer64_be : hash_integer64_le;
+        state->compare = cf->type_config.hashtable.integer_big_endian ? key_compare_integer64_be : key_compare_integer64_le;
+      }
+      break;
+    case RYDB_HASH_SIPHASH:
+    default: //invalid hash functions never make it past the config
+      state->hash_function = fixed ? hashtable_kernels[i].siphash : hash_siphash;
+      break;
+  }
+}
+
 
 
 static const uint64_t btrim64_mask[65] = {
@@ -452,25 +806,39 @@ static inline uint64_t btrim64(uint64_t val, uint8_t bits) {
 }
 
 
-static uint64_t hash_value(const rydb_t *db, const rydb_config_index_t *idx, const char *data, uint8_t trim) {
-  uint64_t h;
-  if(trim < 6) trim = 6; //produce a 58-bit hash at most
-  switch(idx->type_config.hashtable.hash_function) {
+static inline uint64_t hash_value(const rydb_t *db, const rydb_index_t *idx, const char *data) {
+  //produce a 58-bit hash at most
+  return btrim64(idx->state.hashtable.hash_function(data, idx->config->len, db->config.hash_key.value), 6);
+}
+
+//a row's hash, worked out straight from its key's segments if the key is composite
+static inline uint64_t row_hash_value(const rydb_t *db, const rydb_index_t *idx, const char *rowdata) {
+  const rydb_config_index_t *cf = idx->config;
+  char                       keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  if(!rydb_index_composite(cf)) {
+    return hash_value(db, idx, &rowdata[cf->start]);
+  }
+  switch(cf->type_config.hashtable.hash_function) {
     case RYDB_HASH_CRC32:
-      h = btrim64(crc32((const uint8_t *)data, idx->len), trim);
-      break;
-    case RYDB_HASH_NOHASH:
-      h = btrim64(nohash(data, idx->len), trim);
-      break;
+      return btrim64(crc32_segments(cf, rowdata), 6);
     case RYDB_HASH_SIPHASH:
-      h = btrim64(siphash((const uint8_t *)data, idx->len, db->config.hash_key.value), trim);
-      break;
+      return btrim64(siphash_segments(cf, rowdata, db->config.hash_key.value), 6);
     default:
-    case RYDB_HASH_INVALID:
-      h=0;
-      break;
+      //nohash and integer keys only look at a few bytes anyway
+      return hash_value(db, idx, rydb_index_row_key(cf, rowdata, keybuf));
   }
-  return h;
+}
+
+//a composite key compared against the segments in a row, without putting them together first
+static inline int row_key_compare(const rydb_config_index_t *cf, const char *rowdata, const char *val) {
+  int rc;
+  for(int i = 0; i < cf->segment_count; i++) {
+    if((rc = memcmp(&rowdata[cf->segment[i].start], val, cf->segment[i].len)) != 0) {
+      return rc;
+    }
+    val += cf->segment[i].len;
+  }
+  return 0;
 }
 
 static inline rydb_hashtable_header_t *hashtable_header(const rydb_index_t *idx) {
@@ -504,6 +872,18 @@ static void hashtable_bitlevel_subtract(rydb_hashtable_header_t *header, int lev
   }
 }
 
+//move a bucket's count from its old bitlevel to the current one
+static inline void hashtable_bitlevel_transfer(rydb_hashtable_header_t *header, uint_fast8_t old_hashbits) {
+  for(uint_fast8_t i=0, max = header->bucket.count.bitlevels; i<max; i++) {
+    if(header->bucket.bitlevel[i].bits == old_hashbits) {
+      hashtable_bitlevel_subtract(header, i);
+      header->bucket.bitlevel[0].count++;
+      return;
+    }
+  }
+  assert(0);
+}
+
 static inline bool hashtable_bitlevel_push(rydb_t *db, rydb_index_t *idx, rydb_hashtable_header_t *header) {
   DBG("push bitlevel #%i\n", header->bucket.count.bitlevels);
   int_fast8_t count = header->bucket.count.bitlevels;
@@ -516,47 +896,74 @@ static inline bool hashtable_bitlevel_push(rydb_t *db, rydb_index_t *idx, rydb_h
     header->bucket.bitlevel[i] = header->bucket.bitlevel[i-1];
   }
   header->bucket.count.bitlevels++;
+  rydb_stats_count(db, bitlevel_pushes);
   return true;
 }
 
+static inline bool hashtable_chained(const rydb_config_index_t *cf) {
+  return cf->type_config.hashtable.collision_resolution == RYDB_SEPARATE_CHAINING;
+}
+
+static inline bool hashtable_robinhood(const rydb_config_index_t *cf) {
+  return cf->type_config.hashtable.collision_resolution == RYDB_ROBIN_HOOD;
+}
+
+//bytes of stored hash in each bucket: none, a compact 4-byte tag, or the full 8 bytes
+static inline uint_fast8_t stored_hash_size(const rydb_config_index_t *cf) {
+  if(!cf->type_config.hashtable.store_hash) {
+    return 0;
+  }
+  return cf->type_config.hashtable.compact_hash ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
+//how many of the hash's low bits a stored hash of this size keeps. the rest of it is the bitlevel
+static inline uint_fast8_t stored_hash_width(uint_fast8_t hash_sz) {
+  return hash_sz == sizeof(uint32_t) ? RYDB_HASHTABLE_COMPACT_HASH_BITS : 58;
+}
+
+//rownum, then maybe the hash, then maybe the value and the covered bytes
+static inline size_t bucket_entry_size(const rydb_config_index_t *cf) {
+  size_t sz = sizeof(rydb_rownum_t) + stored_hash_size(cf);
+  if(cf->type_config.hashtable.store_value) {
+    sz += cf->len + cf->type_config.hashtable.cover_len;
+  }
+  return ry_align(sz, sizeof(rydb_rownum_t));
+}
+
 static inline size_t bucket_size(const rydb_config_index_t *cf) {
-  size_t sz;
   switch(cf->type_config.hashtable.collision_resolution) {
     case RYDB_OPEN_ADDRESSING:
-      sz = sizeof(rydb_rownum_t);
-      if(cf->type_config.hashtable.store_hash) {
-        sz += sizeof(uint64_t);
-      }
-      if(cf->type_config.hashtable.store_value) {
-        sz += cf->len;
-      }
-      return ry_align(sz, sizeof(rydb_rownum_t));
+    case RYDB_ROBIN_HOOD:
+      return bucket_entry_size(cf);
     case RYDB_SEPARATE_CHAINING:
-      return sizeof(rydb_rownum_t) *3;
+      return sizeof(rydb_rownum_t); //just the chain head's node number
   }
   //we shouldn't even get here
   return 0;
 }
 
-static inline uint64_t bucket_stored_hash58(const rydb_hashbucket_t *bucket) {
+static inline uint64_t bucket_stored_hash_and_bits(const rydb_hashbucket_t *bucket, uint_fast8_t hash_sz, uint_fast8_t *bits) {
   uint64_t hash;
+  uint32_t tag;
   //hash is not aligned correctly, so memcpy() it to a safe place first
+  if(hash_sz == sizeof(uint32_t)) {
+    memcpy(&tag, &bucket[sizeof(rydb_rownum_t)], sizeof(tag));
+    *bits = tag >> RYDB_HASHTABLE_COMPACT_HASH_BITS;
+    return tag & 0x03ffffff;
+  }
   memcpy(&hash, &bucket[sizeof(rydb_rownum_t)], sizeof(hash));
+  *bits = hash >> 58;
   return hash & 0x03ffffffffffffff;
 }
 
-static inline uint64_t bucket_stored_hash58_and_bits(const rydb_hashbucket_t *bucket, uint_fast8_t *bits) {
-  uint64_t hash;
-  //hash is not aligned correctly, so memcpy() it to a safe place first
-  memcpy(&hash, &bucket[sizeof(rydb_rownum_t)], sizeof(hash));
-  *bits = hash >> 58;
-  return hash & 0x03ffffffffffffff;
+static inline uint64_t bucket_stored_hash(const rydb_hashbucket_t *bucket, uint_fast8_t hash_sz) {
+  uint_fast8_t bits;
+  return bucket_stored_hash_and_bits(bucket, hash_sz, &bits);
 }
-static inline uint_fast8_t bucket_stored_hash_bits(const rydb_hashbucket_t *bucket) {
-  uint64_t hash;
-  //hash is not aligned correctly, so memcpy() it to a safe place first
-  memcpy(&hash, &bucket[sizeof(rydb_rownum_t)], sizeof(hash));
-  return hash >> 58;
+static inline uint_fast8_t bucket_stored_hash_bits(const rydb_hashbucket_t *bucket, uint_fast8_t hash_sz) {
+  uint_fast8_t bits;
+  bucket_stored_hash_and_bits(bucket, hash_sz, &bits);
+  return bits;
 }
 
 static inline rydb_hashbucket_t *hashtable_bucket(const rydb_index_t *idx, size_t sz, off_t bucketnum) {
@@ -575,27 +982,25 @@ static inline bool bucket_is_empty(const rydb_hashbucket_t *bucket) {
 static uint64_t bucket_hash(const rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *bucket) {
   assert(!bucket_is_empty(bucket)); //bucket rownum really shouldn't be zero at this point
   rydb_config_index_t       *cf = idx->config;
-  if(cf->type_config.hashtable.store_hash) {
-    return bucket_stored_hash58(bucket);
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  if(hash_sz == sizeof(uint64_t)) {
+    return bucket_stored_hash(bucket, hash_sz);
   }
   if(cf->type_config.hashtable.store_value) {
-    return hash_value(db, cf, (char *)&bucket[sizeof(rydb_rownum_t)], 0);
+    return hash_value(db, idx, &bucket[sizeof(rydb_rownum_t) + hash_sz]);
   }
   rydb_stored_row_t *row = rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket));
   if(!row) {
     //rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Hashtable \"%s\" row lookup failed", idx->config->name);
     return 0; //this just returns a zero hash, the error is not propagated. this could be a problem!
   }
-  return hash_value(db, cf, &row->data[cf->start], 0);
+  return row_hash_value(db, idx, row->data);
 }
   
-static inline const char *bucket_data(const rydb_t *db, const rydb_hashbucket_t *bucket, const uint_fast8_t store_hash, const uint_fast8_t store_value, const off_t data_start) {
+//hash_sz is the size of the stored hash (see stored_hash_size()), 0 if there isn't one
+static inline const char *bucket_data(const rydb_t *db, const rydb_hashbucket_t *bucket, const uint_fast8_t hash_sz, const uint_fast8_t store_value, const off_t data_start) {
   if(store_value) {
-    const char *data = &bucket[sizeof(rydb_rownum_t)];
-    if(store_hash) {
-      data = &data[sizeof(uint64_t)];
-    }
-    return data;
+    return &bucket[sizeof(rydb_rownum_t) + hash_sz];
   }
   
   rydb_stored_row_t *datarow = rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket));
@@ -603,25 +1008,58 @@ static inline const char *bucket_data(const rydb_t *db, const rydb_hashbucket_t
   return &datarow->data[data_start];
 }
 
-static inline int bucket_compare(const rydb_t *db, const rydb_hashbucket_t *bucket, const rydb_rownum_t match_rownum, const uint64_t hashvalue, const char *val, const uint_fast8_t store_hash, const uint_fast8_t store_value, const off_t data_start, const off_t data_len) {
+static inline int bucket_compare(const rydb_t *db, const rydb_hashbucket_t *bucket, const rydb_rownum_t match_rownum, const uint64_t hashvalue, const char *val, const uint_fast8_t hash_sz, const uint_fast8_t store_value, const off_t data_start, const rydb_index_t *idx) {
   rydb_rownum_t stored_rownum;
-  uint64_t      stored_hash;
+  uint64_t      stored_hash, trimmed_hashvalue;
   if(match_rownum && (stored_rownum = BUCKET_STORED_ROWNUM(bucket)) != match_rownum) {
     return match_rownum > stored_rownum ? 1 : -1;
   }
-  if(store_hash && (stored_hash = bucket_stored_hash58(bucket)) != hashvalue) {
-    return hashvalue > stored_hash ? 1 : -1;
+  if(hash_sz && (stored_hash = bucket_stored_hash(bucket, hash_sz)) != (trimmed_hashvalue = btrim64(hashvalue, 64 - stored_hash_width(hash_sz)))) {
+    return trimmed_hashvalue > stored_hash ? 1 : -1;
+  }
+  if(!store_value && rydb_index_composite(idx->config)) {
+    return row_key_compare(idx->config, rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket))->data, val);
+  }
+  return idx->state.hashtable.compare(bucket_data(db, bucket, hash_sz, store_value, data_start), val, idx->config->len);
+}
+
+//the value a cursor's later steps match against: the last bucket found's data, or the search value again if that's not in one piece
+static inline const char *cursor_match_value(rydb_cursor_t *cur, const rydb_hashbucket_t *bucket, const uint_fast8_t hash_sz, const uint_fast8_t store_value) {
+  const rydb_config_index_t *cf = cur->state.index.config;
+  if(!store_value && rydb_index_composite(cf)) {
+    return rydb_index_search_value(cur->db->index_scratch_buffer, cf, cur->data, cur->len);
+  }
+  return bucket_data(cur->db, bucket, hash_sz, store_value, cf->start);
+}
+
+//a hash good enough to find the bucket's slot at the given bitlevel. a compact stored hash will do
+//while the table is small enough, past that the full hash has to be worked out from the value
+static inline uint64_t bucket_hash_for_bits(const rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *bucket, uint_fast8_t bits) {
+  const uint_fast8_t hash_sz = stored_hash_size(idx->config);
+  if(hash_sz && bits <= stored_hash_width(hash_sz)) {
+    return bucket_stored_hash(bucket, hash_sz);
   }
-  return memcmp(bucket_data(db, bucket, store_hash, store_value, data_start), val, data_len);
+  return bucket_hash(db, idx, bucket);
+}
+
+//the slot a bucket hashes to at the given bitlevel
+static inline uint64_t bucket_home(const rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *bucket, uint_fast8_t bits) {
+  return btrim64(bucket_hash_for_bits(db, idx, bucket, bits), 64 - bits);
 }
 
 static inline rydb_hashbucket_t *bucket_next(const rydb_hashbucket_t *bucket, size_t sz, off_t diff) {
   return (rydb_hashbucket_t *)((const char *)bucket + ((off_t )sz * diff));
 }
 
-static const rydb_hashbucket_t *bucket_first_in_run(const rydb_t *db, const rydb_hashbucket_t *bucket, const rydb_hashbucket_t *buckets_end, const uint64_t hashvalue, const char *val, const uint_fast8_t store_hash, const uint_fast8_t store_value, const off_t data_start, const off_t data_len, size_t sz) {
+// robinhood_bits is the table's bitlevel if its runs are sorted by home slot (Robin Hood), 0 otherwise.
+// sorted runs let the search stop at the first bucket homed past ours.
+static const rydb_hashbucket_t *bucket_first_in_run(const rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *bucket, const rydb_hashbucket_t *buckets_end, const uint64_t hashvalue, const char *val, const uint_fast8_t hash_sz, const uint_fast8_t store_value, const off_t data_start, size_t sz, const uint_fast8_t robinhood_bits) {
+  const uint64_t home = btrim64(hashvalue, 64 - robinhood_bits);
   while(bucket < buckets_end && !bucket_is_empty(bucket)) {
-    if(bucket_compare(db, bucket, 0, hashvalue, val, store_hash, store_value, data_start, data_len) == 0) {
+    if(robinhood_bits && bucket_home(db, idx, bucket, robinhood_bits) > home) {
+      break;
+    }
+    if(bucket_compare(db, bucket, 0, hashvalue, val, hash_sz, store_value, data_start, idx) == 0) {
       return bucket;
     }
     bucket = bucket_next(bucket, sz, 1);
@@ -629,8 +1067,14 @@ static const rydb_hashbucket_t *bucket_first_in_run(const rydb_t *db, const rydb
   return NULL;
 }
 
-static inline void bucket_set_hash_bits(rydb_hashbucket_t *bucket, uint_fast8_t bits) {
-  uint64_t bits_n_hash = bucket_stored_hash58(bucket);
+static inline void bucket_set_hash_bits(rydb_hashbucket_t *bucket, uint_fast8_t hash_sz, uint_fast8_t bits) {
+  uint64_t bits_n_hash = bucket_stored_hash(bucket, hash_sz);
+  uint32_t bits_n_tag;
+  if(hash_sz == sizeof(uint32_t)) {
+    bits_n_tag = bits_n_hash | (uint32_t )bits << RYDB_HASHTABLE_COMPACT_HASH_BITS;
+    memcpy(&bucket[sizeof(rydb_rownum_t)], &bits_n_tag, sizeof(bits_n_tag));
+    return;
+  }
   bits_n_hash |= (uint64_t )bits << 58;
   memcpy(&bucket[sizeof(rydb_rownum_t)], &bits_n_hash, sizeof(bits_n_hash));
 }
@@ -639,7 +1083,14 @@ static inline void bucket_write(const rydb_t *db, const rydb_index_t *idx, rydb_
   rydb_config_index_t       *cf = idx->config;
   BUCKET_STORED_ROWNUM(bucket) = rydb_row_to_rownum(db, row);
   DBG("writing rownum %"RYPRIrn" to %p (check: %"RYPRIrn")\n", rydb_row_to_rownum(db, row), (void *)bucket, BUCKET_STORED_ROWNUM(bucket))
-  if(cf->type_config.hashtable.store_hash) {
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  if(hash_sz == sizeof(uint32_t)) {
+    assert(bitlevel < 64);
+    uint32_t stored_bitlevel_and_tag = btrim64(hashvalue, 64 - RYDB_HASHTABLE_COMPACT_HASH_BITS);
+    stored_bitlevel_and_tag |= (uint32_t )bitlevel << RYDB_HASHTABLE_COMPACT_HASH_BITS;
+    memcpy(&bucket[sizeof(rydb_rownum_t)], &stored_bitlevel_and_tag, sizeof(stored_bitlevel_and_tag));
+  }
+  else if(hash_sz) {
     assert(bitlevel < 64);
     uint64_t stored_bitlevel_and_hash = btrim64(hashvalue, 6);
     stored_bitlevel_and_hash |= (uint64_t )bitlevel << 58;
@@ -650,8 +1101,13 @@ static inline void bucket_write(const rydb_t *db, const rydb_index_t *idx, rydb_
     DBG("WRITE VALUE %.*s\n", cf->len, &row->data[cf->start])
     // just to prove we're getting the data straight from the hashtable, pass NULL as db to bucket_data()
     // so it can't be grabbed from the data-table
-    char *data = (char *)bucket_data(NULL, bucket, cf->type_config.hashtable.store_hash, 1, cf->start);
-    memcpy(data, &row->data[cf->start], cf->len);
+    char *data = (char *)bucket_data(NULL, bucket, hash_sz, 1, cf->start);
+    if(rydb_index_row_key(cf, row->data, data) != data) {
+      memcpy(data, &row->data[cf->start], cf->len);
+    }
+    if(cf->type_config.hashtable.cover_len > 0) {
+      memcpy(&data[cf->len], &row->data[cf->type_config.hashtable.cover_start], cf->type_config.hashtable.cover_len);
+    }
   }
 }
 static inline void bucket_remove(const rydb_t *db, const rydb_index_t *idx, rydb_hashtable_header_t *header, rydb_hashbucket_t *bucket, const rydb_hashbucket_t *buckets_end, size_t bucket_sz, uint_fast8_t subtract_from_totals) {
@@ -659,16 +1115,16 @@ static inline void bucket_remove(const rydb_t *db, const rydb_index_t *idx, rydb
   uint_fast8_t         removed_bucket_hashbits = 0;
   uint64_t             emptybucketnum = hashtable_bucketnum(idx, bucket_sz, bucket);
   rydb_hashbucket_t   *emptybucket = bucket;
-  uint_fast8_t         have_stored_hash = idx->config->type_config.hashtable.store_hash;
+  uint_fast8_t         have_stored_hash = stored_hash_size(idx->config);
   if(subtract_from_totals && have_stored_hash) {
-    removed_bucket_hashbits = bucket_stored_hash_bits(bucket);
+    removed_bucket_hashbits = bucket_stored_hash_bits(bucket, have_stored_hash);
   }
   DBG_BUCKET("remove bucket  ", idx, bucket)
   for(bucket += bucket_sz; bucket < buckets_end && !bucket_is_empty(bucket); bucket += bucket_sz) {
-    uint64_t hash = bucket_hash(db, idx, bucket);
     if(have_stored_hash) {
-      hashbits = bucket_stored_hash_bits(bucket);
+      hashbits = bucket_stored_hash_bits(bucket, have_stored_hash);
     }
+    uint64_t hash = bucket_hash_for_bits(db, idx, bucket, hashbits);
     if(btrim64(hash, 64 - hashbits) <= emptybucketnum) {
       //this bucket is not part of the overflow run
       DBG_BUCKET("upshift bucket ", idx, bucket)
@@ -708,7 +1164,7 @@ static bool bucket_rehash(rydb_t *db, rydb_index_t *idx, rydb_hashbucket_t *buck
   rydb_hashtable_header_t   *header = hashtable_header(idx);
   size_t                     sz = bucket_size(idx->config);
   uint_fast8_t               new_hashbits = header->bucket.bitlevel[0].bits;
-  uint64_t                   full_hash = bucket_hash(db, idx, bucket);
+  uint64_t                   full_hash = bucket_hash_for_bits(db, idx, bucket, new_hashbits);
   uint64_t                   old_hash = btrim64(full_hash, 64 - old_hashbits);
   uint64_t                   new_hash = btrim64(full_hash, 64 - new_hashbits);
   DBG_BUCKET("rehash bucket         ", idx, bucket)
@@ -743,7 +1199,7 @@ static bool bucket_rehash(rydb_t *db, rydb_index_t *idx, rydb_hashbucket_t *buck
   if(dst != bucket) {
     //rydb_hashtable_print(db, idx);
     memcpy(dst, bucket, sz);
-    bucket_set_hash_bits(dst, new_hashbits);
+    bucket_set_hash_bits(dst, stored_hash_size(idx->config), new_hashbits);
     if(remove_old_bucket) {
       bucket_remove(db, idx, header, bucket, buckets_end, sz, 0);
     }
@@ -754,57 +1210,763 @@ static bool bucket_rehash(rydb_t *db, rydb_index_t *idx, rydb_hashbucket_t *buck
     rydb_hashtable_cursors_update(db, idx, bucket, dst, old_hashbits, new_hashbits);
   }
   if(transfer_from_old_bitlevel) {
-    for(uint_fast8_t i=0, max = header->bucket.count.bitlevels; i<max; i++) {
-      if(header->bucket.bitlevel[i].bits == old_hashbits) {
-        hashtable_bitlevel_subtract(header, i);
-        header->bucket.bitlevel[0].count++;
-        return true;
-      }
-    }
-    assert(0);
+    hashtable_bitlevel_transfer(header, old_hashbits);
   }
   return true;
 }
 
-bool rydb_index_hashtable_rehash(rydb_t *db, rydb_index_t *idx, off_t last_possible_bucket, uint_fast8_t current_hashbits, int lock) {
-  rydb_hashbucket_t         *bucket;
-  size_t                     bucket_sz = bucket_size(idx->config);
-  rydb_hashbucket_t         *buckets_start = hashtable_bucket(idx, bucket_sz, 0);
+/*
+ * separate chaining: the index file holds the chain heads (node numbers, 0 for an empty slot),
+ * and the nodes live in an arena in the .map file. A node is laid out like an open-addressing bucket,
+ * followed by the number of the next node in the chain, so all the bucket_*() functions work on it.
+ * Removed nodes go on a free-list, and are reused before the arena is grown.
+ */
+static inline size_t chain_node_size(const rydb_config_index_t *cf) {
+  return bucket_entry_size(cf) + sizeof(rydb_rownum_t);
+}
+
+static inline rydb_hashtable_chain_header_t *chain_header(const rydb_index_t *idx) {
+  return (void *)idx->map.file.start;
+}
+
+static inline rydb_hashbucket_t *chain_node(const rydb_index_t *idx, size_t node_sz, rydb_rownum_t nodenum) {
+  return (rydb_hashbucket_t *)&idx->map.data.start[(nodenum - 1) * node_sz];
+}
+
+static inline rydb_rownum_t *chain_node_next(const rydb_hashbucket_t *node, size_t node_sz) {
+  return (rydb_rownum_t *)&node[node_sz - sizeof(rydb_rownum_t)];
+}
+
+static inline rydb_rownum_t chain_node_num(const rydb_index_t *idx, size_t node_sz, const rydb_hashbucket_t *node) {
+  return (node - idx->map.data.start) / node_sz + 1;
+}
+
+static inline rydb_rownum_t *chain_head(const rydb_index_t *idx, uint64_t slot) {
+  return (rydb_rownum_t *)hashtable_bucket(idx, sizeof(rydb_rownum_t), slot);
+}
+
+//link_ptr, if given, is set to the chain link that points to the found node
+static rydb_hashbucket_t *chain_find_node(const rydb_t *db, const rydb_index_t *idx, rydb_rownum_t match_rownum, const char *match_val, uint64_t hashvalue, rydb_rownum_t **link_ptr) {
   rydb_hashtable_header_t   *header = hashtable_header(idx);
-  const bool                 store_hash = idx->config->type_config.hashtable.store_hash;
-  if(lock) hashtable_lock(header);
-  if(last_possible_bucket == 0) {
-    last_possible_bucket = header->bucket.count.total;
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               node_sz = chain_node_size(cf);
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  const uint_fast8_t         store_value = cf->type_config.hashtable.store_value;
+  rydb_rownum_t             *link;
+  rydb_hashbucket_t         *node;
+  if(header->bucket.count.total == 0) {
+    return NULL;
+  }
+  for(link = chain_head(idx, btrim64(hashvalue, 64 - header->bucket.bitlevel[0].bits)); *link != 0; link = chain_node_next(node, node_sz)) {
+    node = chain_node(idx, node_sz, *link);
+    if(bucket_compare(db, node, match_rownum, hashvalue, match_val, hash_sz, store_value, cf->start, idx) == 0) {
+      if(link_ptr) *link_ptr = link;
+      return node;
+    }
   }
-  if(current_hashbits == 0 && !store_hash) {
-    current_hashbits = header->bucket.bitlevel[0].bits;
+  return NULL;
+}
+
+static bool chain_node_alloc(rydb_t *db, rydb_index_t *idx, rydb_rownum_t *nodenum) {
+  rydb_hashtable_chain_header_t *chain = chain_header(idx);
+  const size_t                   node_sz = chain_node_size(idx->config);
+  if(chain->free) {
+    *nodenum = chain->free;
+    chain->free = *chain_node_next(chain_node(idx, node_sz, chain->free), node_sz);
+    return true;
   }
-  for(bucket = hashtable_bucket(idx, bucket_sz, last_possible_bucket - 1); bucket >= buckets_start; bucket = bucket_next(bucket, bucket_sz, -1)) {
-    if(bucket_is_empty(bucket)) {
-      continue;
-    }
-    if(store_hash) {
-      current_hashbits = bucket_stored_hash_bits(bucket);
-    }
-    if(!bucket_rehash(db, idx, bucket, current_hashbits, 0, 1)) {
-      if(lock) hashtable_unlock(hashtable_header(idx));
-      return false;
-    }
+  if(!rydb_file_ensure_size(db, &idx->map, RYDB_INDEX_HASHTABLE_CHAIN_START_OFFSET + (chain->count + 1) * node_sz, NULL)) {
+    return false;
   }
-  if(lock) hashtable_unlock(hashtable_header(idx));
+  chain = chain_header(idx); //file might have gotten remapped
+  *nodenum = ++chain->count;
   return true;
 }
 
-static bool hashtable_grow_locked(rydb_t *db, rydb_index_t *idx) {
+static inline void chain_node_free(const rydb_index_t *idx, rydb_hashbucket_t *node, size_t node_sz) {
+  rydb_hashtable_chain_header_t *chain = chain_header(idx);
+#ifdef RYDB_DEBUG
+  memset(node, '\00', node_sz);
+#else
+  BUCKET_STORED_ROWNUM(node) = 0;
+#endif
+  *chain_node_next(node, node_sz) = chain->free;
+  chain->free = chain_node_num(idx, node_sz, node);
+}
+
+// double the number of chain heads, splitting every chain in two. The nodes stay where they are,
+// only the links change, and each chain's order is preserved so that cursors keep their place.
+static bool chain_grow_locked(rydb_t *db, rydb_index_t *idx) {
   rydb_hashtable_header_t   *header = hashtable_header(idx);
-  rydb_config_index_t       *cf = idx->config;
-  uint8_t                    current_hashbits = header->bucket.bitlevel[0].bits;
-  uint64_t                   max_bucket = (1 << (current_hashbits + 1));
-  size_t                     bucket_sz = bucket_size(cf);
-  size_t                     new_data_sz = max_bucket * bucket_sz;
-  uint64_t                   prev_total_buckets = header->bucket.count.total;
-  bool                       rehash_all = cf->type_config.hashtable.rehash & RYDB_REHASH_ALL_AT_ONCE;
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               node_sz = chain_node_size(cf);
+  const uint_fast8_t         new_bits = header->bucket.bitlevel[0].bits + 1;
+  const uint64_t             old_slots = header->bucket.count.total;
+  const uint64_t             new_slots = (uint64_t )1 << new_bits;
+  rydb_rownum_t             *lo, *hi, nodenum;
+  rydb_hashbucket_t         *node;
   
+  if(!rydb_file_ensure_size(db, &idx->index, RYDB_INDEX_HASHTABLE_START_OFFSET + new_slots * sizeof(rydb_rownum_t), NULL)) {
+    return false;
+  }
+  header = hashtable_header(idx); //get the header again -- the mmap address may have changed
+  idx->index.data.end = idx->index.file.end;
+  for(uint64_t slot = old_slots; slot < new_slots; slot++) {
+    *chain_head(idx, slot) = 0;
+  }
+  for(uint64_t slot = 0; slot < old_slots; slot++) {
+    lo = chain_head(idx, slot);
+    hi = chain_head(idx, slot + old_slots);
+    nodenum = *lo;
+    while(nodenum) {
+      node = chain_node(idx, node_sz, nodenum);
+      if(bucket_home(db, idx, node, new_bits) == slot) {
+        *lo = nodenum;
+        lo = chain_node_next(node, node_sz);
+      }
+      else {
+        *hi = nodenum;
+        hi = chain_node_next(node, node_sz);
+      }
+      nodenum = *chain_node_next(node, node_sz);
+    }
+    *lo = 0;
+    *hi = 0;
+  }
+  header->bucket.bitlevel[0].bits = new_bits;
+  header->bucket.count.total = new_slots;
+  header->bucket.count.load_factor_max = new_slots * cf->type_config.hashtable.load_factor_max;
+  return true;
+}
+
+static bool chain_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row, uint64_t hashvalue) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const size_t               node_sz = chain_node_size(idx->config);
+  const uint_fast8_t         bits = header->bucket.bitlevel[0].bits;
+  rydb_rownum_t              nodenum, *head;
+  rydb_hashbucket_t         *node;
+  if(!chain_node_alloc(db, idx, &nodenum)) {
+    return false;
+  }
+  node = chain_node(idx, node_sz, nodenum);
+  head = chain_head(idx, btrim64(hashvalue, 64 - bits));
+  bucket_write(db, idx, node, hashvalue, bits, row);
+  //new nodes go in front, so cursors already walking the chain aren't affected
+  *chain_node_next(node, node_sz) = *head;
+  *head = nodenum;
+  header->bucket.count.used++;
+  header->bucket.bitlevel[0].count++;
+  return true;
+}
+
+static bool chain_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               node_sz = chain_node_size(cf);
+  char                       keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  const char                *val = rydb_index_row_key(cf, row->data, keybuf);
+  const uint64_t             hashvalue = hash_value(db, idx, val);
+  rydb_rownum_t              nodenum, *link;
+  rydb_hashbucket_t         *node, *next;
+  if((node = chain_find_node(db, idx, rydb_row_to_rownum(db, row), val, hashvalue, &link)) == NULL) {
+    return false;
+  }
+  nodenum = *link;
+  //cursors about to return this node move on to the next match instead
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    if(cur->finished || cur->state.index.typedata.hashtable.bucketnum != nodenum) {
+      continue;
+    }
+    cur->finished = 1;
+    for(rydb_rownum_t n = *chain_node_next(node, node_sz); n != 0; n = *chain_node_next(next, node_sz)) {
+      next = chain_node(idx, node_sz, n);
+      if(bucket_compare(db, next, 0, hashvalue, val, stored_hash_size(cf), cf->type_config.hashtable.store_value, cf->start, idx) == 0) {
+        cur->state.index.typedata.hashtable.bucketnum = n;
+        cur->finished = 0;
+        break;
+      }
+    }
+  }
+  *link = *chain_node_next(node, node_sz);
+  chain_node_free(idx, node, node_sz);
+  header->bucket.count.used--;
+  header->bucket.bitlevel[0].count--;
+  return true;
+}
+
+//lay out n nodes from src, linking them back to front so that every chain ends up in row order
+// counting-sort n buckets by their home slot. returns the order to lay them out in, to be freed by the caller
+static rydb_rownum_t *hashtable_sort_by_home(rydb_t *db, const rydb_config_index_t *cf, const uint64_t *hashes, rydb_rownum_t n, uint_fast8_t bits) {
+  const uint64_t  slots = (uint64_t )1 << bits;
+  rydb_rownum_t  *offset, *order;
+  if((offset = rydb_mem.malloc(sizeof(*offset) * (slots + 1))) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to build hashtable \"%s\"", cf->name);
+    return NULL;
+  }
+  if((order = rydb_mem.malloc(sizeof(*order) * (n > 0 ? n : 1))) == NULL) {
+    rydb_mem.free(offset);
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to build hashtable \"%s\"", cf->name);
+    return NULL;
+  }
+  memset(offset, '\00', sizeof(*offset) * (slots + 1));
+  for(rydb_rownum_t i = 0; i < n; i++) {
+    offset[btrim64(hashes[i], 64 - bits) + 1]++;
+  }
+  for(uint64_t i = 1; i <= slots; i++) {
+    offset[i] += offset[i - 1];
+  }
+  for(rydb_rownum_t i = 0; i < n; i++) {
+    order[offset[btrim64(hashes[i], 64 - bits)]++] = i;
+  }
+  rydb_mem.free(offset);
+  return order;
+}
+
+// equal keys have equal hashes, so any duplicates share a home slot, and end up in the same stretch of the sort order
+static bool hashtable_sorted_unique(rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *src, size_t src_sz, const uint64_t *hashes, const rydb_rownum_t *order, rydb_rownum_t n, uint_fast8_t bits) {
+  const rydb_config_index_t *cf = idx->config;
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  const uint_fast8_t         store_value = cf->type_config.hashtable.store_value;
+  const rydb_hashbucket_t   *bucket;
+  const char                *key;
+  char                       keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  rydb_rownum_t              end;
+  uint64_t                   home;
+  for(rydb_rownum_t start = 0; start < n; start = end) {
+    home = btrim64(hashes[order[start]], 64 - bits);
+    for(end = start + 1; end < n && btrim64(hashes[order[end]], 64 - bits) == home; end++);
+    for(rydb_rownum_t i = start + 1; i < end; i++) {
+      bucket = &src[order[i] * src_sz];
+      if(store_value) {
+        key = bucket_data(db, bucket, hash_sz, 1, cf->start);
+      }
+      else {
+        key = rydb_index_row_key(cf, rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket))->data, keybuf);
+      }
+      for(rydb_rownum_t j = start; j < i; j++) {
+        if(hashes[order[j]] == hashes[order[i]] && bucket_compare(db, &src[order[j] * src_sz], 0, hashes[order[i]], key, hash_sz, store_value, cf->start, idx) == 0) {
+          rydb_set_error(db, RYDB_ERROR_NOT_UNIQUE, "Data for index %s must be unique", cf->name);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static bool chain_load(rydb_t *db, rydb_index_t *idx, const rydb_hashbucket_t *src, const uint64_t *hashes, rydb_rownum_t n, uint_fast8_t bits, bool check_unique) {
+  const rydb_config_index_t     *cf = idx->config;
+  const size_t                   entry_sz = bucket_entry_size(cf);
+  const size_t                   node_sz = chain_node_size(cf);
+  const uint64_t                 slots = (uint64_t )1 << bits;
+  const size_t                   index_sz = RYDB_INDEX_HASHTABLE_START_OFFSET + slots * sizeof(rydb_rownum_t);
+  const size_t                   map_sz = RYDB_INDEX_HASHTABLE_CHAIN_START_OFFSET + n * node_sz;
+  rydb_hashtable_header_t       *header;
+  rydb_hashtable_chain_header_t *chain;
+  rydb_hashbucket_t             *node;
+  rydb_rownum_t                 *head, *order;
+  
+  if(check_unique) {
+    if((order = hashtable_sort_by_home(db, cf, hashes, n, bits)) == NULL) {
+      return false;
+    }
+    bool unique = hashtable_sorted_unique(db, idx, src, entry_sz, hashes, order, n, bits);
+    rydb_mem.free(order);
+    if(!unique) {
+      return false;
+    }
+  }
+  if(!rydb_file_ensure_size(db, &idx->index, index_sz, NULL) || !rydb_file_shrink_to_size(db, &idx->index, index_sz)) {
+    return false;
+  }
+  if(!rydb_file_ensure_size(db, &idx->map, map_sz, NULL) || !rydb_file_shrink_to_size(db, &idx->map, map_sz)) {
+    return false;
+  }
+  idx->index.data.end = idx->index.file.end;
+  memset(idx->index.data.start, '\00', slots * sizeof(rydb_rownum_t));
+  chain = chain_header(idx);
+  chain->free = 0;
+  chain->count = n;
+  for(rydb_rownum_t i = n; i > 0; i--) {
+    node = chain_node(idx, node_sz, i);
+    memcpy(node, &src[(i - 1) * entry_sz], entry_sz);
+    head = chain_head(idx, btrim64(hashes[i - 1], 64 - bits));
+    *chain_node_next(node, node_sz) = *head;
+    *head = i;
+  }
+  header = hashtable_header(idx);
+  header->bucket.count.bitlevels = 1;
+  header->bucket.bitlevel[0].bits = bits;
+  header->bucket.bitlevel[0].count = n;
+  header->bucket.count.used = n;
+  header->bucket.count.total = slots;
+  header->bucket.count.load_factor_max = slots * cf->type_config.hashtable.load_factor_max;
+  header->rehash.watermark = 0;
+  return true;
+}
+
+static const rydb_hashbucket_t *chain_cursor_step(rydb_cursor_t *cur) {
+  rydb_t                    *db = cur->db;
+  const rydb_config_index_t *cf = cur->state.index.config;
+  const rydb_index_t        *idx = cur->state.index.idx;
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const size_t               node_sz = chain_node_size(cf);
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  const uint_fast8_t         store_value = cf->type_config.hashtable.store_value;
+  const rydb_hashbucket_t   *node, *retnode;
+  rydb_rownum_t              nodenum;
+  uint64_t                   hashvalue;
+  const char                *val;
+  if(cur->step == 0) {
+    val = rydb_index_search_value(db->index_scratch_buffer, cf, cur->data, cur->len);
+    hashvalue = hash_value(db, idx, val);
+    cur->state.index.typedata.hashtable.hash = hashvalue;
+    cur->state.index.typedata.hashtable.bitlevel = 0;
+    nodenum = header->bucket.count.total > 0 ? *chain_head(idx, btrim64(hashvalue, 64 - header->bucket.bitlevel[0].bits)) : 0;
+    retnode = NULL;
+  }
+  else {
+    retnode = chain_node(idx, node_sz, cur->state.index.typedata.hashtable.bucketnum);
+    val = cursor_match_value(cur, retnode, hash_sz, store_value);
+    hashvalue = cur->state.index.typedata.hashtable.hash;
+    nodenum = *chain_node_next(retnode, node_sz);
+  }
+  cur->step++;
+  for(; nodenum != 0; nodenum = *chain_node_next(node, node_sz)) {
+    node = chain_node(idx, node_sz, nodenum);
+    if(bucket_compare(db, node, 0, hashvalue, val, hash_sz, store_value, cf->start, idx) == 0) {
+      cur->state.index.typedata.hashtable.bucketnum = nodenum;
+      return retnode;
+    }
+  }
+  cur->finished = 1;
+  return retnode;
+}
+
+/*
+ * Robin Hood hashing: open addressing with every run of buckets kept sorted by home slot. A new bucket takes
+ * the place of the first one in its run that's homed further along (and so is closer to home than the new one
+ * would be), and the rest of the run shifts down by one. Removal shifts the run back up (backward-shift deletion)
+ * instead of leaving holes, and lookups stop at the first bucket homed past their own slot.
+ * Home slots come from the stored hash, and there's only ever one bitlevel: growing re-lays the whole table.
+ */
+static bool hashtable_load_sorted(rydb_t *db, rydb_index_t *idx, const rydb_hashbucket_t *src, const uint64_t *hashes, rydb_rownum_t n, uint_fast8_t bits, bool check_unique);
+
+//cursors waiting on buckets in [first, last) follow them when they're shifted by diff
+static void robinhood_cursors_shift(const rydb_index_t *idx, uint64_t first, uint64_t last, int diff) {
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    uint64_t bucketnum = cur->state.index.typedata.hashtable.bucketnum;
+    if(!cur->finished && bucketnum >= first && bucketnum < last) {
+      cur->state.index.typedata.hashtable.bucketnum = bucketnum + diff;
+    }
+  }
+}
+
+static rydb_hashbucket_t *robinhood_find_bucket(const rydb_t *db, const rydb_index_t *idx, rydb_rownum_t match_rownum, const char *match_val, uint64_t hashvalue) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               sz = bucket_size(cf);
+  const uint_fast8_t         bits = header->bucket.bitlevel[0].bits;
+  const uint64_t             home = btrim64(hashvalue, 64 - bits);
+  const rydb_hashbucket_t   *buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
+  rydb_hashbucket_t         *bucket;
+  for(bucket = hashtable_bucket(idx, sz, home); bucket < buckets_end && !bucket_is_empty(bucket); bucket = bucket_next(bucket, sz, 1)) {
+    if(bucket_home(db, idx, bucket, bits) > home) {
+      return NULL; //everything from here on is homed further along
+    }
+    if(bucket_compare(db, bucket, match_rownum, hashvalue, match_val, stored_hash_size(cf), cf->type_config.hashtable.store_value, cf->start, idx) == 0) {
+      return bucket;
+    }
+  }
+  return NULL;
+}
+
+static bool robinhood_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row, uint64_t hashvalue) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const size_t               sz = bucket_size(idx->config);
+  const uint_fast8_t         bits = header->bucket.bitlevel[0].bits;
+  const uint64_t             home = btrim64(hashvalue, 64 - bits);
+  const rydb_hashbucket_t   *buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
+  rydb_hashbucket_t         *bucket, *run_end;
+  
+  //go past everything homed at or before our slot, so buckets with the same home stay in insertion order
+  bucket = hashtable_bucket(idx, sz, home);
+  while(bucket < buckets_end && !bucket_is_empty(bucket) && bucket_home(db, idx, bucket, bits) <= home) {
+    bucket = bucket_next(bucket, sz, 1);
+  }
+  run_end = bucket;
+  while(run_end < buckets_end && !bucket_is_empty(run_end)) {
+    run_end = bucket_next(run_end, sz, 1);
+  }
+  if(run_end >= buckets_end) {
+    //the run spills past the end, so it gets an overflow bucket just like plain linear probing
+    ptrdiff_t remap_offset;
+    if(!rydb_file_ensure_size(db, &idx->index, run_end - idx->index.file.start + sz, &remap_offset)) {
+      return false;
+    }
+    header = hashtable_header(idx);
+    bucket = REMAP_OFFSET(bucket, remap_offset);
+    run_end = REMAP_OFFSET(run_end, remap_offset);
+    header->bucket.count.total++; //record bucket overflow
+  }
+  if(run_end > bucket) {
+    memmove(bucket_next(bucket, sz, 1), bucket, run_end - bucket);
+    robinhood_cursors_shift(idx, hashtable_bucketnum(idx, sz, bucket), hashtable_bucketnum(idx, sz, run_end), 1);
+  }
+  bucket_write(db, idx, bucket, hashvalue, bits, row);
+  header->bucket.count.used++;
+  header->bucket.bitlevel[0].count++;
+  return true;
+}
+
+static bool robinhood_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               sz = bucket_size(cf);
+  const uint_fast8_t         bits = header->bucket.bitlevel[0].bits;
+  char                       keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  const char                *val = rydb_index_row_key(cf, row->data, keybuf);
+  const uint64_t             hashvalue = hash_value(db, idx, val);
+  const rydb_hashbucket_t   *buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
+  const rydb_hashbucket_t   *next;
+  rydb_hashbucket_t         *bucket, *run_end;
+  uint64_t                   bucketnum;
+  if((bucket = robinhood_find_bucket(db, idx, rydb_row_to_rownum(db, row), val, hashvalue)) == NULL) {
+    return false;
+  }
+  bucketnum = hashtable_bucketnum(idx, sz, bucket);
+  //cursors about to return this bucket move on to the next match instead
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    if(cur->finished || cur->state.index.typedata.hashtable.bucketnum != bucketnum) {
+      continue;
+    }
+    next = bucket_first_in_run(db, idx, bucket_next(bucket, sz, 1), buckets_end, hashvalue, val, stored_hash_size(cf), cf->type_config.hashtable.store_value, cf->start, sz, bits);
+    if(next) {
+      cur->state.index.typedata.hashtable.bucketnum = hashtable_bucketnum(idx, sz, next);
+    }
+    else {
+      cur->finished = 1;
+    }
+  }
+  //backward shift: everything after this that isn't in its home slot moves up by one
+  run_end = bucket_next(bucket, sz, 1);
+  while(run_end < buckets_end && !bucket_is_empty(run_end) && bucket_home(db, idx, run_end, bits) < hashtable_bucketnum(idx, sz, run_end)) {
+    run_end = bucket_next(run_end, sz, 1);
+  }
+  memmove(bucket, bucket_next(bucket, sz, 1), run_end - bucket - sz);
+  robinhood_cursors_shift(idx, bucketnum + 1, hashtable_bucketnum(idx, sz, run_end), -1);
+  bucket = bucket_next(run_end, sz, -1);
+#ifdef RYDB_DEBUG
+  memset(bucket, '\00', sz);
+#else
+  memset(bucket, '\00', sizeof(rydb_rownum_t));
+#endif
+  header->bucket.count.used--;
+  header->bucket.bitlevel[0].count--;
+  return true;
+}
+
+// grow by laying the whole table out again one bit wider. hashtable_load_sorted() already
+// writes every run sorted by home slot, which is exactly the Robin Hood order.
+static bool robinhood_grow_locked(rydb_t *db, rydb_index_t *idx) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               sz = bucket_size(cf);
+  const rydb_rownum_t        used = header->bucket.count.used;
+  const uint64_t             total = header->bucket.count.total;
+  rydb_hashbucket_t         *src, *bucket;
+  const rydb_hashbucket_t   *buckets_end;
+  uint64_t                  *hashes;
+  rydb_rownum_t              n = 0, rownum;
+  uint_fast8_t               bits;
+  bool                       ok;
+  
+  if((src = rydb_mem.malloc(sz * (used > 0 ? used : 1))) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to grow hashtable \"%s\"", cf->name);
+    return false;
+  }
+  if((hashes = rydb_mem.malloc(sizeof(*hashes) * (used > 0 ? used : 1))) == NULL) {
+    rydb_mem.free(src);
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to grow hashtable \"%s\"", cf->name);
+    return false;
+  }
+  for(uint64_t i = 0; i < total && n < used; i++) {
+    bucket = hashtable_bucket(idx, sz, i);
+    if(!bucket_is_empty(bucket)) {
+      memcpy(&src[n * sz], bucket, sz);
+      hashes[n++] = bucket_hash_for_bits(db, idx, bucket, header->bucket.bitlevel[0].bits + 1);
+    }
+  }
+  //cursors hang on to the row they're waiting on, and find it again once everything's been moved
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    if(!cur->finished) {
+      cur->state.index.typedata.hashtable.bucketnum = BUCKET_STORED_ROWNUM(hashtable_bucket(idx, sz, cur->state.index.typedata.hashtable.bucketnum));
+    }
+  }
+  ok = hashtable_load_sorted(db, idx, src, hashes, n, header->bucket.bitlevel[0].bits + 1, false);
+  rydb_mem.free(src);
+  rydb_mem.free(hashes);
+  
+  header = hashtable_header(idx);
+  bits = header->bucket.bitlevel[0].bits;
+  buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    if(cur->finished) {
+      continue;
+    }
+    rownum = cur->state.index.typedata.hashtable.bucketnum;
+    cur->finished = 1;
+    for(bucket = hashtable_bucket(idx, sz, btrim64(cur->state.index.typedata.hashtable.hash, 64 - bits)); bucket < buckets_end && !bucket_is_empty(bucket); bucket = bucket_next(bucket, sz, 1)) {
+      if(BUCKET_STORED_ROWNUM(bucket) == rownum) {
+        cur->state.index.typedata.hashtable.bucketnum = hashtable_bucketnum(idx, sz, bucket);
+        cur->finished = 0;
+        break;
+      }
+    }
+  }
+  return ok;
+}
+
+/*
+ * Bloom filter: one cache-line-sized block per key, picked by the key's hash, with RYDB_HASHTABLE_FILTER_PROBES
+ * bits set in it. It's sized at a byte per hashtable slot. Bits can't be cleared when a key is removed.
+ * A filter sized for a smaller table, or full of removed keys' bits, still never turns away a key that's there. It
+ * just lets more misses through. So growing the table or removing keys leaves the filter as it is, and the full
+ * rebuild happens later, from rydb_maintenance() or the next time the writer opens the database.
+ */
+static inline rydb_hashtable_filter_header_t *filter_header(const rydb_index_t *idx) {
+  return (void *)idx->filter.file.start;
+}
+
+//hashes can be as weak as nohash, so stir them up before picking bits (this is the splitmix64 finalizer)
+static inline uint64_t filter_mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+  return h ^ (h >> 31);
+}
+
+static inline uint64_t *filter_block(const rydb_index_t *idx, rydb_rownum_t blocks, uint64_t hash, uint64_t *probes) {
+  uint64_t h = filter_mix(hash);
+  *probes = filter_mix(h);
+  return (uint64_t *)&idx->filter.data.start[(h & (blocks - 1)) * RYDB_HASHTABLE_FILTER_BLOCK_SIZE];
+}
+
+static inline void filter_set(const rydb_index_t *idx, rydb_rownum_t blocks, uint64_t hash) {
+  uint64_t  probes, bit;
+  uint64_t *block = filter_block(idx, blocks, hash, &probes);
+  for(int i = 0; i < RYDB_HASHTABLE_FILTER_PROBES; i++, probes >>= 9) {
+    bit = probes & 511;
+    block[bit >> 6] |= (uint64_t )1 << (bit & 63);
+  }
+}
+
+static inline void filter_add(const rydb_index_t *idx, uint64_t hash) {
+  if(idx->filter.file.start && filter_header(idx)->blocks > 0) {
+    filter_set(idx, filter_header(idx)->blocks, hash);
+  }
+}
+
+//false means the key is definitely not in the hashtable
+static inline bool filter_may_contain(const rydb_index_t *idx, uint64_t hash) {
+  rydb_rownum_t  blocks;
+  uint64_t       probes, bit;
+  uint64_t      *block;
+  if(!idx->filter.file.start || (blocks = filter_header(idx)->blocks) == 0) {
+    return true;
+  }
+  if(idx->filter.data.start + (size_t )blocks * RYDB_HASHTABLE_FILTER_BLOCK_SIZE > idx->filter.mmap.end) {
+    return true; //the writer grew the filter past what we've got mapped
+  }
+  block = filter_block(idx, blocks, hash, &probes);
+  for(int i = 0; i < RYDB_HASHTABLE_FILTER_PROBES; i++, probes >>= 9) {
+    bit = probes & 511;
+    if(!(block[bit >> 6] & ((uint64_t )1 << (bit & 63)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline rydb_rownum_t filter_blocks_wanted(const rydb_index_t *idx) {
+  const uint_fast8_t bits = hashtable_header(idx)->bucket.bitlevel[0].bits;
+  return bits > 6 ? (rydb_rownum_t )1 << (bits - 6) : 1;
+}
+
+//the filter's been lost, the table has outgrown it, or removed keys outnumber the ones still in the table
+static inline bool filter_outdated(const rydb_index_t *idx) {
+  if(!idx->filter.file.start || hashtable_header(idx)->bucket.bitlevel[0].bits == 0) {
+    return false;
+  }
+  return filter_header(idx)->blocks < filter_blocks_wanted(idx) || filter_header(idx)->stale > hashtable_header(idx)->bucket.count.used;
+}
+
+static bool filter_build(rydb_t *db, rydb_index_t *idx) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const rydb_config_index_t *cf = idx->config;
+  const rydb_rownum_t        blocks = filter_blocks_wanted(idx);
+  const size_t               filter_sz = RYDB_INDEX_HASHTABLE_FILTER_START_OFFSET + (size_t )blocks * RYDB_HASHTABLE_FILTER_BLOCK_SIZE;
+  const rydb_hashbucket_t   *bucket;
+  size_t                     sz;
+  if(!cf->type_config.hashtable.bloom_filter) {
+    return true;
+  }
+  if(!rydb_file_ensure_size(db, &idx->filter, filter_sz, NULL) || !rydb_file_shrink_to_size(db, &idx->filter, filter_sz)) {
+    return false;
+  }
+  //foreign readers retry whatever they read while the filter was being rebuilt
+  rydb_modcount_incr(db);
+  filter_header(idx)->blocks = 0;
+  memset(idx->filter.data.start, '\00', (size_t )blocks * RYDB_HASHTABLE_FILTER_BLOCK_SIZE);
+  if(hashtable_chained(cf)) {
+    sz = chain_node_size(cf);
+    for(rydb_rownum_t n = 1; n <= chain_header(idx)->count; n++) {
+      bucket = chain_node(idx, sz, n);
+      if(!bucket_is_empty(bucket)) {
+        filter_set(idx, blocks, bucket_hash(db, idx, bucket));
+      }
+    }
+  }
+  else {
+    sz = bucket_size(cf);
+    for(uint64_t i = 0; i < header->bucket.count.total; i++) {
+      bucket = hashtable_bucket(idx, sz, i);
+      if(!bucket_is_empty(bucket)) {
+        filter_set(idx, blocks, bucket_hash(db, idx, bucket));
+      }
+    }
+  }
+  filter_header(idx)->stale = 0;
+  filter_header(idx)->blocks = blocks;
+  return true;
+}
+
+//removed keys leave their bits behind. once they make up half the filter, it's due for a rebuild
+static bool filter_removed(const rydb_index_t *idx) {
+  if(idx->filter.file.start && filter_header(idx)->blocks > 0) {
+    filter_header(idx)->stale++;
+  }
+  return true;
+}
+
+bool rydb_index_hashtable_rehash(rydb_t *db, rydb_index_t *idx, off_t last_possible_bucket, uint_fast8_t current_hashbits, int lock) {
+  rydb_hashbucket_t         *bucket;
+  size_t                     bucket_sz = bucket_size(idx->config);
+  rydb_hashbucket_t         *buckets_start = hashtable_bucket(idx, bucket_sz, 0);
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  const uint_fast8_t         store_hash = stored_hash_size(idx->config);
+  if(hashtable_chained(idx->config) || hashtable_robinhood(idx->config)) {
+    return true; //chains are already relinked, and Robin Hood tables re-laid out, as the table grows
+  }
+  rydb_stats_count(db, rehashes);
+  if(lock) hashtable_lock(header);
+  if(last_possible_bucket == 0) {
+    last_possible_bucket = header->bucket.count.total;
+  }
+  if(current_hashbits == 0 && !store_hash) {
+    current_hashbits = header->bucket.bitlevel[0].bits;
+  }
+  for(bucket = hashtable_bucket(idx, bucket_sz, last_possible_bucket - 1); bucket >= buckets_start; bucket = bucket_next(bucket, bucket_sz, -1)) {
+    if(bucket_is_empty(bucket)) {
+      continue;
+    }
+    if(store_hash) {
+      current_hashbits = bucket_stored_hash_bits(bucket, store_hash);
+    }
+    if(!bucket_rehash(db, idx, bucket, current_hashbits, 0, 1)) {
+      if(lock) hashtable_unlock(hashtable_header(idx));
+      return false;
+    }
+  }
+  if(lock) hashtable_unlock(hashtable_header(idx));
+  return true;
+}
+
+bool rydb_index_hashtable_rehash_pending(const rydb_index_t *idx) {
+  return hashtable_header(idx)->rehash.watermark > 0;
+}
+
+bool rydb_index_hashtable_maintenance_pending(const rydb_index_t *idx) {
+  return rydb_index_hashtable_rehash_pending(idx) || filter_outdated(idx);
+}
+
+//the filter rebuild is a single pass over the table, so it only starts if there's budget left over
+bool rydb_index_hashtable_maintenance(rydb_t *db, rydb_index_t *idx, uint64_t deadline_usec) {
+  bool ok;
+  if((idx->config->type_config.hashtable.rehash & RYDB_REHASH_BACKGROUND) && !rydb_index_hashtable_rehash_background(db, idx, deadline_usec)) {
+    return false;
+  }
+  if(!filter_outdated(idx) || rydb_index_hashtable_rehash_pending(idx) || rydb_clock_usec() >= deadline_usec) {
+    return true;
+  }
+  hashtable_lock(hashtable_header(idx));
+  ok = filter_build(db, idx);
+  hashtable_unlock(hashtable_header(idx));
+  return ok;
+}
+
+bool rydb_index_hashtable_rehash_background(rydb_t *db, rydb_index_t *idx, uint64_t deadline_usec) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  size_t                     bucket_sz = bucket_size(idx->config);
+  rydb_hashbucket_t         *bucket;
+  const uint_fast8_t         hash_sz = stored_hash_size(idx->config);
+  uint_fast8_t               bits, current_bits;
+  uint64_t                   hash;
+  if(header->rehash.watermark == 0) {
+    return true;
+  }
+  hashtable_lock(header);
+  while(header->rehash.watermark > 0) {
+    //foreign readers retry whatever they read while we were moving buckets around
+    rydb_modcount_incr(db);
+    for(int i = 0; i < RYDB_HASHTABLE_BACKGROUND_REHASH_SLICE && header->rehash.watermark > 0; i++) {
+      //everything above the watermark is already at the current bitlevel. buckets only ever get
+      //shifted down into the slot being emptied, so the watermark stays valid as it moves down
+      bucket = hashtable_bucket(idx, bucket_sz, --header->rehash.watermark);
+      if(bucket_is_empty(bucket)) {
+        continue;
+      }
+      current_bits = header->bucket.bitlevel[0].bits;
+      bits = bucket_stored_hash_bits(bucket, hash_sz);
+      if(bits == current_bits) {
+        continue;
+      }
+      hash = bucket_hash_for_bits(db, idx, bucket, current_bits);
+      if(btrim64(hash, 64 - bits) == btrim64(hash, 64 - current_bits)) {
+        //already where it belongs, just needs to be moved up to the current bitlevel
+        bucket_set_hash_bits(bucket, hash_sz, current_bits);
+        hashtable_bitlevel_transfer(header, bits);
+      }
+      else if(!bucket_rehash(db, idx, bucket, bits, 1, 1)) {
+        hashtable_unlock(hashtable_header(idx));
+        return false;
+      }
+      header = hashtable_header(idx); //file might have gotten remapped
+    }
+    if(rydb_clock_usec() >= deadline_usec) {
+      break;
+    }
+  }
+  hashtable_unlock(header);
+  return true;
+}
+
+static bool hashtable_grow_locked(rydb_t *db, rydb_index_t *idx) {
+  rydb_hashtable_header_t   *header = hashtable_header(idx);
+  rydb_config_index_t       *cf = idx->config;
+  uint8_t                    current_hashbits = header->bucket.bitlevel[0].bits;
+  uint64_t                   max_bucket = (1 << (current_hashbits + 1));
+  size_t                     bucket_sz = bucket_size(cf);
+  size_t                     new_data_sz = max_bucket * bucket_sz;
+  uint64_t                   prev_total_buckets = header->bucket.count.total;
+  bool                       rehash_all = cf->type_config.hashtable.rehash & RYDB_REHASH_ALL_AT_ONCE;
+  
+  rydb_stats_count(db, index_grows);
+  if(hashtable_chained(cf)) {
+    return chain_grow_locked(db, idx);
+  }
+  if(hashtable_robinhood(cf) && current_hashbits > 0) {
+    return robinhood_grow_locked(db, idx);
+  }
   if(!rydb_file_ensure_size(db, &idx->index, RYDB_INDEX_HASHTABLE_START_OFFSET + new_data_sz, NULL)) {
     return false;
   }
@@ -827,6 +1989,174 @@ static bool hashtable_grow_locked(rydb_t *db, rydb_index_t *idx) {
   if(current_hashbits>0 && rehash_all) {
     rydb_index_hashtable_rehash(db, idx, prev_total_buckets, current_hashbits, 0);
   }
+  else if(current_hashbits>0 && (cf->type_config.hashtable.rehash & RYDB_REHASH_BACKGROUND)) {
+    //everything that was in the table before it grew is now a step behind
+    header->rehash.watermark = prev_total_buckets;
+  }
+  return true;
+}
+
+//smallest table that fits n buckets under the max load factor
+//0 if n rows won't fit under load_factor_max in the biggest table there can be
+static uint_fast8_t hashtable_bits_for_count(const rydb_config_index_t *cf, rydb_rownum_t n) {
+  uint_fast8_t bits = 1;
+  while((double )((uint64_t )1 << bits) * cf->type_config.hashtable.load_factor_max < n) {
+    if(++bits > RYDB_HASHTABLE_MAX_BITS) {
+      return 0;
+    }
+  }
+  return bits;
+}
+
+// lay out n buckets from src into a freshly-sized table in a single sequential pass.
+// hashes[] are the buckets' full hashes. the buckets are counting-sorted by their home slot first,
+// so that linear probing becomes a matter of writing each bucket at max(home, previous + 1).
+// with check_unique, duplicate keys are caught after the sort, before the table is touched.
+static bool hashtable_load_sorted(rydb_t *db, rydb_index_t *idx, const rydb_hashbucket_t *src, const uint64_t *hashes, rydb_rownum_t n, uint_fast8_t bits, bool check_unique) {
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               bucket_sz = bucket_size(cf);
+  const uint64_t             slots = (uint64_t )1 << bits;
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
+  rydb_hashtable_header_t   *header;
+  rydb_rownum_t             *order;
+  uint64_t                   home, pos, total;
+  rydb_hashbucket_t         *bucket;
+  
+  if((order = hashtable_sort_by_home(db, cf, hashes, n, bits)) == NULL) {
+    return false;
+  }
+  if(check_unique && !hashtable_sorted_unique(db, idx, src, bucket_sz, hashes, order, n, bits)) {
+    rydb_mem.free(order);
+    return false;
+  }
+  
+  //where does the overflow end?
+  pos = 0;
+  for(rydb_rownum_t i = 0; i < n; i++) {
+    home = btrim64(hashes[order[i]], 64 - bits);
+    pos = (pos > home ? pos : home) + 1;
+  }
+  total = pos > slots ? pos : slots;
+  
+  if(!rydb_file_ensure_size(db, &idx->index, RYDB_INDEX_HASHTABLE_START_OFFSET + total * bucket_sz, NULL)) {
+    rydb_mem.free(order);
+    return false;
+  }
+  if(!rydb_file_shrink_to_size(db, &idx->index, RYDB_INDEX_HASHTABLE_START_OFFSET + total * bucket_sz)) {
+    rydb_mem.free(order);
+    return false;
+  }
+  idx->index.data.end = idx->index.file.end;
+  header = hashtable_header(idx);
+  memset(idx->index.data.start, '\00', total * bucket_sz);
+  
+  pos = 0;
+  for(rydb_rownum_t i = 0; i < n; i++) {
+    home = btrim64(hashes[order[i]], 64 - bits);
+    if(pos < home) {
+      pos = home;
+    }
+    bucket = hashtable_bucket(idx, bucket_sz, pos++);
+    memcpy(bucket, &src[order[i] * bucket_sz], bucket_sz);
+    if(hash_sz) {
+      bucket_set_hash_bits(bucket, hash_sz, bits);
+    }
+  }
+  rydb_mem.free(order);
+  
+  header->bucket.count.bitlevels = 1;
+  header->bucket.bitlevel[0].bits = bits;
+  header->bucket.bitlevel[0].count = n;
+  header->bucket.count.used = n;
+  header->bucket.count.total = total;
+  header->bucket.count.load_factor_max = total * cf->type_config.hashtable.load_factor_max;
+  header->rehash.watermark = 0;
+  return true;
+}
+
+bool rydb_index_hashtable_build(rydb_t *db, rydb_index_t *idx) {
+  const rydb_config_index_t *cf = idx->config;
+  const size_t               bucket_sz = bucket_entry_size(cf);
+  const uint16_t             row_sz = db->stored_row_size;
+  const rydb_rownum_t        max = db->data_next_rownum - 1;
+  const rydb_stored_row_t   *endrow = rydb_rownum_to_row(db, db->data_next_rownum);
+  rydb_hashbucket_t         *src;
+  uint64_t                  *hashes;
+  rydb_rownum_t              n = 0;
+  uint_fast8_t               bits;
+  bool                       ok;
+  
+  rydb_stats_count(db, index_builds);
+  if((src = rydb_mem.malloc(bucket_sz * (max > 0 ? max : 1))) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to build hashtable \"%s\"", cf->name);
+    return false;
+  }
+  if((hashes = rydb_mem.malloc(sizeof(*hashes) * (max > 0 ? max : 1))) == NULL) {
+    rydb_mem.free(src);
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory to build hashtable \"%s\"", cf->name);
+    return false;
+  }
+  
+  //one pass over the data to hash everything
+  for(rydb_stored_row_t *row = rydb_rownum_to_row(db, 1); row < endrow; row = rydb_row_next(row, row_sz, 1)) {
+    if(row->type != RYDB_ROW_DATA || !rydb_index_covers_row(cf, row->data)) {
+      continue;
+    }
+    hashes[n] = row_hash_value(db, idx, row->data);
+    bucket_write(db, idx, &src[n * bucket_sz], hashes[n], 0, row);
+    n++;
+  }
+  
+  if((bits = hashtable_bits_for_count(cf, n)) == 0) {
+    rydb_mem.free(src);
+    rydb_mem.free(hashes);
+    rydb_set_error(db, RYDB_ERROR_DATA_TOO_LARGE, "Too many rows for hashtable \"%s\" at load_factor_max %f", cf->name, cf->type_config.hashtable.load_factor_max);
+    return false;
+  }
+  
+  //whatever cursors were on this index are pointing at buckets that are about to move
+  for(rydb_cursor_t *cur = idx->cursor; cur != NULL; cur = cur->next) {
+    cur->finished = 1;
+  }
+  
+  hashtable_lock(hashtable_header(idx));
+  if(hashtable_chained(cf)) {
+    ok = chain_load(db, idx, src, hashes, n, bits, cf->flags & RYDB_INDEX_UNIQUE);
+  }
+  else {
+    ok = hashtable_load_sorted(db, idx, src, hashes, n, bits, cf->flags & RYDB_INDEX_UNIQUE);
+  }
+  if(ok) {
+    ok = filter_build(db, idx);
+  }
+  if(ok) {
+    hashtable_header(idx)->version = RYDB_HASHTABLE_HEADER_VERSION;
+    hashtable_header(idx)->active = 1;
+  }
+  hashtable_unlock(hashtable_header(idx));
+  
+  rydb_mem.free(src);
+  rydb_mem.free(hashes);
+  return ok;
+}
+
+bool rydb_index_hashtable_activate(rydb_t *db, rydb_index_t *idx) {
+  if(hashtable_header(idx)->active && hashtable_header(idx)->version == RYDB_HASHTABLE_HEADER_VERSION) {
+    //a lost or outdated filter can always be rebuilt from the index
+    if(filter_outdated(idx)) {
+      hashtable_lock(hashtable_header(idx));
+      bool ok = filter_build(db, idx);
+      hashtable_unlock(hashtable_header(idx));
+      return ok;
+    }
+    return true;
+  }
+  //an index file with an older header can't be trusted to mean what this version thinks it does
+  if(db->data_next_rownum > 1) {
+    return rydb_index_hashtable_build(db, idx);
+  }
+  hashtable_header(idx)->version = RYDB_HASHTABLE_HEADER_VERSION;
+  hashtable_header(idx)->active = 1;
   return true;
 }
 
@@ -834,6 +2164,7 @@ bool rydb_index_hashtable_open(rydb_t *db,  rydb_index_t *idx) {
   rydb_config_index_t  *cf = idx->config;
   
   assert(cf->type == RYDB_INDEX_HASHTABLE);
+  hashtable_kernels_init(idx);
   if(!rydb_file_open_index(db, idx)) {
     return false;
   }
@@ -844,19 +2175,44 @@ bool rydb_index_hashtable_open(rydb_t *db,  rydb_index_t *idx) {
   rydb_hashtable_header_t *header = hashtable_header(idx);
   
   if(!header->active) {
-    //write out header
-    header->active = 1;
+    //write out header. it's marked active once it's been built from the data (see rydb_index_hashtable_activate())
     header->bucket.count.bitlevels = 1;
   }
+  else if(header->version > RYDB_HASHTABLE_HEADER_VERSION) {
+    rydb_set_error(db, RYDB_ERROR_FILE_INVALID, "Index \"%s\" header version %"PRIu8" is newer than this version of RyDB supports (%i)", cf->name, header->version, RYDB_HASHTABLE_HEADER_VERSION);
+    return false;
+  }
+  if(cf->type_config.hashtable.bloom_filter) {
+    if(!rydb_file_open_index_filter(db, idx)) {
+      rydb_file_close_index(db, idx);
+      return false;
+    }
+    if(!rydb_file_ensure_size(db, &idx->filter, RYDB_INDEX_HASHTABLE_FILTER_START_OFFSET, NULL)) {
+      rydb_file_close_filter(db, idx);
+      rydb_file_close_index(db, idx);
+      return false;
+    }
+    idx->filter.data.start = idx->filter.file.start + RYDB_INDEX_HASHTABLE_FILTER_START_OFFSET;
+  }
   switch(cf->type_config.hashtable.collision_resolution) {
     case RYDB_OPEN_ADDRESSING:
+    case RYDB_ROBIN_HOOD:
       if(!rydb_file_open_index_map(db, idx)) {
         rydb_file_close_index(db, idx);
         return false;
       }
       return true;
     case RYDB_SEPARATE_CHAINING:
-    //do nothing
+      if(!rydb_file_open_index_map(db, idx)) {
+        rydb_file_close_index(db, idx);
+        return false;
+      }
+      if(!rydb_file_ensure_size(db, &idx->map, RYDB_INDEX_HASHTABLE_CHAIN_START_OFFSET, NULL)) {
+        rydb_file_close_map(db, idx);
+        rydb_file_close_index(db, idx);
+        return false;
+      }
+      idx->map.data.start = idx->map.file.start + RYDB_INDEX_HASHTABLE_CHAIN_START_OFFSET;
       return true;
   }
   //we shouldn't be here
@@ -865,23 +2221,33 @@ bool rydb_index_hashtable_open(rydb_t *db,  rydb_index_t *idx) {
 static rydb_hashbucket_t *hashtable_find_bucket(const rydb_t *db, const rydb_index_t *idx, rydb_rownum_t match_rownum,  const char *match_val, int_fast8_t *bitlevel_n, uint64_t *hashvalue_ptr) {
   rydb_hashtable_header_t   *header = hashtable_header(idx);
   const rydb_config_index_t *cf = idx->config;
-  const uint64_t             hashvalue = hash_value(db, cf, match_val, 0);
+  const uint64_t             hashvalue = hash_value(db, idx, match_val);
   uint64_t                   current_level_hashvalue;
   rydb_hashbucket_t         *bucket;
   const size_t               bucket_sz = bucket_size(cf);
   const rydb_hashbucket_t   *buckets_end = hashtable_bucket(idx, bucket_sz, header->bucket.count.total);
-  const uint_fast8_t         store_hash = cf->type_config.hashtable.store_hash;
+  const uint_fast8_t         hash_sz = stored_hash_size(cf);
   const uint_fast8_t         store_value = cf->type_config.hashtable.store_value;
   const off_t                data_start = cf->start;
-  const off_t                data_len = cf->len;
   int_fast8_t                bitlevel_count = -1;
   if(hashvalue_ptr) *hashvalue_ptr = hashvalue;
+  if(!filter_may_contain(idx, hashvalue)) {
+    return NULL;
+  }
+  if(hashtable_chained(cf)) {
+    if(bitlevel_n) *bitlevel_n = -1;
+    return chain_find_node(db, idx, match_rownum, match_val, hashvalue, NULL);
+  }
+  if(hashtable_robinhood(cf)) {
+    if(bitlevel_n) *bitlevel_n = -1;
+    return robinhood_find_bucket(db, idx, match_rownum, match_val, hashvalue);
+  }
 
   for(uint_fast8_t i=0, max = header->bucket.count.bitlevels; i<max; i++) {
     current_level_hashvalue = btrim64(hashvalue, 64 - header->bucket.bitlevel[i].bits);
     bucket = hashtable_bucket(idx, bucket_sz, current_level_hashvalue);
     while(bucket < buckets_end && !bucket_is_empty(bucket)) {
-      if(bucket_compare(db, bucket, match_rownum, hashvalue, match_val, store_hash, store_value, data_start, data_len) == 0) {
+      if(bucket_compare(db, bucket, match_rownum, hashvalue, match_val, hash_sz, store_value, data_start, idx) == 0) {
         if(bitlevel_n) *bitlevel_n = bitlevel_count;
         return bucket;
       }
@@ -930,7 +2296,7 @@ bool rydb_index_hashtable_find_row(rydb_t *db, rydb_index_t *idx, const char *va
     hashtable_lock(hashtable_header(idx));
     DBG("let's rehash!\n")
     DBG_HASHTABLE(db, idx)
-    bucket_rehash(db, idx, bucket, bucket_stored_hash_bits(bucket), 1, 1);
+    bucket_rehash(db, idx, bucket, bucket_stored_hash_bits(bucket, stored_hash_size(idx->config)), 1, 1);
     DBG("after rehash\n")
     DBG_HASHTABLE(db, idx)
     hashtable_unlock(hashtable_header(idx));
@@ -938,10 +2304,30 @@ bool rydb_index_hashtable_find_row(rydb_t *db, rydb_index_t *idx, const char *va
   return true;
 }
 
+//the covered bytes come right after the stored value
+bool rydb_index_hashtable_find_covered(rydb_t *db, rydb_index_t *idx, const char *val, char *covered, rydb_rownum_t *rownum) {
+  const rydb_config_index_t *cf = idx->config;
+  rydb_hashbucket_t         *bucket;
+  if((bucket = hashtable_find_bucket(db, idx, 0, val, NULL, NULL)) == NULL || bucket_is_empty(bucket)) {
+    return false;
+  }
+  if(rownum) {
+    *rownum = BUCKET_STORED_ROWNUM(bucket);
+  }
+  memcpy(covered, bucket_data(NULL, bucket, stored_hash_size(cf), 1, cf->start) + cf->len, cf->type_config.hashtable.cover_len);
+  return true;
+}
+
+//an update here has to rewrite the row's bucket
+bool rydb_index_hashtable_covered_in_range(const rydb_config_index_t *cf, off_t start, off_t end) {
+  const uint16_t cover_start = cf->type_config.hashtable.cover_start;
+  return cf->type_config.hashtable.cover_len > 0 && start < cover_start + cf->type_config.hashtable.cover_len && end > cover_start;
+}
+
 bool rydb_index_hashtable_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
   rydb_hashtable_header_t   *header = hashtable_header(idx);
   const rydb_config_index_t *cf = idx->config;
-  const uint64_t             hashvalue = hash_value(db, cf, &row->data[cf->start], 0);
+  const uint64_t             hashvalue = row_hash_value(db, idx, row->data);
   
   DBG_HASHTABLE(db, idx)
   if(header->bucket.count.used+1 > header->bucket.count.load_factor_max) {
@@ -949,6 +2335,17 @@ bool rydb_index_hashtable_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_sto
       return false;
     }
     header = hashtable_header(idx); //file might have gotten remapped, get the header again
+    //an empty table's filter costs nothing to build. after that, resizing it waits for rydb_maintenance()
+    if(header->bucket.count.used == 0 && !filter_build(db, idx)) {
+      return false;
+    }
+  }
+  filter_add(idx, hashvalue);
+  if(hashtable_chained(cf)) {
+    return chain_add_row_locked(db, idx, row, hashvalue);
+  }
+  if(hashtable_robinhood(cf)) {
+    return robinhood_add_row_locked(db, idx, row, hashvalue);
   }
 
   DBG("adding rownum %"RYPRIrn" bits: %"PRIu8 " hashvalue %"PRIu64" trimmed to %"PRIu64" str: \"%.*s\"\n", rydb_row_to_rownum(db, row), header->bucket.bitlevel[0].bits, hashvalue, btrim64(hashvalue, 64 - header->bucket.bitlevel[0].bits), cf->len, &row->data[cf->start])
@@ -964,11 +2361,9 @@ bool rydb_index_hashtable_add_row_locked(rydb_t *db, rydb_index_t *idx, rydb_sto
   while(bucket < buckets_end && !bucket_is_empty(bucket)) {
     if(try_to_rehash) {
       DBG("try to rehash...")
-      uint_fast8_t  rehash_candidate_bits;
-      uint64_t rehash_candidate_hashvalue = bucket_stored_hash58_and_bits(bucket, &rehash_candidate_bits);
-      uint64_t old_bitlevel_hashvalue = btrim64(rehash_candidate_hashvalue, 64 - rehash_candidate_bits);
+      uint_fast8_t  rehash_candidate_bits = bucket_stored_hash_bits(bucket, stored_hash_size(cf));
       if(rehash_candidate_bits != current_bits
-        && old_bitlevel_hashvalue != btrim64(rehash_candidate_hashvalue, 64 - current_bits)) {
+        && bucket_home(db, idx, bucket, rehash_candidate_bits) != bucket_home(db, idx, bucket, current_bits)) {
         //this bucket should be rehashed!
         DBG("rehash bucket on add_row\n")
         DBG_HASHTABLE(db, idx)
@@ -1027,35 +2422,56 @@ bool rydb_index_hashtable_add_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row
   return ret;
 }
 
-const rydb_hashbucket_t *cursor_step(rydb_cursor_t *cur) {
+typedef struct {
+  rydb_hashtable_header_t  *header;
+  const rydb_hashtable_bitlevel_count_t *bitlevels;
+  size_t                    sz;
+  const rydb_hashbucket_t  *buckets_end;
+  uint_fast8_t              hash_sz;
+  uint_fast8_t              store_value;
+  off_t                     data_start;
+  uint_fast8_t              robinhood_bits;
+} hashtable_cursor_setup_t;
+
+//everything a cursor step needs that doesn't change between steps
+static inline void cursor_setup(const rydb_cursor_t *cur, hashtable_cursor_setup_t *setup) {
+  const rydb_config_index_t *cf = cur->state.index.config;
+  const rydb_index_t        *idx = cur->state.index.idx;
+  setup->header = hashtable_header(idx);
+  setup->bitlevels = setup->header->bucket.bitlevel;
+  setup->sz = bucket_size(cf);
+  setup->buckets_end = hashtable_bucket(idx, setup->sz, setup->header->bucket.count.total);
+  setup->hash_sz = stored_hash_size(cf);
+  setup->store_value = cf->type_config.hashtable.store_value;
+  setup->data_start = cf->start;
+  setup->robinhood_bits = hashtable_robinhood(cf) ? setup->header->bucket.bitlevel[0].bits : 0;
+}
+
+static const rydb_hashbucket_t *cursor_step_with_setup(rydb_cursor_t *cur, const hashtable_cursor_setup_t *setup) {
   rydb_t                   *db = cur->db;
-  rydb_config_index_t      *cf = cur->state.index.config;
-  rydb_hashtable_header_t  *header = hashtable_header(cur->state.index.idx);
   rydb_index_t             *idx = cur->state.index.idx;
   int_fast8_t              *lvl = &cur->state.index.typedata.hashtable.bitlevel;
-  const rydb_hashtable_bitlevel_count_t *bitlevels = header->bucket.bitlevel;
-  size_t                    sz = bucket_size(cf);
+  const rydb_hashtable_bitlevel_count_t *bitlevels = setup->bitlevels;
+  const size_t              sz = setup->sz;
   uint64_t                  hashvalue;
   rydb_hashbucket_t        *bucket, *retbucket;
-  const rydb_hashbucket_t  *buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
-  const uint_fast8_t        store_hash = cf->type_config.hashtable.store_hash;
-  const uint_fast8_t        store_value = cf->type_config.hashtable.store_value;
-  const off_t               data_start = cf->start;
-  const off_t               data_len = cf->len;
+  const rydb_hashbucket_t  *buckets_end = setup->buckets_end;
+  const uint_fast8_t        hash_sz = setup->hash_sz;
+  const uint_fast8_t        store_value = setup->store_value;
+  const off_t               data_start = setup->data_start;
   const char               *val;
   DBG_HASHTABLE(db, idx)
   if(cur->step == 0) {
-    cur->state.index.typedata.hashtable.bitlevel = header->bucket.count.bitlevels-1;
-    val = rydb_overlay_data_on_row_for_index(db, db->index_scratch_buffer, 0, NULL, cur->data, data_start, data_start + cur->len, data_start, data_start + data_len);
-    hashvalue = hash_value(cur->db, cf, val, 0);
+    val = rydb_index_search_value(db->index_scratch_buffer, cur->state.index.config, cur->data, cur->len);
+    hashvalue = hash_value(cur->db, idx, val);
     cur->state.index.typedata.hashtable.hash = hashvalue;
-    cur->state.index.typedata.hashtable.bitlevel = header->bucket.count.bitlevels - 1;
+    cur->state.index.typedata.hashtable.bitlevel = setup->header->bucket.count.bitlevels - 1;
     bucket = hashtable_bucket(idx, sz, btrim64(hashvalue, 64 - bitlevels[*lvl].bits));
     retbucket = NULL;
   }
   else {
     retbucket = hashtable_bucket(idx, sz, cur->state.index.typedata.hashtable.bucketnum);
-    val = bucket_data(db, retbucket, store_hash, store_value, data_start);
+    val = cursor_match_value(cur, retbucket, hash_sz, store_value);
     bucket = bucket_next(retbucket, sz, 1);
     hashvalue = cur->state.index.typedata.hashtable.hash;
   }
@@ -1063,7 +2479,7 @@ const rydb_hashbucket_t *cursor_step(rydb_cursor_t *cur) {
   while(*lvl >= 0) {
     cur->step++;
     if(bucket < buckets_end) {
-      bucket = (rydb_hashbucket_t *)bucket_first_in_run(db, bucket, buckets_end, hashvalue, val, store_hash, store_value, data_start, data_len, sz);
+      bucket = (rydb_hashbucket_t *)bucket_first_in_run(db, idx, bucket, buckets_end, hashvalue, val, hash_sz, store_value, data_start, sz, setup->robinhood_bits);
       if(bucket) {
         cur->state.index.typedata.hashtable.bucketnum = hashtable_bucketnum(idx, sz, bucket);
         return retbucket;
@@ -1089,6 +2505,15 @@ const rydb_hashbucket_t *cursor_step(rydb_cursor_t *cur) {
   return retbucket;
 }
 
+const rydb_hashbucket_t *cursor_step(rydb_cursor_t *cur) {
+  hashtable_cursor_setup_t setup;
+  if(hashtable_chained(cur->state.index.config)) {
+    return chain_cursor_step(cur);
+  }
+  cursor_setup(cur, &setup);
+  return cursor_step_with_setup(cur, &setup);
+}
+
 bool rydb_hashtable_cursor_init(rydb_cursor_t *cur) {
   cursor_step(cur);
   return true;
@@ -1103,6 +2528,31 @@ rydb_rownum_t rydb_hashtable_cursor_next(rydb_cursor_t *cur) {
   return BUCKET_STORED_ROWNUM(bucket);
 }
 
+size_t rydb_hashtable_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max) {
+  rydb_t                    *db = cur->db;
+  hashtable_cursor_setup_t   setup;
+  const rydb_hashbucket_t   *bucket;
+  size_t                     n = 0;
+  if(hashtable_chained(cur->state.index.config)) {
+    while(n < max && !cur->finished) {
+      if((bucket = chain_cursor_step(cur)) == NULL) {
+        break;
+      }
+      rydb_storedrow_to_row(db, rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket)), &rows[n++]);
+    }
+    return n;
+  }
+  //nothing is written to the index while we step, so the setup stays valid for the whole batch
+  cursor_setup(cur, &setup);
+  while(n < max && !cur->finished) {
+    if((bucket = cursor_step_with_setup(cur, &setup)) == NULL) {
+      break;
+    }
+    rydb_storedrow_to_row(db, rydb_rownum_to_row(db, BUCKET_STORED_ROWNUM(bucket)), &rows[n++]);
+  }
+  return n;
+}
+
 void rydb_hashtable_cursors_update(UNUSED(const rydb_t *db), const rydb_index_t *idx, const rydb_hashbucket_t *bucket, const rydb_hashbucket_t *dst, uint_fast8_t old_bits, uint_fast8_t new_bits) {
   size_t   sz = bucket_size(idx->config);
   uint64_t bucketnum = hashtable_bucketnum(idx, sz, bucket);
@@ -1124,8 +2574,15 @@ void rydb_hashtable_cursors_update(UNUSED(const rydb_t *db), const rydb_index_t
 bool rydb_index_hashtable_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
   DBG("remove row\n")
   DBG_HASHTABLE(db, idx)
+  if(hashtable_chained(idx->config)) {
+    return chain_remove_row_locked(db, idx, row) && filter_removed(idx);
+  }
+  if(hashtable_robinhood(idx->config)) {
+    return robinhood_remove_row_locked(db, idx, row) && filter_removed(idx);
+  }
   rydb_rownum_t             rownum_to_remove = rydb_row_to_rownum(db, row);
-  rydb_hashbucket_t        *bucket = hashtable_find_bucket(db, idx, rownum_to_remove, &row->data[idx->config->start], NULL, NULL);
+  char                      keybuf[RYDB_INDEX_COMPOSITE_KEY_MAX];
+  rydb_hashbucket_t        *bucket = hashtable_find_bucket(db, idx, rownum_to_remove, rydb_index_row_key(idx->config, row->data, keybuf), NULL, NULL);
   if(!bucket) {
     DBG("bucket ain't here\n")
     return false;
@@ -1135,7 +2592,7 @@ bool rydb_index_hashtable_remove_row_locked(rydb_t *db, rydb_index_t *idx, rydb_
   const rydb_hashbucket_t   *buckets_end = hashtable_bucket(idx, bucket_sz, header->bucket.count.total);
   
   bucket_remove(db, idx, header, bucket, buckets_end, bucket_sz, 1);
-  return true;
+  return filter_removed(idx);
 }
 bool rydb_index_hashtable_remove_row(rydb_t *db, rydb_index_t *idx, rydb_stored_row_t *row) {
   hashtable_lock(hashtable_header(idx));
@@ -1145,9 +2602,116 @@ bool rydb_index_hashtable_remove_row(rydb_t *db, rydb_index_t *idx, rydb_stored_
 }
 
 
+/*
+ * health report. the counts are all in the header, but the probe runs mean looking at the buckets. that's a
+ * straight walk through memory with no hashing, and past RYDB_INDEX_STATS_SAMPLE_WINDOWS windows' worth of
+ * buckets, only that many evenly-spaced windows get walked.
+ */
+#define RYDB_INDEX_STATS_SAMPLE_WINDOWS 64
+#define RYDB_INDEX_STATS_SAMPLE_WINDOW_SIZE 1024
+
+static void stats_add_run(rydb_index_stats_t *st, uint64_t len) {
+  st->probe.runs++;
+  st->probe.rows += len;
+  if(len > st->probe.longest) {
+    st->probe.longest = len;
+  }
+  st->probe.length[(len < RYDB_INDEX_STATS_RUN_LENGTHS ? len : RYDB_INDEX_STATS_RUN_LENGTHS) - 1]++;
+}
+
+//runs that start in [first, last). one that's already going at first belongs to the window before
+static uint64_t stats_scan_buckets(const rydb_index_t *idx, rydb_index_stats_t *st, size_t sz, uint64_t first, uint64_t last, uint64_t end) {
+  uint64_t i = first, len;
+  if(first > 0 && !bucket_is_empty(hashtable_bucket(idx, sz, first - 1))) {
+    while(i < last && !bucket_is_empty(hashtable_bucket(idx, sz, i))) {
+      i++;
+    }
+  }
+  while(i < last) {
+    if(bucket_is_empty(hashtable_bucket(idx, sz, i))) {
+      i++;
+      continue;
+    }
+    for(len = 0; i < end && !bucket_is_empty(hashtable_bucket(idx, sz, i)); i++) {
+      len++;
+    }
+    stats_add_run(st, len);
+  }
+  return i - first;
+}
+
+static uint64_t stats_scan_chains(const rydb_index_t *idx, rydb_index_stats_t *st, uint64_t first, uint64_t last, uint64_t max_len) {
+  const size_t   node_sz = chain_node_size(idx->config);
+  const uint64_t nodes = (idx->map.file.end - idx->map.data.start) / node_sz;
+  uint64_t       len;
+  for(uint64_t slot = first; slot < last; slot++) {
+    len = 0;
+    //nodes a writer added since we last mapped the file aren't ours to look at
+    for(rydb_rownum_t n = *chain_head(idx, slot); n != 0 && n <= nodes && len < max_len; n = *chain_node_next(chain_node(idx, node_sz, n), node_sz)) {
+      len++;
+    }
+    if(len > 0) {
+      stats_add_run(st, len);
+    }
+  }
+  return last - first;
+}
+
+void rydb_index_hashtable_stats(const rydb_index_t *idx, rydb_index_stats_t *st) {
+  const rydb_hashtable_header_t *header = hashtable_header(idx);
+  const rydb_config_index_t     *cf = idx->config;
+  const bool                     chained = hashtable_chained(cf);
+  const size_t                   sz = chained ? sizeof(rydb_rownum_t) : bucket_size(cf);
+  const uint64_t                 total = header->bucket.count.total;
+  uint64_t                       end, step;
+  
+  memset(st, '\0', sizeof(*st));
+  st->rows = header->bucket.count.used;
+  st->buckets = (uint64_t )1 << header->bucket.bitlevel[0].bits;
+  if(!chained && total > st->buckets) {
+    st->overflow_buckets = total - st->buckets;
+  }
+  st->load_factor = (double )st->rows / st->buckets;
+  st->load_factor_max = cf->type_config.hashtable.load_factor_max;
+  if(header->bucket.count.load_factor_max > st->rows) {
+    st->rows_until_grow = header->bucket.count.load_factor_max - st->rows;
+  }
+  st->bitlevel_count = header->bucket.count.bitlevels;
+  for(int i = 0; i < header->bucket.count.bitlevels && i < (int )RYDB_HASHTABLE_BUCKET_MAX_BITLEVELS; i++) {
+    st->bitlevel[i].bits = header->bucket.bitlevel[i].bits;
+    st->bitlevel[i].rows = header->bucket.bitlevel[i].count;
+  }
+  if(!chained && !hashtable_robinhood(cf)) {
+    //chains are relinked and Robin Hood tables laid out again as they grow, so only these ever need a rehash
+    st->rehash.rows = st->rows - st->bitlevel[0].rows;
+    st->rehash.bytes = total * sz;
+    st->rehash.pending = header->rehash.watermark;
+  }
+  
+  //buckets a writer appended since we last mapped the file aren't ours to look at
+  end = (idx->index.file.end - idx->index.data.start) / sz;
+  if(end > total) {
+    end = total;
+  }
+  if(end <= RYDB_INDEX_STATS_SAMPLE_WINDOWS * RYDB_INDEX_STATS_SAMPLE_WINDOW_SIZE) {
+    st->probe.scanned = chained ? stats_scan_chains(idx, st, 0, end, st->rows) : stats_scan_buckets(idx, st, sz, 0, end, end);
+    return;
+  }
+  step = end / RYDB_INDEX_STATS_SAMPLE_WINDOWS;
+  for(uint64_t first = 0; first + RYDB_INDEX_STATS_SAMPLE_WINDOW_SIZE <= end; first += step) {
+    uint64_t last = first + RYDB_INDEX_STATS_SAMPLE_WINDOW_SIZE;
+    st->probe.scanned += chained ? stats_scan_chains(idx, st, first, last, st->rows) : stats_scan_buckets(idx, st, sz, first, last, end);
+  }
+}
+
 void rydb_bucket_print(const rydb_index_t *idx, const rydb_hashbucket_t *bucket) {
   rydb_config_index_t *cf = idx->config;
-  rydb_printf("  %p [%3"PRIu64"] ", (void *)bucket, (uint64_t )hashtable_bucketnum(idx, bucket_size(idx->config), bucket));
+  if(hashtable_chained(cf)) {
+    rydb_printf("  %p (%3"RYPRIrn") ", (void *)bucket, chain_node_num(idx, chain_node_size(cf), bucket));
+  }
+  else {
+    rydb_printf("  %p [%3"PRIu64"] ", (void *)bucket, (uint64_t )hashtable_bucketnum(idx, bucket_size(idx->config), bucket));
+  }
   if(bucket_is_empty(bucket)) {
     rydb_printf("<EMPTY> ");
   }
@@ -1156,12 +2720,12 @@ void rydb_bucket_print(const rydb_index_t *idx, const rydb_hashbucket_t *bucket)
   }
   if(cf->type_config.hashtable.store_hash) {
     uint_fast8_t bits;
-    uint64_t storedhash = bucket_stored_hash58_and_bits(bucket, &bits);
+    uint64_t storedhash = bucket_stored_hash_and_bits(bucket, stored_hash_size(cf), &bits);
     uint64_t trimmed_storedhash = btrim64(storedhash, 64 - bits);
     rydb_printf("%.2"PRIu8":%.18"PRIu64"[%.2"PRIu64"] ", bits, storedhash, trimmed_storedhash);
   }
   if(cf->type_config.hashtable.store_value) {
-    const char *data = bucket_data(NULL, bucket, cf->type_config.hashtable.store_hash, 1, cf->start);
+    const char *data = bucket_data(NULL, bucket, stored_hash_size(cf), 1, cf->start);
     rydb_printf("\"%.*s\"", cf->len, data);
   }
   rydb_printf("\n");
@@ -1198,6 +2762,16 @@ void rydb_hashtable_print(const rydb_t *db, const rydb_index_t *idx) {
     rydb_printf("           %4d: bits: %2"PRIu8" n: %"PRIu32"\n", i+1, header->bucket.bitlevel[i].bits, header->bucket.bitlevel[i].count);
   }
   
+  if(hashtable_chained(idx->config)) {
+    size_t node_sz = chain_node_size(idx->config);
+    for(uint64_t slot = 0; slot < header->bucket.count.total; slot++) {
+      rydb_printf("  [%3"PRIu64"]\n", slot);
+      for(rydb_rownum_t n = *chain_head(idx, slot); n != 0; n = *chain_node_next(chain_node(idx, node_sz, n), node_sz)) {
+        rydb_bucket_print(idx, chain_node(idx, node_sz, n));
+      }
+    }
+    return;
+  }
   rydb_hashbucket_t         *bucket = hashtable_bucket(idx, sz, 0);
   rydb_hashbucket_t         *buckets_end = hashtable_bucket(idx, sz, header->bucket.count.total);
   for(int i = 0; bucket < buckets_end; i++) {
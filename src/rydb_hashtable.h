@@ -3,7 +3,11 @@
 #include "rydb.h"
 
 #define RYDB_HASHTABLE_DEFAULT_MAX_LOAD_FACTOR 0.60
+#define RYDB_HASHTABLE_ROBIN_HOOD_DEFAULT_MAX_LOAD_FACTOR 0.90
+#define RYDB_HASHTABLE_COMPACT_HASH_BITS 26 //low hash bits kept in a compact stored hash. the other 6 hold the bitlevel
 #define RYDB_HASHTABLE_DEFAULT_REHASH_FLAGS RYDB_REHASH_INCREMENTAL
+#define RYDB_HASHTABLE_BACKGROUND_REHASH_SLICE 64 //buckets rehashed between deadline checks
+#define RYDB_HASHTABLE_MAX_BITS (8 * sizeof(rydb_rownum_t) - 1) //bucket counts have to fit in a rydb_rownum_t
 
 typedef struct {
   rydb_rownum_t count;
@@ -11,11 +15,13 @@ typedef struct {
   /* whoa that's a lot of padding at the end there here...*/
 }rydb_hashtable_bitlevel_count_t;
 
-#define RYDB_HASHTABLE_BUCKET_MAX_BITLEVELS (4*sizeof(rydb_rownum_t) + 1)
+#define RYDB_HASHTABLE_BUCKET_MAX_BITLEVELS RYDB_INDEX_STATS_BITLEVELS_MAX
+#define RYDB_HASHTABLE_HEADER_VERSION 1 //bump when the header layout changes. 0 is from before the background rehash watermark
 
 typedef struct {
   AO_t            writelock;
   uint8_t         active;
+  uint8_t         version; //RYDB_HASHTABLE_HEADER_VERSION. the writer rebuilds the index from the data file on a mismatch
   struct {
     struct {
       rydb_rownum_t   total;
@@ -25,12 +31,32 @@ typedef struct {
     }               count;
     rydb_hashtable_bitlevel_count_t bitlevel[RYDB_HASHTABLE_BUCKET_MAX_BITLEVELS];
   }               bucket;
+  struct {
+    rydb_rownum_t   watermark; //background rehash works down from here. 0 means nothing left to do
+  }               rehash;
 } rydb_hashtable_header_t;
 
+//separate chaining keeps its chain nodes in an arena in the .map file, prefixed by this header
+typedef struct {
+  rydb_rownum_t   free; //first node on the free-list, 0 if there's nothing to reuse
+  rydb_rownum_t   count; //nodes carved out of the arena so far, free or not
+} rydb_hashtable_chain_header_t;
+
+//the optional Bloom filter lives in the .filter file: this header, then cache-line-sized blocks of bits
+typedef struct {
+  rydb_rownum_t   blocks; //0 until the filter has been built
+  rydb_rownum_t   stale; //keys removed since the filter was built. their bits are still set
+} rydb_hashtable_filter_header_t;
+
+#define RYDB_HASHTABLE_FILTER_BLOCK_SIZE 64
+#define RYDB_HASHTABLE_FILTER_PROBES 6 //bits set per key, all in the same block
+
 typedef char rydb_hashbucket_t;
 #define BUCKET_STORED_ROWNUM(bucket) *(rydb_rownum_t *)bucket
 
 bool rydb_index_hashtable_open(rydb_t *db, rydb_index_t *idx);
+bool rydb_index_hashtable_activate(rydb_t *db, rydb_index_t *idx);
+bool rydb_index_hashtable_build(rydb_t *db, rydb_index_t *idx);
 
 bool rydb_meta_load_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp);
 bool rydb_meta_save_index_hashtable(rydb_t *db, rydb_config_index_t *idx_cf, FILE *fp);
@@ -50,17 +76,27 @@ void rydb_hashtable_unlock(const rydb_index_t *idx);
 bool rydb_index_hashtable_contains(const rydb_t *db, const rydb_index_t *idx, const char *val);
 
 bool rydb_index_hashtable_find_row(rydb_t *db, rydb_index_t *idx, const char *val, rydb_row_t *row);
+bool rydb_index_hashtable_find_covered(rydb_t *db, rydb_index_t *idx, const char *val, char *covered, rydb_rownum_t *rownum);
+bool rydb_index_hashtable_covered_in_range(const rydb_config_index_t *cf, off_t start, off_t end);
 bool rydb_index_hashtable_rehash(rydb_t *db, rydb_index_t *idx, off_t last_possible_bucket, uint_fast8_t current_hashbits, int reserve);
+bool rydb_index_hashtable_rehash_background(rydb_t *db, rydb_index_t *idx, uint64_t deadline_usec);
+bool rydb_index_hashtable_rehash_pending(const rydb_index_t *idx);
+bool rydb_index_hashtable_maintenance(rydb_t *db, rydb_index_t *idx, uint64_t deadline_usec);
+bool rydb_index_hashtable_maintenance_pending(const rydb_index_t *idx);
+void rydb_index_hashtable_stats(const rydb_index_t *idx, rydb_index_stats_t *stats);
 
 char *rydb_hashfunction_to_str(rydb_hash_function_t hashfn);
 
 bool rydb_hashtable_cursor_init(rydb_cursor_t *cur);
 rydb_rownum_t rydb_hashtable_cursor_next(rydb_cursor_t *cur);
+size_t rydb_hashtable_cursor_next_batch(rydb_cursor_t *cur, rydb_row_t *rows, size_t max);
 void rydb_hashtable_cursors_update(const rydb_t *db, const rydb_index_t *idx, const rydb_hashbucket_t *bucket, const rydb_hashbucket_t *dst, uint_fast8_t old_bits, uint_fast8_t new_bits);
 
 void rydb_hashtable_print(const rydb_t *db, const rydb_index_t *idx);
 void rydb_bucket_print(const rydb_index_t *idx, const rydb_hashbucket_t *bucket);
 
 #define RYDB_INDEX_HASHTABLE_START_OFFSET ry_align(sizeof(rydb_hashtable_header_t), 8)
+#define RYDB_INDEX_HASHTABLE_CHAIN_START_OFFSET ry_align(sizeof(rydb_hashtable_chain_header_t), 8)
+#define RYDB_INDEX_HASHTABLE_FILTER_START_OFFSET ry_align(sizeof(rydb_hashtable_filter_header_t), RYDB_HASHTABLE_FILTER_BLOCK_SIZE)
 
 #endif //_RYDB_HASHTABLE_H
@@ -2,13 +2,14 @@
 #define _RYDB_INTERNAL_H
 
 #include "configure.h"
-#ifdef RYDB_HAVE_MREMAP
+#if defined(RYDB_HAVE_MREMAP) || defined(RYDB_HAVE_COPY_FILE_RANGE)
 #define _GNU_SOURCE
 #endif
 #include <sys/mman.h>
 
 #include "rydb.h"
 #include <atomic_ops.h>
+#include <string.h>
 
 //works only for a = 2^n
 #define ry_align(d, a)     (((d) + (a - 1)) & ~(a - 1))
@@ -24,8 +25,93 @@ typedef struct {
     AO_t            client;
   }               lock;
   AO_t            modcount;
+  AO_t            meta_revision; //bumped every time the meta file is replaced
+  AO_t            replication_lsn; //last transaction shipped to or replayed from another database
+  struct {
+    AO_t            data_next_rownum; //0 while the checkpoint is being written
+    AO_t            cmd_next_rownum;
+    AO_t            commit_rownum; //last COMMIT in the command log, 0 if there isn't one
+  }               checkpoint; //where the data ends and the command log starts, as of the last append or transaction
+  struct {
+    AO_t            clean; //set by a writer that closed between transactions, cleared by the next one to open
+    AO_t            data_next_rownum;
+    AO_t            data_size;
+    AO_t            meta_size;
+  }               shutdown;
 } rydb_state_t;
 
+/*
+ * binary meta file: this header, then index_count index descriptors, link_pair_count link descriptors and
+ * column_group_count column group descriptors, each section starting 8-byte aligned. everything's in host byte
+ * order, so it's read straight out of the mapped file. the text format is still loaded if that's what's there.
+ */
+#define RYDB_META_MAGIC "rydb meta"
+#define RYDB_META_BINARY_VERSION 2
+
+typedef struct {
+  char            magic[16];
+  uint8_t         little_endian;
+  uint8_t         rownum_width;
+  uint16_t        start_offset;
+  uint32_t        version; //RYDB_META_BINARY_VERSION
+  uint32_t        size; //of the whole file
+  uint32_t        checksum; //crc32 of everything after this
+  uint32_t        format_revision;
+  uint32_t        database_revision;
+  uint16_t        type_offset;
+  uint16_t        reserved_offset;
+  uint16_t        data_offset;
+  uint16_t        row_len;
+  uint16_t        id_len;
+  uint16_t        index_count;
+  uint16_t        link_pair_count;
+  uint16_t        column_group_count;
+  uint8_t         hash_key[16];
+  uint8_t         hash_key_quality;
+  uint8_t         reserved[7];
+  uint32_t        change_feed_capacity;
+  uint32_t        backup_page_size;
+} rydb_meta_header_t;
+
+#define RYDB_META_INDEX_STORE_VALUE        0x01
+#define RYDB_META_INDEX_STORE_HASH         0x02
+#define RYDB_META_INDEX_COMPACT_HASH       0x04
+#define RYDB_META_INDEX_BLOOM_FILTER       0x08
+#define RYDB_META_INDEX_INTEGER_BIG_ENDIAN 0x10
+#define RYDB_META_INDEX_DIRECT_BIG_ENDIAN  0x20
+
+typedef struct {
+  char            name[RYDB_NAME_MAX_LEN + 1];
+  uint8_t         type;
+  uint8_t         flags;
+  uint8_t         segment_count;
+  uint16_t        start;
+  uint16_t        len;
+  rydb_index_segment_t segment[RYDB_INDEX_MAX_SEGMENTS];
+  uint16_t        filter_offset;
+  uint8_t         filter_mask;
+  uint8_t         filter_value;
+  //type config
+  uint8_t         options; //RYDB_META_INDEX_* bits
+  uint8_t         hash_function;
+  uint8_t         rehash;
+  uint8_t         collision_resolution;
+  uint16_t        cover_start;
+  uint16_t        cover_len;
+  double          load_factor_max;
+} rydb_meta_index_t;
+
+typedef struct {
+  char            next[RYDB_NAME_MAX_LEN + 1];
+  char            prev[RYDB_NAME_MAX_LEN + 1];
+} rydb_meta_link_t;
+
+typedef struct {
+  char            name[RYDB_NAME_MAX_LEN + 1];
+  uint16_t        start;
+  uint16_t        len;
+} rydb_meta_column_group_t;
+
 #define RYDB_DATA_HEADER_STRING "rydb data"
 #define RYDB_ROW_DATA_OFFSET offsetof(rydb_stored_row_t, data)
 #define RYDB_DATA_START_OFFSET ((unsigned )ry_align(RYDB_ROW_DATA_OFFSET + strlen(RYDB_DATA_HEADER_STRING), 8))
@@ -82,9 +168,12 @@ typedef struct {
 bool rydb_file_open(rydb_t *db, const char *what, rydb_file_t *f);
 bool rydb_file_open_index(rydb_t *db, rydb_index_t *idx);
 bool rydb_file_open_index_map(rydb_t *db, rydb_index_t *idx);
+bool rydb_file_open_index_filter(rydb_t *db, rydb_index_t *idx);
 
 bool rydb_file_close(rydb_t *db, rydb_file_t *f);
 bool rydb_file_close_index(rydb_t *db, rydb_index_t *idx);
+bool rydb_file_close_map(rydb_t *db, rydb_index_t *idx);
+bool rydb_file_close_filter(rydb_t *db, rydb_index_t *idx);
 bool rydb_file_close_data(rydb_t *db, rydb_index_t *idx);
 
 bool rydb_file_ensure_size(rydb_t *db, rydb_file_t *f, size_t desired_min_sz, ptrdiff_t *realloc_offset);
@@ -122,6 +211,8 @@ void rydb_data_update_last_nonempty_data_row(rydb_t *db, rydb_stored_row_t *row_
 
 
 bool getrandombytes(unsigned char *p, size_t len);
+uint64_t rydb_clock_usec(void); //monotonic
+uint64_t rydb_clock_nsec(void); //monotonic
 uint64_t crc32(const uint8_t *data, size_t data_len);
 uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k);
 
@@ -197,6 +288,25 @@ typedef struct {
 #define rydb_index_cursor_detach(index, cur) \
   rydb_ll_remove(rydb_cursor_t, index->cursor, cur, prev, next)
 
+void rydb_checkpoint(rydb_t *db, rydb_rownum_t commit_rownum);
+
+//stats
+void rydb_stats_record(rydb_t *db, rydb_stats_op_t op, uint64_t started);
+#define rydb_stats_count(db, name) do { \
+  if((db)->stats) (db)->stats->counter.name++; \
+} while(0)
+
+static inline uint64_t rydb_stats_start(const rydb_t *db) {
+  return db->stats ? rydb_clock_nsec() : 0;
+}
+//passes result through, so it can wrap the last call of an operation
+static inline bool rydb_stats_done(rydb_t *db, rydb_stats_op_t op, uint64_t started, bool result) {
+  if(started && db->stats) {
+    rydb_stats_record(db, op, started);
+  }
+  return result;
+}
+
 void rydb_modcount_incr(rydb_t *db);
 int64_t rydb_modcount(rydb_t *db);
 bool rydb_modcount_changed(rydb_t *db, int64_t *prev_modcount);
@@ -206,7 +316,34 @@ bool rydb_modcount_changed(rydb_t *db, int64_t *prev_modcount);
   __first || rydb_modcount_changed(db, &__cur_modcount); \
   __first = 0)
 
-const char *rydb_overlay_data_on_row_for_index(const rydb_t *db, char *dst, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row, const char *overlay, off_t ostart, off_t oend, off_t istart, off_t iend);
+const char *rydb_overlay_data_on_row_for_index(const rydb_t *db, char *dst, rydb_rownum_t rownum, const rydb_stored_row_t **cached_row, const char *overlay, off_t ostart, off_t oend, const rydb_config_index_t *cf);
+const char *rydb_index_search_value(char *dst, const rydb_config_index_t *cf, const char *val, size_t len);
+bool rydb_index_data_in_range(const rydb_config_index_t *cf, off_t start, off_t end);
+
+//a composite key is its segments, concatenated in order
+static inline bool rydb_index_composite(const rydb_config_index_t *cf) {
+  return cf->segment_count > 1;
+}
+//a row's key for the index: right there in the row if it's contiguous, gathered into buf otherwise.
+//buf needs room for RYDB_INDEX_COMPOSITE_KEY_MAX bytes
+static inline const char *rydb_index_row_key(const rydb_config_index_t *cf, const char *rowdata, char *buf) {
+  char *cur = buf;
+  if(!rydb_index_composite(cf)) {
+    return &rowdata[cf->start];
+  }
+  for(int i = 0; i < cf->segment_count; i++) {
+    memcpy(cur, &rowdata[cf->segment[i].start], cf->segment[i].len);
+    cur += cf->segment[i].len;
+  }
+  return buf;
+}
+//does a partial index cover this row? every row passes an index without a filter
+static inline bool rydb_index_covers_row(const rydb_config_index_t *cf, const char *rowdata) {
+  return cf->filter.mask == 0 || (rowdata[cf->filter.offset] & cf->filter.mask) == cf->filter.value;
+}
+static inline bool rydb_index_filter_in_range(const rydb_config_index_t *cf, off_t start, off_t end) {
+  return cf->filter.mask != 0 && cf->filter.offset >= start && cf->filter.offset < end;
+}
 //debug stuff?
 void rydb_print_stored_data(rydb_t *db);
 
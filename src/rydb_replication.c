@@ -0,0 +1,162 @@
+#include "rydb_internal.h"
+#include "rydb_replication.h"
+#include "rydb_backup.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*
+ * log-shipping replication: the leader writes out each transaction's command rows right before it runs them, and
+ * the follower drops them into its own command log and runs them through the same rydb_transaction_run() path
+ * as crash recovery. the follower has to start out with the same rows as the leader, so that the rownums the
+ * commands refer to (and the command rows themselves) land in the same places.
+ */
+
+static bool replication_write(int fd, const void *buf, size_t len) {
+  const char *cur = buf;
+  ssize_t     n;
+  while(len > 0) {
+    //don't get SIGPIPE'd if the follower goes away
+    n = send(fd, cur, len, MSG_NOSIGNAL);
+    if(n == -1 && errno == ENOTSOCK) {
+      n = write(fd, cur, len);
+    }
+    if(n == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    cur += n;
+    len -= n;
+  }
+  return true;
+}
+
+//false on EOF too, with errno set to 0
+static bool replication_read(int fd, void *buf, size_t len) {
+  char    *cur = buf;
+  ssize_t  n;
+  while(len > 0) {
+    n = read(fd, cur, len);
+    if(n == 0) {
+      errno = 0;
+      return false;
+    }
+    if(n == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    cur += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool rydb_replication_ship_transaction(rydb_t *db, const rydb_stored_row_t *first, const rydb_stored_row_t *last) {
+  rydb_state_t             *state = (void *)db->state.file.start;
+  size_t                    len = (const char *)last - (const char *)first + db->stored_row_size;
+  rydb_replication_frame_t  frame = {
+    .magic = RYDB_REPLICATION_MAGIC,
+    .row_count = len / db->stored_row_size,
+    .lsn = AO_load(&state->replication_lsn) + 1,
+    .stored_row_size = db->stored_row_size,
+    .row_len = db->config.row_len
+  };
+  if(!replication_write(db->replication.fd, &frame, sizeof(frame)) || !replication_write(db->replication.fd, first, len)) {
+    db->replication.fd = -1;
+    rydb_set_error(db, RYDB_ERROR_REPLICATION, "Failed to ship transaction %"PRIu64", replication has been stopped", (uint64_t )frame.lsn);
+    return false;
+  }
+  AO_store(&state->replication_lsn, frame.lsn);
+  return true;
+}
+
+bool rydb_replication_ship(rydb_t *db, int fd) {
+  if(!rydb_ensure_open(db) || !rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  db->replication.fd = fd;
+  return true;
+}
+
+bool rydb_replication_apply(rydb_t *db, int fd) {
+  rydb_replication_frame_t  frame;
+  rydb_state_t             *state;
+  rydb_stored_row_t        *rows, *last;
+  size_t                    len;
+  AO_t                      lsn;
+  if(!rydb_ensure_open(db) || !rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  if(db->transaction.active) {
+    rydb_set_error(db, RYDB_ERROR_TRANSACTION_ACTIVE, "Cannot replay a replicated transaction while another transaction is active");
+    return false;
+  }
+  if(!replication_read(fd, &frame, sizeof(frame))) {
+    rydb_set_error(db, RYDB_ERROR_REPLICATION, errno == 0 ? "Replication stream was closed" : "Failed to read from replication stream");
+    return false;
+  }
+  if(frame.magic != RYDB_REPLICATION_MAGIC || frame.row_count == 0) {
+    rydb_set_error(db, RYDB_ERROR_REPLICATION, "Replication stream is corrupted");
+    return false;
+  }
+  if(frame.stored_row_size != db->stored_row_size || frame.row_len != db->config.row_len) {
+    rydb_set_error(db, RYDB_ERROR_CONFIG_MISMATCH, "Leader's row length %"PRIu16" doesn't match follower's %"PRIu16, frame.row_len, db->config.row_len);
+    return false;
+  }
+  
+  //read the rows straight into the command log
+  len = (size_t )frame.row_count * db->stored_row_size;
+  if(!rydb_file_ensure_size(db, &db->data, (char *)rydb_rownum_to_row(db, db->cmd_next_rownum) - db->data.file.start + len, NULL)) {
+    return false;
+  }
+  if(!rydb_backup_pages_reserve(db, db->cmd_next_rownum + frame.row_count)) {
+    return false;
+  }
+  rydb_backup_mark_rows(db, db->cmd_next_rownum, frame.row_count);
+  rows = rydb_rownum_to_row(db, db->cmd_next_rownum);
+  if(!replication_read(fd, rows, len)) {
+    memset(rows, '\00', len);
+    rydb_set_error(db, RYDB_ERROR_REPLICATION, errno == 0 ? "Replication stream was closed mid-transaction" : "Failed to read from replication stream");
+    return false;
+  }
+  
+  state = (void *)db->state.file.start;
+  lsn = AO_load(&state->replication_lsn);
+  if(frame.lsn <= lsn) {
+    //already got this one
+    memset(rows, '\00', len);
+    return true;
+  }
+  last = rydb_row_next(rows, db->stored_row_size, frame.row_count - 1);
+  if(frame.lsn != lsn + 1 || last->type != RYDB_ROW_CMD_COMMIT) {
+    memset(rows, '\00', len);
+    if(frame.lsn != lsn + 1) {
+      rydb_set_error(db, RYDB_ERROR_REPLICATION, "Replication stream skipped from transaction %"PRIu64" to %"PRIu64, (uint64_t )lsn, frame.lsn);
+    }
+    else {
+      rydb_set_error(db, RYDB_ERROR_REPLICATION, "Replicated transaction %"PRIu64" doesn't end with a COMMIT", frame.lsn);
+    }
+    return false;
+  }
+  
+  db->cmd_next_rownum += frame.row_count;
+  rydb_checkpoint(db, db->cmd_next_rownum - 1);
+  rydb_transaction_start_or_continue(db, NULL);
+  if(!rydb_transaction_finish_or_continue(db, 1)) {
+    return false;
+  }
+  AO_store(&state->replication_lsn, frame.lsn);
+  return true;
+}
+
+uint64_t rydb_replication_lsn(rydb_t *db) {
+  if(!rydb_ensure_open(db)) {
+    return 0;
+  }
+  return AO_load(&((rydb_state_t *)db->state.file.start)->replication_lsn);
+}
@@ -0,0 +1,22 @@
+#ifndef _RYDB_REPLICATION_H
+#define _RYDB_REPLICATION_H
+#include "rydb.h"
+
+#define RYDB_REPLICATION_MAGIC 0x52794442
+
+/*
+ * a shipped transaction is this header followed by row_count stored command rows, just as they were in the
+ * leader's command log, ending with the COMMIT. both ends are on the same host, so it's all in native byte order.
+ */
+typedef struct {
+  uint32_t        magic;
+  uint32_t        row_count;
+  uint64_t        lsn;
+  uint16_t        stored_row_size;
+  uint16_t        row_len;
+  uint32_t        reserved;
+} rydb_replication_frame_t;
+
+bool rydb_replication_ship_transaction(rydb_t *db, const rydb_stored_row_t *first, const rydb_stored_row_t *last);
+
+#endif //_RYDB_REPLICATION_H
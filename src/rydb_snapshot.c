@@ -0,0 +1,326 @@
+#include "rydb_internal.h"
+#include "rydb_backup.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * snapshots: only the writer changes the files, and between transactions they're consistent with one another.
+ * so the writer itself takes the snapshot, copying each file as it stands, and can't write anything until it's done.
+ * copy_file_range() gets to clone the extents instead of copying the bytes when source and destination are on a
+ * filesystem that can (btrfs, xfs), and then that's brief. otherwise every byte gets copied, and the writer waits
+ * for the whole database.
+ *
+ * with the data pages stamped for incremental backups, the data file can be copied a slice at a time instead,
+ * while the writer carries on. a page that's stamped with the snapshot's epoch or a later one changed after the
+ * snapshot started, and maybe after it was copied, so it gets copied again at the end, between transactions. the
+ * state, pages and meta files are small and are copied then too. everything else is derived from the data, and
+ * is left out to be rebuilt, same as after a restore.
+ */
+
+#define RYDB_SNAPSHOT_FILES_MAX (5 + 3 * RYDB_INDICES_MAX + RYDB_COLUMN_GROUPS_MAX)
+
+static bool snapshot_copy_bytes(int src, int dst, off_t len) {
+  char    buf[16384];
+  ssize_t n, w;
+#ifdef RYDB_HAVE_COPY_FILE_RANGE
+  while(len > 0) {
+    n = copy_file_range(src, NULL, dst, NULL, len, 0);
+    if(n == -1 && errno == EINTR) {
+      continue;
+    }
+    if(n <= 0) {
+      break; //not supported here, or the file shrank. either way, finish up the old-fashioned way
+    }
+    len -= n;
+  }
+#endif
+  while(len > 0) {
+    n = read(src, buf, (size_t )len < sizeof(buf) ? (size_t )len : sizeof(buf));
+    if(n == -1 && errno == EINTR) {
+      continue;
+    }
+    if(n <= 0) {
+      return n == 0;
+    }
+    for(ssize_t off = 0; off < n; off += w) {
+      if((w = write(dst, &buf[off], n - off)) == -1) {
+        if(errno == EINTR) {
+          w = 0;
+          continue;
+        }
+        return false;
+      }
+    }
+    len -= n;
+  }
+  return true;
+}
+
+static void snapshot_filename(const char *dest_path, const char *src_path, char *buf, size_t buflen) {
+  const char *basename = strrchr(src_path, RYDB_PATH_SEPARATOR_CHAR);
+  snprintf(buf, buflen, "%s%s%s", dest_path, strlen(dest_path) > 0 ? RYDB_PATH_SEPARATOR : "", basename ? basename + 1 : src_path);
+}
+
+static bool snapshot_copy_file(rydb_t *db, const char *src_path, const char *dst_path, bool *created) {
+  int         src, dst;
+  struct stat st;
+  bool        ok;
+  *created = false;
+  if((src = open(src_path, O_RDONLY)) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open file %.900s", src_path);
+    return false;
+  }
+  if(fstat(src, &st) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to get filesize");
+    close(src);
+    return false;
+  }
+  //never write over another database
+  if((dst = open(dst_path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP)) == -1) {
+    if(errno == EEXIST) {
+      rydb_set_error(db, RYDB_ERROR_FILE_EXISTS, "Snapshot file %.900s already exists", dst_path);
+    }
+    else {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to create snapshot file %.900s", dst_path);
+    }
+    close(src);
+    return false;
+  }
+  *created = true;
+  ok = snapshot_copy_bytes(src, dst, st.st_size);
+  if(ok && fsync(dst) == -1) {
+    ok = false;
+  }
+  if(!ok) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to copy %.900s to snapshot", src_path);
+  }
+  close(src);
+  close(dst);
+  return ok;
+}
+
+static bool snapshot_write(int fd, const char *buf, size_t len, off_t off) {
+  ssize_t w;
+  while(len > 0) {
+    if((w = pwrite(fd, buf, len, off)) == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += w;
+    off += w;
+    len -= w;
+  }
+  return true;
+}
+
+//nobody's holding any locks on the snapshot
+static bool snapshot_state_unlock(rydb_t *db, const char *dst_path) {
+  rydb_state_t state;
+  int          fd;
+  bool         ok;
+  memcpy(&state, db->state.file.start, sizeof(state));
+  memset(&state.lock, '\0', sizeof(state.lock));
+  if((fd = open(dst_path, O_WRONLY)) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to open file %.900s", dst_path);
+    return false;
+  }
+  ok = pwrite(fd, &state, sizeof(state), 0) == sizeof(state) && fsync(fd) == 0;
+  if(!ok) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to write snapshot state file %.900s", dst_path);
+  }
+  close(fd);
+  return ok;
+}
+
+//meta goes last: without it, a half-made snapshot isn't mistaken for a database
+static int snapshot_list_files(rydb_t *db, const char **files, bool derived) {
+  int count = 0;
+  files[count++] = db->state.path;
+  if(derived) {
+    for(int i = 0; i < db->config.index_count; i++) {
+      rydb_index_t *idx = &db->index[i];
+      if(idx->index.path) files[count++] = idx->index.path;
+      if(idx->map.path) files[count++] = idx->map.path;
+      if(idx->filter.path) files[count++] = idx->filter.path;
+    }
+    for(int i = 0; i < db->config.column_group_count; i++) {
+      files[count++] = db->column_group[i].file.path;
+    }
+    if(db->changes.file.path) {
+      files[count++] = db->changes.file.path;
+    }
+  }
+  if(db->backup.pages.path) {
+    files[count++] = db->backup.pages.path;
+  }
+  files[count++] = db->meta.path;
+  return count;
+}
+
+static bool snapshot_copy_files(rydb_t *db, const char *dest_path, const char **files, int count) {
+  char  dst[2048];
+  int   copied;
+  bool  created, ok = true;
+  for(copied = 0; copied < count; copied++) {
+    snapshot_filename(dest_path, files[copied], dst, sizeof(dst));
+    ok = snapshot_copy_file(db, files[copied], dst, &created);
+    if(ok && files[copied] == db->state.path) {
+      ok = snapshot_state_unlock(db, dst);
+    }
+    if(!ok) {
+      if(created) copied++;
+      break;
+    }
+  }
+  if(!ok) {
+    //clean up after ourselves
+    for(int i = 0; i < copied; i++) {
+      snapshot_filename(dest_path, files[i], dst, sizeof(dst));
+      unlink(dst);
+    }
+  }
+  return ok;
+}
+
+bool rydb_snapshot(rydb_t *db, const char *dest_path) {
+  const char *files[RYDB_SNAPSHOT_FILES_MAX];
+  int         count = 0;
+  if(!rydb_ensure_open(db) || !rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  if(db->transaction.active) {
+    rydb_set_error(db, RYDB_ERROR_TRANSACTION_ACTIVE, "Cannot take a snapshot while a transaction is active");
+    return false;
+  }
+  if(mkdir(dest_path, S_IRWXU) == -1 && errno != EEXIST) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to create snapshot directory %.900s", dest_path);
+    return false;
+  }
+  files[count++] = db->data.path;
+  count += snapshot_list_files(db, &files[count], true);
+  if(!snapshot_copy_files(db, dest_path, files, count)) {
+    return false;
+  }
+  //incremental backups from here on are relative to this snapshot
+  rydb_backup_epoch_next(db);
+  return true;
+}
+
+bool rydb_snapshot_start(rydb_t *db, const char *dest_path) {
+  char dst[2048];
+  if(!rydb_ensure_open(db) || !rydb_ensure_write_privilege(db)) {
+    return false;
+  }
+  if(db->config.backup_page_size == 0) {
+    rydb_set_error(db, RYDB_ERROR_BAD_CONFIG, "Snapshots that don't block the writer need incremental backups configured");
+    return false;
+  }
+  if(db->snapshot.fd != -1) {
+    rydb_set_error(db, RYDB_ERROR_SNAPSHOT_ACTIVE, "Another snapshot is still being taken into %.900s", db->snapshot.path);
+    return false;
+  }
+  if(db->transaction.active) {
+    rydb_set_error(db, RYDB_ERROR_TRANSACTION_ACTIVE, "Cannot take a snapshot while a transaction is active");
+    return false;
+  }
+  if(mkdir(dest_path, S_IRWXU) == -1 && errno != EEXIST) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to create snapshot directory %.900s", dest_path);
+    return false;
+  }
+  if((db->snapshot.path = rydb_strdup(dest_path)) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for snapshot");
+    return false;
+  }
+  //never write over another database
+  snapshot_filename(dest_path, db->data.path, dst, sizeof(dst));
+  if((db->snapshot.fd = open(dst, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP)) == -1) {
+    if(errno == EEXIST) {
+      rydb_set_error(db, RYDB_ERROR_FILE_EXISTS, "Snapshot file %.900s already exists", dst);
+    }
+    else {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to create snapshot file %.900s", dst);
+    }
+    rydb_mem.free(db->snapshot.path);
+    db->snapshot.path = NULL;
+    return false;
+  }
+  db->snapshot.copied = 0;
+  //any page changed from here on gets copied again at the end
+  rydb_backup_epoch_next(db);
+  db->snapshot.epoch = rydb_backup_epoch(db);
+  return true;
+}
+
+void rydb_snapshot_abort(rydb_t *db) {
+  char dst[2048];
+  if(db->snapshot.fd == -1) {
+    return;
+  }
+  close(db->snapshot.fd);
+  db->snapshot.fd = -1;
+  snapshot_filename(db->snapshot.path, db->data.path, dst, sizeof(dst));
+  unlink(dst);
+  rydb_mem.free(db->snapshot.path);
+  db->snapshot.path = NULL;
+}
+
+static bool snapshot_finish(rydb_t *db) {
+  const char *files[RYDB_SNAPSHOT_FILES_MAX];
+  size_t      page_size = db->config.backup_page_size;
+  size_t      sz = db->data.file.end - db->data.file.start;
+  int         count;
+  bool        ok = true;
+  for(size_t i = 0; ok && i * page_size < sz; i++) {
+    size_t off = i * page_size, len = off + page_size <= sz ? page_size : sz - off;
+    //the file may have grown since the last slice, too
+    if(off + len > db->snapshot.copied || rydb_backup_page_changed(db, i, db->snapshot.epoch)) {
+      ok = snapshot_write(db->snapshot.fd, &db->data.file.start[off], len, off);
+    }
+  }
+  if(!ok || ftruncate(db->snapshot.fd, sz) == -1 || fsync(db->snapshot.fd) == -1) {
+    rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to copy %.900s to snapshot", db->data.path);
+    rydb_snapshot_abort(db);
+    return false;
+  }
+  count = snapshot_list_files(db, files, false);
+  if(!snapshot_copy_files(db, db->snapshot.path, files, count)) {
+    rydb_snapshot_abort(db);
+    return false;
+  }
+  close(db->snapshot.fd);
+  db->snapshot.fd = -1;
+  rydb_mem.free(db->snapshot.path);
+  db->snapshot.path = NULL;
+  //incremental backups from here on are relative to this snapshot
+  rydb_backup_epoch_next(db);
+  return true;
+}
+
+//copy at least a page every time, so a snapshot always gets somewhere
+bool rydb_snapshot_step(rydb_t *db, uint64_t deadline_usec) {
+  size_t page_size = db->config.backup_page_size;
+  size_t sz, len;
+  do {
+    sz = db->data.file.end - db->data.file.start;
+    if(db->snapshot.copied >= sz) {
+      break;
+    }
+    len = sz - db->snapshot.copied < page_size ? sz - db->snapshot.copied : page_size;
+    if(!snapshot_write(db->snapshot.fd, &db->data.file.start[db->snapshot.copied], len, db->snapshot.copied)) {
+      rydb_set_error(db, RYDB_ERROR_FILE_ACCESS, "Failed to copy %.900s to snapshot", db->data.path);
+      rydb_snapshot_abort(db);
+      return false;
+    }
+    db->snapshot.copied += len;
+  } while(rydb_clock_usec() < deadline_usec);
+  //the data's only consistent with the rest between transactions
+  if(db->snapshot.copied < sz || db->transaction.active) {
+    return true;
+  }
+  return snapshot_finish(db);
+}
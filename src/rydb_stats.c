@@ -0,0 +1,105 @@
+#include "rydb_internal.h"
+#include <string.h>
+
+static unsigned msb64(uint64_t v) {
+  unsigned n = 0;
+  for(unsigned shift = 32; shift > 0; shift /= 2) {
+    if(v >> shift) {
+      v >>= shift;
+      n += shift;
+    }
+  }
+  return n;
+}
+
+static unsigned histogram_bucket(uint64_t v) {
+  unsigned msb;
+  if(v < RYDB_STATS_HISTOGRAM_SUB_BUCKETS) {
+    return v;
+  }
+  msb = msb64(v);
+  if(msb >= RYDB_STATS_HISTOGRAM_MAX_BITS) {
+    return RYDB_STATS_HISTOGRAM_BUCKETS - 1;
+  }
+  //the 3 bits after the most significant one pick the sub-bucket
+  return (msb - 2) * RYDB_STATS_HISTOGRAM_SUB_BUCKETS + ((v >> (msb - 3)) & (RYDB_STATS_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint64_t histogram_bucket_max(unsigned i) {
+  unsigned shift;
+  if(i < RYDB_STATS_HISTOGRAM_SUB_BUCKETS) {
+    return i;
+  }
+  shift = i / RYDB_STATS_HISTOGRAM_SUB_BUCKETS - 1;
+  return ((uint64_t )(RYDB_STATS_HISTOGRAM_SUB_BUCKETS + i % RYDB_STATS_HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void rydb_stats_record(rydb_t *db, rydb_stats_op_t op, uint64_t started) {
+  rydb_stats_histogram_t *h = &db->stats->latency[op];
+  uint64_t                elapsed = rydb_clock_nsec() - started;
+  if(h->count == 0 || elapsed < h->min) {
+    h->min = elapsed;
+  }
+  if(elapsed > h->max) {
+    h->max = elapsed;
+  }
+  h->count++;
+  h->sum += elapsed;
+  h->bucket[histogram_bucket(elapsed)]++;
+}
+
+bool rydb_stats_enable(rydb_t *db, bool enable) {
+  if(!enable) {
+    if(db->stats) {
+      rydb_mem.free(db->stats);
+      db->stats = NULL;
+    }
+    return true;
+  }
+  if(db->stats) {
+    return true;
+  }
+  if((db->stats = rydb_mem.malloc(sizeof(*db->stats))) == NULL) {
+    rydb_set_error(db, RYDB_ERROR_NOMEMORY, "Unable to allocate memory for stats");
+    return false;
+  }
+  memset(db->stats, '\0', sizeof(*db->stats));
+  return true;
+}
+
+void rydb_stats(const rydb_t *db, rydb_stats_t *stats) {
+  if(db->stats) {
+    *stats = *db->stats;
+  }
+  else {
+    memset(stats, '\0', sizeof(*stats));
+  }
+}
+
+void rydb_stats_reset(rydb_t *db) {
+  if(db->stats) {
+    memset(db->stats, '\0', sizeof(*db->stats));
+  }
+}
+
+uint64_t rydb_stats_percentile(const rydb_stats_histogram_t *histogram, double percentile) {
+  uint64_t target, seen = 0;
+  if(histogram->count == 0) {
+    return 0;
+  }
+  if(percentile >= 100) {
+    return histogram->max;
+  }
+  target = percentile <= 0 ? 1 : (uint64_t )(histogram->count * percentile / 100);
+  if(target == 0) {
+    target = 1;
+  }
+  for(unsigned i = 0; i < RYDB_STATS_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->bucket[i];
+    if(seen >= target) {
+      uint64_t max = histogram_bucket_max(i);
+      return max < histogram->max ? max : histogram->max;
+    }
+  }
+  return histogram->max;
+}
@@ -1,4 +1,8 @@
 #include "rydb_internal.h"
+#include "rydb_column.h"
+#include "rydb_changes.h"
+#include "rydb_replication.h"
+#include "rydb_backup.h"
 #include <string.h>
 #include <assert.h>
 
@@ -21,9 +25,13 @@ bool rydb_data_append_cmd_rows(rydb_t *db, rydb_row_t *rows, const off_t count)
   if(!rydb_file_ensure_size(db, &db->data, (db->cmd_next_rownum + count) * rowsize, NULL)) {
     return false;
   }
+  if(!rydb_backup_pages_reserve(db, db->cmd_next_rownum + count)) {
+    return false;
+  }
   rydb_stored_row_t   *newrows_start = rydb_rownum_to_row(db, db->cmd_next_rownum);
   rydb_stored_row_t   *newrows_end = rydb_row_next(newrows_start, rowsize, count);
   rydb_stored_row_t *cur = newrows_start;
+  rydb_rownum_t      commit_rownum = AO_load(&((rydb_state_t *)db->state.file.start)->checkpoint.commit_rownum);
   for(int i=0; i<count; i++) {
     //copy the data
     rydb_row_t    *row = &rows[i];
@@ -47,10 +55,13 @@ bool rydb_data_append_cmd_rows(rydb_t *db, rydb_row_t *rows, const off_t count)
       case RYDB_ROW_CMD_UPDATE2:
         memcpy(cur->data, row->data, rowlen);
         break;
+      case RYDB_ROW_CMD_COMMIT:
+        commit_rownum = db->cmd_next_rownum + i;
+        //copy no data
+        break;
       case RYDB_ROW_CMD_DELETE:
       case RYDB_ROW_CMD_SWAP1:
       case RYDB_ROW_CMD_SWAP2:
-      case RYDB_ROW_CMD_COMMIT:
         //copy no data
         break;
       case RYDB_ROW_EMPTY:
@@ -62,15 +73,43 @@ bool rydb_data_append_cmd_rows(rydb_t *db, rydb_row_t *rows, const off_t count)
     cur->type = rows[i].type;
     cur = rydb_row_next(cur, rowsize, 1);
   }
+  rydb_backup_mark_rows(db, db->cmd_next_rownum, count);
   db->cmd_next_rownum = rydb_row_to_rownum(db, newrows_end);
+  rydb_checkpoint(db, commit_rownum);
   return true;
 }
 
+//remember where the data ends and the command log starts, so that opening the database doesn't have to go looking
+void rydb_checkpoint(rydb_t *db, rydb_rownum_t commit_rownum) {
+  rydb_state_t *state = (void *)db->state.file.start;
+  if(!db->privileges.write) {
+    return;
+  }
+  //a checkpoint that's only half-written is ignored
+  AO_store(&state->checkpoint.data_next_rownum, 0);
+  AO_nop_full();
+  AO_store(&state->checkpoint.cmd_next_rownum, db->cmd_next_rownum);
+  AO_store(&state->checkpoint.commit_rownum, commit_rownum);
+  AO_nop_full();
+  AO_store(&state->checkpoint.data_next_rownum, db->data_next_rownum);
+}
+
+//a data row was just changed by a command. keep the column groups, the change feed and the backup pages up with it
+static inline void rydb_cmd_row_changed(rydb_t *db, const rydb_stored_row_t *row, rydb_change_op_t op, off_t start, off_t end) {
+  rydb_rownum_t rownum = rydb_row_to_rownum(db, row);
+  rydb_column_groups_write_row(db, row, start, end);
+  rydb_changes_record(db, rownum, op, start, end - start);
+  rydb_backup_mark_rows(db, rownum, 1);
+}
+
 static inline bool rydb_cmd_set(rydb_t *db, rydb_stored_row_t *cmd) {
   rydb_stored_row_t   *dst = rydb_rownum_to_row(db, cmd->target_rownum);
   if(!rydb_cmd_rangecheck(db, "SET", cmd, dst)) {
     return false;
   }
+  if(!rydb_column_groups_reserve(db, cmd->target_rownum)) {
+    return false;
+  }
   if(cmd != dst && dst->type == RYDB_ROW_DATA) {
     rydb_indices_remove_row(db, dst);
   }
@@ -89,6 +128,7 @@ static inline bool rydb_cmd_set(rydb_t *db, rydb_stored_row_t *cmd) {
     dst->type = RYDB_ROW_DATA;
     cmd->type = RYDB_ROW_EMPTY;
   }
+  rydb_cmd_row_changed(db, dst, RYDB_CHANGE_SET, 0, db->config.row_len);
   rydb_rownum_t dst_rownum = rydb_row_to_rownum(db, dst);
   if(dst_rownum >= db->data_next_rownum) {
     db->data_next_rownum = dst_rownum + 1;
@@ -103,9 +143,10 @@ static inline bool rydb_cmd_update(rydb_t *db, rydb_stored_row_t *cmd) {
     return false;
   }
   char *update_data = (char *)&header[1];
-  rydb_indices_update_row(db, dst, 0, header->start, header->len);
+  rydb_indices_update_row(db, dst, 0, header->start, header->start + header->len);
   memcpy(&dst->data[header->start], update_data, header->len);
-  rydb_indices_update_row(db, dst, 1, header->start, header->len);
+  rydb_indices_update_row(db, dst, 1, header->start, header->start + header->len);
+  rydb_cmd_row_changed(db, dst, RYDB_CHANGE_UPDATE, header->start, header->start + header->len);
   cmd->type = RYDB_ROW_EMPTY;
   return true;
 }
@@ -139,11 +180,12 @@ static inline bool rydb_cmd_update2(rydb_t *db, rydb_stored_row_t *cmd1, rydb_st
   if(!rydb_cmd_rangecheck(db, "UPDATE2", cmd1, dst)) {
     return false;
   }
-  rydb_indices_update_row(db, dst, 0, header->start, header->len);
+  rydb_indices_update_row(db, dst, 0, header->start, header->start + header->len);
   memcpy(&dst->data[header->start], cmd2->data, header->len);
+  rydb_cmd_row_changed(db, dst, RYDB_CHANGE_UPDATE, header->start, header->start + header->len);
   cmd2->type = RYDB_ROW_EMPTY;
   cmd1->type = RYDB_ROW_EMPTY;
-  rydb_indices_update_row(db, dst, 1, header->start, header->len);
+  rydb_indices_update_row(db, dst, 1, header->start, header->start + header->len);
   return true;
 }
 static inline bool rydb_cmd_delete(rydb_t *db, rydb_stored_row_t *cmd) {
@@ -153,6 +195,7 @@ static inline bool rydb_cmd_delete(rydb_t *db, rydb_stored_row_t *cmd) {
   }
   rydb_indices_remove_row(db, dst);
   dst->type = RYDB_ROW_EMPTY;
+  rydb_cmd_row_changed(db, dst, RYDB_CHANGE_DELETE, 0, db->config.row_len);
   cmd->type = RYDB_ROW_EMPTY;
   // remove contiguous empty rows at the end of the data from the data range
   // this gives the DELETE command a worst-case performance of O(n)
@@ -183,6 +226,7 @@ static inline bool rydb_cmd_swap1(rydb_t *db, rydb_stored_row_t *cmd1, rydb_stor
         return false;
       }
       memcpy(src, dst, db->stored_row_size);
+      rydb_cmd_row_changed(db, src, src->type == RYDB_ROW_DATA ? RYDB_CHANGE_SET : RYDB_CHANGE_DELETE, 0, db->config.row_len);
       if(src->type == RYDB_ROW_EMPTY) {
         // remove contiguous empty rows at the end of the data from the data range
         // this gives the SWAP command a worst-case performance of O(n)
@@ -280,6 +324,13 @@ bool rydb_transaction_run(rydb_t *db, rydb_stored_row_t *last_row_to_run) {
     rydb_set_error(db, RYDB_ERROR_TRANSACTION_INCOMPLETE, "Refused to run a transaction that doesn't end with a COMMIT");
     return false;
   }
+  //ship it before running it, the commands don't survive being run. a transaction that can't be shipped doesn't get run at all
+  if(!last_row_to_run && db->replication.fd != -1 && !rydb_replication_ship_transaction(db, rydb_rownum_to_row(db, db->data_next_rownum), lastcmd)) {
+    RYDB_EACH_CMD_ROW(db, cur) {
+      cur->type = RYDB_ROW_EMPTY;
+    }
+    return false;
+  }
   rydb_modcount_incr(db);
   bool ret = true;
   rydb_stored_row_t *commit_row = NULL;
@@ -331,6 +382,8 @@ bool rydb_transaction_run(rydb_t *db, rydb_stored_row_t *last_row_to_run) {
       cur->type = RYDB_ROW_EMPTY;
     }
   }
+  //whatever did get applied is out there now, so it goes in the change feed either way
+  rydb_changes_publish(db);
   if(!ret) {
     return false;
   }
@@ -444,10 +497,12 @@ bool rydb_transaction_unique_remove(rydb_t *db, const char *val, off_t i) {
 
 bool rydb_transaction_finish_or_continue(rydb_t *db, int finish) {
   if(finish && db->transaction.active) {
-    bool ret = rydb_transaction_run(db, NULL);
+    uint64_t started = rydb_stats_start(db);
+    bool     ret = rydb_stats_done(db, RYDB_STATS_COMMIT, started, rydb_transaction_run(db, NULL));
     //succeed or fail -- the transaction should be cleared
     rydb_transaction_data_reset(db);
     db->cmd_next_rownum = db->data_next_rownum;
+    rydb_checkpoint(db, 0);
     return ret;
   }
   return true;
@@ -504,5 +559,6 @@ bool rydb_transaction_cancel(rydb_t *db) {
   }
   rydb_transaction_data_reset(db);
   db->cmd_next_rownum = db->data_next_rownum;
+  rydb_checkpoint(db, 0);
   return true;
 }
@@ -1,8 +1,14 @@
 #include <rydb_internal.h>
 #include <rydb_hashtable.h>
+#include <rydb_direct.h>
+#include <rydb_column.h>
+#include <rydb_replication.h>
+#include <rydb_backup.h>
 #include <math.h>
 #include "test_util.h"
 #include <pthread.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 
 double repeat_multiplier = 1.0;
 
@@ -218,6 +224,14 @@ describe(config) {
       cf.rehash = RYDB_REHASH_INCREMENTAL_ON_WRITE | RYDB_REHASH_MANUAL;
       assert_db_fail(db, rydb_config_add_index_hashtable(db, "foobar", 5, 5, RYDB_INDEX_DEFAULT, &cf), RYDB_ERROR_BAD_CONFIG, "[Ii]nvalid rehash flags");
       
+      cf.rehash = RYDB_REHASH_BACKGROUND | RYDB_REHASH_ALL_AT_ONCE;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "foobar", 5, 5, RYDB_INDEX_DEFAULT, &cf), RYDB_ERROR_BAD_CONFIG, "[Ii]nvalid rehash flags");
+      
+      cf.rehash = RYDB_REHASH_BACKGROUND;
+      cf.store_hash = 0;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "foobar", 5, 5, RYDB_INDEX_DEFAULT, &cf), RYDB_ERROR_BAD_CONFIG, "[Rr]equires store_hash");
+      cf.store_hash = 1;
+      
       cf.rehash = RYDB_REHASH_INCREMENTAL;
       cf.store_hash = 0;
       assert_db_fail(db, rydb_config_add_index_hashtable(db, "foobar", 5, 5, RYDB_INDEX_DEFAULT, &cf), RYDB_ERROR_BAD_CONFIG, "[Rr]equires store_hash");
@@ -644,7 +658,97 @@ describe(rydb_open) {
       assert_db_ok(db, rydb_open(db, path, "test"));
       assert(memcmp(db->config.hash_key.value, hashkey, 16) == 0);
       assert(db->config.hash_key.quality == hashkey_quality);
-      
+
+    }
+
+    it("writes a binary meta file") {
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_config_index_filter(db, "foo", 3, 0x0f, 0x01));
+      assert_db_ok(db, rydb_config_add_column_group(db, "grp", 2, 4));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      asserteq(memcmp(db->meta.file.start, "rydb meta", 9), 0);
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(db->config.index_count, 3);
+      asserteq(db->config.link_pair_count, 2);
+      asserteq(db->config.column_group_count, 1);
+
+      rydb_close(db);
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_config_index_filter(db, "foo", 3, 0x0f, 0x01));
+      assert_db_ok(db, rydb_config_add_column_group(db, "grp", 2, 4));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+    }
+
+    it("fails on a bad meta file checksum") {
+      char path_buf[256];
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      strcpy(path_buf, db->meta.path);
+      rydb_close(db);
+      int fd = open(path_buf, O_RDWR);
+      assert(fd != -1);
+      asserteq(pwrite(fd, "X", 1, 100), 1);
+      close(fd);
+      db = rydb_new();
+      assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_FILE_INVALID, "checksum");
+    }
+
+    it("exports, loads and converts the text format") {
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char   *buf = NULL;
+      size_t  buflen = 0;
+      FILE   *fp = open_memstream(&buf, &buflen);
+      assert_db_ok(db, rydb_meta_export(db, fp));
+      fclose(fp);
+      assert(strstr(buf, "--- #rydb\n") == buf);
+      assert(strstr(buf, "row_len: 20\n"));
+      free(buf);
+
+      sed_meta_file(db, "s/nothing//");
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(memcmp(db->meta.file.start, "rydb meta", 9), 0, "text meta file should've been converted");
+      assert_db_ok(db, rydb_reopen(&db));
+    }
+
+    it("loads a text meta file without the newer index options") {
+      char       buf[21];
+      rydb_row_t row;
+      rydb_config_index_hashtable_t cf = {
+        .rehash = RYDB_REHASH_DEFAULT, .hash_function = RYDB_HASH_SIPHASH,
+        .store_hash = 1, .load_factor_max = 0.65
+      };
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "baz", 15, 5, RYDB_INDEX_DEFAULT, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i = 1; i <= 20; i++) {
+        data_fill(buf, 20, i);
+        assert_db_ok(db, rydb_insert_str(db, buf));
+      }
+      //that's what the meta file looked like before these options were added
+      sed_meta_file(db, "/compact_hash:\\|bloom_filter:\\|integer_big_endian:\\|cover_offset:\\|cover_length:/d");
+      char   metabuf[4096];
+      FILE  *fp = fopen(db->meta.path, "r");
+      size_t metalen = fread(metabuf, 1, sizeof(metabuf) - 1, fp);
+      fclose(fp);
+      metabuf[metalen] = '\0';
+      assert(strstr(metabuf, "load_factor_max:"));
+      assert(!strstr(metabuf, "compact_hash:") && !strstr(metabuf, "cover_length:"));
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(memcmp(db->meta.file.start, "rydb meta", 9), 0, "text meta file should've been converted");
+      data_fill(buf, 20, 7);
+      assert_db_ok(db, rydb_find_row_str(db, buf, &row));
+      asserteq(row.num, 7);
+      assert_db_ok(db, rydb_index_find_row(db, "baz", &buf[15], 5, &row));
+      asserteq(row.num, 7);
+
+      assert_db_ok(db, rydb_reopen(&db));
+      for(int i = 0; i < db->config.index_count; i++) {
+        if(strcmp(db->config.index[i].name, "baz") == 0) {
+          asserteq(db->config.index[i].type_config.hashtable.load_factor_max, cf.load_factor_max, "load_factor_max should survive the binary meta file as-is");
+        }
+      }
     }
     subdesc(format_check) {
       before_each() {
@@ -695,6 +799,8 @@ describe(rydb_open) {
         {"store_value", "9000", RYDB_ERROR_FILE_INVALID, "invalid"},
         {"store_hash", "9000", RYDB_ERROR_FILE_INVALID, "invalid"},
         {"collision_resolution", "3", RYDB_ERROR_FILE_INVALID, "invalid"},
+        {"compact_hash", "9000", RYDB_ERROR_FILE_INVALID, "invalid"},
+        {"bloom_filter", "9000", RYDB_ERROR_FILE_INVALID, "invalid"},
         {"link_pair_count", "9000", RYDB_ERROR_FILE_INVALID, "invalid"},
       };
       static unsigned i;
@@ -842,6 +948,15 @@ static void interrupt_read_for_concurrency_test(rydb_t *db, void *pd) {
   }
 }
 
+static int lazy_index_fd(rydb_t *db, const char *name) {
+  for(int i = 0; i < db->config.index_count; i++) {
+    if(strcmp(db->config.index[i].name, name) == 0) {
+      return db->index[i].index.fd;
+    }
+  }
+  return -2;
+}
+
 describe(concurrency) {
   static rydb_t *db;
   static rydb_t *db2;
@@ -890,6 +1005,35 @@ describe(concurrency) {
       rydb_close(rdb[i]);
     }
   }
+  it("lets readers open indices lazily") {
+    char       buf[21];
+    rydb_row_t row;
+    assert_db_ok(db, rydb_config_lazy_indices(db, true));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i = 0; i < db->config.index_count; i++) {
+      assert(db->index[i].index.fd != -1, "writer should open every index");
+    }
+    for(int i = 1; i <= 20; i++) {
+      data_fill(buf, 20, i);
+      assert_db_ok(db, rydb_insert_str(db, buf));
+    }
+
+    assert_db_ok(db2, rydb_config_lazy_indices(db2, true));
+    assert_db_ok(db2, rydb_open_reader(db2, path, "test"));
+    for(int i = 0; i < db2->config.index_count; i++) {
+      asserteq(db2->index[i].index.fd, -1, "reader shouldn't have opened any indices yet");
+    }
+    data_fill(buf, 20, 7);
+    assert_db_ok(db2, rydb_find_row_str(db2, buf, &row));
+    asserteq(row.num, 7);
+    assert(lazy_index_fd(db2, "primary") != -1);
+    asserteq(lazy_index_fd(db2, "foo"), -1);
+    assert_db_ok(db2, rydb_index_find_row(db2, "foo", &buf[5], 5, &row));
+    asserteq(row.num, 7);
+    assert(lazy_index_fd(db2, "foo") != -1);
+    asserteq(lazy_index_fd(db2, "bar"), -1);
+    assert(!rydb_maintenance_pending(db2));
+  }
 #ifdef RYDB_DEBUG
   it("re-reads if written to during read") {
     int numrows = 100;
@@ -1156,6 +1300,40 @@ describe(row_operations) {
       assert_data_match(db, rowdata_results, nrows);
     }
     
+    it("keeps unique indices past the start of the row unique") {
+      rydb_row_t row;
+      char       key[5];
+      assert_db_insert_rows(db, rowdata, nrows);
+      assert_db_ok(db, rydb_index_add_hashtable(db, "uniq", 10, 5, RYDB_INDEX_UNIQUE, NULL));
+      memcpy(key, &rydb_rownum_to_row(db, 1)->data[10], 5);
+      assert_db_fail(db, rydb_update_rownum(db, 2, key, 10, 5), RYDB_ERROR_NOT_UNIQUE, "uniq must be unique");
+      assert(!db->transaction.active);
+      assert_db_ok(db, rydb_update_rownum(db, 2, "fresh", 10, 5));
+      assert_db_ok(db, rydb_index_find_row(db, "uniq", "fresh", 5, &row));
+      asserteq(row.num, 2);
+      assert(!rydb_index_find_row(db, "uniq", " is a", 5, &row));
+    }
+    
+    it("updates every index even if one of them fails") {
+      rydb_row_t    row;
+      rydb_index_t *bar = NULL;
+      assert_db_insert_rows(db, rowdata, nrows);
+      RYDB_EACH_INDEX(db, idx) {
+        if(strcmp(idx->config->name, "bar") == 0) bar = idx;
+      }
+      //lose row 3 from bar, so taking it out of there fails. bar is updated before foo
+      assert_db_ok(db, rydb_index_hashtable_remove_row(db, bar, rydb_rownum_to_row(db, 3)));
+      assert_db_ok(db, rydb_update_rownum(db, 3, "bcdefghi", 6, 8));
+      RYDB_EACH_INDEX(db, idx) {
+        asserteq(AO_load(&((rydb_hashtable_header_t *)idx->index.file.start)->writelock), 0, "index left locked");
+      }
+      assert_db_ok(db, rydb_index_find_row(db, "foo", "sbcde", 5, &row));
+      asserteq(row.num, 3);
+      assert(!rydb_index_find_row(db, "foo", "s one", 5, &row));
+      assert_db_ok(db, rydb_index_find_row(db, "bar", "fghih", 5, &row));
+      asserteq(row.num, 3);
+    }
+    
   }
 }
 
@@ -1567,8 +1745,73 @@ describe(transactions) {
       assert(new_sz <= old_sz);
       asserteq(n, nrows, "no rows should follow data after a reload");
     }
+#ifdef RYDB_DEBUG
+    it("uses the checkpoint to skip scanning uncommitted commands") {
+      assert_db_ok(db, rydb_transaction_start(db));
+      for(int i = 0; i < 200; i++) {
+        assert_db_ok(db, rydb_swap_rownum(db, 1, 2));
+      }
+      //don't finish the transaction
+      rydb_close(db);
+
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_data_match(db, rowdata, nrows);
+      assert(db->tail_rows_scanned <= 1);
+      asserteq(db->data_next_rownum, (rydb_rownum_t )nrows + 1);
+    }
+    it("falls back to a full scan when the checkpoint is bad") {
+      rydb_state_t *state = (rydb_state_t *)db->state.file.start;
+      assert_db_ok(db, rydb_transaction_start(db));
+      assert_db_ok(db, rydb_swap_rownum(db, 1, 2));
+      AO_store(&state->checkpoint.data_next_rownum, 0); //as if we crashed in the middle of writing it
+      rydb_close(db);
+
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_data_match(db, rowdata, nrows);
+      assert(db->tail_rows_scanned > 1);
+    }
+    it("skips recovery after a clean close") {
+      rydb_close(db);
+
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_data_match(db, rowdata, nrows);
+      asserteq(db->tail_rows_scanned, 0);
+      asserteq(AO_load(&((rydb_state_t *)db->state.file.start)->shutdown.clean), 0, "writer should have cleared the flag");
+      assert_db_ok(db, rydb_insert_str(db, "7.after"));
+    }
+    it("recovers anyway if the files changed after a clean close") {
+      static char datapath[128];
+      uint16_t    stored_row_size = db->stored_row_size;
+      snprintf(datapath, sizeof(datapath), "%s/rydb.test.data", path);
+      rydb_close(db);
+      assert(truncate(datapath, filesize(datapath) + 3 * stored_row_size) == 0);
+
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_data_match(db, rowdata, nrows);
+      assert(db->tail_rows_scanned > 0);
+    }
+    it("doesn't count a close in the middle of a transaction as clean") {
+      assert_db_ok(db, rydb_transaction_start(db));
+      assert_db_ok(db, rydb_delete_rownum(db, 1));
+      rydb_close(db);
+
+      db = rydb_new();
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_data_match(db, rowdata, nrows);
+      assert(db->tail_rows_scanned > 0);
+    }
+#endif
   }
-  
+
   subdesc(uniqueness_constraints) {
     static const char *fmt = "%i.........yeah?................";
     static char buf[64];
@@ -1615,7 +1858,78 @@ describe(transactions) {
         assert_db_fail(db, rydb_insert_str(db, rowdata[i]), RYDB_ERROR_NOT_UNIQUE, "must be unique");
       }
     }
+    
+    it("doesn't leave a transaction open after a failed insert") {
+      rydb_row_t row;
+      assert_db_fail(db, rydb_insert_str(db, rowdata[0]), RYDB_ERROR_NOT_UNIQUE, "primary must be unique");
+      assert(!db->transaction.active);
+      assert_db_ok(db, rydb_insert_str(db, "7.a row after the failed one"));
+      assert(!db->transaction.active);
+      assert_db_ok(db, rydb_find_row_str(db, "7.a r", &row));
+      asserteq(row.num, nrows + 1);
+    }
+  }
+}
+
+//a 15-byte composite key made of 3 segments, none of them lined up with 8-byte words
+static const rydb_index_segment_t composite_seg[] = {{.start = 12, .len = 3}, {.start = 5, .len = 7}, {.start = 15, .len = 5}};
+
+static void composite_key(const char *row, char *dst) {
+  for(int i=0; i<3; i++) {
+    memcpy(dst, &row[composite_seg[i].start], composite_seg[i].len);
+    dst += composite_seg[i].len;
+  }
+}
+static void composite_row(char *row, int i) {
+  memset(row, '\00', ROW_LEN);
+  sprintf(row, "%05i", i);
+  sprintf(&row[5], "k%03i", i % 211);
+  sprintf(&row[12], "v%04i", i / 211);
+}
+#define COMPOSITE_KEY_LEN 15
+
+static void composite_find_test(rydb_t **dbp, const char *path, rydb_config_index_hashtable_t *cf) {
+  char       str[ROW_LEN], key[ROW_LEN];
+  rydb_row_t row;
+  int        numrows = 1000 * repeat_multiplier + 5;
+  assert_db_ok(*dbp, rydb_config_add_index_hashtable_composite(*dbp, "comp", composite_seg, 3, RYDB_INDEX_UNIQUE, cf));
+  assert_db_ok(*dbp, rydb_open(*dbp, path, "test"));
+  for(int i=1; i<=numrows; i++) {
+    composite_row(str, i);
+    assert_db_ok(*dbp, rydb_insert(*dbp, str, ROW_LEN));
+  }
+  assert_db_ok(*dbp, rydb_reopen(dbp));
+  rydb_t *db = *dbp;
+  for(int i=numrows; i>=1; i--) {
+    composite_row(str, i);
+    composite_key(str, key);
+    assert_db_ok(db, rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+    asserteq(row.num, i);
+    //the same bytes, in row order, aren't the key
+    assert(!rydb_index_find_row(db, "comp", &str[5], COMPOSITE_KEY_LEN, &row));
   }
+  rydb_cursor_t cur;
+  composite_row(str, 7);
+  composite_key(str, key);
+  assert_db_ok(db, rydb_index_find_rows(db, "comp", key, COMPOSITE_KEY_LEN, &cur));
+  assert(rydb_cursor_next(&cur, &row));
+  asserteq(row.num, 7);
+  assert(!rydb_cursor_next(&cur, &row));
+  rydb_cursor_done(&cur);
+  assert_db_ok(db, rydb_index_rebuild(db, "comp"));
+  assert_db_ok(db, rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+  asserteq(row.num, 7);
+}
+
+//rows are "<id:5><name:7>........<status:1>", and only rows with status bit 0x01 set get into the "active" index
+static void partial_row(char *row, int i, const char *name, char status) {
+  memset(row, '\00', ROW_LEN);
+  sprintf(row, "%05i", i);
+  strcpy(&row[5], name);
+  row[ROW_LEN - 1] = status;
+}
+static rydb_rownum_t partial_used(rydb_t *db) {
+  return ((rydb_hashtable_header_t *)db->index[0].index.file.start)->bucket.count.used; //"active" sorts ahead of "primary"
 }
 
 describe(indexing) {
@@ -1669,9 +1983,9 @@ describe(indexing) {
       RYDB_HASH_SIPHASH, RYDB_HASH_CRC32, RYDB_HASH_NOHASH
     };
     static int t, start, rh;
-    static uint8_t rehash[] = {RYDB_REHASH_ALL_AT_ONCE, RYDB_REHASH_MANUAL, RYDB_REHASH_INCREMENTAL};
-    static char   *rehash_name[] = {"all-at-once", "manual", "incremental"};
-    for(rh=0; rh<3; rh++) {
+    static uint8_t rehash[] = {RYDB_REHASH_ALL_AT_ONCE, RYDB_REHASH_MANUAL, RYDB_REHASH_INCREMENTAL, RYDB_REHASH_BACKGROUND};
+    static char   *rehash_name[] = {"all-at-once", "manual", "incremental", "background"};
+    for(rh=0; rh<4; rh++) {
       for(start=0; start <=9; start+=9) {
         for(t=0; t<3; t++) {
           sprintf(testname, "finding rows (index start at %i) in %s %s-rehash hashtable", start, rydb_hashfunction_to_str(hashfunction[t]), rehash_name[rh]);
@@ -1705,6 +2019,9 @@ describe(indexing) {
                 assert_db_ok(db, rydb_index_rehash(db, "primary"));
                 assert_db_ok(db, rydb_index_rehash(db, "secondary"));
               }
+              if(rehash[rh] == RYDB_REHASH_BACKGROUND && i%7 == 0) {
+                assert_db_ok(db, rydb_maintenance(db, 10));
+              }
               for(int j=0; j<=i; j++) {
                 sprintf(searchstr, fmt, j, j, j, j, j, j, j, j, j, j);
                 memset(&searchstr[ROW_LEN], '\00', 128 - ROW_LEN);
@@ -1731,169 +2048,2343 @@ describe(indexing) {
       }
     }
     for(t=0; t<3; t++) {
-      sprintf(testname, "delete rows in %s hashtable", rydb_hashfunction_to_str(hashfunction[t]));
+      sprintf(testname, "skewed keys in %s separate-chaining hashtable", rydb_hashfunction_to_str(hashfunction[t]));
       test(testname) {
         assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
         rydb_config_index_hashtable_t cf = {
           .hash_function = hashfunction[t],
           .store_value = 0,
           .store_hash = 1,
-          .collision_resolution = RYDB_OPEN_ADDRESSING
+          .collision_resolution = RYDB_SEPARATE_CHAINING
         };
-        rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf);
-        cf.store_value = 1;
-        rydb_config_add_index_hashtable(db, "secondary", 0, 5, RYDB_INDEX_DEFAULT, &cf);
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
         cf.store_hash = 0;
-        cf.rehash = RYDB_REHASH_ALL_AT_ONCE;
-        rydb_config_add_index_hashtable(db, "tertiary", 0, 5, RYDB_INDEX_DEFAULT, &cf);
+        cf.store_value = 1;
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf));
         assert_db_ok(db, rydb_open(db, path, "test"));
-        char str[128];
-        char *fmt = "%izzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz";
-        int numrows = 1000 * repeat_multiplier;
+        char str[32];
+        rydb_row_t row;
+        rydb_cursor_t cur;
+        int numrows = 2000 * repeat_multiplier;
+        //most rows share a handful of secondary keys
         for(int i=1; i<=numrows; i++) {
-          sprintf(str, fmt, i);
+          sprintf(str, "%-5i%-5izzzzzzzzzz", i, i%3 == 0 ? i : i%4);
           assert_db_ok(db, rydb_insert_str(db, str));
         }
         hashtable_header_count_check(db, &db->index[0], numrows);
-        
+        hashtable_header_count_check(db, &db->index[1], numrows);
+        sprintf(str, "%-5i%-5izzzzzzzzzz", 1, 1);
+        assert_db_fail(db, rydb_insert_str(db, str), RYDB_ERROR_NOT_UNIQUE);
         for(int i=1; i<=numrows; i++) {
-          sprintf(str, fmt, i);
-          assert_db_ok(db, rydb_delete_rownum(db, i));
-          hashtable_header_count_check(db, &db->index[0], numrows - i);
-          //rydb_hashtable_print(db, &db->index[0]);
-          for(int j=1; j<=numrows; j++) {
-            sprintf(str, fmt, j);
-            rydb_row_t found_row, found_row2, found_row3;
-            int        rc, rc2, rc3;
-            //printf("find %s\n", str);
-            rc = rydb_find_row_str(db, str, &found_row);
-            rc2 = rydb_index_find_row_str(db, "secondary", str, &found_row2);
-            rc3 = rydb_index_find_row_str(db, "tertiary", str, &found_row3);
-            assert_db(db);
-            if(j <= i) {
-              asserteq(rc, 0);
-              asserteq(rc2, 0);
-              asserteq(rc3, 0);
-            }
-            else {
-              assert(rc);
-              assert(rc2);
-              assert(rc3);
-              asserteq(found_row.num, j);
-              asserteq(found_row2.num, j);
-              asserteq(found_row3.num, j);
-            }
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+        
+        int found;
+        for(int g=0; g<4; g++) {
+          int expected = 0;
+          for(int i=1; i<=numrows; i++) {
+            if((i%3 == 0 ? i : i%4) == g) expected++;
+          }
+          sprintf(str, "%-5i", g);
+          found = 0;
+          assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+          while(rydb_cursor_next(&cur, &row)) {
+            asserteq(atoi(&row.data[5]), g);
+            found++;
+          }
+          asserteq(found, expected);
+        }
+        
+        //delete while a cursor is walking the chain. a rebuilt chain is in row order
+        assert_db_ok(db, rydb_index_rebuild(db, "secondary"));
+        rydb_rownum_t prev = 0;
+        found = 0;
+        sprintf(str, "%-5i", 1);
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          assert(row.num > prev); //chains are kept in row order
+          prev = row.num;
+          asserteq(atoi(&row.data[5]), 1);
+          if(row.num + 4 <= (rydb_rownum_t )numrows && (row.num + 4) % 3 != 0) {
+            assert_db_ok(db, rydb_delete_rownum(db, row.num + 4));
+          }
+          found++;
+        }
+        assert(found > 0);
+        
+        //freed chain nodes get reused
+        rydb_hashtable_chain_header_t *chain = (void *)db->index[1].map.file.start;
+        rydb_rownum_t nodes = chain->count;
+        assert(chain->free != 0);
+        rydb_rownum_t used = ((rydb_hashtable_header_t *)db->index[1].index.file.start)->bucket.count.used;
+        for(rydb_rownum_t i = used; i < nodes; i++) {
+          sprintf(str, "%-5i%-5izzzzzzzzzz", numrows + 1 + i, 2);
+          assert_db_ok(db, rydb_insert_str(db, str));
+        }
+        chain = (void *)db->index[1].map.file.start;
+        asserteq(chain->count, nodes);
+        asserteq(chain->free, 0);
+        
+        //still consistent after reopening
+        used = ((rydb_hashtable_header_t *)db->index[1].index.file.start)->bucket.count.used;
+        assert_db_ok(db, rydb_reopen(&db));
+        hashtable_header_count_check(db, &db->index[1], used);
+        for(int g=0; g<4; g++) {
+          sprintf(str, "%-5i", g);
+          found = 0;
+          assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+          while(rydb_cursor_next(&cur, &row)) {
+            asserteq(atoi(&row.data[5]), g);
+            found++;
           }
+          if(g > 0) assert(found > 0);
         }
       }
     }
     
+    test("Robin Hood hashtable config") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      rydb_config_index_hashtable_t cf = {
+        .hash_function = RYDB_HASH_SIPHASH,
+        .store_hash = 0,
+        .collision_resolution = RYDB_ROBIN_HOOD
+      };
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "requires store_hash");
+      cf.store_hash = 1;
+      cf.rehash = RYDB_REHASH_INCREMENTAL;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "ALL_AT_ONCE");
+      cf.rehash = RYDB_REHASH_MANUAL;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "ALL_AT_ONCE");
+      cf.rehash = RYDB_REHASH_DEFAULT;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+      asserteq(db->config.index[0].type_config.hashtable.rehash, RYDB_REHASH_ALL_AT_ONCE);
+      assert(db->config.index[0].type_config.hashtable.load_factor_max > 0.85);
+    }
+    
     for(t=0; t<3; t++) {
-      sprintf(testname, "works with long index %s hashtable", rydb_hashfunction_to_str(hashfunction[t]));
+      sprintf(testname, "skewed keys in %s Robin Hood hashtable", rydb_hashfunction_to_str(hashfunction[t]));
       test(testname) {
-        int rowlen = 2000, indexlen = 1500;
-        char *data = malloc(rowlen+1);
-        assert_db_ok(db, rydb_config_row(db, rowlen, indexlen));
+        assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
         rydb_config_index_hashtable_t cf = {
           .hash_function = hashfunction[t],
           .store_value = 0,
           .store_hash = 1,
-          .collision_resolution = RYDB_OPEN_ADDRESSING
+          .collision_resolution = RYDB_ROBIN_HOOD
         };
-        rydb_config_add_index_hashtable(db, "primary", 0, indexlen, RYDB_INDEX_UNIQUE, &cf);
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+        cf.store_value = 1;
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf));
         assert_db_ok(db, rydb_open(db, path, "test"));
-        int numrows = 1000 * repeat_multiplier;
+        char str[32];
+        rydb_row_t row;
+        rydb_cursor_t cur;
+        int numrows = 2000 * repeat_multiplier;
+        int expected[4] = {0, 0, 0, 0};
         for(int i=1; i<=numrows; i++) {
-          rydb_row_t row;
-          data_fill(data, rowlen, i);
-          assert_db_ok(db, rydb_insert_str(db, data));
-          int rc = rydb_find_row_str(db, data, &row);
-          asserteq(rc, 1);
-          asserteq(memcmp(data, row.data, rowlen), 0);
+          int g = i%3 == 0 ? i : i%4;
+          sprintf(str, "%-5i%-5izzzzzzzzzz", i, g);
+          assert_db_ok(db, rydb_insert_str(db, str));
+          if(g < 4) expected[g]++;
+        }
+        hashtable_header_count_check(db, &db->index[0], numrows);
+        hashtable_header_count_check(db, &db->index[1], numrows);
+        hashtable_robinhood_order_check(db, &db->index[0]);
+        hashtable_robinhood_order_check(db, &db->index[1]);
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+        sprintf(str, "%-5i", numrows + 1);
+        assert(!rydb_find_row_str(db, str, &row));
+        
+        //same-home buckets stay in insertion order, so cursors see rows in row order.
+        //inserting while walking the cursor shifts buckets around and eventually grows the table
+        rydb_rownum_t prev = 0;
+        int found = 0, inserted = 0;
+        sprintf(str, "%-5i", 2);
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          assert(row.num > prev);
+          prev = row.num;
+          asserteq(atoi(&row.data[5]), 2);
+          found++;
+          sprintf(str, "%-5i%-5izzzzzzzzzz", numrows + ++inserted, 3);
+          assert_db_ok(db, rydb_insert_str(db, str));
+        }
+        asserteq(found, expected[2]);
+        hashtable_robinhood_order_check(db, &db->index[1]);
+        
+        //delete while a cursor is walking the run, including the very bucket it's about to return
+        prev = 0;
+        found = 0;
+        sprintf(str, "%-5i", 1);
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          assert(row.num > prev);
+          prev = row.num;
+          assert_data_rownum_type(db, row.num, RYDB_ROW_DATA);
+          asserteq(atoi(&row.data[5]), 1);
+          if(row.num + 4 <= (rydb_rownum_t )numrows && (row.num + 4) % 3 != 0) {
+            assert_db_ok(db, rydb_delete_rownum(db, row.num + 4));
+          }
+          found++;
+        }
+        assert(found > 0);
+        assert(found < expected[1]);
+        hashtable_robinhood_order_check(db, &db->index[0]);
+        hashtable_robinhood_order_check(db, &db->index[1]);
+        
+        //still consistent after reopening
+        rydb_rownum_t used = ((rydb_hashtable_header_t *)db->index[1].index.file.start)->bucket.count.used;
+        assert_db_ok(db, rydb_reopen(&db));
+        hashtable_header_count_check(db, &db->index[0], used);
+        hashtable_header_count_check(db, &db->index[1], used);
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          if(rydb_rownum_to_row(db, i)->type == RYDB_ROW_DATA) {
+            assert_db_ok(db, rydb_find_row_str(db, str, &row));
+            asserteq(row.num, i);
+          }
+          else {
+            assert(!rydb_find_row_str(db, str, &row));
+          }
         }
-        free(data);
       }
     }
     
-    it("obeys uniqueness criteria") {
-      //char str[128];
-      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
-      assert_db_ok(db, rydb_open(db, path, "test"));
-      assert_db_ok(db, rydb_insert_str(db, "hello this is a string"));
-      assert_db_ok(db, rydb_insert_str(db, "oh this is a different string"));
-      assert_db_ok(db, rydb_insert_str(db, "samestring"));
-      assert_db_fail(db, rydb_insert_str(db, "samestring"), RYDB_ERROR_NOT_UNIQUE, "primary must be unique");
-    }
-  }
-
-
-}
-describe(storage) {
-  static rydb_t *db;
-  static char path[64];
-  static char *data;
-  static int  maxlen = 0;
-  before_each() {
-    db = rydb_new();
-    strcpy(path, "test.db.XXXXXX");
-    mkdtemp(path);
-    data = malloc(maxlen+1);
-  }
-  after_each() {
-    rydb_close(db);
-    rmdir_recursive(path);
-    free(data);
-  }
+    int collision_resolution[3] = {RYDB_OPEN_ADDRESSING, RYDB_SEPARATE_CHAINING, RYDB_ROBIN_HOOD};
+    for(t=0; t<3; t++) {
+      sprintf(testname, "Bloom filter on %s hashtable", t == 0 ? "open-addressing" : (t == 1 ? "separate-chaining" : "Robin Hood"));
+      test(testname) {
+        assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+        rydb_config_index_hashtable_t cf = {
+          .hash_function = RYDB_HASH_SIPHASH,
+          .store_hash = 1,
+          .bloom_filter = 1,
+          .collision_resolution = collision_resolution[t]
+        };
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        char str[32], filterpath[1024];
+        rydb_row_t row;
+        int numrows = 2000 * repeat_multiplier;
+        rydb_hashtable_filter_header_t *filter;
+        rydb_rownum_t initial_blocks = 0;
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i%-5izzzzzzzzzz", i, i);
+          assert_db_ok(db, rydb_insert_str(db, str));
+          if(i == 1) {
+            filter = (void *)db->index[0].filter.file.start;
+            initial_blocks = filter->blocks;
+            assert(initial_blocks > 0);
+          }
+        }
+        //the table grew, but the filter waits for maintenance to catch up
+        filter = (void *)db->index[0].filter.file.start;
+        asserteq(filter->blocks, initial_blocks);
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+        assert(rydb_maintenance_pending(db));
+        while(rydb_maintenance_pending(db)) {
+          assert_db_ok(db, rydb_maintenance(db, 1000000));
+        }
+        filter = (void *)db->index[0].filter.file.start;
+        assert(filter->blocks > initial_blocks);
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+        for(int i=numrows+1; i<=numrows*2; i++) {
+          sprintf(str, "%-5i", i);
+          assert(!rydb_find_row_str(db, str, &row));
+        }
+        
+        //lookups really do go through the filter
+        memset(db->index[0].filter.data.start, '\00', (size_t )filter->blocks * RYDB_HASHTABLE_FILTER_BLOCK_SIZE);
+        sprintf(str, "%-5i", 1);
+        assert(!rydb_find_row_str(db, str, &row));
+        assert_db_ok(db, rydb_index_rebuild(db, "primary"));
+        filter = (void *)db->index[0].filter.file.start;
+        assert_db_ok(db, rydb_find_row_str(db, str, &row));
+        
+        //enough deletes and maintenance rebuilds the filter without them
+        rydb_rownum_t deleted = 0;
+        for(int i=1; i<=numrows; i++) {
+          if(i%3) {
+            assert_db_ok(db, rydb_delete_rownum(db, i));
+            deleted++;
+          }
+        }
+        filter = (void *)db->index[0].filter.file.start;
+        asserteq(filter->stale, deleted);
+        assert(rydb_maintenance_pending(db));
+        assert_db_ok(db, rydb_maintenance(db, 1000000));
+        assert(!rydb_maintenance_pending(db));
+        filter = (void *)db->index[0].filter.file.start;
+        asserteq(filter->stale, 0);
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          if(i%3) {
+            assert(!rydb_find_row_str(db, str, &row));
+          }
+          else {
+            assert_db_ok(db, rydb_find_row_str(db, str, &row));
+            asserteq(row.num, i);
+          }
+        }
+        
+        //a lost filter gets rebuilt
+        strcpy(filterpath, db->index[0].filter.path);
+        assert(unlink(filterpath) == 0);
+        assert_db_ok(db, rydb_reopen(&db));
+        filter = (void *)db->index[0].filter.file.start;
+        assert(filter->blocks > 0);
+        for(int i=3; i<=numrows; i+=3) {
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+      }
+    }
+    
+    test("compact hash config") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      rydb_config_index_hashtable_t cf = {
+        .hash_function = RYDB_HASH_SIPHASH,
+        .store_hash = 0,
+        .compact_hash = 1
+      };
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "requires store_hash");
+      cf.store_hash = 1;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_ok(db, rydb_reopen(&db));
+      assert(db->config.index[0].type_config.hashtable.compact_hash);
+    }
+    
+    for(t=0; t<3; t++) {
+      sprintf(testname, "compact hash on %s hashtable", t == 0 ? "open-addressing" : (t == 1 ? "separate-chaining" : "Robin Hood"));
+      test(testname) {
+        assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+        rydb_config_index_hashtable_t cf = {
+          .hash_function = RYDB_HASH_SIPHASH,
+          .store_hash = 1,
+          .compact_hash = 1,
+          .collision_resolution = collision_resolution[t]
+        };
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+        cf.store_value = 1;
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf));
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        char str[32];
+        rydb_row_t row;
+        rydb_cursor_t cur;
+        int numrows = 2000 * repeat_multiplier;
+        int expected = 0, found;
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i%-5izzzzzzzzzz", i, i%5);
+          assert_db_ok(db, rydb_insert_str(db, str));
+          if(i%5 == 2) expected++;
+        }
+        hashtable_header_count_check(db, &db->index[0], numrows);
+        hashtable_header_count_check(db, &db->index[1], numrows);
+        if(t != 1) {
+          //rownum, 4-byte tag and the value, with no room left for an 8-byte hash
+          rydb_hashtable_header_t *header = (void *)db->index[1].index.file.start;
+          for(uint64_t i = 0; i < header->bucket.count.total; i++) {
+            const char *bucket = &db->index[1].index.data.start[i * 16];
+            rydb_rownum_t rownum = BUCKET_STORED_ROWNUM(bucket);
+            if(rownum != 0) {
+              assert(memcmp(&bucket[8], &rydb_rownum_to_row(db, rownum)->data[5], 5) == 0);
+            }
+          }
+        }
+        if(t == 2) {
+          hashtable_robinhood_order_check(db, &db->index[0]);
+          hashtable_robinhood_order_check(db, &db->index[1]);
+        }
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+        sprintf(str, "%-5i", numrows + 1);
+        assert(!rydb_find_row_str(db, str, &row));
+        sprintf(str, "%-5i", 2);
+        found = 0;
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          asserteq(row.num % 5, 2);
+          found++;
+        }
+        asserteq(found, expected);
+        
+        for(int i=1; i<=numrows; i+=2) {
+          assert_db_ok(db, rydb_delete_rownum(db, i));
+        }
+        if(t == 2) {
+          hashtable_robinhood_order_check(db, &db->index[0]);
+          hashtable_robinhood_order_check(db, &db->index[1]);
+        }
+        assert_db_ok(db, rydb_reopen(&db));
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, "%-5i", i);
+          if(i%2) {
+            assert(!rydb_find_row_str(db, str, &row));
+          }
+          else {
+            assert_db_ok(db, rydb_find_row_str(db, str, &row));
+            asserteq(row.num, i);
+          }
+        }
+        sprintf(str, "%-5i", 2);
+        found = 0;
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          asserteq(row.num % 10, 2);
+          found++;
+        }
+        asserteq(found, (expected + 1) / 2);
+      }
+    }
+    
+    test("background rehash catches up in bounded slices") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      rydb_config_index_hashtable_t cf = {
+        .rehash = RYDB_REHASH_BACKGROUND,
+        .hash_function = RYDB_HASH_SIPHASH,
+        .store_value = 1,
+        .store_hash = 1,
+        .collision_resolution = RYDB_OPEN_ADDRESSING
+      };
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_hashtable_header_t *header;
+      char str[32];
+      int numrows = 5000 * repeat_multiplier;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%izzzzzzzzzzzzzzzzzz", i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      header = (void *)db->index[0].index.file.start;
+      assert(header->bucket.count.bitlevels > 1);
+      assert(rydb_maintenance_pending(db));
+      int slices = 0;
+      while(rydb_maintenance_pending(db)) {
+        assert_db_ok(db, rydb_maintenance(db, 0)); //a zero budget still makes progress, one slice at a time
+        slices++;
+      }
+      assert(slices > 1);
+      header = (void *)db->index[0].index.file.start;
+      asserteq(header->bucket.count.bitlevels, 1);
+      asserteq(header->rehash.watermark, 0);
+      hashtable_header_count_check(db, &db->index[0], numrows);
+      for(int i=1; i<=numrows; i++) {
+        rydb_row_t row;
+        sprintf(str, "%izzzzzzzzzzzzzzzzzz", i);
+        assert_db_ok(db, rydb_find_row_str(db, str, &row));
+        asserteq(row.num, i);
+      }
+    }
+    
+    test("rebuilds an index with an old header version") {
+      config_testdb(db, 0);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_hashtable_header_t *header;
+      char str[64];
+      int numrows = 1000 * repeat_multiplier;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5i%-5i%-5izzzzz", i, i, i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      RYDB_EACH_INDEX(db, idx) {
+        header = (void *)idx->index.file.start;
+        asserteq(header->version, RYDB_HASHTABLE_HEADER_VERSION);
+        //what an index file from before the rehash watermark might look like
+        header->version = 0;
+        header->rehash.watermark = 12345;
+      }
+      assert_db_ok(db, rydb_reopen(&db));
+      RYDB_EACH_INDEX(db, idx) {
+        header = (void *)idx->index.file.start;
+        asserteq(header->version, RYDB_HASHTABLE_HEADER_VERSION);
+        asserteq(header->rehash.watermark, 0);
+        asserteq(header->bucket.count.bitlevels, 1);
+        hashtable_header_count_check(db, idx, numrows);
+      }
+      for(int i=1; i<=numrows; i++) {
+        rydb_row_t row;
+        sprintf(str, "%-5i", i);
+        assert_db_ok(db, rydb_find_row_str(db, str, &row));
+        asserteq(row.num, i);
+      }
+      
+      header = (void *)db->index[0].index.file.start;
+      header->version = RYDB_HASHTABLE_HEADER_VERSION + 1;
+      rydb_close(db);
+      db = rydb_new();
+      assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_FILE_INVALID, "header version.*newer");
+    }
+    
+    test("bulk rebuild from the data file") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      rydb_config_index_hashtable_t cf = {
+        .rehash = RYDB_REHASH_INCREMENTAL,
+        .hash_function = RYDB_HASH_CRC32,
+        .store_value = 1,
+        .store_hash = 1,
+        .collision_resolution = RYDB_OPEN_ADDRESSING
+      };
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf));
+      cf.store_hash = 0;
+      cf.rehash = RYDB_REHASH_ALL_AT_ONCE;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char str[32];
+      int numrows = 3000 * repeat_multiplier;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5i%-5izzzzzzzzzz", i, i%10);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      for(int i=1; i<=numrows; i+=3) {
+        assert_db_ok(db, rydb_delete_rownum(db, i));
+      }
+      int remaining = numrows - (numrows+2)/3;
+      assert_db_ok(db, rydb_index_rebuild(db, "primary"));
+      assert_db_ok(db, rydb_index_rebuild(db, "secondary"));
+      rydb_hashtable_header_t *header = (void *)db->index[0].index.file.start;
+      asserteq(header->bucket.count.bitlevels, 1);
+      assert(header->bucket.count.used <= header->bucket.count.load_factor_max);
+      hashtable_header_count_check(db, &db->index[0], remaining);
+      hashtable_header_count_check(db, &db->index[1], remaining);
+      for(int i=1; i<=numrows; i++) {
+        rydb_row_t row;
+        sprintf(str, "%-5i", i);
+        if((i-1)%3 == 0) {
+          asserteq(rydb_find_row_str(db, str, &row), false);
+        }
+        else {
+          assert_db_ok(db, rydb_find_row_str(db, str, &row));
+          asserteq(row.num, i);
+        }
+      }
+      int found = 0;
+      for(int g=0; g<10; g++) {
+        rydb_cursor_t cur;
+        rydb_row_t    row;
+        sprintf(str, "%-5i", g);
+        assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+        while(rydb_cursor_next(&cur, &row)) {
+          asserteq(atoi(&row.data[5]), g);
+          found++;
+        }
+      }
+      asserteq(found, remaining);
+      //still works as a normal hashtable afterwards
+      sprintf(str, "%-5i%-5izzzzzzzzzz", numrows+1, 0);
+      assert_db_ok(db, rydb_insert_str(db, str));
+      hashtable_header_count_check(db, &db->index[0], remaining + 1);
+      assert_db_fail(db, rydb_index_rebuild(db, "nope"), RYDB_ERROR_INDEX_NOT_FOUND);
+    }
+    
+    test("missing index file is rebuilt on open") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char str[32], indexpath[2048];
+      int numrows = 2000 * repeat_multiplier;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5izzzzzzzzzzzzzzz", i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      strcpy(indexpath, db->index[0].index.path);
+      rydb_close(db);
+      asserteq(unlink(indexpath), 0);
+      db = rydb_new();
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      hashtable_header_count_check(db, &db->index[0], numrows);
+      for(int i=1; i<=numrows; i++) {
+        rydb_row_t row;
+        sprintf(str, "%-5i", i);
+        assert_db_ok(db, rydb_find_row_str(db, str, &row));
+        asserteq(row.num, i);
+      }
+    }
+    
+    test("builds an index added to an open database just once") {
+      rydb_stats_t stats;
+      char str[32];
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i=1; i<=100; i++) {
+        sprintf(str, "%-5i%-5izzzzzzzzzz", i, i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      assert_db_ok(db, rydb_stats_enable(db, true));
+      assert_db_ok(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_UNIQUE, NULL));
+      rydb_stats(db, &stats);
+      asserteq(stats.counter.index_builds, 1);
+      assert_db_ok(db, rydb_index_add_direct(db, "direct", 0, 4, RYDB_INDEX_UNIQUE, NULL));
+      rydb_stats(db, &stats);
+      asserteq(stats.counter.index_builds, 2);
+      assert_db_ok(db, rydb_index_rebuild(db, "secondary"));
+      rydb_stats(db, &stats);
+      asserteq(stats.counter.index_builds, 3);
+      
+      //and it's left active, so opening it again doesn't build it over
+      assert_db_ok(db, rydb_reopen(&db));
+      RYDB_EACH_INDEX(db, idx) {
+        if(idx->config->type == RYDB_INDEX_HASHTABLE) {
+          asserteq(((rydb_hashtable_header_t *)idx->index.file.start)->active, 1);
+        }
+        else {
+          asserteq(((rydb_direct_header_t *)idx->index.file.start)->active, 1);
+        }
+      }
+    }
+    
+    test("add and drop indices on an open database") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char str[32], indexpath[2048];
+      rydb_row_t row;
+      int numrows = 2000 * repeat_multiplier;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5i%-5izzzzzzzzzz", i, numrows + 1 - i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      rydb_t *reader = rydb_new();
+      assert_db_ok(reader, rydb_open_reader(reader, path, "test"));
+      assert_db_fail(reader, rydb_index_add_hashtable(reader, "secondary", 5, 5, RYDB_INDEX_UNIQUE, NULL), RYDB_ERROR_NO_WRITE_PRIVILEGE);
+      assert_db_fail(db, rydb_index_add_hashtable(db, "secondary", 5, 50, RYDB_INDEX_UNIQUE, NULL), RYDB_ERROR_BAD_CONFIG, "out of bounds");
+      assert_db_ok(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_fail(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_UNIQUE, NULL), RYDB_ERROR_BAD_CONFIG, "already exists");
+      hashtable_header_count_check(db, &db->index[1], numrows);
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5i", numrows + 1 - i);
+        assert_db_ok(db, rydb_index_find_row_str(db, "secondary", str, &row));
+        asserteq(row.num, i);
+      }
+      //new rows get indexed, and the uniqueness constraint holds
+      sprintf(str, "%-5i%-5izzzzzzzzzz", numrows + 1, 0);
+      assert_db_ok(db, rydb_insert_str(db, str));
+      sprintf(str, "%-5i%-5izzzzzzzzzz", numrows + 2, 1);
+      assert_db_fail(db, rydb_insert_str(db, str), RYDB_ERROR_NOT_UNIQUE);
+      
+      //the reader picks up the new index after the switch
+      sprintf(str, "%-5i", 1);
+      assert_db_ok(reader, rydb_index_find_row_str(reader, "secondary", str, &row));
+      asserteq(row.num, numrows);
+      
+      //and it sticks around
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(db->config.index_count, 2);
+      sprintf(str, "%-5i", 0);
+      assert_db_ok(db, rydb_index_find_row_str(db, "secondary", str, &row));
+      asserteq(row.num, numrows + 1);
+      
+      rydb_cursor_t cur;
+      assert_db_ok(db, rydb_index_find_rows_str(db, "secondary", str, &cur));
+      strcpy(indexpath, db->index[1].index.path);
+      assert_db_fail(db, rydb_index_drop(db, "primary"), RYDB_ERROR_BAD_CONFIG);
+      assert_db_fail(db, rydb_index_drop(db, "nope"), RYDB_ERROR_INDEX_NOT_FOUND);
+      assert_db_ok(db, rydb_index_drop(db, "secondary"));
+      asserteq(rydb_cursor_next(&cur, &row), false);
+      asserteq(access(indexpath, F_OK), -1);
+      assert_db_fail(db, rydb_index_find_row_str(db, "secondary", str, &row), RYDB_ERROR_INDEX_NOT_FOUND);
+      assert_db_fail(reader, rydb_index_find_row_str(reader, "secondary", str, &row), RYDB_ERROR_INDEX_NOT_FOUND);
+      sprintf(str, "%-5i", numrows);
+      assert_db_ok(reader, rydb_find_row_str(reader, str, &row));
+      asserteq(row.num, numrows);
+      rydb_close(reader);
+    }
+    
+    test("unique index can't be added over duplicate data") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char str[64];
+      int numrows = 500 * repeat_multiplier + 10;
+      int files;
+      rydb_config_index_hashtable_t cf[] = {
+        {.hash_function = RYDB_HASH_SIPHASH, .store_value = 1, .store_hash = 1, .collision_resolution = RYDB_OPEN_ADDRESSING},
+        {.hash_function = RYDB_HASH_SIPHASH, .store_value = 0, .store_hash = 0, .rehash = RYDB_REHASH_ALL_AT_ONCE, .collision_resolution = RYDB_OPEN_ADDRESSING},
+        {.hash_function = RYDB_HASH_SIPHASH, .store_value = 1, .store_hash = 1, .collision_resolution = RYDB_SEPARATE_CHAINING},
+        {.hash_function = RYDB_HASH_SIPHASH, .store_value = 0, .store_hash = 1, .rehash = RYDB_REHASH_ALL_AT_ONCE, .collision_resolution = RYDB_ROBIN_HOOD}
+      };
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str, "%-5i%-5izzzzzzzzzz", i, i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      //just the one duplicate, somewhere in the middle
+      sprintf(str, "%-5i%-5izzzzzzzzzz", numrows + 1, numrows / 2);
+      assert_db_ok(db, rydb_insert_str(db, str));
+      files = count_files(path);
+      for(unsigned i=0; i < sizeof(cf)/sizeof(*cf); i++) {
+        assert_db_fail(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_UNIQUE, &cf[i]), RYDB_ERROR_NOT_UNIQUE, "must be unique");
+        asserteq(db->config.index_count, 1);
+        //the half-built index files are gone
+        asserteq(count_files(path), files);
+      }
+      assert_db_ok(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf[0]));
+      assert_db_ok(db, rydb_index_add_hashtable(db, "tertiary", 0, 5, RYDB_INDEX_UNIQUE, &cf[2]));
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(db->config.index_count, 3);
+    }
+    
+    test("won't build a table bigger than its bucket numbers can count") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      char str[64];
+      int files;
+      //1000 rows at this load factor would need 10^10 buckets
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_SIPHASH, .store_hash = 1, .load_factor_max = 1e-7};
+      for(int i=1; i<=1000; i++) {
+        sprintf(str, "%-5i%-5izzzzzzzzzz", i, i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+      }
+      files = count_files(path);
+      assert_db_fail(db, rydb_index_add_hashtable(db, "secondary", 5, 5, RYDB_INDEX_DEFAULT, &cf), RYDB_ERROR_DATA_TOO_LARGE, "Too many rows");
+      asserteq(db->config.index_count, 1);
+      asserteq(count_files(path), files);
+    }
+    
+    for(t=0; t<3; t++) {
+      sprintf(testname, "delete rows in %s hashtable", rydb_hashfunction_to_str(hashfunction[t]));
+      test(testname) {
+        assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+        rydb_config_index_hashtable_t cf = {
+          .hash_function = hashfunction[t],
+          .store_value = 0,
+          .store_hash = 1,
+          .collision_resolution = RYDB_OPEN_ADDRESSING
+        };
+        rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf);
+        cf.store_value = 1;
+        rydb_config_add_index_hashtable(db, "secondary", 0, 5, RYDB_INDEX_DEFAULT, &cf);
+        cf.store_hash = 0;
+        cf.rehash = RYDB_REHASH_ALL_AT_ONCE;
+        rydb_config_add_index_hashtable(db, "tertiary", 0, 5, RYDB_INDEX_DEFAULT, &cf);
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        char str[128];
+        char *fmt = "%izzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz";
+        int numrows = 1000 * repeat_multiplier;
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, fmt, i);
+          assert_db_ok(db, rydb_insert_str(db, str));
+        }
+        hashtable_header_count_check(db, &db->index[0], numrows);
+        
+        for(int i=1; i<=numrows; i++) {
+          sprintf(str, fmt, i);
+          assert_db_ok(db, rydb_delete_rownum(db, i));
+          hashtable_header_count_check(db, &db->index[0], numrows - i);
+          //rydb_hashtable_print(db, &db->index[0]);
+          for(int j=1; j<=numrows; j++) {
+            sprintf(str, fmt, j);
+            rydb_row_t found_row, found_row2, found_row3;
+            int        rc, rc2, rc3;
+            //printf("find %s\n", str);
+            rc = rydb_find_row_str(db, str, &found_row);
+            rc2 = rydb_index_find_row_str(db, "secondary", str, &found_row2);
+            rc3 = rydb_index_find_row_str(db, "tertiary", str, &found_row3);
+            assert_db(db);
+            if(j <= i) {
+              asserteq(rc, 0);
+              asserteq(rc2, 0);
+              asserteq(rc3, 0);
+            }
+            else {
+              assert(rc);
+              assert(rc2);
+              assert(rc3);
+              asserteq(found_row.num, j);
+              asserteq(found_row2.num, j);
+              asserteq(found_row3.num, j);
+            }
+          }
+        }
+      }
+    }
+    
+    for(t=0; t<3; t++) {
+      sprintf(testname, "works with long index %s hashtable", rydb_hashfunction_to_str(hashfunction[t]));
+      test(testname) {
+        int rowlen = 2000, indexlen = 1500;
+        char *data = malloc(rowlen+1);
+        assert_db_ok(db, rydb_config_row(db, rowlen, indexlen));
+        rydb_config_index_hashtable_t cf = {
+          .hash_function = hashfunction[t],
+          .store_value = 0,
+          .store_hash = 1,
+          .collision_resolution = RYDB_OPEN_ADDRESSING
+        };
+        rydb_config_add_index_hashtable(db, "primary", 0, indexlen, RYDB_INDEX_UNIQUE, &cf);
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        int numrows = 1000 * repeat_multiplier;
+        for(int i=1; i<=numrows; i++) {
+          rydb_row_t row;
+          data_fill(data, rowlen, i);
+          assert_db_ok(db, rydb_insert_str(db, data));
+          int rc = rydb_find_row_str(db, data, &row);
+          asserteq(rc, 1);
+          asserteq(memcmp(data, row.data, rowlen), 0);
+        }
+        free(data);
+      }
+    }
+    
+    for(t=0; t<3; t++) {
+      sprintf(testname, "uses fixed-length kernels for %s hashtable keys", rydb_hashfunction_to_str(hashfunction[t]));
+      test(testname) {
+        int keylen[] = {3, 4, 8, 16, 24, 32};
+        char str[64], other[64];
+        rydb_row_t row;
+        for(unsigned k=0; k<sizeof(keylen)/sizeof(keylen[0]); k++) {
+          int len = keylen[k];
+          assert_db_ok(db, rydb_config_row(db, 40, len));
+          rydb_config_index_hashtable_t cf = {
+            .hash_function = hashfunction[t],
+            .store_hash = 1,
+            .collision_resolution = RYDB_OPEN_ADDRESSING
+          };
+          assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, len, RYDB_INDEX_UNIQUE, &cf));
+          assert_db_ok(db, rydb_open(db, path, "test"));
+          rydb_index_state_hashtable_t *state = &db->index[0].state.hashtable;
+          const uint8_t *key = db->config.hash_key.value;
+          int numrows = 200 * repeat_multiplier;
+          for(int i=1; i<=numrows; i++) {
+            data_fill(str, 40, i);
+            memcpy(other, str, 40);
+            other[len - 1]++;
+            switch(hashfunction[t]) {
+              case RYDB_HASH_SIPHASH:
+                asserteq(state->hash_function(str, len, key), siphash((uint8_t *)str, len, key));
+                break;
+              case RYDB_HASH_CRC32:
+                asserteq(state->hash_function(str, len, key), crc32((uint8_t *)str, len));
+                break;
+              default:
+                break;
+            }
+            asserteq(state->compare(str, str, len), 0);
+            assertneq(state->compare(str, other, len), 0);
+            assert_db_ok(db, rydb_insert(db, str, 40));
+          }
+          for(int i=1; i<=numrows; i++) {
+            data_fill(str, 40, i);
+            assert_db_ok(db, rydb_find_row(db, str, len, &row));
+            asserteq(row.num, i);
+          }
+          rydb_close(db);
+          rmdir_recursive(path);
+          db = rydb_new();
+          strcpy(path, "test.db.XXXXXX");
+          mkdtemp(path);
+        }
+      }
+    }
+    
+    test("integer key config") {
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 8));
+      rydb_config_index_hashtable_t cf = {
+        .hash_function = RYDB_HASH_INTEGER,
+        .store_hash = 1
+      };
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 5, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "4- or 8-byte key");
+      cf.hash_function = RYDB_HASH_SIPHASH;
+      cf.integer_big_endian = 1;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "primary", 0, 8, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "requires the integer hash function");
+      cf.hash_function = RYDB_HASH_INTEGER;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, 8, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(db->config.index[0].type_config.hashtable.hash_function, RYDB_HASH_INTEGER);
+      assert(db->config.index[0].type_config.hashtable.integer_big_endian);
+    }
+    
+    for(t=0; t<4; t++) {
+      sprintf(testname, "spreads sequential %i-bit %s-endian ids in integer-keyed hashtable", t < 2 ? 64 : 32, t % 2 ? "big" : "little");
+      test(testname) {
+        int width = t < 2 ? 8 : 4, big_endian = t % 2;
+        assert_db_ok(db, rydb_config_row(db, ROW_LEN, width));
+        rydb_config_index_hashtable_t cf = {
+          .hash_function = RYDB_HASH_INTEGER,
+          .integer_big_endian = big_endian,
+          .store_hash = 1,
+          .rehash = RYDB_REHASH_ALL_AT_ONCE,
+          .collision_resolution = RYDB_OPEN_ADDRESSING
+        };
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "primary", 0, width, RYDB_INDEX_UNIQUE, &cf));
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        char str[ROW_LEN];
+        rydb_row_t row;
+        int numrows = 4000 * repeat_multiplier;
+        uint64_t base = (uint64_t )1 << (width * 8 - 16);
+        for(int i=1; i<=numrows; i++) {
+          uint64_t id = base + i;
+          memset(str, 'z', ROW_LEN);
+          for(int b=0; b<width; b++) {
+            str[big_endian ? width - 1 - b : b] = (char )(id >> (b * 8));
+          }
+          assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+        }
+        //sequential ids mustn't pile up into long probe runs
+        rydb_hashtable_header_t *header = (void *)db->index[0].index.file.start;
+        int run = 0, longest_run = 0;
+        for(uint64_t i = 0; i < header->bucket.count.total; i++) {
+          run = BUCKET_STORED_ROWNUM(&db->index[0].index.data.start[i * 12]) ? run + 1 : 0;
+          longest_run = MAX(run, longest_run);
+        }
+        assert(longest_run < 16);
+        for(int i=numrows; i>=1; i--) {
+          uint64_t id = base + i;
+          for(int b=0; b<width; b++) {
+            str[big_endian ? width - 1 - b : b] = (char )(id >> (b * 8));
+          }
+          assert_db_ok(db, rydb_find_row(db, str, width, &row));
+          asserteq(row.num, i);
+        }
+        str[big_endian ? width - 1 : 0]++;
+        str[big_endian ? width - 2 : 1] = (char )0xff;
+        assert(!rydb_find_row(db, str, width, &row));
+        
+        //compares give the integers' order
+        char lo[8], hi[8];
+        memset(lo, 0, 8);
+        memset(hi, 0, 8);
+        lo[big_endian ? width - 1 : 0] = 2;
+        hi[big_endian ? 0 : width - 1] = 1;
+        assert(db->index[0].state.hashtable.compare(lo, hi, width) < 0);
+        assert(db->index[0].state.hashtable.compare(hi, lo, width) > 0);
+        asserteq(db->index[0].state.hashtable.compare(hi, hi, width), 0);
+      }
+    }
+    
+    it("obeys uniqueness criteria") {
+      //char str[128];
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_ok(db, rydb_insert_str(db, "hello this is a string"));
+      assert_db_ok(db, rydb_insert_str(db, "oh this is a different string"));
+      assert_db_ok(db, rydb_insert_str(db, "samestring"));
+      assert_db_fail(db, rydb_insert_str(db, "samestring"), RYDB_ERROR_NOT_UNIQUE, "primary must be unique");
+    }
+  }
+
+  subdesc(direct) {
+    static char str[ROW_LEN];
+
+    it("rejects bad config") {
+      rydb_config_index_direct_t cf = {.big_endian = 1};
+      assert_db_fail(db, rydb_config_add_index_direct(db, "id", 8, 5, RYDB_INDEX_UNIQUE, NULL), RYDB_ERROR_BAD_CONFIG, "4- or 8-byte integer key");
+      assert_db_fail(db, rydb_config_add_index_direct(db, "id", 8, 4, RYDB_INDEX_DEFAULT, NULL), RYDB_ERROR_BAD_CONFIG, "must be unique");
+      assert_db_ok(db, rydb_config_add_index_direct(db, "id", 8, 4, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_ok(db, rydb_reopen(&db));
+      rydb_index_t *idx = &db->index[0]; //sorted ahead of "primary"
+      asserteq(idx->config->type, RYDB_INDEX_DIRECT);
+      assert(idx->config->type_config.direct.big_endian);
+    }
+
+    it("finds dense and sparse keys") {
+      assert_db_ok(db, rydb_config_add_index_direct(db, "id", 8, 4, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      int       numrows = 3000 * repeat_multiplier + 2;
+      uint32_t  key;
+      rydb_row_t row;
+      for(int i=1; i<=numrows; i++) {
+        //the first half are dense, the rest are spread out one per leaf page
+        key = i <= numrows/2 ? (uint32_t )i : (uint32_t )i * RYDB_DIRECT_PAGE_SLOTS * 7 + 3;
+        memset(str, 'z', ROW_LEN);
+        sprintf(str, "%05i", i);
+        for(int b=0; b<4; b++) str[8 + b] = (char )(key >> (b * 8));
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      rydb_direct_header_t *header = (void *)db->index[0].index.file.start;
+      asserteq(header->count, (rydb_rownum_t )numrows);
+      asserteq(header->pages, (rydb_rownum_t )(numrows/2 / RYDB_DIRECT_PAGE_SLOTS + 1 + numrows - numrows/2));
+      assert_db_ok(db, rydb_reopen(&db));
+      for(int i=numrows; i>=1; i--) {
+        key = i <= numrows/2 ? (uint32_t )i : (uint32_t )i * RYDB_DIRECT_PAGE_SLOTS * 7 + 3;
+        for(int b=0; b<4; b++) str[b] = (char )(key >> (b * 8));
+        assert_db_ok(db, rydb_index_find_row(db, "id", str, 4, &row));
+        asserteq(row.num, i);
+        key++;
+        for(int b=0; b<4; b++) str[b] = (char )(key >> (b * 8));
+        if(i > numrows/2) {
+          assert(!rydb_index_find_row(db, "id", str, 4, &row));
+        }
+      }
+      memset(str, (char )0xff, 4);
+      assert(!rydb_index_find_row(db, "id", str, 4, &row));
+
+      rydb_cursor_t cur;
+      key = 10;
+      for(int b=0; b<4; b++) str[b] = (char )(key >> (b * 8));
+      assert_db_ok(db, rydb_index_find_rows(db, "id", str, 4, &cur));
+      assert(rydb_cursor_next(&cur, &row));
+      asserteq(row.num, 10);
+      assert(!rydb_cursor_next(&cur, &row));
+    }
+
+    it("follows deletes and updates") {
+      assert_db_ok(db, rydb_config_add_index_direct(db, "id", 8, 4, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_row_t row;
+      for(int i=1; i<=20; i++) {
+        memset(str, '\00', ROW_LEN);
+        sprintf(str, "%05i", i);
+        str[8] = (char )(i * 3);
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      memset(str, '\00', 4);
+      str[0] = 15;
+      assert_db_ok(db, rydb_delete_rownum(db, 5));
+      assert(!rydb_index_find_row(db, "id", str, 4, &row));
+      assert_db_fail(db, rydb_update_rownum(db, 6, "\x15", 8, 1), RYDB_ERROR_NOT_UNIQUE, "id must be unique");
+      str[0] = 18;
+      assert_db_ok(db, rydb_update_rownum(db, 6, "\x7f", 8, 1));
+      assert(!rydb_index_find_row(db, "id", str, 4, &row));
+      str[0] = 0x7f;
+      assert_db_ok(db, rydb_index_find_row(db, "id", str, 4, &row));
+      asserteq(row.num, 6);
+      str[0] = 21;
+      assert_db_ok(db, rydb_reopen(&db));
+      assert_db_ok(db, rydb_index_find_row(db, "id", str, 4, &row));
+      asserteq(row.num, 7);
+      assert_db_ok(db, rydb_index_rebuild(db, "id"));
+      assert_db_ok(db, rydb_index_find_row(db, "id", str, 4, &row));
+      asserteq(row.num, 7);
+      str[0] = 15;
+      assert(!rydb_index_find_row(db, "id", str, 4, &row));
+    }
+
+    it("enforces uniqueness and the key range") {
+      assert_db_ok(db, rydb_config_add_index_direct(db, "id", 8, 8, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      memset(str, '\00', ROW_LEN);
+      strcpy(str, "one");
+      str[8] = 1;
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      strcpy(str, "two");
+      assert_db_fail(db, rydb_insert(db, str, ROW_LEN), RYDB_ERROR_NOT_UNIQUE, "id must be unique");
+      str[12] = 1;
+      assert_db_fail(db, rydb_insert(db, str, ROW_LEN), RYDB_ERROR_DATA_TOO_LARGE, "too large for direct index id");
+      str[12] = 0;
+      str[11] = (char )0xff;
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+
+    it("builds when added to an open db") {
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_row_t row;
+      for(int i=1; i<=100; i++) {
+        memset(str, '\00', ROW_LEN);
+        sprintf(str, "%05i", i);
+        str[8] = (char )(i * 2);
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      assert_db_ok(db, rydb_index_add_direct(db, "id", 8, 4, RYDB_INDEX_UNIQUE, NULL));
+      memset(str, '\00', 4);
+      str[0] = 100;
+      assert_db_ok(db, rydb_index_find_row(db, "id", str, 4, &row));
+      asserteq(row.num, 50);
+      assert_db_fail(db, rydb_index_add_direct(db, "twice", 0, 4, RYDB_INDEX_UNIQUE, NULL), RYDB_ERROR_NOT_UNIQUE, "twice must be unique");
+    }
+  }
+
+  subdesc(composite) {
+    static char str[ROW_LEN];
+    static char key[ROW_LEN];
+
+    it("rejects bad config") {
+      rydb_index_segment_t bad[] = {{.start = 0, .len = 4}, {.start = 10, .len = 0}};
+      assert_db_fail(db, rydb_config_add_index_hashtable_composite(db, "comp", bad, 0, RYDB_INDEX_DEFAULT, NULL), RYDB_ERROR_BAD_CONFIG, "between 1 and [0-9]+ segments");
+      assert_db_fail(db, rydb_config_add_index_hashtable_composite(db, "comp", bad, RYDB_INDEX_MAX_SEGMENTS + 1, RYDB_INDEX_DEFAULT, NULL), RYDB_ERROR_BAD_CONFIG, "between 1 and [0-9]+ segments");
+      assert_db_fail(db, rydb_config_add_index_hashtable_composite(db, "comp", bad, 2, RYDB_INDEX_DEFAULT, NULL), RYDB_ERROR_BAD_CONFIG, "segment 1 is empty");
+      bad[1].len = 12;
+      assert_db_fail(db, rydb_config_add_index_hashtable_composite(db, "comp", bad, 2, RYDB_INDEX_DEFAULT, NULL), RYDB_ERROR_BAD_CONFIG, "out of bounds");
+      bad[1].len = 4;
+      assert_db_ok(db, rydb_config_add_index_hashtable_composite(db, "comp", bad, 1, RYDB_INDEX_DEFAULT, NULL));
+      asserteq(db->config.index[0].segment_count, 0); //a single segment is just a plain index
+      asserteq(db->config.index[0].start, 0);
+      asserteq(db->config.index[0].len, 4);
+    }
+
+    it("finds rows with siphash") {
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_SIPHASH, .store_value = 0, .store_hash = 1, .collision_resolution = RYDB_OPEN_ADDRESSING};
+      composite_find_test(&db, path, &cf);
+    }
+    it("finds rows with crc32 and stored values") {
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_CRC32, .store_value = 1, .store_hash = 1, .collision_resolution = RYDB_ROBIN_HOOD};
+      composite_find_test(&db, path, &cf);
+    }
+    it("finds rows with nohash in chains") {
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_NOHASH, .store_value = 0, .store_hash = 0, .collision_resolution = RYDB_SEPARATE_CHAINING};
+      composite_find_test(&db, path, &cf);
+    }
+
+    it("follows updates to any segment") {
+      rydb_row_t row;
+      assert_db_ok(db, rydb_config_add_index_hashtable_composite(db, "comp", composite_seg, 3, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i=1; i<=20; i++) {
+        composite_row(str, i);
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      //the middle segment only; makes row 4's key the same as row 3's
+      assert_db_fail(db, rydb_update_rownum(db, 4, "k003", 5, 4), RYDB_ERROR_NOT_UNIQUE, "comp must be unique");
+      assert_db_ok(db, rydb_update_rownum(db, 4, "v9999", 12, 5));
+      composite_row(str, 4);
+      composite_key(str, key);
+      assert(!rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+      memcpy(&str[12], "v9999", 5);
+      composite_key(str, key);
+      assert_db_ok(db, rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+      asserteq(row.num, 4);
+      assert_db_ok(db, rydb_delete_rownum(db, 4));
+      assert(!rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+    }
+
+    it("checks segments in the metadata") {
+      assert_db_ok(db, rydb_config_add_index_hashtable_composite(db, "comp", composite_seg, 3, RYDB_INDEX_DEFAULT, NULL));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_close(db);
+      db = rydb_new();
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      rydb_index_segment_t other[] = {{.start = 12, .len = 3}, {.start = 5, .len = 7}, {.start = 15, .len = 4}};
+      assert_db_ok(db, rydb_config_add_index_hashtable_composite(db, "comp", other, 3, RYDB_INDEX_DEFAULT, NULL));
+      assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_CONFIG_MISMATCH, "[Mm]ismatch");
+      rydb_close(db);
+      db = rydb_new();
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      asserteq(db->config.index[0].segment_count, 3);
+      asserteq(db->config.index[0].segment[2].start, 15);
+      asserteq(db->config.index[0].segment[2].len, 5);
+      asserteq(db->config.index[0].start, 12);
+      asserteq(db->config.index[0].len, COMPOSITE_KEY_LEN);
+    }
+
+    it("builds when added to an open db") {
+      rydb_row_t row;
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i=1; i<=300; i++) {
+        composite_row(str, i);
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      assert_db_ok(db, rydb_index_add_hashtable_composite(db, "comp", composite_seg, 3, RYDB_INDEX_UNIQUE, NULL));
+      composite_row(str, 250);
+      composite_key(str, key);
+      assert_db_ok(db, rydb_index_find_row(db, "comp", key, COMPOSITE_KEY_LEN, &row));
+      asserteq(row.num, 250);
+    }
+  }
+
+  subdesc(partial) {
+    static char str[ROW_LEN];
+
+    it("rejects bad config") {
+      assert_db_fail(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x01), RYDB_ERROR_INDEX_NOT_FOUND, "active does not exist");
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "active", 5, 7, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_fail(db, rydb_config_index_filter(db, "active", ROW_LEN, 0x01, 0x01), RYDB_ERROR_BAD_CONFIG, "filter is out of bounds");
+      assert_db_fail(db, rydb_config_index_filter(db, "active", 19, 0x00, 0x00), RYDB_ERROR_BAD_CONFIG, "mask can't be 0");
+      assert_db_fail(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x03), RYDB_ERROR_BAD_CONFIG, "would never match");
+      assert_db_ok(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x01));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_fail(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x00), RYDB_ERROR_DATABASE_OPEN, "cannot be configured");
+    }
+
+    it("indexes only the rows that match") {
+      rydb_row_t row;
+      char       name[16];
+      int        numrows = 500 * repeat_multiplier + 2;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "active", 5, 7, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x01));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i=1; i<=numrows; i++) {
+        //inactive rows can share names with anything
+        sprintf(name, "n%05i", i % 2 ? i : 1);
+        partial_row(str, i, name, i % 2 ? 0x03 : 0x02);
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      asserteq(partial_used(db), (rydb_rownum_t )(numrows - numrows/2));
+      assert_db_ok(db, rydb_reopen(&db));
+      assert_db_ok(db, rydb_index_rebuild(db, "active"));
+      asserteq(partial_used(db), (rydb_rownum_t )(numrows - numrows/2));
+      for(int i=1; i<=numrows; i+=2) {
+        sprintf(name, "n%05i", i);
+        assert_db_ok(db, rydb_index_find_row_str(db, "active", name, &row));
+        asserteq(row.num, i);
+      }
+      sprintf(name, "n%05i", 2);
+      assert(!rydb_index_find_row_str(db, "active", name, &row));
+      //but they can't share a name with another active row
+      partial_row(str, numrows + 1, "n00001", 0x01);
+      assert_db_fail(db, rydb_insert(db, str, ROW_LEN), RYDB_ERROR_NOT_UNIQUE, "active must be unique");
+      partial_row(str, numrows + 1, "n00001", 0x00);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      assert_db_ok(db, rydb_delete_rownum(db, 2));
+      assert_db_ok(db, rydb_delete_rownum(db, 3));
+      sprintf(name, "n%05i", 3);
+      assert(!rydb_index_find_row_str(db, "active", name, &row));
+      asserteq(partial_used(db), (rydb_rownum_t )(numrows - numrows/2 - 1));
+    }
+
+    it("moves rows in and out on update") {
+      rydb_row_t row;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "active", 5, 7, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_config_index_filter(db, "active", 19, 0x01, 0x01));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      partial_row(str, 1, "alice", 0x01);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      partial_row(str, 2, "alice", 0x00);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      partial_row(str, 3, "bob", 0x00);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      asserteq(partial_used(db), 1);
+      
+      assert_db_fail(db, rydb_update_rownum(db, 2, "\x01", 19, 1), RYDB_ERROR_NOT_UNIQUE, "active must be unique");
+      assert_db_ok(db, rydb_update_rownum(db, 3, "\x01", 19, 1));
+      assert_db_ok(db, rydb_index_find_row_str(db, "active", "bob", &row));
+      asserteq(row.num, 3);
+      //the status flips along with the key
+      assert_db_ok(db, rydb_update_rownum(db, 3, "robert\00\00\00\00\00\00\00\00", 5, 15));
+      assert(!rydb_index_find_row_str(db, "active", "bob", &row));
+      assert(!rydb_index_find_row_str(db, "active", "robert", &row));
+      asserteq(partial_used(db), 1);
+      //an inactive row's key can change without touching the index
+      assert_db_ok(db, rydb_update_rownum(db, 2, "carol", 5, 5));
+      assert_db_ok(db, rydb_update_rownum(db, 1, "\x00", 19, 1));
+      asserteq(partial_used(db), 0);
+      assert(!rydb_index_find_row_str(db, "active", "alice", &row));
+      assert_db_ok(db, rydb_update_rownum(db, 2, "\x01", 19, 1));
+      assert_db_ok(db, rydb_index_find_row_str(db, "active", "carol", &row));
+      asserteq(row.num, 2);
+      //other bits don't matter
+      assert_db_ok(db, rydb_update_rownum(db, 2, "\x81", 19, 1));
+      assert_db_ok(db, rydb_index_find_row_str(db, "active", "carol", &row));
+      asserteq(partial_used(db), 1);
+      
+      //deleting an inactive row doesn't free up its key inside a transaction
+      partial_row(str, 4, "carol", 0x00);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      assert_db_ok(db, rydb_transaction_start(db));
+      assert_db_ok(db, rydb_delete_rownum(db, 4));
+      partial_row(str, 5, "carol", 0x01);
+      assert_db_fail(db, rydb_insert(db, str, ROW_LEN), RYDB_ERROR_NOT_UNIQUE, "active must be unique");
+      assert_db_ok(db, rydb_transaction_finish(db));
+    }
+
+    it("checks the filter in the metadata") {
+      assert_db_ok(db, rydb_config_add_index_direct(db, "active", 8, 4, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_ok(db, rydb_config_index_filter(db, "active", 19, 0x0f, 0x01));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      rydb_close(db);
+      db = rydb_new();
+      assert_db_ok(db, rydb_config_row(db, ROW_LEN, 5));
+      assert_db_ok(db, rydb_config_add_index_direct(db, "active", 8, 4, RYDB_INDEX_UNIQUE, NULL));
+      assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_CONFIG_MISMATCH, "index 0 filter");
+      rydb_close(db);
+      db = rydb_new();
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      asserteq(db->config.index[0].filter.offset, 19);
+      asserteq(db->config.index[0].filter.mask, 0x0f);
+      asserteq(db->config.index[0].filter.value, 0x01);
+      rydb_row_t row;
+      partial_row(str, 1, "", 0x11);
+      str[8] = 7;
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      partial_row(str, 2, "", 0x12);
+      str[8] = 7;
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      assert_db_ok(db, rydb_index_find_row(db, "active", "\x07\x00\x00\x00", 4, &row));
+      asserteq(row.num, 1);
+    }
+  }
+
+  subdesc(covering) {
+    static char str[ROW_LEN];
+    static char covered[8];
+
+    it("rejects bad config") {
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_SIPHASH, .store_value = 0, .store_hash = 1, .cover_start = 12, .cover_len = 8};
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "requires store_value");
+      cf.store_value = 1;
+      cf.cover_len = 9;
+      assert_db_fail(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_UNIQUE, &cf), RYDB_ERROR_BAD_CONFIG, "cover is out of bounds");
+      cf.cover_len = 8;
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      assert_db_fail(db, rydb_index_find_covered(db, "primary", "00001", 5, covered, NULL), RYDB_ERROR_WRONG_INDEX_TYPE, "not a covering index");
+      assert_db_ok(db, rydb_reopen(&db));
+      asserteq(db->index[0].config->type_config.hashtable.cover_start, 12);
+      asserteq(db->index[0].config->type_config.hashtable.cover_len, 8);
+    }
+
+    static int cr;
+    for(cr = RYDB_OPEN_ADDRESSING; cr <= RYDB_ROBIN_HOOD; cr++) {
+      static char testname[64];
+      sprintf(testname, "reads covered bytes from the index only (%s)", cr == RYDB_OPEN_ADDRESSING ? "open addressing" : cr == RYDB_SEPARATE_CHAINING ? "chaining" : "Robin Hood");
+      it(testname) {
+        rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_SIPHASH, .store_value = 1, .store_hash = 1, .collision_resolution = cr, .cover_start = 12, .cover_len = 8};
+        rydb_rownum_t rownum;
+        uint64_t      counter;
+        int           numrows = 500 * repeat_multiplier + 2;
+        assert_db_ok(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_UNIQUE, &cf));
+        assert_db_ok(db, rydb_open(db, path, "test"));
+        for(int i=1; i<=numrows; i++) {
+          memset(str, '\00', ROW_LEN);
+          sprintf(str, "%05in%05i", i, i);
+          counter = i * 1000;
+          memcpy(&str[12], &counter, sizeof(counter));
+          assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+        }
+        assert_db_ok(db, rydb_reopen(&db));
+        for(int i=1; i<=numrows; i++) {
+          //scribble over the data file's copy. the index's copy is the one we should get
+          char *rowdata = (char *)rydb_rownum_to_row(db, i)->data;
+          memset(&rowdata[12], 0xff, 8);
+        }
+        for(int i=numrows; i>=1; i--) {
+          sprintf(str, "n%05i", i);
+          assert_db_ok(db, rydb_index_find_covered(db, "name", str, 6, covered, &rownum));
+          asserteq(rownum, i);
+          memcpy(&counter, covered, sizeof(counter));
+          asserteq(counter, (uint64_t )i * 1000);
+        }
+        assert(!rydb_index_find_covered(db, "name", "nope", 4, covered, NULL));
+      }
+    }
+
+    it("keeps covered bytes up to date") {
+      rydb_config_index_hashtable_t cf = {.hash_function = RYDB_HASH_CRC32, .store_value = 1, .store_hash = 0, .rehash = RYDB_REHASH_ALL_AT_ONCE, .cover_start = 12, .cover_len = 8};
+      assert_db_ok(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_UNIQUE, &cf));
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      for(int i=1; i<=20; i++) {
+        memset(str, '\00', ROW_LEN);
+        sprintf(str, "%05in%05i", i, i);
+        strcpy(&str[12], "count");
+        assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      }
+      assert_db_ok(db, rydb_update_rownum(db, 7, "COUNTED", 12, 7));
+      assert_db_ok(db, rydb_index_find_covered(db, "name", "n00007", 6, covered, NULL));
+      assert(memcmp(covered, "COUNTED\00", 8) == 0);
+      //covered bytes can overlap the key too
+      assert_db_ok(db, rydb_update_rownum(db, 8, "n00108\00CO", 5, 9));
+      assert(!rydb_index_find_covered(db, "name", "n00008", 6, covered, NULL));
+      assert_db_ok(db, rydb_index_find_covered(db, "name", "n00108", 6, covered, NULL));
+      assert(memcmp(covered, "COunt\00\00\00", 8) == 0);
+      assert_db_ok(db, rydb_index_rebuild(db, "name"));
+      assert_db_ok(db, rydb_index_find_covered(db, "name", "n00007", 6, covered, NULL));
+      assert(memcmp(covered, "COUNTED\00", 8) == 0);
+      assert_db_ok(db, rydb_delete_rownum(db, 7));
+      assert(!rydb_index_find_covered(db, "name", "n00007", 6, covered, NULL));
+    }
+  }
+
+}
+describe(storage) {
+  static rydb_t *db;
+  static char path[64];
+  static char *data;
+  static int  maxlen = 0;
+  before_each() {
+    db = rydb_new();
+    strcpy(path, "test.db.XXXXXX");
+    mkdtemp(path);
+    data = malloc(maxlen+1);
+  }
+  after_each() {
+    rydb_close(db);
+    rmdir_recursive(path);
+    free(data);
+  }
+  
+  static char testname[128];
+  maxlen = RYDB_ROW_LEN_MAX - RYDB_ROW_DATA_OFFSET;
+  static int rowlens[] = {1, 2 , 8, 15, 16, 32, 64, 100, 1000, 5000, 10000, 20000, 50000, 60000, 65500};
+  static unsigned rowlen_n;
+  static int rowlen;
+
+  static int max_rownum = 500;
+  max_rownum *= repeat_multiplier;
+
+  test("row length cannot exceed UINT16_MAX") {
+    assert_db_fail(db, rydb_config_row(db, maxlen+1, 5), RYDB_ERROR_BAD_CONFIG, "length [0-9]+ cannot exceed");
+    assert_db_ok(db, rydb_config_row(db, maxlen-8, 5));
+  }
+  
+  for(rowlen_n = 0; rowlen_n < sizeof(rowlens)/sizeof(int); rowlen_n++) {
+    rowlen = rowlens[rowlen_n];
+    sprintf(testname, "storage with row length %i", rowlen);
+    test(testname) {
+      config_testdb(db, rowlen);
+      assert_db_ok(db, rydb_open(db, path, "test"));
+      int rownum = max_rownum;
+      if(rowlen == 1) rownum = MIN(9, rownum);
+      else if(rowlen == 2) rownum = MIN(99, rownum);
+      else if(rowlen == 3) rownum = MIN(999, rownum);
+      else if(rowlen == 4) rownum = MIN(9999, rownum);
+      
+      for(int i=1; i<=rownum; i++) {
+        data_fill(data, rowlen, i);
+        assert_db_ok(db, rydb_insert_str(db, data));
+      }
+      for(int i=1; i<=rownum + 4; i++) {
+        rydb_row_t row;
+        int rc = rydb_find_row_at(db, i, &row);
+        //printf("%i\n", i);
+        if(i<=rownum) {
+          data_fill(data, rowlen, i);
+          asserteq(rc, 1);
+          
+          asserteq(memcmp(data, row.data, rowlen), 0);
+        }
+        else if(i == rownum + 1) {
+          asserteq(rc, 1);
+          asserteq(row.type, RYDB_ROW_EMPTY);
+        }
+        else {
+          asserteq(rc, 0);
+        }
+      }
+    }
+  }
+}
+
+//every row's group entry matches the data file, and the group cursor sees just the data rows
+static void column_group_check(rydb_t *db, const char *name, uint16_t start, uint16_t len) {
+  rydb_row_t    row, grprow;
+  rydb_cursor_t cur;
+  int           n = 0, n_check = 0;
+  for(rydb_rownum_t i = 1; rydb_find_row_at(db, i, &row) && i < db->data_next_rownum; i++) {
+    assert_db_ok(db, rydb_column_group_find_row_at(db, name, i, &grprow));
+    asserteq(grprow.num, i);
+    asserteq(grprow.type, row.type);
+    asserteq(grprow.start, start);
+    asserteq(grprow.len, len);
+    if(row.type == RYDB_ROW_DATA) {
+      assert(memcmp(grprow.data, &row.data[start], len) == 0);
+      n++;
+    }
+  }
+  assert_db_ok(db, rydb_column_group_rows(db, name, &cur));
+  while(rydb_cursor_next(&cur, &grprow)) {
+    asserteq(grprow.type, RYDB_ROW_DATA);
+    n_check++;
+  }
+  asserteq(n, n_check);
+}
+
+describe(column_groups) {
+  static rydb_t    *db;
+  static char       path[64];
+  static char       str[ROW_LEN];
+  static int        numrows;
+  before_each() {
+    numrows = 500 * repeat_multiplier + 10;
+    db = rydb_new();
+    strcpy(path, "test.db.XXXXXX");
+    mkdtemp(path);
+    assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+  }
+  after_each() {
+    if(db) rydb_close(db);
+    rmdir_recursive(path);
+  }
+  
+  it("rejects bad config") {
+    assert_db_fail(db, rydb_config_add_column_group(db, "", 12, 8), RYDB_ERROR_BAD_CONFIG, "length 0");
+    assert_db_fail(db, rydb_config_add_column_group(db, "hot!", 12, 8), RYDB_ERROR_BAD_CONFIG, "alphanumeric");
+    assert_db_fail(db, rydb_config_add_column_group(db, "hot", 12, 0), RYDB_ERROR_BAD_CONFIG, "length can't be 0");
+    assert_db_fail(db, rydb_config_add_column_group(db, "hot", 12, 9), RYDB_ERROR_BAD_CONFIG, "out of bounds");
+    assert_db_ok(db, rydb_config_add_column_group(db, "hot", 12, 8));
+    assert_db_fail(db, rydb_config_add_column_group(db, "hot", 0, 5), RYDB_ERROR_BAD_CONFIG, "already exists");
+    assert_db_ok(db, rydb_config_add_column_group(db, "id", 0, 5));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_fail(db, rydb_config_add_column_group(db, "cold", 5, 7), RYDB_ERROR_DATABASE_OPEN, "cannot be configured");
+    assert_db_fail(db, rydb_column_group_rows(db, "cold", &(rydb_cursor_t ){0}), RYDB_ERROR_BAD_CONFIG, "does not exist");
+    
+    //groups are saved in the meta file
+    assert_db_ok(db, rydb_reopen(&db));
+    asserteq(db->config.column_group_count, 2);
+    asserteq(db->config.column_group[0].start, 12);
+    asserteq(db->config.column_group[1].len, 5);
+    rydb_close(db);
+    db = rydb_new();
+    assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+    assert_db_ok(db, rydb_config_add_column_group(db, "hot", 12, 7));
+    assert_db_ok(db, rydb_config_add_column_group(db, "id", 0, 5));
+    assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_CONFIG_MISMATCH, "column group");
+  }
+  
+  it("mirrors inserts, updates, deletes and swaps") {
+    assert_db_ok(db, rydb_config_add_column_group(db, "hot", 12, 8));
+    assert_db_ok(db, rydb_config_add_column_group(db, "name", 5, 7));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    column_group_check(db, "hot", 12, 8);
+    column_group_check(db, "name", 5, 7);
+    for(int i=1; i<=numrows; i+=7) {
+      assert_db_ok(db, rydb_update_rownum(db, i, "UPDATED", 13, 7));
+    }
+    for(int i=2; i<=numrows; i+=5) {
+      assert_db_ok(db, rydb_delete_rownum(db, i));
+    }
+    for(int i=3; i<=numrows - 1; i+=11) {
+      assert_db_ok(db, rydb_swap_rownum(db, i, i == 3 ? 2 : i + 1));
+    }
+    assert_db_ok(db, rydb_delete_rownum(db, numrows));
+    column_group_check(db, "hot", 12, 8);
+    column_group_check(db, "name", 5, 7);
+    
+    assert_db_ok(db, rydb_transaction_start(db));
+    assert_db_ok(db, rydb_update_rownum(db, 1, "transactional", 5, 13));
+    data_fill(str, ROW_LEN, numrows + 1);
+    assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    assert_db_ok(db, rydb_transaction_finish(db));
+    column_group_check(db, "hot", 12, 8);
+    column_group_check(db, "name", 5, 7);
+    assert_db_ok(db, rydb_reopen(&db));
+    column_group_check(db, "hot", 12, 8);
+    column_group_check(db, "name", 5, 7);
+  }
+  
+  it("scans only the group's file") {
+    rydb_row_t    rows[32];
+    rydb_cursor_t cur;
+    size_t        batch;
+    int           n = 0;
+    char          counter[16];
+    assert_db_ok(db, rydb_config_add_column_group(db, "hot", 12, 8));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      memset(str, '\00', ROW_LEN);
+      sprintf(str, "%05i", i);
+      sprintf(counter, "c%07i", i);
+      memcpy(&str[12], counter, 8);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    for(int i=1; i<=numrows; i++) {
+      //scribble over the data file's copy. the group's copy is the one we should get
+      memset(&((char *)rydb_rownum_to_row(db, i)->data)[12], 0xff, 8);
+    }
+    assert_db_ok(db, rydb_column_group_rows(db, "hot", &cur));
+    while((batch = rydb_cursor_next_batch(&cur, rows, 32)) > 0) {
+      for(size_t i=0; i<batch; i++) {
+        n++;
+        asserteq(rows[i].num, (rydb_rownum_t )n);
+        sprintf(counter, "c%07i", n);
+        assert(memcmp(rows[i].data, counter, 8) == 0);
+      }
+    }
+    asserteq(n, numrows);
+    asserteq(rydb_cursor_next_batch(&cur, rows, 32), 0);
+  }
+  
+  it("rebuilds a stale group file on open") {
+    char grppath[128];
+    assert_db_ok(db, rydb_config_add_column_group(db, "hot", 12, 8));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    strcpy(grppath, db->column_group[0].file.path);
+    assert_db_ok(db, rydb_reopen(&db));
+    column_group_check(db, "hot", 12, 8);
+    rydb_close(db);
+    db = NULL;
+    assert(truncate(grppath, RYDB_COLUMN_GROUP_START_OFFSET + 8 * 9) == 0);
+    db = rydb_new();
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    column_group_check(db, "hot", 12, 8);
+    rydb_close(db);
+    db = NULL;
+    assert(unlink(grppath) == 0);
+    db = rydb_new();
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    column_group_check(db, "hot", 12, 8);
+  }
+}
+
+static void change_expect(rydb_changes_cursor_t *cur, uint64_t lsn, rydb_rownum_t rownum, rydb_change_op_t op, uint16_t start, uint16_t len) {
+  rydb_change_t change;
+  assert_db_ok(cur->db, rydb_changes_next(cur, &change));
+  asserteq(change.lsn, lsn);
+  asserteq(change.rownum, rownum);
+  asserteq(change.op, op);
+  asserteq(change.start, start);
+  asserteq(change.len, len);
+}
+
+describe(change_feed) {
+  static rydb_t                *db;
+  static char                   path[64];
+  static char                   str[ROW_LEN];
+  static rydb_changes_cursor_t  cur;
+  static rydb_change_t          change;
+  before_each() {
+    db = rydb_new();
+    strcpy(path, "test.db.XXXXXX");
+    mkdtemp(path);
+    assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+  }
+  after_each() {
+    if(db) rydb_close(db);
+    rmdir_recursive(path);
+  }
   
-  static char testname[128];
-  maxlen = RYDB_ROW_LEN_MAX - RYDB_ROW_DATA_OFFSET;
-  static int rowlens[] = {1, 2 , 8, 15, 16, 32, 64, 100, 1000, 5000, 10000, 20000, 50000, 60000, 65500};
-  static unsigned rowlen_n;
-  static int rowlen;
+  it("rejects bad config") {
+    assert_db_fail(db, rydb_config_change_feed(db, 0), RYDB_ERROR_BAD_CONFIG, "must be between");
+    assert_db_fail(db, rydb_config_change_feed(db, RYDB_CHANGE_FEED_CAPACITY_MAX + 1), RYDB_ERROR_BAD_CONFIG, "must be between");
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_fail(db, rydb_changes(db, 0, &cur), RYDB_ERROR_BAD_CONFIG, "not enabled");
+    assert_db_fail(db, rydb_config_change_feed(db, 100), RYDB_ERROR_DATABASE_OPEN, "cannot be configured");
+    rydb_close(db);
+    db = rydb_new();
+    assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+    assert_db_ok(db, rydb_config_change_feed(db, 100));
+    assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_CONFIG_MISMATCH, "change feed capacity");
+  }
+  
+  it("records committed changes in order") {
+    assert_db_ok(db, rydb_config_change_feed(db, 100));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    asserteq(rydb_changes_last_lsn(db), 0);
+    for(int i=1; i<=3; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    assert_db_ok(db, rydb_update_rownum(db, 2, "hello", 10, 5));
+    assert_db_ok(db, rydb_delete_rownum(db, 1));
+    assert_db_ok(db, rydb_swap_rownum(db, 2, 3));
+    assert_db_ok(db, rydb_transaction_start(db));
+    assert_db_ok(db, rydb_delete_rownum(db, 3));
+    assert_db_ok(db, rydb_transaction_cancel(db));
+    
+    assert_db_ok(db, rydb_changes(db, 0, &cur));
+    change_expect(&cur, 1, 1, RYDB_CHANGE_SET, 0, ROW_LEN);
+    change_expect(&cur, 2, 2, RYDB_CHANGE_SET, 0, ROW_LEN);
+    change_expect(&cur, 3, 3, RYDB_CHANGE_SET, 0, ROW_LEN);
+    change_expect(&cur, 4, 2, RYDB_CHANGE_UPDATE, 10, 5);
+    change_expect(&cur, 5, 1, RYDB_CHANGE_DELETE, 0, ROW_LEN);
+    change_expect(&cur, 6, 2, RYDB_CHANGE_SET, 0, ROW_LEN);
+    change_expect(&cur, 7, 3, RYDB_CHANGE_SET, 0, ROW_LEN);
+    asserteq(rydb_changes_next(&cur, &change), false);
+    asserteq(rydb_changes_last_lsn(db), 7);
+    
+    //transactions are published all at once, and lsns carry on after reopening
+    assert_db_ok(db, rydb_transaction_start(db));
+    assert_db_ok(db, rydb_delete_rownum(db, 3));
+    assert_db_ok(db, rydb_update_rownum(db, 2, "x", 19, 1));
+    asserteq(rydb_changes_next(&cur, &change), false);
+    assert_db_ok(db, rydb_transaction_finish(db));
+    assert_db_ok(db, rydb_reopen(&db));
+    assert_db_ok(db, rydb_changes(db, 8, &cur));
+    change_expect(&cur, 8, 3, RYDB_CHANGE_DELETE, 0, ROW_LEN);
+    change_expect(&cur, 9, 2, RYDB_CHANGE_UPDATE, 19, 1);
+    asserteq(rydb_changes_next(&cur, &change), false);
+  }
+  
+  it("skips ahead when the feed wraps") {
+    assert_db_ok(db, rydb_config_change_feed(db, 16));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_ok(db, rydb_changes(db, 0, &cur));
+    for(int i=1; i<=10; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    change_expect(&cur, 1, 1, RYDB_CHANGE_SET, 0, ROW_LEN);
+    for(int i=11; i<=40; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    assert_db_fail(db, rydb_changes_next(&cur, &change), RYDB_ERROR_CHANGES_LOST, "2 to 24");
+    for(int i=25; i<=40; i++) {
+      change_expect(&cur, i, i, RYDB_CHANGE_SET, 0, ROW_LEN);
+    }
+    asserteq(rydb_changes_next(&cur, &change), false);
+    assert_db_ok(db, rydb_changes(db, 0, &cur));
+    asserteq(cur.lsn, 25);
+  }
+  
+  it("can be tailed by a reader") {
+    rydb_t *reader = rydb_new();
+    int     numrows = 200 * repeat_multiplier + 10;
+    assert_db_ok(db, rydb_config_change_feed(db, numrows));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_ok(reader, rydb_open_reader(reader, path, "test"));
+    assert_db_ok(reader, rydb_changes(reader, 0, &cur));
+    asserteq(rydb_changes_next(&cur, &change), false);
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      if(i % 3 == 0) {
+        assert_db_ok(db, rydb_update_rownum(db, i - 1, "zz", 7, 2));
+      }
+      if(i % 10 == 0) {
+        for(int j = i - 9; j <= i; j++) {
+          change_expect(&cur, cur.lsn, j, RYDB_CHANGE_SET, 0, ROW_LEN);
+          if(j % 3 == 0) {
+            change_expect(&cur, cur.lsn, j - 1, RYDB_CHANGE_UPDATE, 7, 2);
+          }
+        }
+        asserteq(rydb_changes_next(&cur, &change), false);
+      }
+    }
+    asserteq(rydb_changes_last_lsn(reader), rydb_changes_last_lsn(db));
+    rydb_close(reader);
+  }
+}
 
-  static int max_rownum = 500;
-  max_rownum *= repeat_multiplier;
+//the follower's rows are the same as the leader's
+static void replication_check(rydb_t *leader, rydb_t *follower) {
+  rydb_row_t row1, row2;
+  asserteq(leader->data_next_rownum, follower->data_next_rownum);
+  for(rydb_rownum_t i = 1; i < leader->data_next_rownum; i++) {
+    assert_db_ok(leader, rydb_find_row_at(leader, i, &row1));
+    assert_db_ok(follower, rydb_find_row_at(follower, i, &row2));
+    asserteq(row1.type, row2.type);
+    if(row1.type == RYDB_ROW_DATA) {
+      assert(memcmp(row1.data, row2.data, leader->config.row_len) == 0);
+    }
+  }
+  asserteq(rydb_replication_lsn(leader) - rydb_replication_lsn(follower), 0);
+}
 
-  test("row length cannot exceed UINT16_MAX") {
-    assert_db_fail(db, rydb_config_row(db, maxlen+1, 5), RYDB_ERROR_BAD_CONFIG, "length [0-9]+ cannot exceed");
-    assert_db_ok(db, rydb_config_row(db, maxlen-8, 5));
+describe(replication) {
+  static rydb_t    *leader, *follower;
+  static char       path[64], path2[64];
+  static char       str[ROW_LEN];
+  static int        sv[2];
+  before_each() {
+    strcpy(path, "test.db.XXXXXX");
+    mkdtemp(path);
+    strcpy(path2, "test.db.XXXXXX");
+    mkdtemp(path2);
+    leader = rydb_new();
+    follower = rydb_new();
+    assert_db_ok(leader, rydb_config_row(leader, ROW_LEN, ROW_INDEX_LEN));
+    assert_db_ok(leader, rydb_config_add_index_hashtable(leader, "name", 5, 7, RYDB_INDEX_DEFAULT, NULL));
+    assert_db_ok(follower, rydb_config_row(follower, ROW_LEN, ROW_INDEX_LEN));
+    assert_db_ok(follower, rydb_config_add_index_hashtable(follower, "name", 5, 7, RYDB_INDEX_DEFAULT, NULL));
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  }
+  after_each() {
+    if(leader) rydb_close(leader);
+    if(follower) rydb_close(follower);
+    close(sv[0]);
+    close(sv[1]);
+    rmdir_recursive(path);
+    rmdir_recursive(path2);
   }
   
-  for(rowlen_n = 0; rowlen_n < sizeof(rowlens)/sizeof(int); rowlen_n++) {
-    rowlen = rowlens[rowlen_n];
-    sprintf(testname, "storage with row length %i", rowlen);
-    test(testname) {
-      config_testdb(db, rowlen);
-      assert_db_ok(db, rydb_open(db, path, "test"));
-      int rownum = max_rownum;
-      if(rowlen == 1) rownum = MIN(9, rownum);
-      else if(rowlen == 2) rownum = MIN(99, rownum);
-      else if(rowlen == 3) rownum = MIN(999, rownum);
-      else if(rowlen == 4) rownum = MIN(9999, rownum);
-      
-      for(int i=1; i<=rownum; i++) {
-        data_fill(data, rowlen, i);
-        assert_db_ok(db, rydb_insert_str(db, data));
+  it("replays the leader's transactions on the follower") {
+    int numrows = 300 * repeat_multiplier + 20;
+    assert_db_ok(leader, rydb_open(leader, path, "test"));
+    assert_db_ok(follower, rydb_open(follower, path2, "test"));
+    assert_db_ok(leader, rydb_replication_ship(leader, sv[0]));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(leader, rydb_insert(leader, str, ROW_LEN));
+      if(i % 4 == 0) {
+        assert_db_ok(leader, rydb_update_rownum(leader, i - 2, "updated", 5, 7));
       }
-      for(int i=1; i<=rownum + 4; i++) {
-        rydb_row_t row;
-        int rc = rydb_find_row_at(db, i, &row);
-        //printf("%i\n", i);
-        if(i<=rownum) {
-          data_fill(data, rowlen, i);
-          asserteq(rc, 1);
-          
-          asserteq(memcmp(data, row.data, rowlen), 0);
-        }
-        else if(i == rownum + 1) {
-          asserteq(rc, 1);
-          asserteq(row.type, RYDB_ROW_EMPTY);
-        }
-        else {
-          asserteq(rc, 0);
+      if(i % 7 == 0) {
+        assert_db_ok(leader, rydb_delete_rownum(leader, i - 5));
+      }
+      if(i % 9 == 0) {
+        assert_db_ok(leader, rydb_swap_rownum(leader, i, i - 3));
+      }
+      //catch up every so often, there's only so much room in the socket
+      if(i % 10 == 0) {
+        asserteq(rydb_replication_lsn(leader) > rydb_replication_lsn(follower), 1);
+        while(rydb_replication_lsn(follower) < rydb_replication_lsn(leader)) {
+          assert_db_ok(follower, rydb_replication_apply(follower, sv[1]));
         }
+        replication_check(leader, follower);
+      }
+    }
+    assert_db_ok(leader, rydb_transaction_start(leader));
+    assert_db_ok(leader, rydb_delete_rownum(leader, numrows));
+    assert_db_ok(leader, rydb_update_rownum(leader, 3, "in a tx", 5, 7));
+    assert_db_ok(leader, rydb_transaction_finish(leader));
+    assert_db_ok(follower, rydb_replication_apply(follower, sv[1]));
+    replication_check(leader, follower);
+    
+    //the follower's indices are kept up too
+    rydb_row_t row1, row2;
+    assert_db_ok(leader, rydb_index_find_row(leader, "name", "in a tx", 7, &row1));
+    assert_db_ok(follower, rydb_index_find_row(follower, "name", "in a tx", 7, &row2));
+    asserteq(row1.num, row2.num);
+    
+    //and its lsn outlives a reopen
+    uint64_t lsn = rydb_replication_lsn(follower);
+    assert_db_ok(follower, rydb_reopen(&follower));
+    asserteq(rydb_replication_lsn(follower), lsn);
+  }
+  
+  it("refuses transactions out of order") {
+    int pipefd[2];
+    assert(pipe(pipefd) == 0);
+    assert_db_ok(leader, rydb_open(leader, path, "test"));
+    assert_db_ok(follower, rydb_open(follower, path2, "test"));
+    assert_db_ok(leader, rydb_replication_ship(leader, pipefd[1]));
+    assert_db_ok(leader, rydb_insert_str(leader, "00001hello"));
+    assert_db_ok(leader, rydb_insert_str(leader, "00002world"));
+    //replay the first one twice, then skip
+    char                      frame1[1024], frame2[1024];
+    rydb_replication_frame_t *hdr;
+    ssize_t                   len1, len2;
+    asserteq(read(pipefd[0], frame1, sizeof(*hdr)), sizeof(*hdr));
+    hdr = (void *)frame1;
+    len1 = sizeof(*hdr) + hdr->row_count * leader->stored_row_size;
+    asserteq(read(pipefd[0], &frame1[sizeof(*hdr)], len1 - sizeof(*hdr)), len1 - sizeof(*hdr));
+    asserteq(read(pipefd[0], frame2, sizeof(*hdr)), sizeof(*hdr));
+    hdr = (void *)frame2;
+    len2 = sizeof(*hdr) + hdr->row_count * leader->stored_row_size;
+    asserteq(read(pipefd[0], &frame2[sizeof(*hdr)], len2 - sizeof(*hdr)), len2 - sizeof(*hdr));
+    assert(write(sv[0], frame1, len1) == len1);
+    assert(write(sv[0], frame1, len1) == len1);
+    assert_db_ok(follower, rydb_replication_apply(follower, sv[1]));
+    assert_db_ok(follower, rydb_replication_apply(follower, sv[1]));
+    asserteq(rydb_replication_lsn(follower), 1);
+    asserteq(follower->data_next_rownum, 2);
+    //skip ahead
+    hdr->lsn = 3;
+    assert(write(sv[0], frame2, len2) == len2);
+    assert_db_fail(follower, rydb_replication_apply(follower, sv[1]), RYDB_ERROR_REPLICATION, "skipped from transaction 1 to 3");
+    hdr->lsn = 2;
+    assert(write(sv[0], frame2, len2) == len2);
+    assert_db_ok(follower, rydb_replication_apply(follower, sv[1]));
+    replication_check(leader, follower);
+    
+    //garbage
+    assert(write(sv[0], frame1, 3) == 3);
+    close(sv[0]);
+    assert_db_fail(follower, rydb_replication_apply(follower, sv[1]), RYDB_ERROR_REPLICATION, "closed");
+    sv[0] = dup(sv[1]);
+    close(pipefd[0]);
+    close(pipefd[1]);
+  }
+  
+  it("fails the leader's commit when the follower is gone") {
+    assert_db_ok(leader, rydb_open(leader, path, "test"));
+    assert_db_ok(leader, rydb_replication_ship(leader, sv[0]));
+    assert_db_ok(leader, rydb_insert_str(leader, "00001hello"));
+    shutdown(sv[1], SHUT_RDWR);
+    assert_db_fail(leader, rydb_insert_str(leader, "00002world"), RYDB_ERROR_REPLICATION, "replication has been stopped");
+    asserteq(leader->data_next_rownum, 2);
+    asserteq(rydb_replication_lsn(leader), 1);
+    //no longer shipping, so it's back to committing as usual
+    assert_db_ok(leader, rydb_insert_str(leader, "00002world"));
+    assert_db_ok(leader, rydb_reopen(&leader));
+    asserteq(leader->data_next_rownum, 3);
+  }
+  
+  it("refuses a mismatched leader") {
+    rydb_close(follower);
+    follower = rydb_new();
+    assert_db_ok(follower, rydb_config_row(follower, ROW_LEN + 8, ROW_INDEX_LEN));
+    assert_db_ok(leader, rydb_open(leader, path, "test"));
+    assert_db_ok(follower, rydb_open(follower, path2, "test"));
+    assert_db_ok(leader, rydb_replication_ship(leader, sv[0]));
+    assert_db_ok(leader, rydb_insert_str(leader, "00001hello"));
+    assert_db_fail(follower, rydb_replication_apply(follower, sv[1]), RYDB_ERROR_CONFIG_MISMATCH, "row length");
+  }
+}
+
+//snapshots and backups are configured just like the database they were taken from
+static rydb_t *copy_db_new(int change_feed, unsigned backup_page_size) {
+  rydb_t *db = rydb_new();
+  assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+  assert_db_ok(db, rydb_config_add_index_hashtable(db, "name", 5, 7, RYDB_INDEX_DEFAULT, NULL));
+  assert_db_ok(db, rydb_config_add_column_group(db, "name", 5, 7));
+  if(change_feed) {
+    assert_db_ok(db, rydb_config_change_feed(db, 64));
+  }
+  if(backup_page_size) {
+    assert_db_ok(db, rydb_config_incremental_backup(db, backup_page_size));
+  }
+  return db;
+}
+
+//the source database goes in path, the copies somewhere in path2
+static void copy_db_paths(char *path, char *path2) {
+  strcpy(path, "test.db.XXXXXX");
+  mkdtemp(path);
+  strcpy(path2, "test.db.XXXXXX");
+  mkdtemp(path2);
+}
+
+describe(snapshot) {
+  static rydb_t    *db, *snap;
+  static char       path[64], path2[64], snappath[128];
+  static char       str[ROW_LEN];
+  before_each() {
+    copy_db_paths(path, path2);
+    sprintf(snappath, "%s/snap", path2);
+    db = copy_db_new(1, 0);
+    snap = NULL;
+  }
+  after_each() {
+    if(db) rydb_close(db);
+    if(snap) rydb_close(snap);
+    rmdir_recursive(path);
+    rmdir_recursive(path2);
+  }
+  
+  it("copies a database that opens on its own") {
+    int            numrows = 200 * repeat_multiplier + 20;
+    rydb_rownum_t  snap_rows;
+    uint64_t       snap_lsn;
+    rydb_row_t     row1, row2;
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      if(i % 5 == 0) {
+        assert_db_ok(db, rydb_delete_rownum(db, i - 2));
+      }
+    }
+    assert_db_ok(db, rydb_update_rownum(db, 1, "snapped", 5, 7));
+    assert_db_ok(db, rydb_snapshot(db, snappath));
+    snap_rows = db->data_next_rownum;
+    snap_lsn = rydb_changes_last_lsn(db);
+    
+    //the writer carries on as usual
+    assert_db_ok(db, rydb_update_rownum(db, 1, "changed", 5, 7));
+    assert_db_ok(db, rydb_insert_str(db, "99999after"));
+    
+    snap = copy_db_new(1, 0);
+    assert_db_ok(snap, rydb_open(snap, snappath, "test"));
+    asserteq(snap->data_next_rownum, snap_rows);
+    asserteq(rydb_changes_last_lsn(snap), snap_lsn);
+    for(rydb_rownum_t i = 2; i < snap_rows; i++) {
+      assert_db_ok(db, rydb_find_row_at(db, i, &row1));
+      assert_db_ok(snap, rydb_find_row_at(snap, i, &row2));
+      asserteq(row1.type, row2.type);
+      if(row1.type == RYDB_ROW_DATA) {
+        assert(memcmp(row1.data, row2.data, ROW_LEN) == 0);
+      }
+    }
+    assert_db_ok(snap, rydb_index_find_row(snap, "name", "snapped", 7, &row2));
+    asserteq(row2.num, 1);
+    assert(!rydb_index_find_row(snap, "name", "changed", 7, &row2));
+    assert_db_ok(snap, rydb_column_group_find_row_at(snap, "name", 1, &row2));
+    assert(memcmp(row2.data, "snapped", 7) == 0);
+    
+    //and it's a database of its own
+    assert_db_ok(snap, rydb_insert_str(snap, "88888mine"));
+    assert_db_ok(snap, rydb_reopen(&snap));
+    asserteq(snap->data_next_rownum, snap_rows + 1);
+    asserteq(db->data_next_rownum, snap_rows + 1);
+  }
+  
+  it("only snapshots from the writer, between transactions") {
+    rydb_t *reader = copy_db_new(1, 0);
+    assert_db_fail(db, rydb_snapshot(db, snappath), RYDB_ERROR_DATABASE_CLOSED);
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_ok(reader, rydb_open_reader(reader, path, "test"));
+    assert_db_fail(reader, rydb_snapshot(reader, snappath), RYDB_ERROR_NO_WRITE_PRIVILEGE);
+    rydb_close(reader);
+    
+    assert_db_ok(db, rydb_transaction_start(db));
+    assert_db_ok(db, rydb_insert_str(db, "00001hello"));
+    assert_db_fail(db, rydb_snapshot(db, snappath), RYDB_ERROR_TRANSACTION_ACTIVE);
+    assert_db_ok(db, rydb_transaction_finish(db));
+    
+    assert_db_ok(db, rydb_snapshot(db, snappath));
+    assert_db_fail(db, rydb_snapshot(db, snappath), RYDB_ERROR_FILE_EXISTS, "already exists");
+    //the failed one didn't take the first snapshot's files with it
+    snap = copy_db_new(1, 0);
+    assert_db_ok(snap, rydb_open(snap, snappath, "test"));
+    asserteq(snap->data_next_rownum, 2);
+  }
+  
+  it("copies a database a slice at a time while the writer carries on") {
+    int            numrows = 200 * repeat_multiplier + 400, steps = 0;
+    rydb_rownum_t  snap_rows;
+    rydb_row_t     row1, row2;
+    char           snappath2[160];
+    rydb_close(db);
+    db = copy_db_new(1, 4096);
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    assert_db_ok(db, rydb_snapshot_start(db, snappath));
+    assert_db_fail(db, rydb_snapshot_start(db, snappath), RYDB_ERROR_SNAPSHOT_ACTIVE);
+    
+    //writes land on pages that have already been copied, and on ones that haven't been yet
+    while(rydb_maintenance_pending(db)) {
+      assert_db_ok(db, rydb_maintenance(db, 0));
+      steps++;
+      if(steps == 2) {
+        assert_db_ok(db, rydb_update_rownum(db, 1, "snapped", 5, 7));
+        assert_db_ok(db, rydb_delete_rownum(db, numrows - 1));
+      }
+      if(steps == 3) {
+        assert_db_ok(db, rydb_insert_str(db, "99999later"));
+        //and it won't finish in the middle of a transaction
+        assert_db_ok(db, rydb_transaction_start(db));
+        assert_db_ok(db, rydb_update_rownum(db, 2, "intrans", 5, 7));
+      }
+      if(steps == 100) {
+        assert(rydb_maintenance_pending(db));
+        assert_db_ok(db, rydb_transaction_finish(db));
+      }
+    }
+    assert(steps > 100);
+    snap_rows = db->data_next_rownum;
+    
+    assert_db_ok(db, rydb_update_rownum(db, 1, "changed", 5, 7));
+    assert_db_ok(db, rydb_insert_str(db, "88888after"));
+    
+    //indices and column groups are rebuilt from the data
+    snap = copy_db_new(1, 4096);
+    assert_db_ok(snap, rydb_open(snap, snappath, "test"));
+    asserteq(snap->data_next_rownum, snap_rows);
+    for(rydb_rownum_t i = 2; i < snap_rows; i++) {
+      assert_db_ok(db, rydb_find_row_at(db, i, &row1));
+      assert_db_ok(snap, rydb_find_row_at(snap, i, &row2));
+      asserteq(row1.type, row2.type);
+      if(row1.type == RYDB_ROW_DATA) {
+        assert(memcmp(row1.data, row2.data, ROW_LEN) == 0);
+      }
+    }
+    assert_db_ok(snap, rydb_index_find_row(snap, "name", "snapped", 7, &row2));
+    asserteq(row2.num, 1);
+    assert_db_ok(snap, rydb_index_find_row(snap, "name", "intrans", 7, &row2));
+    asserteq(row2.num, 2);
+    assert(!rydb_index_find_row(snap, "name", "changed", 7, &row2));
+    assert_db_ok(snap, rydb_column_group_find_row_at(snap, "name", 1, &row2));
+    assert(memcmp(row2.data, "snapped", 7) == 0);
+    
+    //one that's cut short by closing the database leaves nothing behind
+    sprintf(snappath2, "%s/snap2", path2);
+    assert_db_ok(db, rydb_snapshot_start(db, snappath2));
+    assert_db_ok(db, rydb_maintenance(db, 0));
+    rydb_close(db);
+    db = NULL;
+    sprintf(snappath2, "%s/snap2/rydb.test.data", path2);
+    assert(access(snappath2, F_OK) == -1);
+  }
+  
+  it("only snapshots a slice at a time with incremental backups configured") {
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_fail(db, rydb_snapshot_start(db, snappath), RYDB_ERROR_BAD_CONFIG, "incremental backups");
+  }
+}
+
+//the restored database has the same rows as the one that was backed up
+static void backup_restored_check(rydb_t *db, rydb_t *restored) {
+  rydb_row_t row1, row2;
+  asserteq(restored->data_next_rownum, db->data_next_rownum);
+  for(rydb_rownum_t i = 1; i < db->data_next_rownum; i++) {
+    assert_db_ok(db, rydb_find_row_at(db, i, &row1));
+    assert_db_ok(restored, rydb_find_row_at(restored, i, &row2));
+    asserteq(row1.type, row2.type);
+    if(row1.type == RYDB_ROW_DATA) {
+      assert(memcmp(row1.data, row2.data, ROW_LEN) == 0);
+      //rebuilt from the data
+      assert_db_ok(restored, rydb_column_group_find_row_at(restored, "name", i, &row2));
+      assert(memcmp(row1.data + 5, row2.data, 7) == 0);
+    }
+  }
+}
+
+describe(incremental_backup) {
+  static rydb_t    *db, *restored;
+  static char       path[64], path2[64], basepath[128], delta1[128], delta2[128];
+  static char       str[ROW_LEN];
+  before_each() {
+    copy_db_paths(path, path2);
+    sprintf(basepath, "%s/base", path2);
+    sprintf(delta1, "%s/delta1", path2);
+    sprintf(delta2, "%s/delta2", path2);
+    db = copy_db_new(0, 4096);
+    restored = NULL;
+  }
+  after_each() {
+    if(db) rydb_close(db);
+    if(restored) rydb_close(restored);
+    rmdir_recursive(path);
+    rmdir_recursive(path2);
+  }
+  
+  it("backs up only the pages that changed") {
+    int                         numrows = 2000 * repeat_multiplier + 1000;
+    uint32_t                    epoch;
+    rydb_backup_delta_header_t  delta;
+    FILE                       *fp;
+    rydb_row_t                  row;
+    rydb_rownum_t               changed = (numrows / 2) | 1; //odd, so the deletes below leave it be
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i=1; i<=numrows; i++) {
+      data_fill(str, ROW_LEN, i);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+    }
+    assert_db_ok(db, rydb_snapshot(db, basepath));
+    epoch = rydb_backup_epoch(db);
+    
+    //one row in the middle, and the command log past the end
+    assert_db_ok(db, rydb_update_rownum(db, changed, "changed", 5, 7));
+    assert_db_ok(db, rydb_backup_incremental(db, epoch, delta1));
+    asserteq(rydb_backup_epoch(db), epoch + 1);
+    fp = fopen(delta1, "r");
+    assert(fread(&delta, sizeof(delta), 1, fp) == 1);
+    fclose(fp);
+    asserteq(delta.since_epoch, epoch);
+    assert(delta.page_count <= 3);
+    assert(delta.page_count < delta.data_size / delta.page_size);
+    
+    epoch = rydb_backup_epoch(db);
+    for(int i=1; i<=numrows / 4; i++) {
+      data_fill(str, ROW_LEN, i + numrows);
+      assert_db_ok(db, rydb_insert(db, str, ROW_LEN));
+      if(i % 3 == 0) {
+        assert_db_ok(db, rydb_delete_rownum(db, i * 2));
       }
     }
+    assert_db_ok(db, rydb_swap_rownum(db, 1, numrows));
+    assert_db_ok(db, rydb_backup_incremental(db, epoch, delta2));
+    
+    restored = copy_db_new(0, 4096);
+    assert_db_ok(restored, rydb_backup_restore(restored, basepath, "test", delta1));
+    assert_db_ok(restored, rydb_backup_restore(restored, basepath, "test", delta2));
+    assert_db_ok(restored, rydb_open(restored, basepath, "test"));
+    backup_restored_check(db, restored);
+    assert_db_ok(restored, rydb_index_find_row(restored, "name", "changed", 7, &row));
+    asserteq(row.num, changed);
+  }
+  
+  it("refuses deltas out of order") {
+    uint32_t epoch;
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_fail(db, rydb_backup_incremental(db, 99, delta1), RYDB_ERROR_BACKUP_MISMATCH, "hasn't started yet");
+    assert_db_ok(db, rydb_insert_str(db, "00001hello"));
+    assert_db_ok(db, rydb_snapshot(db, basepath));
+    epoch = rydb_backup_epoch(db);
+    assert_db_ok(db, rydb_insert_str(db, "00002world"));
+    assert_db_ok(db, rydb_backup_incremental(db, epoch, delta1));
+    assert_db_fail(db, rydb_backup_incremental(db, epoch, delta1), RYDB_ERROR_FILE_EXISTS);
+    assert_db_ok(db, rydb_insert_str(db, "00003again"));
+    assert_db_ok(db, rydb_backup_incremental(db, rydb_backup_epoch(db), delta2));
+    
+    restored = copy_db_new(0, 4096);
+    assert_db_fail(restored, rydb_backup_restore(restored, basepath, "test", delta2), RYDB_ERROR_BACKUP_MISMATCH, "epochs");
+    assert_db_ok(restored, rydb_backup_restore(restored, basepath, "test", delta1));
+    assert_db_fail(restored, rydb_backup_restore(restored, basepath, "test", delta1), RYDB_ERROR_BACKUP_MISMATCH, "epochs");
+    assert_db_ok(restored, rydb_backup_restore(restored, basepath, "test", delta2));
+    assert_db_fail(restored, rydb_backup_restore(restored, basepath, "test", "no such backup"), RYDB_ERROR_FILE_NOT_FOUND);
+    
+    //a backup since epoch 0 has every page, and can go on top of anything
+    rydb_close(db);
+    db = copy_db_new(0, 4096);
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_ok(db, rydb_insert_str(db, "00004fully"));
+    remove(delta1);
+    assert_db_ok(db, rydb_backup_incremental(db, 0, delta1));
+    assert_db_ok(restored, rydb_backup_restore(restored, basepath, "test", delta1));
+    assert_db_ok(restored, rydb_open(restored, basepath, "test"));
+    backup_restored_check(db, restored);
+  }
+  
+  it("needs page tracking configured") {
+    rydb_t *untracked = rydb_new();
+    assert_db_fail(db, rydb_config_incremental_backup(db, 5000), RYDB_ERROR_BAD_CONFIG, "power of 2");
+    assert_db_fail(db, rydb_config_incremental_backup(db, 1024), RYDB_ERROR_BAD_CONFIG, "power of 2");
+    assert_db_ok(untracked, rydb_config_row(untracked, ROW_LEN, ROW_INDEX_LEN));
+    assert_db_ok(untracked, rydb_open(untracked, path, "test"));
+    asserteq(rydb_backup_epoch(untracked), 0);
+    assert_db_fail(untracked, rydb_backup_incremental(untracked, 0, delta1), RYDB_ERROR_BAD_CONFIG, "aren't configured");
+    rydb_close(untracked);
+    assert_db_fail(db, rydb_open(db, path, "test"), RYDB_ERROR_CONFIG_MISMATCH);
+    rydb_close(db);
+    
+    rmdir_recursive(path);
+    mkdtemp(strcpy(path, "test.db.XXXXXX"));
+    db = copy_db_new(0, 4096);
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    assert_db_ok(db, rydb_transaction_start(db));
+    assert_db_fail(db, rydb_backup_incremental(db, 0, delta1), RYDB_ERROR_TRANSACTION_ACTIVE);
+    assert_db_ok(db, rydb_transaction_finish(db));
+  }
+}
+
+describe(stats) {
+  static rydb_t       *db;
+  static char          path[64];
+  static rydb_stats_t  stats;
+  static char          buf[21];
+  before_each() {
+    db = rydb_new();
+    strcpy(path, "test.db.XXXXXX");
+    mkdtemp(path);
+    config_testdb(db, 0);
+    assert_db_ok(db, rydb_open(db, path, "test"));
+  }
+  after_each() {
+    rydb_close(db);
+    rmdir_recursive(path);
+  }
+  
+  it("collects nothing until enabled") {
+    for(int i = 1; i <= 20; i++) {
+      data_fill(buf, 20, i);
+      assert_db_ok(db, rydb_insert_str(db, buf));
+    }
+    rydb_stats(db, &stats);
+    asserteq(stats.latency[RYDB_STATS_INSERT].count, 0);
+    asserteq(stats.counter.index_grows, 0);
+    asserteq(rydb_stats_percentile(&stats.latency[RYDB_STATS_INSERT], 99), 0);
+  }
+  
+  it("records operation latencies and counters") {
+    int            numrows = 500;
+    rydb_row_t     row;
+    rydb_stats_histogram_t *h;
+    assert_db_ok(db, rydb_stats_enable(db, true));
+    for(int i = 1; i <= numrows; i++) {
+      data_fill(buf, 20, i);
+      assert_db_ok(db, rydb_insert_str(db, buf));
+    }
+    for(int i = 1; i <= numrows; i += 2) {
+      data_fill(buf, 20, i);
+      assert_db_ok(db, rydb_find_row_str(db, buf, &row));
+    }
+    assert_db_ok(db, rydb_update_rownum(db, 1, "hey", 15, 3));
+    assert_db_ok(db, rydb_delete_rownum(db, 2));
+    asserteq(rydb_find_row_str(db, "nope", &row), 0);
+    
+    rydb_stats(db, &stats);
+    asserteq(stats.latency[RYDB_STATS_INSERT].count, numrows);
+    asserteq(stats.latency[RYDB_STATS_FIND].count, numrows / 2 + 1);
+    asserteq(stats.latency[RYDB_STATS_UPDATE].count, 1);
+    asserteq(stats.latency[RYDB_STATS_DELETE].count, 1);
+    asserteq(stats.latency[RYDB_STATS_COMMIT].count, numrows + 2);
+    assert(stats.counter.index_grows > 0);
+    assert(stats.counter.file_grows > 0);
+    
+    h = &stats.latency[RYDB_STATS_INSERT];
+    assert(h->min > 0);
+    assert(h->min <= h->max);
+    assert(h->sum >= h->max);
+    assert(rydb_stats_percentile(h, 0) >= h->min);
+    assert(rydb_stats_percentile(h, 50) <= rydb_stats_percentile(h, 99));
+    assert(rydb_stats_percentile(h, 99) <= h->max);
+    asserteq(rydb_stats_percentile(h, 100), h->max);
+    
+    rydb_stats_reset(db);
+    rydb_stats(db, &stats);
+    asserteq(stats.latency[RYDB_STATS_INSERT].count, 0);
+    asserteq(stats.counter.file_grows, 0);
+    
+    assert_db_ok(db, rydb_stats_enable(db, false));
+    data_fill(buf, 20, numrows + 1);
+    assert_db_ok(db, rydb_insert_str(db, buf));
+    rydb_stats(db, &stats);
+    asserteq(stats.latency[RYDB_STATS_INSERT].count, 0);
+  }
+  
+  it("buckets latencies to within an eighth") {
+    rydb_stats_histogram_t h;
+    uint64_t               p;
+    memset(&h, '\0', sizeof(h));
+    //nothing recorded
+    asserteq(rydb_stats_percentile(&h, 50), 0);
+    assert_db_ok(db, rydb_stats_enable(db, true));
+    for(int i = 0; i < 100; i++) {
+      data_fill(buf, 20, i + 1);
+      assert_db_ok(db, rydb_insert_str(db, buf));
+    }
+    rydb_stats(db, &stats);
+    h = stats.latency[RYDB_STATS_INSERT];
+    p = rydb_stats_percentile(&h, 0);
+    //the smallest value lands in the first bucket, whose top is at most 1/8th above it
+    assert(p >= h.min);
+    assert(p - h.min <= h.min / 8 + 1);
+  }
+  
+  it("reports hashtable health") {
+    rydb_index_stats_t ist;
+    uint64_t           rows = 0, levelrows = 0;
+    for(int i = 1; i <= 500; i++) {
+      data_fill(buf, 20, i);
+      assert_db_ok(db, rydb_insert_str(db, buf));
+    }
+    assert_db_fail(db, rydb_index_stats(db, "nope", &ist), RYDB_ERROR_INDEX_NOT_FOUND);
+    assert_db_ok(db, rydb_index_stats(db, "primary", &ist));
+    asserteq(ist.rows, 500);
+    assert(ist.buckets >= 500);
+    assert(ist.load_factor > 0);
+    assert(ist.load_factor <= ist.load_factor_max);
+    asserteq(ist.rows + ist.rows_until_grow, (uint64_t )(ist.buckets * ist.load_factor_max));
+    //small enough to look at every bucket
+    asserteq(ist.probe.scanned, ist.buckets + ist.overflow_buckets);
+    asserteq(ist.probe.rows, 500);
+    assert(ist.probe.longest > 0);
+    for(int i = 0; i < RYDB_INDEX_STATS_RUN_LENGTHS; i++) {
+      rows += ist.probe.length[i] * (i + 1);
+    }
+    assert(rows <= 500);
+    assert(ist.bitlevel_count >= 1);
+    for(int i = 0; i < ist.bitlevel_count; i++) {
+      levelrows += ist.bitlevel[i].rows;
+    }
+    asserteq(levelrows, 500);
+    asserteq(ist.rehash.rows, 500 - ist.bitlevel[0].rows);
+    assert(ist.rehash.bytes >= ist.probe.scanned);
+  }
+  
+  it("reports health for every kind of hashtable") {
+    rydb_index_stats_t ist;
+    rydb_close(db);
+    rmdir_recursive(path);
+    mkdtemp(strcpy(path, "test.db.XXXXXX"));
+    db = rydb_new();
+    assert_db_ok(db, rydb_config_row(db, ROW_LEN, ROW_INDEX_LEN));
+    rydb_config_index_hashtable_t chained = {.hash_function = RYDB_HASH_SIPHASH, .store_value = 1, .collision_resolution = RYDB_SEPARATE_CHAINING};
+    rydb_config_index_hashtable_t robinhood = {.hash_function = RYDB_HASH_SIPHASH, .store_value = 1, .store_hash = 1, .collision_resolution = RYDB_ROBIN_HOOD};
+    assert_db_ok(db, rydb_config_add_index_hashtable(db, "chained", 5, 5, RYDB_INDEX_DEFAULT, &chained));
+    assert_db_ok(db, rydb_config_add_index_hashtable(db, "robinhood", 10, 5, RYDB_INDEX_DEFAULT, &robinhood));
+    assert_db_ok(db, rydb_config_add_index_direct(db, "direct", 16, 4, RYDB_INDEX_UNIQUE, NULL));
+    assert_db_ok(db, rydb_open(db, path, "test"));
+    for(int i = 1; i <= 300; i++) {
+      data_fill(buf, 20, i);
+      memcpy(&buf[16], &i, 4);
+      assert_db_ok(db, rydb_insert(db, buf, 20));
+    }
+    assert_db_fail(db, rydb_index_stats(db, "direct", &ist), RYDB_ERROR_WRONG_INDEX_TYPE, "not a hashtable");
+    
+    assert_db_ok(db, rydb_index_stats(db, "chained", &ist));
+    asserteq(ist.rows, 300);
+    asserteq(ist.overflow_buckets, 0);
+    asserteq(ist.probe.scanned, ist.buckets);
+    asserteq(ist.probe.rows, 300);
+    asserteq(ist.rehash.rows, 0);
+    asserteq(ist.rehash.bytes, 0);
+    
+    assert_db_ok(db, rydb_index_stats(db, "robinhood", &ist));
+    asserteq(ist.rows, 300);
+    asserteq(ist.bitlevel_count, 1);
+    asserteq(ist.bitlevel[0].rows, 300);
+    asserteq(ist.probe.scanned, ist.buckets + ist.overflow_buckets);
+    asserteq(ist.probe.rows, 300);
+    asserteq(ist.rehash.rows, 0);
   }
 }
 
@@ -2041,6 +4532,25 @@ describe(cursor) {
       free(counts[2]);
     }
     
+    test("batched cursor") {
+      rydb_row_t rows[7];
+      for(int g=0; g<groups; g++) {
+        data_fill(str, 10, g);
+        rydb_cursor_t cur;
+        assert_db_ok(db, rydb_index_find_rows_str(db, "group", str, &cur));
+        size_t n;
+        while((n = rydb_cursor_next_batch(&cur, rows, 7)) > 0) {
+          assert(n <= 7);
+          for(size_t i=0; i<n; i++) {
+            asserteq(atoi(&rows[i].data[10]), g);
+            count[g*numrows+rows[i].num]++;
+          }
+        }
+        asserteq(rydb_cursor_next_batch(&cur, rows, 7), 0);
+      }
+      assert_groupcheck(check, count, numrows, groups);
+    }
+    
     test("cursor for primary index") {
       data_fill(str, 10, 1);
       rydb_cursor_t   cur;
@@ -2116,6 +4626,33 @@ describe(cursor) {
       asserteq(n, n_check);
     }
     
+    test("walk through all nonempty rows in batches") {
+      int n = 0;
+      for(int i=1; i<=numrows; i++) {
+        sprintf(str,"%i", i);
+        assert_db_ok(db, rydb_insert_str(db, str));
+        n++;
+      }
+      for(int i=3; i<=numrows; i+= 10) {
+        rydb_delete_rownum(db, i);
+        n--;
+      }
+      rydb_row_t    rows[64];
+      rydb_cursor_t cur;
+      rydb_rows(db, &cur);
+      int    n_check=0;
+      size_t batch;
+      while((batch = rydb_cursor_next_batch(&cur, rows, 64)) > 0) {
+        for(size_t i=0; i<batch; i++) {
+          n_check++;
+          asserteq(rows[i].type, RYDB_ROW_DATA);
+          assertneq((atoi(rows[i].data)-3)%10, 0);
+        }
+      }
+      asserteq(n, n_check);
+      asserteq(rydb_cursor_next_batch(&cur, rows, 64), 0);
+    }
+    
     test("finish cursor early") {
       for(int i=1; i<=numrows; i++) {
         sprintf(str,"%i", i);
@@ -39,10 +39,20 @@ int rydb_unintercept_printfs(void) {
 
 int sed_meta_file(rydb_t *db, char *regex) {
   char cmd[1024];
+  FILE *fp;
   
+  //edit the text version of the meta file, and put that in place of the binary one
+  sprintf(cmd, "%s.txt", db->meta.path);
+  if((fp = fopen(cmd, "w")) == NULL) {
+    return 0;
+  }
+  rydb_meta_export(db, fp);
+  fclose(fp);
   //sprintf(cmd, "sed -r -e \"%s\" %s", regex, db->meta.path);
   //system(cmd);
-  sprintf(cmd, "sed -e \"%s\" %s > %s.tmp", regex, db->meta.path, db->meta.path);
+  sprintf(cmd, "sed -e \"%s\" %s.txt > %s.tmp", regex, db->meta.path, db->meta.path);
+  system(cmd);
+  sprintf(cmd, "rm %s.txt", db->meta.path);
   system(cmd);
   sprintf(cmd, "mv %s.tmp %s", db->meta.path, db->meta.path);
   system(cmd);
@@ -244,6 +254,43 @@ void hashtable_header_count_check(const rydb_t *db, const rydb_index_t *idx, siz
   }
   asserteq(levels_total, count);
 }
+void hashtable_robinhood_order_check(const rydb_t *db, const rydb_index_t *idx) {
+  (void )(db);
+  rydb_hashtable_header_t *header = (void *)idx->index.file.start;
+  const rydb_config_index_t *cf = idx->config;
+  size_t hash_sz = cf->type_config.hashtable.compact_hash ? sizeof(uint32_t) : sizeof(uint64_t);
+  size_t sz = sizeof(rydb_rownum_t) + hash_sz + (cf->type_config.hashtable.store_value ? cf->len : 0);
+  sz = ry_align(sz, sizeof(rydb_rownum_t));
+  uint64_t mask = ((uint64_t )1 << header->bucket.bitlevel[0].bits) - 1;
+  uint64_t hash = 0, home, prev_home = 0;
+  uint64_t hash_mask = hash_sz == sizeof(uint32_t) ? 0x03ffffff : 0x03ffffffffffffff;
+  int prev_empty = 1;
+  size_t used = 0;
+  asserteq(header->bucket.count.bitlevels, 1);
+  for(uint64_t i = 0; i < header->bucket.count.total; i++) {
+    const char *bucket = &idx->index.data.start[i * sz];
+    if(BUCKET_STORED_ROWNUM(bucket) == 0) {
+      prev_empty = 1;
+      continue;
+    }
+    memcpy(&hash, &bucket[sizeof(rydb_rownum_t)], hash_sz); //little-endian only, like the rest of the bucket peeking
+    home = hash & hash_mask & mask;
+    if(home > i) {
+      fail("bucket %"PRIu64" is homed after itself, at %"PRIu64, i, home);
+    }
+    if(!prev_empty && home < prev_home) {
+      fail("bucket %"PRIu64" (home %"PRIu64") is out of order after a bucket homed at %"PRIu64, i, home, prev_home);
+    }
+    if(prev_empty && home != i) {
+      fail("bucket %"PRIu64" starts a run but isn't in its home slot %"PRIu64, i, home);
+    }
+    prev_home = home;
+    prev_empty = 0;
+    used++;
+  }
+  asserteq(used, header->bucket.count.used);
+}
+
 char *argv_extract2(int *argc, char **argv, off_t i) {
   char *ret = argv[i+1];
   for(off_t n=i; n<*argc-2; n++) {
@@ -65,6 +65,7 @@ struct cmd_rownum_out_of_range_check_s {
 void cmd_rownum_out_of_range_check(rydb_t *db, struct cmd_rownum_out_of_range_check_s *check, int nrows);
 
 void hashtable_header_count_check(const rydb_t *db, const rydb_index_t *idx, size_t count);
+void hashtable_robinhood_order_check(const rydb_t *db, const rydb_index_t *idx);
 
 #define assert_groupcheck(check, count, numrows, groups) do { \
   for(int __g=0; __g<groups; __g++) { \